@@ -0,0 +1,237 @@
+#include "Analysis.h"
+#include "Perf.h"
+
+#include <algorithm>
+
+hc::Analysis::Analysis(Cpu* const cpu)
+    : _cpu(cpu)
+    , _log(nullptr)
+    , _base(0)
+    , _size(0)
+    , _instructions(0)
+    , _elapsedUs(0)
+{}
+
+void hc::Analysis::addEntry(uint64_t const address) {
+    if (std::find(_entries.begin(), _entries.end(), address) == _entries.end()) {
+        _entries.push_back(address);
+    }
+}
+
+void hc::Analysis::run() {
+    uint64_t const start = Perf::getTimeUs();
+
+    // Everything after this works on the snapshot, which is much faster to read than the core's memory
+    _snapshot.reset(new Snapshot(_cpu->mainMemory()));
+    _base = _snapshot->base();
+    _size = _snapshot->size();
+
+    _flags.assign(_size, 0);
+    _xrefs.clear();
+    _blocks.clear();
+    _functions.clear();
+    _calls.clear();
+    _instructions = 0;
+
+    std::vector<uint64_t> pending;
+    _cpu->entryPoints(_snapshot.get(), &pending);
+    pending.insert(pending.end(), _entries.begin(), _entries.end());
+
+    for (auto const address : pending) {
+        if (address - _base < _size) {
+            _flags[address - _base] |= Entry | Function;
+        }
+    }
+
+    if (_log != nullptr) {
+        uint8_t const* const flags = _log->data();
+        uint64_t const base = _log->base();
+
+        for (size_t i = 0; i < _log->size(); i++) {
+            if ((flags[i] & CodeDataLog::Opcode) != 0) {
+                pending.push_back(base + i);
+            }
+        }
+    }
+
+    disassemble(&pending);
+    buildBlocks();
+    assignFunctions();
+
+    std::sort(_xrefs.begin(), _xrefs.end(), [](Xref const& a, Xref const& b) {
+        return a.to < b.to || (a.to == b.to && a.from < b.from);
+    });
+
+    _elapsedUs = Perf::getTimeUs() - start;
+}
+
+uint8_t hc::Analysis::flags(uint64_t const address) const {
+    return address - _base < _size ? _flags[address - _base] : 0;
+}
+
+hc::Analysis::Block const* hc::Analysis::findBlock(uint64_t const address) const {
+    auto const found = std::upper_bound(_blocks.begin(), _blocks.end(), address, [](uint64_t const address, Block const& block) {
+        return address < block.start;
+    });
+
+    if (found == _blocks.begin()) {
+        return nullptr;
+    }
+
+    Block const* const block = &*(found - 1);
+    return address - block->start < block->size ? block : nullptr;
+}
+
+void hc::Analysis::findXrefs(uint64_t const address, Xref const** const begin, Xref const** const end) const {
+    auto const range = std::equal_range(_xrefs.begin(), _xrefs.end(), Xref{0, address, XrefType::Jump}, [](Xref const& a, Xref const& b) {
+        return a.to < b.to;
+    });
+
+    *begin = _xrefs.data() + (range.first - _xrefs.begin());
+    *end = _xrefs.data() + (range.second - _xrefs.begin());
+}
+
+void hc::Analysis::disassemble(std::vector<uint64_t>* const pending) {
+    Memory const* const memory = _snapshot.get();
+
+    while (!pending->empty()) {
+        uint64_t address = pending->back();
+        pending->pop_back();
+
+        // Follow the path until it leaves the memory, reaches code already seen, or can't continue
+        while (address - _base < _size) {
+            uint64_t const offset = address - _base;
+
+            if ((_flags[offset] & (LengthMask | Operand)) != 0) {
+                break;
+            }
+
+            uint64_t const length = _cpu->instructionLength(address, memory);
+
+            if (length == 0 || length > LengthMask || length > _size - offset) {
+                break;
+            }
+
+            _flags[offset] |= static_cast<uint8_t>(length);
+
+            for (uint64_t i = 1; i < length; i++) {
+                _flags[offset + i] |= Operand;
+            }
+
+            _instructions++;
+
+            uint64_t target = 0;
+            Cpu::Flow const flow = _cpu->flow(address, memory, &target);
+
+            switch (flow) {
+                case Cpu::Flow::Jump:
+                case Cpu::Flow::Branch:
+                case Cpu::Flow::Call: {
+                    XrefType const type = flow == Cpu::Flow::Jump ? XrefType::Jump
+                                        : flow == Cpu::Flow::Branch ? XrefType::Branch
+                                        : XrefType::Call;
+
+                    _xrefs.push_back(Xref{address, target, type});
+
+                    if (target - _base < _size) {
+                        _flags[target - _base] |= type == XrefType::Call ? Function : Label;
+                        pending->push_back(target);
+                    }
+
+                    break;
+                }
+
+                default: break;
+            }
+
+            if (flow != Cpu::Flow::Next && flow != Cpu::Flow::Call) {
+                _flags[offset] |= EndsBlock;
+            }
+
+            if (flow == Cpu::Flow::Jump || flow == Cpu::Flow::Return || flow == Cpu::Flow::Indirect) {
+                break;
+            }
+
+            address += length;
+        }
+    }
+}
+
+void hc::Analysis::buildBlocks() {
+    bool inBlock = false;
+
+    for (uint64_t offset = 0; offset < _size;) {
+        uint8_t const flags = _flags[offset];
+        unsigned const length = flags & LengthMask;
+
+        if (length == 0) {
+            inBlock = false;
+            offset++;
+            continue;
+        }
+
+        if (!inBlock || (flags & (Label | Function | Entry)) != 0) {
+            _blocks.push_back(Block{_base + offset, _base + offset, 0, NoFunction});
+            inBlock = true;
+        }
+
+        Block& block = _blocks.back();
+        block.last = _base + offset;
+        block.size = static_cast<uint32_t>(_base + offset + length - block.start);
+
+        if ((flags & Function) != 0) {
+            _functions.push_back(_base + offset);
+        }
+
+        inBlock = (flags & EndsBlock) == 0;
+        offset += length;
+    }
+}
+
+void hc::Analysis::assignFunctions() {
+    Memory const* const memory = _snapshot.get();
+    std::vector<size_t> pending;
+
+    // Blocks reachable from more than one function go to the one with the lowest address
+    for (uint32_t function = 0; function < _functions.size(); function++) {
+        pending.push_back(findBlock(_functions[function]) - _blocks.data());
+
+        while (!pending.empty()) {
+            Block& block = _blocks[pending.back()];
+            pending.pop_back();
+
+            if (block.function != NoFunction) {
+                continue;
+            }
+
+            block.function = function;
+
+            // Other functions aren't entered by jumping or falling into them
+            auto const follow = [&](uint64_t const address) {
+                Block const* const next = findBlock(address);
+
+                if (next != nullptr && next->start == address && (flags(address) & Function) == 0) {
+                    pending.push_back(next - _blocks.data());
+                }
+            };
+
+            uint64_t target = 0;
+            Cpu::Flow const flow = _cpu->flow(block.last, memory, &target);
+
+            if (flow == Cpu::Flow::Jump || flow == Cpu::Flow::Branch) {
+                follow(target);
+            }
+
+            if (flow != Cpu::Flow::Jump && flow != Cpu::Flow::Return && flow != Cpu::Flow::Indirect) {
+                follow(block.start + block.size);
+            }
+        }
+    }
+
+    for (auto const& xref : _xrefs) {
+        if (xref.type == XrefType::Call) {
+            Block const* const block = findBlock(xref.from);
+            _calls.push_back(Call{block != nullptr ? block->function : NoFunction, xref.from, xref.to});
+        }
+    }
+}
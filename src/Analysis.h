@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Cpu.h"
+#include "CodeDataLog.h"
+#include "cheats/Snapshot.h"
+
+#include <memory>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hc {
+    // Recursive descent disassembly of a CPU's address space. The results are kept in flat arrays over
+    // a snapshot of the memory taken when the analysis runs, so querying them never calls into the core.
+    class Analysis {
+    public:
+        enum : uint8_t {
+            // The low bits are the length of the instruction starting at the address, zero if there's none
+            LengthMask = 0x07,
+            Operand = 0x08,
+            EndsBlock = 0x10,
+            Function = 0x20,
+            Label = 0x40,
+            Entry = 0x80
+        };
+
+        enum class XrefType : uint8_t {
+            Jump,
+            Branch,
+            Call
+        };
+
+        struct Xref {
+            uint64_t from;
+            uint64_t to;
+            XrefType type;
+        };
+
+        struct Block {
+            uint64_t start;
+            uint64_t last;
+            uint32_t size;
+            // Index of the function the block belongs to, NoFunction if it's not reachable from any
+            uint32_t function;
+        };
+
+        enum : uint32_t {
+            NoFunction = UINT32_MAX
+        };
+
+        struct Call {
+            uint32_t caller;
+            uint64_t from;
+            uint64_t to;
+        };
+
+        Analysis(Cpu* const cpu);
+
+        Cpu* cpu() const { return _cpu; }
+
+        // Extra entry points such as traced program counters, kept across runs
+        void addEntry(uint64_t const address);
+        // Instructions executed according to the log are disassembled even if nothing static reaches them
+        void setLog(CodeDataLog const* const log) { _log = log; }
+        CodeDataLog const* log() const { return _log; }
+        void run();
+
+        bool valid() const { return _snapshot != nullptr; }
+        Memory const* memory() const { return _snapshot.get(); }
+        uint64_t getElapsedUs() const { return _elapsedUs; }
+
+        uint8_t flags(uint64_t const address) const;
+        unsigned length(uint64_t const address) const { return flags(address) & LengthMask; }
+
+        std::vector<Block> const& blocks() const { return _blocks; }
+        std::vector<uint64_t> const& functions() const { return _functions; }
+        std::vector<Call> const& calls() const { return _calls; }
+        size_t instructionCount() const { return _instructions; }
+
+        // Returns the block with the address, or nullptr if it's not code
+        Block const* findBlock(uint64_t const address) const;
+        // Xrefs are sorted by their target
+        void findXrefs(uint64_t const address, Xref const** begin, Xref const** end) const;
+
+    protected:
+        void disassemble(std::vector<uint64_t>* const pending);
+        void buildBlocks();
+        void assignFunctions();
+
+        Cpu* const _cpu;
+        CodeDataLog const* _log;
+        std::unique_ptr<Snapshot> _snapshot;
+        std::vector<uint64_t> _entries;
+
+        uint64_t _base;
+        uint64_t _size;
+        std::vector<uint8_t> _flags;
+        std::vector<Xref> _xrefs;
+        std::vector<Block> _blocks;
+        std::vector<uint64_t> _functions;
+        std::vector<Call> _calls;
+        size_t _instructions;
+        uint64_t _elapsedUs;
+    };
+}
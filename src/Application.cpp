@@ -14,9 +14,13 @@
 #include <FontAwesome4.inl>
 #include <IconsFontAwesome4.h>
 
+#include <inttypes.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 
+#include <chrono>
+#include <thread>
+
 extern "C" {
     #include "lauxlib.h"
     #include "lualib.h"
@@ -66,20 +70,22 @@ static void const* readAll(hc::Logger* logger, char const* const path, size_t* c
 hc::Application::Application()
     : _fsm(*this, lifeCycleVprintf, this)
     , _logger(this)
-    , _config(this, &_memorySelector)
+    , _config(this, &_memorySelector, &_control)
     , _video(this)
     , _led(this)
     , _audio(this)
     , _input(this)
     , _perf(this)
     , _control(this)
+    , _rewind(this)
+    , _pacer(this)
     , _memorySelector(this)
     , _devices(this)
     , _repl(this, &_logger)
     , _debugger(this, &_config, &_memorySelector)
 {}
 
-bool hc::Application::init(std::string const& title, int const width, int const height) {
+bool hc::Application::init(std::string const& title, int const width, int const height, Options const& options) {
     class Undo {
     public:
         ~Undo() {
@@ -101,6 +107,9 @@ bool hc::Application::init(std::string const& title, int const width, int const
     }
     undo;
 
+    _headless = options.headless;
+    _paced = options.paced;
+
     if (!_logger.init()) {
         return false;
     }
@@ -113,91 +122,110 @@ bool hc::Application::init(std::string const& title, int const width, int const
         SDL_LogSetOutputFunction(sdlPrint, this);
         SDL_LogSetAllPriority(SDL_LOG_PRIORITY_VERBOSE);
 
-        // Setup SDL
-        if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
+        // Setup SDL, headless runs must work on machines without a display or a sound card
+        if (SDL_Init(_headless ? SDL_INIT_TIMER | SDL_INIT_EVENTS : SDL_INIT_EVERYTHING) != 0) {
             error(TAG "Error in SDL_Init: %s", SDL_GetError());
             return false;
         }
 
         undo.add([]() { SDL_Quit(); });
 
-        // Setup window
-        SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
-        SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
-        SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
-        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
-        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
+        if (_headless) {
+            _window = nullptr;
+            _glContext = nullptr;
+            _audioDev = 0;
 
-        Uint32 const windowFlags = SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_MAXIMIZED;
+            // The audio is dropped instead of resampled, the fifo only has to exist
+            memset(&_audioSpec, 0, sizeof(_audioSpec));
+            _audioSpec.freq = 44100;
+            _audioSpec.size = 4096;
 
-        _window = SDL_CreateWindow(
-            title.c_str(),
-            SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-            width, height,
-            windowFlags
-        );
+            if (!_fifo.init(_audioSpec.size * 2)) {
+                error(TAG "Error in audio FIFO init");
+                return false;
+            }
 
-        if (_window == nullptr) {
-            error(TAG "Error in SDL_CreateWindow: %s", SDL_GetError());
-            return false;
+            undo.add([this]() { _fifo.destroy(); });
         }
+        else {
+            // Setup window
+            SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+            SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+            SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
+            SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
+            SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
+
+            Uint32 const windowFlags = SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_MAXIMIZED;
+
+            _window = SDL_CreateWindow(
+                title.c_str(),
+                SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                width, height,
+                windowFlags
+            );
+
+            if (_window == nullptr) {
+                error(TAG "Error in SDL_CreateWindow: %s", SDL_GetError());
+                return false;
+            }
 
-        undo.add([this]() { SDL_DestroyWindow(_window); });
+            undo.add([this]() { SDL_DestroyWindow(_window); });
 
-        _glContext = SDL_GL_CreateContext(_window);
+            _glContext = SDL_GL_CreateContext(_window);
 
-        if (_glContext == nullptr) {
-            error(TAG "Error in SDL_GL_CreateContext: %s", SDL_GetError());
-            return false;
-        }
+            if (_glContext == nullptr) {
+                error(TAG "Error in SDL_GL_CreateContext: %s", SDL_GetError());
+                return false;
+            }
 
-        undo.add([this]() { SDL_GL_DeleteContext(_glContext); });
+            undo.add([this]() { SDL_GL_DeleteContext(_glContext); });
 
-        SDL_GL_MakeCurrent(_window, _glContext);
-        SDL_GL_SetSwapInterval(1);
+            SDL_GL_MakeCurrent(_window, _glContext);
+            SDL_GL_SetSwapInterval(1);
 
-        // Init audio
-        SDL_AudioSpec want;
-        memset(&want, 0, sizeof(want));
+            // Init audio
+            SDL_AudioSpec want;
+            memset(&want, 0, sizeof(want));
 
-        want.freq = 44100;
-        want.format = AUDIO_S16SYS;
-        want.channels = 2;
-        want.samples = 1024;
-        want.callback = audioCallback;
-        want.userdata = this;
+            want.freq = 44100;
+            want.format = AUDIO_S16SYS;
+            want.channels = 2;
+            want.samples = 1024;
+            want.callback = audioCallback;
+            want.userdata = this;
 
-        _audioDev = SDL_OpenAudioDevice(
-            nullptr, 0,
-            &want, &_audioSpec,
-            SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE
-        );
+            _audioDev = SDL_OpenAudioDevice(
+                nullptr, 0,
+                &want, &_audioSpec,
+                SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE
+            );
 
-        if (_audioDev == 0) {
-            error(TAG "Error in SDL_OpenAudioDevice: %s", SDL_GetError());
-            return false;
-        }
+            if (_audioDev == 0) {
+                error(TAG "Error in SDL_OpenAudioDevice: %s", SDL_GetError());
+                return false;
+            }
 
-        undo.add([this]() { SDL_CloseAudioDevice(_audioDev); });
+            undo.add([this]() { SDL_CloseAudioDevice(_audioDev); });
 
-        if (!_fifo.init(_audioSpec.size * 2)) {
-            error(TAG "Error in audio FIFO init");
-            return false;
-        }
+            if (!_fifo.init(_audioSpec.size * 2)) {
+                error(TAG "Error in audio FIFO init");
+                return false;
+            }
 
-        undo.add([this]() { _fifo.destroy(); });
+            undo.add([this]() { _fifo.destroy(); });
 
-        SDL_PauseAudioDevice(_audioDev, 0);
+            SDL_PauseAudioDevice(_audioDev, 0);
 
-        // Add controller mappings
-        SDL_RWops* const ctrldb = SDL_RWFromMem(
-            const_cast<void*>(static_cast<void const*>(gamecontrollerdb_txt)),
-            static_cast<int>(sizeof(gamecontrollerdb_txt))
-        );
+            // Add controller mappings
+            SDL_RWops* const ctrldb = SDL_RWFromMem(
+                const_cast<void*>(static_cast<void const*>(gamecontrollerdb_txt)),
+                static_cast<int>(sizeof(gamecontrollerdb_txt))
+            );
 
-        if (SDL_GameControllerAddMappingsFromRW(ctrldb, 1) < 0) {
-            error(TAG "Error in SDL_GameControllerAddMappingsFromRW: %s", SDL_GetError());
-            return false;
+            if (SDL_GameControllerAddMappingsFromRW(ctrldb, 1) < 0) {
+                error(TAG "Error in SDL_GameControllerAddMappingsFromRW: %s", SDL_GetError());
+                return false;
+            }
         }
     }
 
@@ -224,50 +252,53 @@ bool hc::Application::init(std::string const& title, int const width, int const
 
         ImGui::StyleColorsDark();
 
-        if (!ImGui_ImplSDL2_InitForOpenGL(_window, _glContext)) {
-            error(TAG "Error initializing ImGui for OpenGL");
-            return false;
-        }
+        // Headless runs only need the context, for views that use ImGui outside of onDraw
+        if (!_headless) {
+            if (!ImGui_ImplSDL2_InitForOpenGL(_window, _glContext)) {
+                error(TAG "Error initializing ImGui for OpenGL");
+                return false;
+            }
 
-        undo.add([]() { ImGui_ImplSDL2_Shutdown(); });
+            undo.add([]() { ImGui_ImplSDL2_Shutdown(); });
 
-        if (!ImGui_ImplOpenGL2_Init()) {
-            error(TAG "Error initializing ImGui OpenGL implementation");
-            return false;
-        }
+            if (!ImGui_ImplOpenGL2_Init()) {
+                error(TAG "Error initializing ImGui OpenGL implementation");
+                return false;
+            }
 
-        undo.add([]() { ImGui_ImplOpenGL2_Shutdown(); });
+            undo.add([]() { ImGui_ImplOpenGL2_Shutdown(); });
 
-        // Set Proggy Tiny as the default font
-        io = ImGui::GetIO();
+            // Set Proggy Tiny as the default font
+            io = ImGui::GetIO();
 
-        ImFont* const proggyTiny = io.Fonts->AddFontFromMemoryCompressedTTF(
-            ProggyTiny_compressed_data,
-            ProggyTiny_compressed_size,
-            10.0f
-        );
+            ImFont* const proggyTiny = io.Fonts->AddFontFromMemoryCompressedTTF(
+                ProggyTiny_compressed_data,
+                ProggyTiny_compressed_size,
+                10.0f
+            );
 
-        if (proggyTiny == nullptr) {
-            error(TAG "Error adding Proggy Tiny font");
-            return false;
-        }
+            if (proggyTiny == nullptr) {
+                error(TAG "Error adding Proggy Tiny font");
+                return false;
+            }
 
-        // Add icons from Font Awesome
-        ImFontConfig config;
-        config.MergeMode = true;
-        config.PixelSnapH = true;
+            // Add icons from Font Awesome
+            ImFontConfig config;
+            config.MergeMode = true;
+            config.PixelSnapH = true;
 
-        static ImWchar const ranges1[] = {ICON_MIN_FA, ICON_MAX_FA, 0};
+            static ImWchar const ranges1[] = {ICON_MIN_FA, ICON_MAX_FA, 0};
 
-        ImFont* const fontAwesome = io.Fonts->AddFontFromMemoryCompressedTTF(
-            FontAwesome4_compressed_data,
-            FontAwesome4_compressed_size,
-            12.0f, &config, ranges1
-        );
+            ImFont* const fontAwesome = io.Fonts->AddFontFromMemoryCompressedTTF(
+                FontAwesome4_compressed_data,
+                FontAwesome4_compressed_size,
+                12.0f, &config, ranges1
+            );
 
-        if (fontAwesome == nullptr) {
-            error(TAG "Error adding Font Awesome 4 font");
-            return false;
+            if (fontAwesome == nullptr) {
+                error(TAG "Error adding Font Awesome 4 font");
+                return false;
+            }
         }
     }
 
@@ -318,6 +349,8 @@ bool hc::Application::init(std::string const& title, int const width, int const
         addView(&_perf, true, false);
 
         addView(&_control, true, false);
+        addView(&_rewind, true, false);
+        addView(&_pacer, true, false);
         addView(&_memorySelector, true, false);
         addView(&_devices, true, false);
         addView(&_repl, true, false);
@@ -327,13 +360,15 @@ bool hc::Application::init(std::string const& title, int const width, int const
             return false;
         }
 
-        _video.init();
+        _video.init(&_perf);
         _led.init();
         _audio.init(_audioSpec.freq, &_fifo);
         _input.init(&frontend);
         _perf.init();
 
         _control.init(&_fsm, &_logger);
+        _rewind.init(&_perf);
+        _pacer.init(&_video);
         _memorySelector.init();
         _devices.init(&_video);
         _repl.init();
@@ -351,7 +386,7 @@ bool hc::Application::init(std::string const& title, int const width, int const
     }
 
     {
-        // Run the autorun script
+        // Run the autorun script, and the script given in the command line
         static auto const main = [](lua_State* const L) -> int {
             char const* const path = luaL_checkstring(L, 1);
 
@@ -363,15 +398,22 @@ bool hc::Application::init(std::string const& title, int const width, int const
             return 0;
         };
 
-        std::string const& autorun = _config.getScriptsPath() + "autorun.lua";
+        std::vector<std::string> scripts;
+        scripts.emplace_back(_config.getScriptsPath() + "autorun.lua");
 
-        lua_pushcfunction(_L, main);
-        lua_pushlstring(_L, autorun.c_str(), autorun.length());
-        
-        info(TAG "Running \"%s\"", autorun.c_str());
+        if (options.script != nullptr) {
+            scripts.emplace_back(options.script);
+        }
 
-        if (!protectedCall(_L, 1, 0, &_logger)) {
-            return false;
+        for (auto const& script : scripts) {
+            lua_pushcfunction(_L, main);
+            lua_pushlstring(_L, script.c_str(), script.length());
+
+            info(TAG "Running \"%s\"", script.c_str());
+
+            if (!protectedCall(_L, 1, 0, &_logger)) {
+                return false;
+            }
         }
     }
 
@@ -384,47 +426,80 @@ void hc::Application::destroy() {
     Desktop::onQuit();
     lua_close(_L);
 
-    ImGui_ImplOpenGL2_Shutdown();
-    ImGui_ImplSDL2_Shutdown();
+    if (!_headless) {
+        ImGui_ImplOpenGL2_Shutdown();
+        ImGui_ImplSDL2_Shutdown();
+    }
+
     ImGui::DestroyContext();
 
-    SDL_CloseAudioDevice(_audioDev);
+    if (!_headless) {
+        SDL_CloseAudioDevice(_audioDev);
+    }
+
     _fifo.destroy();
 
-    SDL_GL_DeleteContext(_glContext);
-    SDL_DestroyWindow(_window);
+    if (!_headless) {
+        SDL_GL_DeleteContext(_glContext);
+        SDL_DestroyWindow(_window);
+    }
+
     SDL_Quit();
 }
 
 void hc::Application::run() {
-    bool done = false;
-    lrcpp::Frontend& frontend = lrcpp::Frontend::getInstance();
+    if (_headless) {
+        runHeadless();
+        return;
+    }
 
-    do {
-        SDL_Event event;
+    bool done = false;
 
-        while (SDL_PollEvent(&event)) {
-            ImGui_ImplSDL2_ProcessEvent(&event);
-            _devices.process(&event);
+    _quit = false;
+    _control.setDeferTransitions(true);
+    std::thread emulation(&Application::emulate, this);
 
-            if (event.type == SDL_QUIT) {
-                done = _fsm.quit();
+    do {
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            SDL_Event event;
+
+            while (SDL_PollEvent(&event)) {
+                ImGui_ImplSDL2_ProcessEvent(&event);
+                _devices.process(&event);
+
+                if (event.type == SDL_QUIT) {
+                    done = _fsm.quit();
+                }
+                else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_TAB && event.key.repeat == 0) {
+                    // Tab toggles fast-forward unless an ImGui widget is taking the keyboard
+                    if (!ImGui::GetIO().WantCaptureKeyboard) {
+                        _control.toggleFastForward();
+                    }
+                }
+                else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_BACKSPACE && event.key.repeat == 0) {
+                    // Backspace rewinds while held down
+                    if (!ImGui::GetIO().WantCaptureKeyboard) {
+                        _rewind.setRewinding(true);
+                    }
+                }
+                else if (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_BACKSPACE) {
+                    _rewind.setRewinding(false);
+                }
             }
-        }
-
-        if (_fsm.currentState() == LifeCycle::State::GameRunning) {
-            if (_runningTime.getTimeUs() >= _nextFrameTime) {
-                _nextFrameTime += _coreUsPerFrame;
 
-                _perf.start(&_runPerf);
-                frontend.run();
-                _perf.stop(&_runPerf);
+            // Transitions requested by scripts, the REPL or the views since the last frame run here, on the thread
+            // that owns the GL context and draws the views
+            _control.applyPendingTransitions();
+            done = done || _fsm.currentState() == LifeCycle::State::Quit;
 
-                _audio.flush();
-                onFrame();
-            }
+            // Polls background scans even when the game isn't running
+            hc::cheats::onFrame(_L, &_logger);
+            onSync();
         }
 
+        // The emulation thread runs while the views draw what they copied in onSync, and while the frame is
+        // rendered and waits for the vertical sync
         ImGui_ImplOpenGL2_NewFrame();
         ImGui_ImplSDL2_NewFrame(_window);
         ImGui::NewFrame();
@@ -443,6 +518,190 @@ void hc::Application::run() {
         SDL_Delay(1);
     }
     while (!done);
+
+    _quit = true;
+    emulation.join();
+    _control.setDeferTransitions(false);
+}
+
+void hc::Application::emulate() {
+    while (!_quit) {
+        bool running = false;
+        uint64_t deadline = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            // Don't run frames the scripts asked to pause or unload before the UI thread gets to do it
+            running = _fsm.currentState() == LifeCycle::State::GameRunning && !_control.hasPendingTransitions();
+
+            if (running && _pacer.due(&deadline)) {
+                unsigned const speed = _control.getFastForward();
+                runFrames(speed);
+
+                // Fast-forwarded frames can take longer than real time to run, don't try to catch up
+                if (speed != 1) {
+                    _pacer.skipMissed();
+                }
+            }
+
+            // Traces are also recorded while the game is paused
+            _debugger.update();
+        }
+
+        // Wait outside the lock
+        if (!running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        else if (deadline != 0) {
+            Pacer::waitUntil(deadline);
+        }
+        else {
+            // Give the UI thread a chance to take the lock when running behind or fast-forwarding
+            std::this_thread::yield();
+        }
+    }
+}
+
+void hc::Application::runFrames(unsigned const count) {
+    lrcpp::Frontend& frontend = lrcpp::Frontend::getInstance();
+
+    if (_rewind.isRewinding()) {
+        // Run one frame from the restored state to show it, the rewind doesn't save frames while rewinding
+        if (_rewind.step()) {
+            _video.setSkipFrames(_headless);
+
+            _perf.start(&_runPerf);
+            frontend.run();
+            _perf.stop(&_runPerf);
+
+            _audio.drop();
+            onFrame();
+        }
+
+        return;
+    }
+
+    // Only the last frame is shown and heard when fast-forwarding, and none in headless runs since
+    // there's nowhere to show or play them
+    for (unsigned i = 1; i <= count; i++) {
+        bool const last = i == count;
+
+        if (last && _control.getRunAhead() != 0) {
+            runAhead(_control.getRunAhead());
+            break;
+        }
+
+        _video.setSkipFrames(_headless || !last);
+
+        _perf.start(&_runPerf);
+        frontend.run();
+        _perf.stop(&_runPerf);
+
+        if (last && !_headless) {
+            _audio.flush();
+        }
+        else {
+            _audio.drop();
+        }
+
+        onFrame();
+    }
+}
+
+void hc::Application::runAhead(unsigned const frames) {
+    lrcpp::Frontend& frontend = lrcpp::Frontend::getInstance();
+    uint64_t const start = Perf::getTimeNs();
+    size_t size = 0;
+
+    if (!frontend.serializeSize(&size) || size == 0) {
+        warn(TAG "The core can't save its state, disabling run-ahead");
+        _control.setRunAhead(0);
+        runFrames(1);
+        return;
+    }
+
+    _perf.start(&_runAheadPerf);
+
+    // The frame that counts, heard but not shown, everything else sees it as a regular frame
+    _video.setSkipFrames(true);
+
+    _perf.start(&_runPerf);
+    frontend.run();
+    _perf.stop(&_runPerf);
+
+    if (_headless) {
+        _audio.drop();
+    }
+    else {
+        _audio.flush();
+    }
+
+    onFrame();
+
+    // Reused between frames, resize only allocates when the state grows
+    _runAheadState.resize(size);
+
+    if (!frontend.serialize(_runAheadState.data(), size)) {
+        _perf.stop(&_runAheadPerf);
+        warn(TAG "Error saving the state, disabling run-ahead");
+        _control.setRunAhead(0);
+        return;
+    }
+
+    // Run ahead with the same input, show the last frame and throw away their audio, and keep them out of the
+    // traces and logs since they're rolled back
+    _debugger.setSpeculative(true);
+
+    for (unsigned i = 1; i <= frames; i++) {
+        _video.setSkipFrames(_headless || i != frames);
+        frontend.run();
+        _audio.drop();
+    }
+
+    _debugger.setSpeculative(false);
+
+    if (!frontend.unserialize(_runAheadState.data(), size)) {
+        error(TAG "Error restoring the state after running ahead");
+    }
+
+    _perf.stop(&_runAheadPerf);
+
+    uint64_t const elapsed = Perf::getTimeNs() - start;
+    _control.setHeadroom(1.0 - static_cast<double>(elapsed) / _pacer.getFramePeriodNs());
+}
+
+void hc::Application::runHeadless() {
+    uint64_t const start = Perf::getTimeUs();
+    uint64_t frames = 0;
+
+    // The scripts load and start the game, stop as soon as it isn't running anymore
+    while (_fsm.currentState() == LifeCycle::State::GameRunning) {
+        uint64_t deadline = 0;
+
+        while (_paced && !_pacer.due(&deadline)) {
+            Pacer::waitUntil(deadline);
+        }
+
+        // Unpaced runs are already as fast as possible
+        unsigned const speed = _paced ? _control.getFastForward() : 1;
+        runFrames(speed);
+        hc::cheats::onFrame(_L, &_logger);
+        _debugger.update();
+
+        frames += speed;
+    }
+
+    uint64_t const elapsed = Perf::getTimeUs() - start;
+    double const seconds = elapsed / 1000000.0;
+
+    info(
+        TAG "Ran %" PRIu64 " frames in %.3f seconds, %.2f frames per second",
+        frames, seconds, elapsed != 0 ? frames / seconds : 0.0
+    );
+
+    if (_fsm.currentState() != LifeCycle::State::Quit) {
+        _fsm.quit();
+    }
 }
 
 bool hc::Application::loadCore(char const* path) {
@@ -531,7 +790,6 @@ bool hc::Application::loadGame(char const* path) {
 }
 
 bool hc::Application::pauseGame() {
-    SDL_GL_SetSwapInterval(1);
     onGamePaused();
     return true;
 }
@@ -547,13 +805,11 @@ bool hc::Application::resetGame() {
 }
 
 bool hc::Application::resumeGame() {
-    SDL_GL_SetSwapInterval(0);
     onGameResumed();
     return true;
 }
 
 bool hc::Application::startGame() {
-    SDL_GL_SetSwapInterval(0);
     onGameStarted();
     return true;
 }
@@ -577,8 +833,6 @@ bool hc::Application::unloadCore() {
 }
 
 bool hc::Application::unloadGame() {
-    SDL_GL_SetSwapInterval(1);
-
     if (lrcpp::Frontend::getInstance().unloadGame()) {
         onGameUnloaded();
         _runPerf.start = _runPerf.total = _runPerf.call_cnt = 0;
@@ -597,31 +851,22 @@ void hc::Application::onCoreLoaded() {
     // register this here.
     _runPerf.ident = "hc::retro_run";
     _perf.register_(&_runPerf);
+    _runAheadPerf.ident = "hc::runAhead";
+    _perf.register_(&_runAheadPerf);
 
     Desktop::onCoreLoaded();
 }
 
-void hc::Application::onGameLoaded() {
-    Desktop::onGameLoaded();
-    _coreUsPerFrame = 1000000.0 / _video.getCoreFps();
-}
-
 void hc::Application::onGameStarted() {
-    Desktop::onGameStarted();
-    _runningTime.start();
-    _nextFrameTime = _runningTime.getTimeUs();
-}
-
-void hc::Application::onGamePaused() {
-    Desktop::onGamePaused();
-    _runningTime.pause();
-}
+    if (_window != nullptr) {
+        SDL_DisplayMode mode;
 
-void hc::Application::onGameResumed() {
-    Desktop::onGameResumed();
+        if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(_window), &mode) == 0) {
+            _pacer.setDisplayRate(mode.refresh_rate);
+        }
+    }
 
-    _runningTime.resume();
-    _nextFrameTime = _runningTime.getTimeUs() + _coreUsPerFrame;
+    Desktop::onGameStarted();
 }
 
 void hc::Application::onDraw() {
@@ -629,11 +874,6 @@ void hc::Application::onDraw() {
     Desktop::onDraw();
 }
 
-void hc::Application::onGameUnloaded() {
-    Desktop::onGameUnloaded();
-    _runningTime.stop();
-}
-
 int hc::Application::push(lua_State* const L) {
     static struct {char const* name; char const* value;} const stringConsts[] = {
         {"_COPYRIGHT", "Copyright (c) 2020-2021 Andre Leiradella"},
@@ -654,7 +894,7 @@ int hc::Application::push(lua_State* const L) {
 
     size_t const stringCount = sizeof(stringConsts) / sizeof(stringConsts[0]);
 
-    lua_createtable(L, 0, stringCount + 6);
+    lua_createtable(L, 0, stringCount + 11);
 
     _logger.push(L);
     lua_setfield(L, -2, "logger");
@@ -671,15 +911,30 @@ int hc::Application::push(lua_State* const L) {
     _control.push(L);
     lua_setfield(L, -2, "control");
 
+    _audio.push(L);
+    lua_setfield(L, -2, "audio");
+
+    _rewind.push(L);
+    lua_setfield(L, -2, "rewind");
+
+    _pacer.push(L);
+    lua_setfield(L, -2, "pacer");
+
     _memorySelector.push(L);
     lua_setfield(L, -2, "memory");
 
+    _debugger.push(L);
+    lua_setfield(L, -2, "debugger");
+
     _repl.push(L);
     lua_setfield(L, -2, "repl");
 
     hc::cheats::push(_L);
     lua_setfield(L, -2, "cheats");
 
+    lua_pushboolean(L, _headless);
+    lua_setfield(L, -2, "headless");
+
     for (size_t i = 0; i < stringCount; i++) {
         lua_pushstring(L, stringConsts[i].value);
         lua_setfield(L, -2, stringConsts[i].name);
@@ -724,13 +979,10 @@ void hc::Application::lifeCycleVprintf(void* ud, char const* fmt, va_list args)
 
 void hc::Application::audioCallback(void* const udata, Uint8* const stream, int const len) {
     auto const self = static_cast<Application*>(udata);
-    size_t const avail = self->_fifo.occupied();
+    size_t const avail = self->_fifo.read(static_cast<void*>(stream), len);
 
     if (avail < (size_t)len) {
-        self->_fifo.read(static_cast<void*>(stream), avail);
         memset(static_cast<void*>(stream + avail), 0, len - avail);
-    }
-    else {
-        self->_fifo.read(static_cast<void*>(stream), len);
+        self->_audio.underrun();
     }
 }
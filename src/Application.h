@@ -14,6 +14,8 @@
 #include "LifeCycle.h"
 
 #include "Control.h"
+#include "Rewind.h"
+#include "Pacer.h"
 #include "Memory.h"
 #include "Devices.h"
 #include "LuaRepl.h"
@@ -29,13 +31,26 @@ extern "C" {
 }
 
 #include <stdarg.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
 
 namespace hc {
     class Application : public Desktop, public Scriptable {
     public:
+        struct Options {
+            Options() : headless(false), paced(false), script(nullptr) {}
+
+            // No window, no OpenGL and no audio device, games run as fast as possible unless paced
+            bool headless;
+            bool paced;
+            // Runs after autorun.lua
+            char const* script;
+        };
+
         Application();
 
-        bool init(std::string const& title, int const width, int const height);
+        bool init(std::string const& title, int const width, int const height, Options const& options);
         void destroy();
         void draw();
         void run();
@@ -55,12 +70,8 @@ namespace hc {
         // hc::View
         virtual char const* getTitle() override;
         virtual void onCoreLoaded() override;
-        virtual void onGameLoaded() override;
         virtual void onGameStarted() override;
-        virtual void onGamePaused() override;
-        virtual void onGameResumed() override;
         virtual void onDraw() override;
-        virtual void onGameUnloaded() override;
 
         // hc::Scriptable
         virtual int push(lua_State* const L) override;
@@ -70,6 +81,14 @@ namespace hc {
         static void lifeCycleVprintf(void* ud, char const* fmt, va_list args);
         static void audioCallback(void* const udata, Uint8* const stream, int const len);
 
+        // Runs the core at its own frame rate
+        void emulate();
+        // Runs count frames, only presenting the last one, or goes back one saved state when rewinding
+        void runFrames(unsigned const count);
+        // Runs a frame, then the given number of frames ahead to show the last one, and rolls back
+        void runAhead(unsigned const frames);
+        void runHeadless();
+
         SDL_Window* _window;
         SDL_GLContext _glContext;
         SDL_AudioSpec _audioSpec;
@@ -86,18 +105,23 @@ namespace hc {
         Perf _perf;
         
         Control _control;
+        Rewind _rewind;
+        Pacer _pacer;
         MemorySelector _memorySelector;
         Devices _devices;
         LuaRepl _repl;
         Debugger _debugger;
 
-        Timer _runningTime;
-        uint64_t _nextFrameTime;
-        uint64_t _coreUsPerFrame;
-
         retro_perf_counter _runPerf;
+        retro_perf_counter _runAheadPerf;
+        std::vector<uint8_t> _runAheadState;
 
         Fifo _fifo;
         lua_State* _L;
+
+        bool _headless;
+        bool _paced;
+
+        std::atomic<bool> _quit;
     };
 }
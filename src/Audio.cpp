@@ -4,6 +4,8 @@
 #include <IconsFontAwesome4.h>
 
 #include <float.h>
+#include <inttypes.h>
+#include <math.h>
 
 extern "C" {
     #include "lauxlib.h"
@@ -11,17 +13,35 @@ extern "C" {
 
 #define TAG "[AUD] "
 
+// The fill level the controller aims for, as a fraction of the fifo size
+static double const FillTarget = 0.5;
+// Weight of each new fill level measurement, they're taken once per frame
+static double const FillSmoothing = 0.05;
+// Controller gains, an error of 0.5 alone asks for the maximum adjustment
+static double const ProportionalGain = 0.01;
+static double const IntegralGain = 0.0002;
+// Adjustments of up to half a percent in pitch aren't noticeable
+static double const MaxAdjust = 0.005;
+// Maximum change in the adjustment per frame, so the pitch never jumps
+static double const MaxSlew = 0.0001;
+// The ratio given to the resampler is quantized so it's not rebuilding its filter every frame
+static double const RateScale = 100.0;
+static double const AdjustStep = 0.00001;
+
 hc::Audio::Audio(Desktop* desktop)
     : View(desktop)
     , _sampleRate(0.0)
     , _fifo(nullptr)
     , _mute(false)
     , _wasMuted(false)
-    , _rateControlDelta(0.0)
     , _currentRatio(0.0)
     , _originalRatio(0.0)
     , _resampler(nullptr)
+    , _running(false)
+    , _underruns(0)
+    , _overruns(0)
 {
+    resetRateControl();
     memset(&_timing, 0, sizeof(_timing));
 }
 
@@ -40,44 +60,74 @@ void hc::Audio::flush() {
     _mutex.unlock();
     _samples.clear();
 
-    int16_t const* const data = _previousSamples.data();
-    size_t const frames = _previousSamples.size() / 2;
-
-    size_t const avail = _fifo->free();
-
-    // Readjust the audio input rate
-    int const halfSize = (int)_fifo->size() / 2;
-    int const deltaMid = (int)avail - halfSize;
-    double const direction = (double)deltaMid / (double)halfSize;
-    double const adjust = 1.0 + _rateControlDelta * direction;
+    updateRatio();
 
-    _currentRatio = _originalRatio * adjust;
+    int16_t const* input = _previousSamples.data();
+    spx_uint32_t inLen = _previousSamples.size() / 2;
 
-    spx_uint32_t inLen = frames * 2;
-    spx_uint32_t outLen = (spx_uint32_t)(inLen * _currentRatio);
-    outLen += outLen & 1; // request an even number of samples (stereo)
-    int16_t* const output = (int16_t*)alloca(outLen * 2);
+    if (_mute) {
+        // Write as much silence as the samples would have resampled to, so the fill level is kept
+        spx_uint32_t silence = static_cast<spx_uint32_t>(inLen * _currentRatio + 0.5);
+
+        while (silence != 0) {
+            size_t size = 0;
+            void* const output = _fifo->acquireWrite(&size);
+            spx_uint32_t outLen = size / 4;
+
+            if (outLen == 0) {
+                _overruns++;
+                break;
+            }
+
+            outLen = outLen < silence ? outLen : silence;
+            memset(output, 0, outLen * 4);
+            _fifo->commitWrite(outLen * 4);
+            silence -= outLen;
+        }
 
-    if (output == NULL) {
-        _desktop->error(TAG "Error allocating temporary output buffer");
         return;
     }
 
-    if (_mute) {
-        memset(output, 0, outLen * 2);
-    }
-    else {
-        int const error = speex_resampler_process_int(_resampler, 0, data, &inLen, output, &outLen);
+    // Resample straight into the fifo, in up to two pieces when it wraps around
+    while (inLen != 0) {
+        size_t size = 0;
+        int16_t* const output = static_cast<int16_t*>(_fifo->acquireWrite(&size));
+        spx_uint32_t outLen = size / 4;
+
+        if (outLen == 0) {
+            // The rest of the samples don't fit
+            _overruns++;
+            break;
+        }
+
+        spx_uint32_t consumed = inLen;
+        int const error = speex_resampler_process_interleaved_int(_resampler, input, &consumed, output, &outLen);
 
         if (error != RESAMPLER_ERR_SUCCESS) {
-            memset(output, 0, outLen * 2);
             _desktop->error(TAG "Error resampling: %s", speex_resampler_strerror(error));
+            break;
+        }
+
+        _fifo->commitWrite(outLen * 4);
+        input += consumed * 2;
+        inLen -= consumed;
+
+        if (consumed == 0 && outLen == 0) {
+            break;
         }
     }
+}
+
+void hc::Audio::drop() {
+    _mutex.lock();
+    _samples.clear();
+    _mutex.unlock();
+}
 
-    outLen &= ~1; // don't send incomplete audio frames
-    size_t const size = outLen * 2;
-    _fifo->write(output, size <= avail ? size : avail);
+void hc::Audio::underrun() {
+    if (_running) {
+        _underruns++;
+    }
 }
 
 char const* hc::Audio::getTitle() {
@@ -87,7 +137,7 @@ char const* hc::Audio::getTitle() {
 void hc::Audio::onGameLoaded() {
     // setSystemAvInfo has been called by now
     _currentRatio = _originalRatio = _sampleRate / _timing.sample_rate;
-    _rateControlDelta = 0.005;
+    resetRateControl();
 
     int error;
     _resampler = speex_resampler_init(2, _timing.sample_rate, _sampleRate, SPEEX_RESAMPLER_QUALITY_DEFAULT, &error);
@@ -100,27 +150,58 @@ void hc::Audio::onGameLoaded() {
     }
 }
 
+void hc::Audio::onGameStarted() {
+    _running = true;
+}
+
 void hc::Audio::onGamePaused() {
+    _running = false;
     _wasMuted = _mute;
     _mute = true;
 }
 
 void hc::Audio::onGameResumed() {
     _mute = _wasMuted;
+    _running = true;
 }
 
 void hc::Audio::onGameReset() {
     _mutex.lock();
     _samples.clear();
     _previousSamples.clear();
-    _drawSamples.clear();
     _mutex.unlock();
 }
 
+void hc::Audio::onSync() {
+    _shown.mute = _mute;
+    _shown.ratio = _currentRatio;
+    _shown.adjust = _adjust;
+    _shown.fill = _fill;
+    _shown.underruns = _underruns;
+    _shown.overruns = _overruns;
+}
+
 void hc::Audio::onDraw() {
-    ImGui::Checkbox("Mute", &_mute);
+    if (ImGui::Checkbox("Mute", &_shown.mute)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _mute = _shown.mute;
+    }
+
+    ImGui::SameLine();
+
+    ImGui::Text(
+        "Ratio %.6f (%+.3f%%), fill %.1f%%, %" PRIu64 " underruns, %" PRIu64 " overruns",
+        _shown.ratio, (_shown.adjust - 1.0) * 100.0, _shown.fill * 100.0, _shown.underruns, _shown.overruns
+    );
+
     ImGui::SameLine();
 
+    if (ImGui::Button(ICON_FA_REFRESH " Reset")) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _underruns = 0;
+        _overruns = 0;
+    }
+
     static auto const left = [](void* const data, int const idx) -> float {
         auto const self = static_cast<Audio*>(data);
         return self->_drawSamples[idx * 2];
@@ -162,6 +243,8 @@ void hc::Audio::onDraw() {
 }
 
 void hc::Audio::onGameUnloaded() {
+    _running = false;
+
     if (_resampler != nullptr) {
         speex_resampler_destroy(_resampler);
         _resampler = nullptr;
@@ -170,10 +253,28 @@ void hc::Audio::onGameUnloaded() {
     _mutex.lock();
     _samples.clear();
     _previousSamples.clear();
-    _drawSamples.clear();
     _mutex.unlock();
 }
 
+int hc::Audio::push(lua_State* const L) {
+    auto const self = static_cast<Audio**>(lua_newuserdata(L, sizeof(Audio*)));
+    *self = this;
+
+    if (luaL_newmetatable(L, "hc::Audio")) {
+        static luaL_Reg const methods[] = {
+            {"getStats", l_getStats},
+            {"resetStats", l_resetStats},
+            {nullptr, nullptr}
+        };
+
+        luaL_newlib(L, methods);
+        lua_setfield(L, -2, "__index");
+    }
+
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
 bool hc::Audio::setSystemAvInfo(retro_system_av_info const* info) {
     _timing = info->timing;
 
@@ -204,3 +305,83 @@ void hc::Audio::sample(int16_t left, int16_t right) {
     int16_t frame[2] = {left, right};
     sampleBatch(frame, 1);
 }
+
+void hc::Audio::updateRatio() {
+    double const size = static_cast<double>(_fifo->size());
+    double const fill = size != 0.0 ? _fifo->occupied() / size : FillTarget;
+
+    // The audio thread reads the fifo in large chunks, so a single measurement is mostly noise
+    _fill += (fill - _fill) * FillSmoothing;
+
+    // A positive error means the fifo is draining, so produce more samples per input sample
+    double const error = FillTarget - _fill;
+    double const integralLimit = MaxAdjust / IntegralGain;
+
+    _integral += error;
+    _integral = _integral < -integralLimit ? -integralLimit : _integral > integralLimit ? integralLimit : _integral;
+
+    double target = 1.0 + ProportionalGain * error + IntegralGain * _integral;
+    target = target < 1.0 - MaxAdjust ? 1.0 - MaxAdjust : target > 1.0 + MaxAdjust ? 1.0 + MaxAdjust : target;
+
+    double const delta = target - _adjust;
+    _adjust += delta < -MaxSlew ? -MaxSlew : delta > MaxSlew ? MaxSlew : delta;
+    _currentRatio = _originalRatio * _adjust;
+
+    double const adjust = floor(_adjust / AdjustStep + 0.5) * AdjustStep;
+    spx_uint32_t const num = static_cast<spx_uint32_t>(_timing.sample_rate * RateScale + 0.5);
+    spx_uint32_t const den = static_cast<spx_uint32_t>(_sampleRate * adjust * RateScale + 0.5);
+
+    if (den != _rateDen) {
+        int const error = speex_resampler_set_rate_frac(
+            _resampler, num, den,
+            static_cast<spx_uint32_t>(_timing.sample_rate + 0.5), static_cast<spx_uint32_t>(_sampleRate + 0.5)
+        );
+
+        if (error != RESAMPLER_ERR_SUCCESS) {
+            _desktop->error(TAG "Error setting the resampler rate: %s", speex_resampler_strerror(error));
+        }
+
+        _rateDen = den;
+    }
+}
+
+void hc::Audio::resetRateControl() {
+    _fill = FillTarget;
+    _integral = 0.0;
+    _adjust = 1.0;
+    _rateDen = 0;
+}
+
+hc::Audio* hc::Audio::check(lua_State* const L, int const index) {
+    return *static_cast<Audio**>(luaL_checkudata(L, index, "hc::Audio"));
+}
+
+int hc::Audio::l_getStats(lua_State* const L) {
+    auto const self = check(L, 1);
+
+    lua_createtable(L, 0, 5);
+
+    lua_pushnumber(L, self->_currentRatio);
+    lua_setfield(L, -2, "ratio");
+
+    lua_pushnumber(L, self->_adjust);
+    lua_setfield(L, -2, "adjust");
+
+    lua_pushnumber(L, self->_fill);
+    lua_setfield(L, -2, "fill");
+
+    lua_pushinteger(L, static_cast<lua_Integer>(self->_underruns));
+    lua_setfield(L, -2, "underruns");
+
+    lua_pushinteger(L, static_cast<lua_Integer>(self->_overruns));
+    lua_setfield(L, -2, "overruns");
+
+    return 1;
+}
+
+int hc::Audio::l_resetStats(lua_State* const L) {
+    auto const self = check(L, 1);
+    self->_underruns = 0;
+    self->_overruns = 0;
+    return 0;
+}
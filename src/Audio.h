@@ -1,33 +1,49 @@
 #pragma once
 
 #include "Desktop.h"
+#include "Scriptable.h"
 
 #include <lrcpp/Components.h>
 #include <Fifo.h>
 
 #include <speex_resampler.h>
 
+#include <atomic>
 #include <vector>
 #include <mutex>
+#include <stdint.h>
 
 namespace hc {
-    class Audio: public View, public lrcpp::Audio {
+    // Resamples the game audio to the device rate. The ratio is slightly adjusted by a PI controller to
+    // keep the fifo half full, since the game and the audio device clocks are never exactly in sync.
+    class Audio: public View, public Scriptable, public lrcpp::Audio {
     public:
         Audio(Desktop* desktop);
         virtual ~Audio() {}
 
         void init(double const sampleRate, Fifo* const fifo);
         void flush();
+        // Throws away the samples of the last frame instead of playing them
+        void drop();
+        // Called from the audio thread when the fifo doesn't have enough samples
+        void underrun();
+
+        static Audio* check(lua_State* const L, int const index);
 
         // hc::View
         virtual char const* getTitle() override;
         virtual void onGameLoaded() override;
+        virtual void onGameStarted() override;
         virtual void onGamePaused() override;
         virtual void onGameResumed() override;
         virtual void onGameReset() override;
+        virtual void onSync() override;
         virtual void onDraw() override;
         virtual void onGameUnloaded() override;
 
+        // hc::Scriptable
+        virtual int push(lua_State* const L) override;
+
         // lrcpp::Audio
         virtual bool setSystemAvInfo(retro_system_av_info const* info) override;
         virtual bool setAudioCallback(retro_audio_callback const* callback) override;
@@ -36,6 +52,12 @@ namespace hc {
         virtual void sample(int16_t left, int16_t right) override;
 
     protected:
+        void updateRatio();
+        void resetRateControl();
+
+        static int l_getStats(lua_State* const L);
+        static int l_resetStats(lua_State* const L);
+
         double _sampleRate;
         Fifo* _fifo;
 
@@ -46,12 +68,33 @@ namespace hc {
         bool _mute;
         bool _wasMuted;
 
-        double _rateControlDelta;
         double _currentRatio;
         double _originalRatio;
         SpeexResamplerState* _resampler;
 
+        // Rate control, the fill level is smoothed and the adjustment is applied to the original ratio
+        double _fill;
+        double _integral;
+        double _adjust;
+        spx_uint32_t _rateDen;
+
+        // Underruns are only counted while the game is running, the fifo is expected to drain otherwise
+        std::atomic<bool> _running;
+        std::atomic<uint64_t> _underruns;
+        uint64_t _overruns;
+
         std::vector<int16_t> _previousSamples;
         std::vector<int16_t> _drawSamples;
+
+        // Copied in onSync
+        struct {
+            bool mute;
+            double ratio;
+            double adjust;
+            double fill;
+            uint64_t underruns;
+            uint64_t overruns;
+        }
+        _shown;
     };
 }
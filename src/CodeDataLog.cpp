@@ -0,0 +1,198 @@
+#include "CodeDataLog.h"
+#include "Cpu.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Full logs start with this, so they aren't mistaken for plain ones when loaded
+static char const fullMagic[8] = {'H', 'C', 'C', 'D', 'L', '\0', '\1', '\0'};
+
+hc::CodeDataLog::CodeDataLog(DebugMemory* const memory)
+    : _memory(memory)
+    , _base(memory->base())
+    , _flags(memory->size(), 0)
+    , _detectWrites(false)
+    , _hasPrevious(false)
+{}
+
+void hc::CodeDataLog::mark(uint64_t const address, uint64_t const length, uint8_t const flags) {
+    uint64_t const offset = address - _base;
+
+    if (offset >= _flags.size()) {
+        return;
+    }
+
+    uint64_t const count = length < _flags.size() - offset ? length : _flags.size() - offset;
+
+    for (uint64_t i = 0; i < count; i++) {
+        _flags[offset + i] |= flags;
+    }
+}
+
+void hc::CodeDataLog::markCode(uint64_t const address, unsigned const length) {
+    mark(address, length, Code);
+    mark(address, 1, Opcode);
+}
+
+void hc::CodeDataLog::merge(uint8_t const* const flags, size_t size) {
+    uint8_t* const dest = _flags.data();
+    size = size < _flags.size() ? size : _flags.size();
+    size_t i = 0;
+
+    // A word at a time, which compilers turn into vector instructions
+    for (; i + 8 <= size; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, dest + i, 8);
+        memcpy(&b, flags + i, 8);
+        a |= b;
+        memcpy(dest + i, &a, 8);
+    }
+
+    for (; i < size; i++) {
+        dest[i] |= flags[i];
+    }
+}
+
+void hc::CodeDataLog::clear() {
+    memset(_flags.data(), 0, _flags.size());
+}
+
+void hc::CodeDataLog::setDetectWrites(bool const enabled) {
+    _detectWrites = enabled;
+    _hasPrevious = false;
+
+    // Two copies of the region are only needed while detecting writes
+    _previous.resize(enabled ? _flags.size() : 0);
+    _current.resize(enabled ? _flags.size() : 0);
+    _previous.shrink_to_fit();
+    _current.shrink_to_fit();
+}
+
+void hc::CodeDataLog::onFrame() {
+    if (!_detectWrites) {
+        return;
+    }
+
+    size_t const size = _flags.size();
+    _memory->read(_base, _current.data(), size);
+
+    if (_hasPrevious) {
+        uint8_t const* const current = _current.data();
+        uint8_t const* const previous = _previous.data();
+        size_t i = 0;
+
+        // Most words don't change between frames, only look at the bytes of the ones that did
+        for (; i + 8 <= size; i += 8) {
+            uint64_t a, b;
+            memcpy(&a, current + i, 8);
+            memcpy(&b, previous + i, 8);
+
+            if (a != b) {
+                for (size_t j = i; j < i + 8; j++) {
+                    _flags[j] |= current[j] != previous[j] ? Written : 0;
+                }
+            }
+        }
+
+        for (; i < size; i++) {
+            _flags[i] |= current[i] != previous[i] ? Written : 0;
+        }
+    }
+
+    _current.swap(_previous);
+    _hasPrevious = true;
+}
+
+bool hc::CodeDataLog::canWatch() const {
+    return _memory->canWatch();
+}
+
+bool hc::CodeDataLog::watch(uint64_t const address, uint64_t const length, bool const read, bool const write) {
+    if (!canWatch() || (!read && !write)) {
+        return false;
+    }
+
+    unsigned const id = _memory->setWatchpoint(address, length, read, write);
+    uint8_t const flags = (read ? Data : 0) | (write ? Written : 0);
+    _watches.emplace_back(Watch{id, address, length, flags});
+    return true;
+}
+
+void hc::CodeDataLog::onBreakpoint(unsigned const id) {
+    for (auto const& watch : _watches) {
+        if (watch.id == id) {
+            mark(watch.address, watch.length, watch.flags);
+        }
+    }
+}
+
+size_t hc::CodeDataLog::count(uint8_t const flags) const {
+    size_t count = 0;
+
+    for (auto const value : _flags) {
+        count += (value & flags) != 0;
+    }
+
+    return count;
+}
+
+bool hc::CodeDataLog::save(char const* const path, Format const format) const {
+    FILE* const file = fopen(path, "wb");
+
+    if (file == nullptr) {
+        return false;
+    }
+
+    bool ok = true;
+
+    if (format == Format::Full) {
+        ok = fwrite(fullMagic, 1, sizeof(fullMagic), file) == sizeof(fullMagic);
+        ok = ok && fwrite(_flags.data(), 1, _flags.size(), file) == _flags.size();
+    }
+    else {
+        std::vector<uint8_t> plain(_flags.size());
+
+        for (size_t i = 0; i < _flags.size(); i++) {
+            uint8_t const flags = _flags[i];
+            plain[i] = (flags & (Code | Data)) | ((flags & Written) != 0 ? Data : 0);
+        }
+
+        ok = fwrite(plain.data(), 1, plain.size(), file) == plain.size();
+    }
+
+    return fclose(file) == 0 && ok;
+}
+
+bool hc::CodeDataLog::load(char const* const path) {
+    FILE* const file = fopen(path, "rb");
+
+    if (file == nullptr) {
+        return false;
+    }
+
+    char magic[sizeof(fullMagic)];
+    bool const full = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, fullMagic, sizeof(magic)) == 0;
+
+    if (!full) {
+        rewind(file);
+    }
+
+    std::vector<uint8_t> flags(_flags.size());
+    size_t const size = fread(flags.data(), 1, flags.size(), file);
+    bool const ok = ferror(file) == 0;
+    fclose(file);
+
+    if (!ok) {
+        return false;
+    }
+
+    // Plain logs only have code and data bits, don't take anything else from files written by other tools
+    if (!full) {
+        for (size_t i = 0; i < size; i++) {
+            flags[i] &= Code | Data;
+        }
+    }
+
+    merge(flags.data(), size);
+    return true;
+}
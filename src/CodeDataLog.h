@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hc {
+    class DebugMemory;
+
+    // One byte of flags per address of a memory region, telling if it was executed as code, read as data,
+    // or written to.
+    class CodeDataLog {
+    public:
+        enum : uint8_t {
+            // The only flags kept in the plain format
+            Code = 0x01,
+            Data = 0x02,
+            // Only kept in the full format
+            Opcode = 0x40,
+            Written = 0x80
+        };
+
+        enum class Format {
+            // Code and data flags only, written bytes are saved as data. Indexed by CPU address, so it's
+            // not the ROM offset indexed format of emulators such as FCEUX or Mesen
+            Plain,
+            Full
+        };
+
+        CodeDataLog(DebugMemory* const memory);
+
+        DebugMemory* memory() const { return _memory; }
+        uint64_t base() const { return _base; }
+
+        uint8_t flags(uint64_t const address) const {
+            return address - _base < _flags.size() ? _flags[address - _base] : 0;
+        }
+
+        uint8_t const* data() const { return _flags.data(); }
+        size_t size() const { return _flags.size(); }
+
+        void mark(uint64_t const address, uint64_t const length, uint8_t const flags);
+        void markCode(uint64_t const address, unsigned const length);
+        void merge(CodeDataLog const& other) { merge(other._flags.data(), other._flags.size()); }
+        void merge(uint8_t const* const flags, size_t const size);
+        void clear();
+
+        // Marks the bytes that changed since the last call as written, only when enabled
+        bool getDetectWrites() const { return _detectWrites; }
+        void setDetectWrites(bool const enabled);
+        void onFrame();
+
+        // Marks the whole range when the core reports the watchpoint was hit
+        bool canWatch() const;
+        bool watch(uint64_t const address, uint64_t const length, bool const read, bool const write);
+        void onBreakpoint(unsigned const id);
+
+        size_t count(uint8_t const flags) const;
+
+        bool save(char const* const path, Format const format) const;
+        // Merges the log in the file into this one
+        bool load(char const* const path);
+
+    protected:
+        struct Watch {
+            unsigned id;
+            uint64_t address;
+            uint64_t length;
+            uint8_t flags;
+        };
+
+        DebugMemory* const _memory;
+        uint64_t const _base;
+        std::vector<uint8_t> _flags;
+
+        bool _detectWrites;
+        bool _hasPrevious;
+        std::vector<uint8_t> _previous;
+        std::vector<uint8_t> _current;
+
+        std::vector<Watch> _watches;
+    };
+}
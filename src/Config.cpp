@@ -1,4 +1,5 @@
 #include "Config.h"
+#include "Control.h"
 #include "Logger.h"
 
 #include <fnkdat.h>
@@ -9,6 +10,8 @@ extern "C" {
 }
 
 #include <inttypes.h>
+#include <string.h>
+#include <algorithm>
 
 #define TAG "[CFG] "
 
@@ -61,6 +64,46 @@ void hc::CoreMemory::poke(uint64_t address, uint8_t value) {
     }
 }
 
+void hc::CoreMemory::read(uint64_t address, void* buffer, uint64_t size) const {
+    auto dest = static_cast<uint8_t*>(buffer);
+    address -= _base;
+
+    for (auto const& block : _blocks) {
+        if (size == 0) {
+            return;
+        }
+
+        if (address < block.size) {
+            uint64_t const count = std::min(size, block.size - address);
+            memcpy(dest, static_cast<uint8_t const*>(block.data) + address, count);
+
+            dest += count;
+            size -= count;
+            address = 0;
+        }
+        else {
+            address -= block.size;
+        }
+    }
+
+    // Addresses past the last block read as zero, like in peek
+    memset(dest, 0, size);
+}
+
+uint8_t const* hc::CoreMemory::span(uint64_t address, uint64_t size) const {
+    address -= _base;
+
+    for (auto const& block : _blocks) {
+        if (address < block.size) {
+            return size <= block.size - address ? static_cast<uint8_t const*>(block.data) + address : nullptr;
+        }
+
+        address -= block.size;
+    }
+
+    return nullptr;
+}
+
 static void getFlags(char flags[7], uint64_t const mcflags) {
     flags[0] = 'M';
     flags[2] = 'A';
@@ -84,9 +127,10 @@ static void getFlags(char flags[7], uint64_t const mcflags) {
     flags[5] = (mcflags & RETRO_MEMDESC_CONST) != 0 ? 'C' : 'c';
 }
 
-hc::Config::Config(Desktop* desktop, MemorySelector* memorySelector)
+hc::Config::Config(Desktop* desktop, MemorySelector* memorySelector, Control const* control)
     : View(desktop)
     , _memorySelector(memorySelector)
+    , _control(control)
     , _performanceLevel(0)
     , _supportsNoGame(false)
     , _supportAchievements(false)
@@ -171,8 +215,14 @@ void hc::Config::onGameLoaded() {
     _optionsUpdated = false;
 }
 
+void hc::Config::onSync() {
+    _shownOptions = _coreOptions;
+}
+
 void hc::Config::onDraw() {
-    for (auto& option : _coreOptions) {
+    for (size_t i = 0; i < _shownOptions.size(); i++) {
+        CoreOption const& option = _shownOptions[i];
+
         if (!option.visible) {
             continue;
         }
@@ -194,9 +244,14 @@ void hc::Config::onDraw() {
         ImGui::Combo(option.label.c_str(), &selected, getter, (void*)&option, option.values.size());
 
         if (old != selected) {
-            option.selected = static_cast<unsigned>(selected);
-            _optionsUpdated = true;
-            _desktop->info(TAG "Variable \"%s\" changed to \"%s\"", option.key.c_str(), option.values[selected].value.c_str());
+            std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+
+            // The options may have changed since they were copied
+            if (i < _coreOptions.size() && _coreOptions[i].key == option.key) {
+                _coreOptions[i].selected = static_cast<unsigned>(selected);
+                _optionsUpdated = true;
+                _desktop->info(TAG "Variable \"%s\" changed to \"%s\"", option.key.c_str(), option.values[selected].value.c_str());
+            }
         }
     }
 }
@@ -413,9 +468,10 @@ bool hc::Config::getAudioVideoEnable(int* enabled) {
 }
 
 bool hc::Config::getFastForwarding(bool* is) {
-    *is = false;
+    *is = _control->getFastForward() != 1;
     return true;
 }
+
 bool hc::Config::setCoreOptions(retro_core_option_definition const* options) {
     _desktop->info(TAG "Setting core options");
 
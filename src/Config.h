@@ -15,6 +15,8 @@ extern "C" {
 #include <unordered_map>
 
 namespace hc {
+    class Control;
+
     class CoreMemory : public Memory {
     public:
         CoreMemory(char const* id, char const* name, bool readonly);
@@ -30,6 +32,8 @@ namespace hc {
         virtual bool readonly() const override { return _readonly; }
         virtual uint8_t peek(uint64_t address) const override;
         virtual void poke(uint64_t address, uint8_t value) override;
+        virtual void read(uint64_t address, void* buffer, uint64_t size) const override;
+        virtual uint8_t const* span(uint64_t address, uint64_t size) const override;
 
     protected:
         struct Block {
@@ -49,7 +53,7 @@ namespace hc {
 
     class Config: public View, public Scriptable, public lrcpp::Config {
     public:
-        Config(Desktop* desktop, MemorySelector* memorySelector);
+        Config(Desktop* desktop, MemorySelector* memorySelector, Control const* control);
         virtual ~Config() {}
 
         bool init();
@@ -63,6 +67,7 @@ namespace hc {
         // hc::View
         virtual char const* getTitle() override;
         virtual void onGameLoaded() override;
+        virtual void onSync() override;
         virtual void onDraw() override;
         virtual void onCoreUnloaded() override;
         virtual void onQuit() override;
@@ -152,6 +157,7 @@ namespace hc {
         };
 
         MemorySelector* _memorySelector;
+        Control const* _control;
 
         std::string _rootPath;
         std::string _scriptsPath;
@@ -172,5 +178,8 @@ namespace hc {
         std::vector<CoreOption> _coreOptions;
         std::unordered_map<std::string, size_t> _coreMap;
         bool _optionsUpdated;
+
+        // The core can set its options at any time, they're copied in onSync
+        std::vector<CoreOption> _shownOptions;
     };
 }
@@ -15,6 +15,12 @@ extern "C" {
 
 #define TAG "[CTR] "
 
+// Indexed by Control::Transition
+static char const* const transitionNames[] = {
+    "load core", "quit", "unload console", "load game", "start game", "resume game", "reset game",
+    "step one game frame", "unload game", "pause game"
+};
+
 static int str2id(char const* const str) {
     if (strcmp(str, "save") == 0) {
         return RETRO_MEMORY_SAVE_RAM;
@@ -40,7 +46,16 @@ static int str2id(char const* const str) {
     }
 }
 
-hc::Control::Control(Desktop* desktop) : View(desktop),  _selected(0), _opened(-1) {}
+hc::Control::Control(Desktop* desktop)
+    : View(desktop)
+    , _deferTransitions(false)
+    , _selected(0)
+    , _opened(-1)
+    , _fastForward(1)
+    , _fastForwardSpeed(4)
+    , _runAhead(0)
+    , _headroom(1.0)
+{}
 
 void hc::Control::init(LifeCycle* const fsm, Logger* const logger) {
     _fsm = fsm;
@@ -83,10 +98,29 @@ void hc::Control::onStep() {
     callConsoleMethod("onStep");
 }
 
+void hc::Control::onSync() {
+    _shown.state = _fsm->currentState();
+    _shown.canLoadGame = _fsm->canTransitionTo(LifeCycle::State::GameLoaded);
+    _shown.canStartGame = _fsm->canTransitionTo(LifeCycle::State::GameRunning);
+    _shown.canUnloadCore = _fsm->canTransitionTo(LifeCycle::State::Start);
+
+    _shown.consoles.resize(_consoles.size());
+
+    for (size_t i = 0; i < _consoles.size(); i++) {
+        _shown.consoles[i] = _consoles[i].name;
+    }
+
+    _shown.extensions = _extensions;
+    _shown.fastForward = _fastForward;
+    _shown.fastForwardSpeed = _fastForwardSpeed;
+    _shown.runAhead = _runAhead;
+    _shown.headroom = _headroom;
+}
+
 void hc::Control::onDraw() {
     static auto const getter = [](void* const data, int idx, char const** const text) -> bool {
-        auto const consoles = (std::vector<Console>*)data;
-        *text = (*consoles)[idx].name.c_str();
+        auto const consoles = (std::vector<std::string>*)data;
+        *text = (*consoles)[idx].c_str();
         return true;
     };
 
@@ -95,16 +129,18 @@ void hc::Control::onDraw() {
     float const width = (available.x - spacing.x * 2) / 3.0f;
     ImVec2 const size = ImVec2(width, 0.0f);
 
-    int const count = static_cast<int>(_consoles.size());
+    int const count = static_cast<int>(_shown.consoles.size());
 
-    ImGui::Combo("##Consoles", &_selected, getter, &_consoles, count);
+    ImGui::Combo("##Consoles", &_selected, getter, &_shown.consoles, count);
     ImGui::SameLine();
 
-    bool const loadConsoleEnabled = _fsm->currentState() == LifeCycle::State::Start && _selected < count;
+    bool const loadConsoleEnabled = _shown.state == LifeCycle::State::Start && _selected < count;
 
     ImVec2 const rest = ImVec2(ImGui::GetContentRegionAvail().x, 0.0f);
 
     if (ImGuiAl::Button(ICON_FA_FOLDER_OPEN " Load Console", loadConsoleEnabled, rest)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+
         _opened = _selected;
         Console const& cb = _consoles[_selected];
 
@@ -115,7 +151,7 @@ void hc::Control::onDraw() {
 
     bool loadGamePressed = false;
 
-    if (ImGuiAl::Button(ICON_FA_ROCKET " Load Game", _fsm->canTransitionTo(LifeCycle::State::GameLoaded), size)) {
+    if (ImGuiAl::Button(ICON_FA_ROCKET " Load Game", _shown.canLoadGame, size)) {
         loadGamePressed = true;
     }
 
@@ -134,14 +170,16 @@ void hc::Control::onDraw() {
     char const* const path = gameDialog.chooseFileDialog(
         loadGamePressed,
         _lastGameFolder.c_str(),
-        _extensions.c_str(),
+        _shown.extensions.c_str(),
         ICON_FA_ROCKET" Load Game",
         gameDialogSize,
         gameDialogPos
     );
 
     if (path != nullptr && path[0] != 0) {
-        if (_fsm->loadGame(path)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+
+        if (transition(Transition::LoadGame, path)) {
             char temp[ImGuiFs::MAX_PATH_BYTES];
             ImGuiFs::PathGetDirectoryName(path, temp);
             _lastGameFolder = temp;
@@ -150,51 +188,93 @@ void hc::Control::onDraw() {
 
     ImGui::SameLine();
 
-    if (_fsm->currentState() == LifeCycle::State::GameRunning) {
+    if (_shown.state == LifeCycle::State::GameRunning) {
         if (ImGuiAl::Button(ICON_FA_PAUSE " Pause", true, size)) {
-            _fsm->pauseGame();
+            std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+            transition(Transition::PauseGame);
         }
     }
-    else if (_fsm->currentState() == LifeCycle::State::GamePaused) {
+    else if (_shown.state == LifeCycle::State::GamePaused) {
         if (ImGuiAl::Button(ICON_FA_PLAY " Resume", true, size)) {
-            _fsm->resumeGame();
+            std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+            transition(Transition::ResumeGame);
         }
     }
     else {
-        if (ImGuiAl::Button(ICON_FA_PLAY " Start", _fsm->canTransitionTo(LifeCycle::State::GameRunning), size)) {
-            _fsm->startGame();
+        if (ImGuiAl::Button(ICON_FA_PLAY " Start", _shown.canStartGame, size)) {
+            std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+            transition(Transition::StartGame);
         }
     }
 
     ImGui::SameLine();
 
-    if (ImGuiAl::Button(ICON_FA_STEP_FORWARD " Frame Step", _fsm->currentState() == LifeCycle::State::GamePaused, size)) {
-        _fsm->step();
+    if (ImGuiAl::Button(ICON_FA_STEP_FORWARD " Frame Step", _shown.state == LifeCycle::State::GamePaused, size)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        transition(Transition::Step);
     }
 
-    bool const gameLoaded = _fsm->currentState() == LifeCycle::State::GameLoaded ||
-                            _fsm->currentState() == LifeCycle::State::GameRunning ||
-                            _fsm->currentState() == LifeCycle::State::GamePaused;
+    bool const gameLoaded = _shown.state == LifeCycle::State::GameLoaded ||
+                            _shown.state == LifeCycle::State::GameRunning ||
+                            _shown.state == LifeCycle::State::GamePaused;
 
     if (ImGuiAl::Button(ICON_FA_REFRESH " Reset Game", gameLoaded, size)) {
-        _fsm->resetGame();
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        transition(Transition::ResetGame);
     }
 
     ImGui::SameLine();
 
     if (ImGuiAl::Button(ICON_FA_EJECT " Unload Game", gameLoaded, size)) {
-        _fsm->unloadGame();
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        transition(Transition::UnloadGame);
+    }
+
+    ImGui::SameLine();
+
+    if (ImGuiAl::Button(ICON_FA_POWER_OFF " Unload Console", _shown.canUnloadCore, size)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        transition(Transition::UnloadCore);
+    }
+
+    char const* const label = _shown.fastForward != 1 ? ICON_FA_FAST_FORWARD " Normal Speed" : ICON_FA_FAST_FORWARD " Fast Forward";
+
+    if (ImGuiAl::Button(label, gameLoaded, size)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        toggleFastForward();
     }
 
     ImGui::SameLine();
+    ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+
+    int speed = _shown.fastForwardSpeed;
+
+    if (ImGui::SliderInt("##Speed", &speed, 2, MaxFastForward, "%dx")) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _fastForwardSpeed = speed;
+
+        if (_fastForward != 1) {
+            setFastForward(_fastForwardSpeed);
+        }
+    }
 
-    if (ImGuiAl::Button(ICON_FA_POWER_OFF " Unload Console", _fsm->canTransitionTo(LifeCycle::State::Start), size)) {
-        _fsm->unloadCore();
+    int runAhead = static_cast<int>(_shown.runAhead);
+    ImGui::SetNextItemWidth(size.x);
+
+    if (ImGui::SliderInt("##RunAhead", &runAhead, 0, MaxRunAhead, runAhead == 0 ? "No run-ahead" : "Run %d ahead")) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        setRunAhead(static_cast<unsigned>(runAhead));
+    }
+
+    if (_shown.runAhead != 0) {
+        ImGui::SameLine();
+        ImGui::Text("%.0f%% of the frame time left", _shown.headroom * 100.0);
     }
 }
 
 void hc::Control::onGameUnloaded() {
     callConsoleMethod("onGameUnloaded");
+    _fastForward = 1;
 }
 
 void hc::Control::onCoreUnloaded() {
@@ -234,6 +314,75 @@ void hc::Control::setSystemInfo(retro_system_info const* info) {
     }
 }
 
+void hc::Control::setFastForward(unsigned const speed) {
+    _fastForward = speed < 1 ? 1 : speed > MaxFastForward ? MaxFastForward : speed;
+
+    if (_fastForward != 1) {
+        _fastForwardSpeed = static_cast<int>(_fastForward);
+    }
+}
+
+void hc::Control::setRunAhead(unsigned const frames) {
+    _runAhead = frames > MaxRunAhead ? MaxRunAhead : frames;
+    _headroom = 1.0;
+}
+
+void hc::Control::setHeadroom(double const headroom) {
+    _headroom = _headroom * 0.95 + headroom * 0.05;
+}
+
+void hc::Control::toggleFastForward() {
+    setFastForward(_fastForward != 1 ? 1 : static_cast<unsigned>(_fastForwardSpeed));
+}
+
+void hc::Control::applyPendingTransitions() {
+    // Lifecycle callbacks can queue more transitions, they're applied on the next frame
+    std::vector<PendingTransition> pending;
+    pending.swap(_pending);
+
+    for (auto const& request : pending) {
+        bool const ok = apply(request.transition, request.path.c_str());
+
+        if (!ok) {
+            _logger->error(TAG "Could not %s", transitionNames[static_cast<int>(request.transition)]);
+        }
+
+        if (request.callback != LUA_NOREF) {
+            lua_rawgeti(request.L, LUA_REGISTRYINDEX, request.callback);
+            luaL_unref(request.L, LUA_REGISTRYINDEX, request.callback);
+            lua_pushboolean(request.L, ok);
+            protectedCall(request.L, 1, 0, _logger);
+        }
+    }
+}
+
+bool hc::Control::transition(Transition const which, char const* const path) {
+    if (!_deferTransitions) {
+        return apply(which, path);
+    }
+
+    PendingTransition request = {which, path != nullptr ? path : "", nullptr, LUA_NOREF};
+    _pending.emplace_back(request);
+    return true;
+}
+
+bool hc::Control::apply(Transition const which, char const* const path) {
+    switch (which) {
+        case Transition::LoadCore: return _fsm->loadCore(path);
+        case Transition::Quit: return _fsm->quit();
+        case Transition::UnloadCore: return _fsm->unloadCore();
+        case Transition::LoadGame: return _fsm->loadGame(path);
+        case Transition::StartGame: return _fsm->startGame();
+        case Transition::ResumeGame: return _fsm->resumeGame();
+        case Transition::ResetGame: return _fsm->resetGame();
+        case Transition::Step: return _fsm->step();
+        case Transition::UnloadGame: return _fsm->unloadGame();
+        case Transition::PauseGame: return _fsm->pauseGame();
+    }
+
+    return false;
+}
+
 void hc::Control::callConsoleMethod(char const* const name) {
     auto const& cb = _consoles[_opened];
     lua_rawgeti(cb.L, LUA_REGISTRYINDEX, cb.ref);
@@ -257,6 +406,10 @@ int hc::Control::push(lua_State* const L) {
             {"step", l_step},
             {"unloadGame", l_unloadGame},
             {"pauseGame", l_pauseGame},
+            {"getFastForward", l_getFastForward},
+            {"setFastForward", l_setFastForward},
+            {"getRunAhead", l_getRunAhead},
+            {"setRunAhead", l_setRunAhead},
             {"apiVersion", l_apiVersion},
             {"getSystemInfo", l_getSystemInfo},
             {"getSystemAvInfo", l_getSystemAvInfo},
@@ -302,95 +455,121 @@ int hc::Control::l_addConsole(lua_State* const L) {
     return 0;
 }
 
-int hc::Control::l_loadCore(lua_State* const L) {
+int hc::Control::luaTransition(lua_State* const L, Transition const which, char const* const path, int const callback) {
     auto const self = check(L, 1);
-    char const* const path = luaL_checkstring(L, 2);
+    bool const hasCallback = !lua_isnoneornil(L, callback);
 
-    if (!self->_fsm->loadCore(path)) {
-        return luaL_error(L, "could not load core \"%s\"", path);
+    if (hasCallback) {
+        luaL_checktype(L, callback, LUA_TFUNCTION);
     }
 
-    return 0;
-}
+    if (!self->_deferTransitions) {
+        if (!self->apply(which, path)) {
+            char const* const name = transitionNames[static_cast<int>(which)];
+            return path != nullptr ? luaL_error(L, "could not %s \"%s\"", name, path) : luaL_error(L, "could not %s", name);
+        }
 
-int hc::Control::l_quit(lua_State* const L) {
-    auto const self = check(L, 1);
+        if (hasCallback) {
+            lua_pushvalue(L, callback);
+            lua_pushboolean(L, 1);
+            lua_call(L, 1, 0);
+        }
 
-    if (!self->_fsm->quit()) {
-        return luaL_error(L, "could not quit");
+        lua_pushboolean(L, 1);
+        return 1;
     }
 
-    return 0;
+    int ref = LUA_NOREF;
+
+    if (hasCallback) {
+        lua_pushvalue(L, callback);
+        ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    // The caller can be a coroutine that is gone when the transition runs
+    lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+    lua_State* const main = lua_tothread(L, -1);
+    lua_pop(L, 1);
+
+    PendingTransition request = {which, path != nullptr ? path : "", main, ref};
+    self->_pending.emplace_back(request);
+
+    lua_pushboolean(L, 0);
+    return 1;
 }
 
-int hc::Control::l_unloadCore(lua_State* const L) {
-    auto const self = check(L, 1);
+int hc::Control::l_loadCore(lua_State* const L) {
+    char const* const path = luaL_checkstring(L, 2);
+    return luaTransition(L, Transition::LoadCore, path, 3);
+}
 
-    if (!self->_fsm->unloadCore()) {
-        return luaL_error(L, "could not unload console");
-    }
+int hc::Control::l_quit(lua_State* const L) {
+    return luaTransition(L, Transition::Quit, nullptr, 2);
+}
 
-    return 0;
+int hc::Control::l_unloadCore(lua_State* const L) {
+    return luaTransition(L, Transition::UnloadCore, nullptr, 2);
 }
 
 int hc::Control::l_loadGame(lua_State* const L) {
-    auto const self = check(L, 1);
     char const* const name = luaL_checkstring(L, 2);
-
-    if (!self->_fsm->loadGame(name)) {
-        return luaL_error(L, "could not load game \"%s\"", name);
-    }
-
-    return 0;
+    return luaTransition(L, Transition::LoadGame, name, 3);
 }
 
 int hc::Control::l_resumeGame(lua_State* const L) {
-    auto const self = check(L, 1);
-
-    if (!self->_fsm->resumeGame()) {
-        return luaL_error(L, "could not resume game");
-    }
-
-    return 0;
+    return luaTransition(L, Transition::ResumeGame, nullptr, 2);
 }
 
 int hc::Control::l_resetGame(lua_State* const L) {
-    auto const self = check(L, 1);
-
-    if (!self->_fsm->resetGame()) {
-        return luaL_error(L, "could not reset game");
-    }
-
-    return 0;
+    return luaTransition(L, Transition::ResetGame, nullptr, 2);
 }
 
 int hc::Control::l_step(lua_State* const L) {
-    auto const self = check(L, 1);
+    return luaTransition(L, Transition::Step, nullptr, 2);
+}
 
-    if (!self->_fsm->step()) {
-        return luaL_error(L, "could not step one game frame");
-    }
+int hc::Control::l_unloadGame(lua_State* const L) {
+    return luaTransition(L, Transition::UnloadGame, nullptr, 2);
+}
 
-    return 0;
+int hc::Control::l_pauseGame(lua_State* const L) {
+    return luaTransition(L, Transition::PauseGame, nullptr, 2);
 }
 
-int hc::Control::l_unloadGame(lua_State* const L) {
+int hc::Control::l_getFastForward(lua_State* const L) {
+    auto const self = check(L, 1);
+    lua_pushinteger(L, self->_fastForward);
+    return 1;
+}
+
+int hc::Control::l_setFastForward(lua_State* const L) {
     auto const self = check(L, 1);
 
-    if (!self->_fsm->unloadGame()) {
-        return luaL_error(L, "could not unload game");
+    // Booleans toggle the speed selected in the UI, numbers set it
+    if (lua_type(L, 2) == LUA_TBOOLEAN) {
+        self->setFastForward(lua_toboolean(L, 2) ? static_cast<unsigned>(self->_fastForwardSpeed) : 1);
+    }
+    else {
+        lua_Integer const speed = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, speed >= 1 && speed <= MaxFastForward, 2, "speed out of range");
+        self->setFastForward(static_cast<unsigned>(speed));
     }
 
     return 0;
 }
 
-int hc::Control::l_pauseGame(lua_State* const L) {
+int hc::Control::l_getRunAhead(lua_State* const L) {
     auto const self = check(L, 1);
+    lua_pushinteger(L, self->_runAhead);
+    return 1;
+}
 
-    if (!self->_fsm->pauseGame()) {
-        return luaL_error(L, "could not pause game");
-    }
+int hc::Control::l_setRunAhead(lua_State* const L) {
+    auto const self = check(L, 1);
+    lua_Integer const frames = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, frames >= 0 && frames <= MaxRunAhead, 2, "frames out of range");
 
+    self->setRunAhead(static_cast<unsigned>(frames));
     return 0;
 }
 
@@ -506,19 +685,15 @@ int hc::Control::l_serialize(lua_State* const L) {
         return luaL_error(L, "error serializing state");
     }
 
-    void* const data = malloc(size);
-
-    if (data == nullptr) {
-        return luaL_error(L, "out of memory");
-    }
+    // Serialize straight into the string's buffer instead of copying from a temporary one
+    luaL_Buffer buffer;
+    char* const data = luaL_buffinitsize(L, &buffer, size);
 
     if (!frontend.serialize(data, size)) {
-        free(data);
         return luaL_error(L, "error serializing state");
     }
 
-    lua_pushlstring(L, static_cast<char*>(data), size);
-    free(data);
+    luaL_pushresultsize(&buffer, size);
     return 1;
 }
 
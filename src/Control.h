@@ -16,6 +16,23 @@ namespace hc {
 
         void setSystemInfo(retro_system_info const* info);
 
+        // Number of frames run for each frame of real time, 1 is normal speed
+        unsigned getFastForward() const { return _fastForward; }
+        void setFastForward(unsigned const speed);
+        void toggleFastForward();
+
+        // Number of frames run ahead of the one shown, 0 disables run-ahead
+        unsigned getRunAhead() const { return _runAhead; }
+        void setRunAhead(unsigned const frames);
+        // Fraction of the frame time left after running ahead, smoothed
+        void setHeadroom(double const headroom);
+
+        // While the emulation thread runs, lifecycle transitions are queued and applied by the UI thread between
+        // frames, so views never see the game or the core go away while they draw
+        void setDeferTransitions(bool const defer) { _deferTransitions = defer; }
+        bool hasPendingTransitions() const { return !_pending.empty(); }
+        void applyPendingTransitions();
+
         static Control* check(lua_State* const L, int const index);
 
         // hc::View
@@ -28,6 +45,7 @@ namespace hc {
         virtual void onGameReset() override;
         virtual void onFrame() override;
         virtual void onStep() override;
+        virtual void onSync() override;
         virtual void onDraw() override;
         virtual void onGameUnloaded() override;
         virtual void onCoreUnloaded() override;
@@ -37,8 +55,44 @@ namespace hc {
         virtual int push(lua_State* const L) override;
 
     protected:
+        enum {
+            MaxFastForward = 64,
+            MaxRunAhead = 8
+        };
+
+        enum class Transition {
+            LoadCore,
+            Quit,
+            UnloadCore,
+            LoadGame,
+            StartGame,
+            ResumeGame,
+            ResetGame,
+            Step,
+            UnloadGame,
+            PauseGame
+        };
+
+        struct PendingTransition {
+            Transition transition;
+            std::string path;
+            // The Lua function called with the result once the transition ran, or LUA_NOREF
+            lua_State* L;
+            int callback;
+        };
+
         void callConsoleMethod(char const* const name);
 
+        // Runs the transition now, or queues it and returns true when transitions are deferred
+        bool transition(Transition const which, char const* const path = nullptr);
+        bool apply(Transition const which, char const* const path);
+
+        // Runs the transition for a lifecycle method called from Lua. The methods take an optional function as
+        // their last argument, which is called with true or false once the transition ran. They return true
+        // if it ran right away, raising an error if it failed, or false if it was queued because the
+        // emulation thread is running. Queued transitions that fail are logged.
+        static int luaTransition(lua_State* const L, Transition const which, char const* const path, int const callback);
+
         // Control will also be responsible for exposing LifeCycle and Frontend
         // methods to Lua
         static int l_addConsole(lua_State* const L);
@@ -52,6 +106,10 @@ namespace hc {
         static int l_step(lua_State* const L);
         static int l_unloadGame(lua_State* const L);
         static int l_pauseGame(lua_State* const L);
+        static int l_getFastForward(lua_State* const L);
+        static int l_setFastForward(lua_State* const L);
+        static int l_getRunAhead(lua_State* const L);
+        static int l_setRunAhead(lua_State* const L);
 
         static int l_apiVersion(lua_State* const L);
         static int l_getSystemInfo(lua_State* const L);
@@ -74,10 +132,33 @@ namespace hc {
         LifeCycle* _fsm;
         Logger* _logger;
 
+        // Guarded by the emulation lock like everything else Lua can reach
+        bool _deferTransitions;
+        std::vector<PendingTransition> _pending;
+
         std::vector<Console> _consoles;
         int _selected;
         int _opened;
+        unsigned _fastForward;
+        int _fastForwardSpeed;
+        unsigned _runAhead;
+        double _headroom;
         std::string _extensions;
         std::string _lastGameFolder;
+
+        // Lua can change all of this while the UI draws, it's copied in onSync
+        struct {
+            LifeCycle::State state;
+            bool canLoadGame;
+            bool canStartGame;
+            bool canUnloadCore;
+            std::vector<std::string> consoles;
+            std::string extensions;
+            unsigned fastForward;
+            int fastForwardSpeed;
+            unsigned runAhead;
+            double headroom;
+        }
+        _shown;
     };
 }
@@ -23,11 +23,18 @@ hc::Cpu* hc::Cpu::create(Desktop* desktop, hc_Cpu const* cpu, void* userdata) {
     return nullptr;
 }
 
-hc::Cpu::Cpu(Desktop* desktop, hc_Cpu const* cpu, void* userdata) : View(desktop), _cpu(cpu), _userdata(userdata), _valid(true) {
+hc::Cpu::Cpu(Desktop* desktop, hc_Cpu const* cpu, void* userdata)
+    : View(desktop)
+    , _cpu(cpu)
+    , _userdata(userdata)
+    , _valid(true)
+    , _memory(new DebugMemory(cpu->v1.memory_region, userdata))
+    , _disasmCache(this, _memory)
+    , _hasChanged(0)
+    , _frameRan(false)
+{
     _title = ICON_FA_MICROCHIP " ";
     _title += _cpu->v1.description;
-
-    _memory = new DebugMemory(_cpu->v1.memory_region, _userdata);
 }
 
 void hc::Cpu::drawRegister(unsigned const reg, char const* const name, unsigned const width, bool const highlight) {
@@ -52,7 +59,7 @@ void hc::Cpu::drawRegister(unsigned const reg, char const* const name, unsigned
 
     snprintf(label, sizeof(label), "##%uhex", reg);
     snprintf(format, sizeof(format), "0x%%0%d" PRIx64, (width + 3) / 4);
-    snprintf(buffer, sizeof(buffer), format, _cpu->v1.get_register(_userdata, reg));
+    snprintf(buffer, sizeof(buffer), format, _registers[reg]);
     ImGuiInputTextFlags const flagsHex = ImGuiInputTextFlags_EnterReturnsTrue | ImGuiInputTextFlags_CharsHexadecimal;
 
     ImGui::PushItemWidth(inputWidth);
@@ -61,6 +68,7 @@ void hc::Cpu::drawRegister(unsigned const reg, char const* const name, unsigned
         uint64_t value = 0;
 
         if (sscanf(buffer, "0x%" SCNx64, &value) == 1) {
+            std::lock_guard<std::mutex> lock(_desktop->emulationLock());
             _cpu->v1.set_register(_userdata, reg, value);
         }
     }
@@ -69,7 +77,7 @@ void hc::Cpu::drawRegister(unsigned const reg, char const* const name, unsigned
     ImGui::SameLine();
 
     snprintf(label, sizeof(label), "##%udec", reg);
-    snprintf(buffer, sizeof(buffer), "%" PRIu64, _cpu->v1.get_register(_userdata, reg));
+    snprintf(buffer, sizeof(buffer), "%" PRIu64, _registers[reg]);
     ImGuiInputTextFlags const flagsDec = ImGuiInputTextFlags_EnterReturnsTrue | ImGuiInputTextFlags_CharsDecimal;
 
     ImGui::PushItemWidth(inputWidth);
@@ -78,6 +86,7 @@ void hc::Cpu::drawRegister(unsigned const reg, char const* const name, unsigned
         uint64_t value = 0;
 
         if (sscanf(buffer, "%" SCNu64, &value) == 1) {
+            std::lock_guard<std::mutex> lock(_desktop->emulationLock());
             _cpu->v1.set_register(_userdata, reg, value);
         }
     }
@@ -91,7 +100,7 @@ void hc::Cpu::drawFlags(unsigned reg, char const* name, char const* const* flags
     ImGui::PopItemWidth();
     ImGui::SameLine();
 
-    uint64_t const value = _cpu->v1.get_register(_userdata, reg);
+    uint64_t const value = _registers[reg];
     uint64_t newValue = 0;
     int f = 0;
 
@@ -105,7 +114,11 @@ void hc::Cpu::drawFlags(unsigned reg, char const* name, char const* const* flags
         }
     }
 
-    _cpu->v1.set_register(_userdata, reg, value);
+    if (newValue != value) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _cpu->v1.set_register(_userdata, reg, newValue);
+    }
+
     ImGui::NewLine();
 }
 
@@ -115,4 +128,48 @@ char const* hc::Cpu::getTitle() {
 
 void hc::Cpu::onGameUnloaded() {
     _valid = false;
+    _disasmCache.clear();
+}
+
+void hc::Cpu::onFrame() {
+    _frameRan = true;
+}
+
+void hc::Cpu::onSync() {
+    if (!_valid) {
+        return;
+    }
+
+    unsigned const count = registerCount();
+
+    if (_registers.size() != count) {
+        _registers.resize(count);
+        _previous.resize(count);
+
+        for (unsigned i = 0; i < count; i++) {
+            _previous[i] = getRegister(i);
+        }
+    }
+
+    // Registers stay highlighted until the next frame once they change
+    if (_frameRan) {
+        _hasChanged = 0;
+        _frameRan = false;
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        uint32_t const regBit = UINT32_C(1) << i;
+        _registers[i] = getRegister(i);
+
+        if ((_hasChanged & regBit) == 0) {
+            _hasChanged |= ((_registers[i] == _previous[i]) - 1) & regBit;
+            _previous[i] = _registers[i];
+        }
+    }
+}
+
+void hc::Cpu::step() {
+    std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+    _hasChanged = 0;
+    stepInto();
 }
@@ -2,6 +2,7 @@
 
 #include "Desktop.h"
 #include "Memory.h"
+#include "DisasmCache.h"
 
 extern "C" {
     #include "hcdebug.h"
@@ -9,6 +10,7 @@ extern "C" {
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace hc {
     class DebugMemory : public Memory {
@@ -30,6 +32,22 @@ namespace hc {
 
         virtual bool readonly() const override { return _memory->v1.poke == nullptr; }
 
+        bool canWatch() const { return _memory->v1.set_watchpoint != nullptr; }
+
+        unsigned setWatchpoint(uint64_t address, uint64_t length, int read, int write) {
+            return _memory->v1.set_watchpoint(_userdata, address, length, read, write);
+        }
+
+        virtual void read(uint64_t address, void* buffer, uint64_t size) const override {
+            // The debug interface only has byte access, but at least skip the virtual call per byte
+            auto const peek = _memory->v1.peek;
+            auto const bytes = static_cast<uint8_t*>(buffer);
+
+            for (uint64_t i = 0; i < size; i++) {
+                bytes[i] = peek(_userdata, address + i);
+            }
+        }
+
     protected:
         hc_Memory const* const _memory;
         void* const _userdata;
@@ -37,6 +55,17 @@ namespace hc {
 
     class Cpu : public View {
     public:
+        // How an instruction changes the program counter, for static analysis
+        enum class Flow {
+            Next,              // Continues with the next instruction
+            Jump,              // Continues at the target
+            Branch,            // Continues at the target or with the next instruction
+            Call,              // Calls the target and continues with the next instruction when it returns
+            Return,
+            ConditionalReturn, // Returns or continues with the next instruction
+            Indirect           // Continues at an address only known at run time
+        };
+
         ~Cpu() {}
         
         static Cpu* create(Desktop* desktop, hc_Cpu const* cpu, void* userdata);
@@ -46,8 +75,12 @@ namespace hc {
         bool isMain() const { return _cpu->v1.is_main; }
 
         Memory* mainMemory() const { return _memory; }
+        DisasmCache* disasmCache() { return &_disasmCache; }
 
         uint64_t getRegister(unsigned reg) const { return _cpu->v1.get_register(_userdata, reg); }
+        virtual uint64_t programCounter() const = 0;
+        virtual unsigned registerCount() const = 0;
+        virtual char const* registerName(unsigned reg) const = 0;
 
         void stepInto() const { if (canStepInto()) _cpu->v1.step_into(_userdata); }
         void stepOver() const { if (canStepOver()) _cpu->v1.step_over(_userdata); }
@@ -66,18 +99,35 @@ namespace hc {
 
         virtual uint64_t instructionLength(uint64_t address, Memory const* memory) = 0;
         virtual void disasm(uint64_t address, Memory const* memory, char* buffer, size_t size, char* tooltip, size_t ttsz) = 0;
+        virtual Flow flow(uint64_t address, Memory const* memory, uint64_t* target) = 0;
+        // The reset and interrupt handlers, and the current program counter
+        virtual void entryPoints(Memory const* memory, std::vector<uint64_t>* entries) = 0;
+        // Words on the stack that may be return addresses, innermost first, the profiler keeps the ones right after a call
+        virtual unsigned stackWalk(Memory const* memory, uint64_t* addresses, unsigned count) = 0;
 
         // hc::View
         virtual char const* getTitle() override;
         virtual void onGameUnloaded() override;
+        virtual void onFrame() override;
+        virtual void onSync() override;
 
     protected:
         Cpu(Desktop* desktop, hc_Cpu const* cpu, void* userdata);
 
+        // Takes the emulation lock, steps and highlights the registers changed by the step
+        void step();
+
         hc_Cpu const* const _cpu;
         void* const _userdata;
         bool _valid;
         std::string _title;
         Memory* _memory;
+        DisasmCache _disasmCache;
+
+        // The registers copied in onSync, and the ones that changed since the last frame or step
+        std::vector<uint64_t> _registers;
+        std::vector<uint64_t> _previous;
+        uint32_t _hasChanged;
+        bool _frameRan;
     };
 }
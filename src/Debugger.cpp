@@ -5,10 +5,16 @@
 #include <imgui.h>
 #include <imguial_button.h>
 
+extern "C" {
+    #include "lauxlib.h"
+}
+
 #include <inttypes.h>
 #include <math.h>
 
+#include <algorithm>
 #include <atomic>
+#include <new>
 
 #define TAG "DGB "
 
@@ -23,6 +29,9 @@ hc::Disasm::Disasm(Desktop* desktop, Cpu* cpu, Memory* memory, unsigned reg)
     , _cpu(cpu)
     , _memory(memory)
     , _register(reg)
+    , _lastAddress(UINT64_MAX)
+    , _draws(0)
+    , _numItems(0)
 {
     static std::atomic<unsigned> counter;
 
@@ -40,6 +49,49 @@ void hc::Disasm::onGameUnloaded() {
     _valid = false;
 }
 
+void hc::Disasm::onSync() {
+    _lines.clear();
+
+    if (!_valid) {
+        return;
+    }
+
+    DisasmCache* const cache = _cpu->disasmCache();
+    uint64_t const address = _cpu->getRegister(_register);
+
+    // The program counter moves when the game runs or is stepped, that's when memory is likely to change
+    if (address != _lastAddress || ++_draws >= RecheckDraws) {
+        cache->touch();
+        _lastAddress = address;
+        _draws = 0;
+    }
+
+    std::vector<uint64_t> addresses;
+    addresses.reserve(_numItems + _numItems / 2);
+
+    uint64_t addr = address >= _numItems * 4 ? address - _numItems * 4 : 0;
+    size_t addrLine = 0;
+
+    for (size_t i = 0;; i++) {
+        addresses.emplace_back(addr);
+
+        if (addr >= address) {
+            addrLine = addresses.size();
+            break;
+        }
+
+        addr += cache->length(addr);
+    }
+
+    size_t const firstLine = addrLine >= _numItems / 2 ? addrLine - _numItems / 2 : 0;
+    addr = addresses[firstLine];
+
+    for (size_t i = 0; i < _numItems; i++) {
+        _lines.emplace_back(cache->get(addr));
+        addr += _lines.back().length;
+    }
+}
+
 void hc::Disasm::onDraw() {
     if (!_valid) {
         return;
@@ -56,78 +108,865 @@ void hc::Disasm::onDraw() {
     ImGui::BeginChild("##scrolling", ImVec2(0.0f, 0.0f), false, flagsFollow);
 
     ImVec2 const regionMax = ImGui::GetContentRegionMax();
-    size_t const numItems = static_cast<size_t>(ceil(regionMax.y / lineHeight));
+    _numItems = static_cast<size_t>(ceil(regionMax.y / lineHeight));
 
-    std::vector<uint64_t> addresses;
-    addresses.reserve(numItems + numItems / 2);
+    for (auto const& line : _lines) {
+        if (line.address == _lastAddress) {
+            ImVec2 const pos = ImGui::GetCursorScreenPos();
+            renderFrame(ImVec2(pos.x, pos.y), ImVec2(pos.x + regionMax.x, pos.y + lineHeight), ImGui::GetColorU32(ImGuiCol_FrameBg));
+        }
 
-    uint64_t const address = _cpu->getRegister(_register);
-    uint64_t addr = address >= numItems * 4 ? address - numItems * 4 : 0;
-    size_t addrLine = 0;
+        ImGui::Text(format, line.address, line.opcodes, line.text);
 
-    for (size_t i = 0;; i++) {
-        addresses.emplace_back(addr);
+        if (ImGui::IsItemHovered()) {
+            ImGui::BeginTooltip();
+            ImGui::Text("%s", line.tooltip);
+            ImGui::EndTooltip();
+        }
+    }
 
-        if (addr >= address) {
-            addrLine = addresses.size();
+    ImGui::EndChild();
+}
+
+hc::Listing::Listing(Desktop* desktop, Analysis* analysis)
+    : View(desktop)
+    , _valid(true)
+    , _analysis(analysis)
+    , _followPc(true)
+    , _lastPc(UINT64_MAX)
+    , _scrollTo(SIZE_MAX)
+    , _analyse(false)
+    , _addPc(false)
+    , _pc(0)
+    , _digits(0)
+    , _displayStart(0)
+    , _displayEnd(0)
+    , _firstLine(0)
+{
+    static std::atomic<unsigned> counter;
+
+    _title = ICON_FA_LIST " ";
+    _title += analysis->cpu()->name();
+    _title += " Listing##";
+    _title += counter++;
+
+    _goto[0] = 0;
+    _stats[0] = 0;
+}
+
+char const* hc::Listing::getTitle() {
+    return _title.c_str();
+}
+
+void hc::Listing::onGameUnloaded() {
+    _valid = false;
+}
+
+void hc::Listing::onSync() {
+    _lines.clear();
+
+    if (!_valid) {
+        return;
+    }
+
+    _pc = _analysis->cpu()->programCounter();
+
+    // Analysing replaces the snapshot, so the memory is only read here
+    _digits = static_cast<int>(const_cast<Memory*>(_analysis->memory())->requiredDigits());
+
+    // Code only reached through indirect jumps is found by adding the program counter when it gets there
+    if (_addPc) {
+        _analysis->addEntry(_pc);
+        _analyse = true;
+        _addPc = false;
+    }
+
+    if (_analyse || !_analysis->valid()) {
+        analyse();
+        _analyse = false;
+    }
+
+    snprintf(
+        _stats, sizeof(_stats), "%zu instructions, %zu blocks, %zu functions, %zu calls, analysed in %" PRIu64 " us",
+        _analysis->instructionCount(), _analysis->blocks().size(), _analysis->functions().size(),
+        _analysis->calls().size(), _analysis->getElapsedUs()
+    );
+
+    _firstLine = _displayStart >= SyncMargin ? _displayStart - SyncMargin : 0;
+    size_t const end = std::min(_displayEnd + SyncMargin, _rows.size());
+
+    if (_firstLine < end) {
+        _lines.resize(end - _firstLine);
+
+        for (size_t i = _firstLine; i < end; i++) {
+            formatRow(_rows[i], &_lines[i - _firstLine]);
+        }
+    }
+}
+
+void hc::Listing::onDraw() {
+    if (!_valid) {
+        return;
+    }
+
+    if (ImGui::Button(ICON_FA_REFRESH " Analyse")) {
+        _analyse = true;
+    }
+
+    ImGui::SameLine();
+
+    if (ImGui::Button(ICON_FA_PLUS " Add PC")) {
+        _addPc = true;
+    }
+
+    ImGui::SameLine();
+    ImGui::Checkbox("Follow PC", &_followPc);
+    ImGui::SameLine();
+
+    ImGuiInputTextFlags const flags = ImGuiInputTextFlags_EnterReturnsTrue | ImGuiInputTextFlags_CharsHexadecimal;
+
+    if (ImGui::InputText("Go to", _goto, sizeof(_goto), flags)) {
+        uint64_t address = 0;
+
+        if (sscanf(_goto, "%" SCNx64, &address) == 1) {
+            _scrollTo = findRow(address);
+            _followPc = false;
+        }
+    }
+
+    ImGui::Text("%s", _stats);
+
+    if (_followPc && _pc != _lastPc) {
+        _scrollTo = findRow(_pc);
+    }
+
+    _lastPc = _pc;
+
+    ImGui::BeginChild("##listing");
+
+    float const lineHeight = ImGui::GetTextLineHeightWithSpacing();
+    float const width = ImGui::GetContentRegionMax().x;
+
+    if (_scrollTo != SIZE_MAX) {
+        float const y = _scrollTo * lineHeight - ImGui::GetWindowHeight() / 2.0f;
+        ImGui::SetScrollY(y > 0.0f ? y : 0.0f);
+        _scrollTo = SIZE_MAX;
+    }
+
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(_rows.size()), lineHeight);
+    _displayStart = SIZE_MAX;
+    _displayEnd = 0;
+
+    while (clipper.Step()) {
+        _displayStart = std::min(_displayStart, static_cast<size_t>(clipper.DisplayStart));
+        _displayEnd = std::max(_displayEnd, static_cast<size_t>(clipper.DisplayEnd));
+
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            drawRow(static_cast<size_t>(i), width);
+        }
+    }
+
+    clipper.End();
+    ImGui::EndChild();
+}
+
+void hc::Listing::analyse() {
+    _analysis->run();
+    _rows.clear();
+
+    Memory const* const memory = _analysis->memory();
+    uint64_t const end = memory->base() + memory->size();
+
+    for (uint64_t address = memory->base(); address < end;) {
+        uint8_t const flags = _analysis->flags(address);
+        unsigned const length = flags & Analysis::LengthMask;
+
+        if (length != 0) {
+            if ((flags & (Analysis::Label | Analysis::Function | Analysis::Entry)) != 0) {
+                _rows.push_back(Row{address, RowType::Label, 0});
+            }
+
+            _rows.push_back(Row{address, RowType::Code, static_cast<uint8_t>(length)});
+            address += length;
+            continue;
+        }
+
+        uint8_t count = 0;
+
+        while (count < DataPerRow && address + count < end && _analysis->length(address + count) == 0) {
+            count++;
+        }
+
+        _rows.push_back(Row{address, RowType::Data, count});
+        address += count;
+    }
+
+    _lastPc = UINT64_MAX;
+}
+
+size_t hc::Listing::findRow(uint64_t const address) const {
+    auto const found = std::upper_bound(_rows.begin(), _rows.end(), address, [](uint64_t const address, Row const& row) {
+        return address < row.address;
+    });
+
+    return found != _rows.begin() ? found - _rows.begin() - 1 : 0;
+}
+
+void hc::Listing::formatRow(Row const& row, Line* const line) {
+    Memory const* const memory = _analysis->memory();
+    int const digits = _digits;
+
+    line->text[0] = 0;
+    line->tooltip.clear();
+    line->used = false;
+
+    switch (row.type) {
+        case RowType::Label: {
+            bool const function = (_analysis->flags(row.address) & Analysis::Function) != 0;
+            snprintf(line->text, sizeof(line->text), "%s_%0*" PRIx64 ":", function ? "sub" : "loc", digits, row.address);
+
+            Analysis::Xref const* begin;
+            Analysis::Xref const* end;
+            _analysis->findXrefs(row.address, &begin, &end);
+
+            if (begin == end) {
+                line->tooltip = "Entry point";
+            }
+
+            for (auto xref = begin; xref != end; xref++) {
+                static char const* const types[] = {"Jumped", "Branched", "Called"};
+
+                char buffer[64];
+                snprintf(buffer, sizeof(buffer), "%s from %0*" PRIx64 "\n", types[static_cast<int>(xref->type)], digits, xref->from);
+                line->tooltip += buffer;
+            }
+
+            break;
+        }
+
+        case RowType::Code: {
+            char opcodes[DisasmCache::MaxBytes * 3];
+            char* out = opcodes;
+
+            for (unsigned i = 0; i < row.count && i < 4; i++) {
+                out += snprintf(out, opcodes + sizeof(opcodes) - out, i == 0 ? "%02x" : " %02x", memory->peek(row.address + i));
+            }
+
+            *out = 0;
+
+            char buffer[64], tooltip[64];
+            _analysis->cpu()->disasm(row.address, memory, buffer, sizeof(buffer), tooltip, sizeof(tooltip));
+            line->tooltip = tooltip;
+
+            snprintf(line->text, sizeof(line->text), "    %0*" PRIx64 ":  %-11s  %s", digits, row.address, opcodes, buffer);
             break;
         }
 
-        addr += _cpu->instructionLength(addr, _memory);
+        case RowType::Data: {
+            char bytes[DataPerRow * 5];
+            char* out = bytes;
+
+            for (unsigned i = 0; i < row.count; i++) {
+                out += snprintf(out, bytes + sizeof(bytes) - out, i == 0 ? "%02x" : ", %02x", memory->peek(row.address + i));
+            }
+
+            *out = 0;
+
+            // Data the game was seen using stands out from bytes nothing touched
+            CodeDataLog const* const log = _analysis->log();
+
+            for (unsigned i = 0; log != nullptr && i < row.count; i++) {
+                line->used = line->used || (log->flags(row.address + i) & (CodeDataLog::Data | CodeDataLog::Written)) != 0;
+            }
+
+            snprintf(line->text, sizeof(line->text), "    %0*" PRIx64 ":  db %s", digits, row.address, bytes);
+            break;
+        }
     }
+}
 
-    size_t const firstLine = addrLine >= numItems / 2 ? addrLine - numItems / 2 : 0;
-    addr = addresses[firstLine];
+void hc::Listing::drawRow(size_t const index, float const width) {
+    Row const& row = _rows[index];
 
-    for (size_t i = 0; i < numItems; i++) {
-        if (addr == address) {
-            ImVec2 const pos = ImGui::GetCursorScreenPos();
-            renderFrame(ImVec2(pos.x, pos.y), ImVec2(pos.x + regionMax.x, pos.y + lineHeight), ImGui::GetColorU32(ImGuiCol_FrameBg));
+    // Rows scrolled into view since onSync are formatted on the next frame
+    if (index < _firstLine || index - _firstLine >= _lines.size()) {
+        ImGui::TextDisabled("    %0*" PRIx64 ":", _digits, row.address);
+        return;
+    }
+
+    Line const& line = _lines[index - _firstLine];
+
+    if (row.type == RowType::Code && row.address == _pc) {
+        ImVec2 const pos = ImGui::GetCursorScreenPos();
+        float const lineHeight = ImGui::GetTextLineHeightWithSpacing();
+        renderFrame(pos, ImVec2(pos.x + width, pos.y + lineHeight), ImGui::GetColorU32(ImGuiCol_FrameBg));
+    }
+
+    if (row.type == RowType::Data && !line.used) {
+        ImGui::TextDisabled("%s", line.text);
+    }
+    else {
+        ImGui::Text("%s", line.text);
+    }
+
+    if (ImGui::IsItemHovered() && !line.tooltip.empty()) {
+        ImGui::BeginTooltip();
+        ImGui::TextUnformatted(line.tooltip.c_str());
+        ImGui::EndTooltip();
+    }
+}
+
+namespace {
+    // Lua values hold a handle so they can't reach an analysis after its game is unloaded
+    struct AnalysisRef {
+        hc::Debugger* debugger;
+        hc::Handle<hc::Analysis*> handle;
+    };
+}
+
+static hc::Analysis* checkAnalysis(lua_State* const L, int const index) {
+    auto const ref = static_cast<AnalysisRef*>(luaL_checkudata(L, index, "hc::Analysis"));
+    hc::Analysis* const* const analysis = ref->debugger->translate(ref->handle);
+
+    if (analysis == nullptr) {
+        luaL_error(L, "the analysis is gone with the game that was unloaded");
+    }
+
+    return *analysis;
+}
+
+static int l_run(lua_State* const L) {
+    auto const self = checkAnalysis(L, 1);
+    self->run();
+    lua_pushinteger(L, static_cast<lua_Integer>(self->getElapsedUs()));
+    return 1;
+}
+
+static int l_addEntry(lua_State* const L) {
+    auto const self = checkAnalysis(L, 1);
+    self->addEntry(static_cast<uint64_t>(luaL_checkinteger(L, 2)));
+    return 0;
+}
+
+static int l_isCode(lua_State* const L) {
+    auto const self = checkAnalysis(L, 1);
+    uint8_t const flags = self->flags(static_cast<uint64_t>(luaL_checkinteger(L, 2)));
+    lua_pushboolean(L, (flags & (hc::Analysis::LengthMask | hc::Analysis::Operand)) != 0);
+    return 1;
+}
+
+static int l_getBlocks(lua_State* const L) {
+    auto const self = checkAnalysis(L, 1);
+    auto const& blocks = self->blocks();
+    auto const& functions = self->functions();
+
+    lua_createtable(L, static_cast<int>(blocks.size()), 0);
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+        lua_createtable(L, 0, 3);
+
+        lua_pushinteger(L, static_cast<lua_Integer>(blocks[i].start));
+        lua_setfield(L, -2, "address");
+
+        lua_pushinteger(L, blocks[i].size);
+        lua_setfield(L, -2, "size");
+
+        if (blocks[i].function != hc::Analysis::NoFunction) {
+            lua_pushinteger(L, static_cast<lua_Integer>(functions[blocks[i].function]));
+            lua_setfield(L, -2, "func");
         }
 
-        char opcodes[12];
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    return 1;
+}
 
-        uint64_t const length = _cpu->instructionLength(addr, _memory);
+static int l_getFunctions(lua_State* const L) {
+    auto const self = checkAnalysis(L, 1);
+    auto const& functions = self->functions();
 
-        switch (length) {
-            case 1: snprintf(opcodes, sizeof(opcodes), "%02x", _memory->peek(addr)); break;
-            case 2: snprintf(opcodes, sizeof(opcodes), "%02x %02x", _memory->peek(addr), _memory->peek(addr + 1)); break;
+    lua_createtable(L, static_cast<int>(functions.size()), 0);
 
-            case 3:
-                snprintf(
-                    opcodes, sizeof(opcodes),
-                    "%02x %02x %02x", _memory->peek(addr), _memory->peek(addr + 1), _memory->peek(addr + 2)
-                );
+    for (size_t i = 0; i < functions.size(); i++) {
+        lua_pushinteger(L, static_cast<lua_Integer>(functions[i]));
+        lua_rawseti(L, -2, i + 1);
+    }
 
-                break;
+    return 1;
+}
 
-            case 4:
-                snprintf(opcodes, sizeof(opcodes),
-                    "%02x %02x %02x %02x",
-                    _memory->peek(addr), _memory->peek(addr + 1), _memory->peek(addr + 2), _memory->peek(addr + 3)
-                );
+static int l_getFunction(lua_State* const L) {
+    auto const self = checkAnalysis(L, 1);
+    hc::Analysis::Block const* const block = self->findBlock(static_cast<uint64_t>(luaL_checkinteger(L, 2)));
 
-                break;
+    if (block == nullptr || block->function == hc::Analysis::NoFunction) {
+        lua_pushnil(L);
+    }
+    else {
+        lua_pushinteger(L, static_cast<lua_Integer>(self->functions()[block->function]));
+    }
+
+    return 1;
+}
+
+static int l_getCalls(lua_State* const L) {
+    auto const self = checkAnalysis(L, 1);
+    auto const& calls = self->calls();
+    auto const& functions = self->functions();
+
+    lua_createtable(L, static_cast<int>(calls.size()), 0);
+
+    for (size_t i = 0; i < calls.size(); i++) {
+        lua_createtable(L, 0, 3);
+
+        if (calls[i].caller != hc::Analysis::NoFunction) {
+            lua_pushinteger(L, static_cast<lua_Integer>(functions[calls[i].caller]));
+            lua_setfield(L, -2, "caller");
         }
 
-        char buffer[64], tooltip[64];
-        _cpu->disasm(addr, _memory, buffer, sizeof(buffer), tooltip, sizeof(tooltip));
+        lua_pushinteger(L, static_cast<lua_Integer>(calls[i].from));
+        lua_setfield(L, -2, "from");
 
-        ImGui::Text(format, addr, opcodes, buffer);
+        lua_pushinteger(L, static_cast<lua_Integer>(calls[i].to));
+        lua_setfield(L, -2, "to");
 
-        if (ImGui::IsItemHovered()) {
-            ImGui::BeginTooltip();
-            ImGui::Text("%s", tooltip);
-            ImGui::EndTooltip();
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    return 1;
+}
+
+static int l_getXrefs(lua_State* const L) {
+    auto const self = checkAnalysis(L, 1);
+
+    hc::Analysis::Xref const* begin;
+    hc::Analysis::Xref const* end;
+    self->findXrefs(static_cast<uint64_t>(luaL_checkinteger(L, 2)), &begin, &end);
+
+    lua_createtable(L, static_cast<int>(end - begin), 0);
+
+    for (auto xref = begin; xref != end; xref++) {
+        static char const* const types[] = {"jump", "branch", "call"};
+
+        lua_createtable(L, 0, 2);
+
+        lua_pushinteger(L, static_cast<lua_Integer>(xref->from));
+        lua_setfield(L, -2, "from");
+
+        lua_pushstring(L, types[static_cast<int>(xref->type)]);
+        lua_setfield(L, -2, "type");
+
+        lua_rawseti(L, -2, xref - begin + 1);
+    }
+
+    return 1;
+}
+
+static int pushAnalysis(lua_State* const L, hc::Debugger* const debugger, hc::Handle<hc::Analysis*> const& handle) {
+    new (lua_newuserdata(L, sizeof(AnalysisRef))) AnalysisRef{debugger, handle};
+
+    if (luaL_newmetatable(L, "hc::Analysis")) {
+        static luaL_Reg const methods[] = {
+            {"run", l_run},
+            {"addEntry", l_addEntry},
+            {"isCode", l_isCode},
+            {"getBlocks", l_getBlocks},
+            {"getFunctions", l_getFunctions},
+            {"getFunction", l_getFunction},
+            {"getCalls", l_getCalls},
+            {"getXrefs", l_getXrefs},
+            {nullptr, nullptr}
+        };
+
+        luaL_newlib(L, methods);
+        lua_setfield(L, -2, "__index");
+    }
+
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+namespace {
+    struct TraceRef {
+        hc::Debugger* debugger;
+        hc::Handle<hc::Trace*> handle;
+    };
+}
+
+static hc::Trace* checkTrace(lua_State* const L, int const index) {
+    auto const ref = static_cast<TraceRef*>(luaL_checkudata(L, index, "hc::Trace"));
+    hc::Trace* const* const trace = ref->debugger->translate(ref->handle);
+
+    if (trace == nullptr) {
+        luaL_error(L, "the trace is gone with the game that was unloaded");
+    }
+
+    return *trace;
+}
+
+static int l_record(lua_State* const L) {
+    auto const self = checkTrace(L, 1);
+    self->start(static_cast<uint64_t>(luaL_checkinteger(L, 2)));
+
+    // Scripts get the whole capture at once instead of a slice per frame
+    while (self->isRecording()) {
+        self->update();
+    }
+
+    lua_pushinteger(L, static_cast<lua_Integer>(self->getTotal()));
+    return 1;
+}
+
+static int l_arm(lua_State* const L) {
+    auto const self = checkTrace(L, 1);
+    self->arm(static_cast<uint64_t>(luaL_checkinteger(L, 2)));
+    return 0;
+}
+
+static int l_stop(lua_State* const L) {
+    auto const self = checkTrace(L, 1);
+    self->arm(0);
+    self->stop();
+    return 0;
+}
+
+static int l_clear(lua_State* const L) {
+    auto const self = checkTrace(L, 1);
+    self->clear();
+    return 0;
+}
+
+static int l_setFile(lua_State* const L) {
+    auto const self = checkTrace(L, 1);
+    char const* const path = luaL_optstring(L, 2, nullptr);
+    lua_pushboolean(L, self->setFile(path));
+    return 1;
+}
+
+static int l_setBudget(lua_State* const L) {
+    auto const self = checkTrace(L, 1);
+    self->setBudget(static_cast<size_t>(luaL_checkinteger(L, 2)));
+    return 0;
+}
+
+static int l_getFirst(lua_State* const L) {
+    auto const self = checkTrace(L, 1);
+    lua_pushinteger(L, static_cast<lua_Integer>(self->getFirst()));
+    return 1;
+}
+
+static int l_getTotal(lua_State* const L) {
+    auto const self = checkTrace(L, 1);
+    lua_pushinteger(L, static_cast<lua_Integer>(self->getTotal()));
+    return 1;
+}
+
+static int l_get(lua_State* const L) {
+    auto const self = checkTrace(L, 1);
+    hc::Trace::Record const* const record = self->get(static_cast<uint64_t>(luaL_checkinteger(L, 2)));
+
+    if (record == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    hc::Cpu* const cpu = self->cpu();
+    unsigned const count = std::min(cpu->registerCount(), static_cast<unsigned>(hc::Trace::MaxRegisters));
+
+    lua_createtable(L, 0, 3);
+
+    lua_pushinteger(L, static_cast<lua_Integer>(record->pc));
+    lua_setfield(L, -2, "pc");
+
+    lua_pushlstring(L, reinterpret_cast<char const*>(record->bytes), record->length);
+    lua_setfield(L, -2, "bytes");
+
+    lua_createtable(L, 0, static_cast<int>(count));
+
+    for (unsigned i = 0; i < count; i++) {
+        lua_pushinteger(L, static_cast<lua_Integer>(record->registers[i]));
+        lua_setfield(L, -2, cpu->registerName(i));
+    }
+
+    lua_setfield(L, -2, "registers");
+    return 1;
+}
+
+static int pushTrace(lua_State* const L, hc::Debugger* const debugger, hc::Handle<hc::Trace*> const& handle) {
+    new (lua_newuserdata(L, sizeof(TraceRef))) TraceRef{debugger, handle};
+
+    if (luaL_newmetatable(L, "hc::Trace")) {
+        static luaL_Reg const methods[] = {
+            {"record", l_record},
+            {"arm", l_arm},
+            {"stop", l_stop},
+            {"clear", l_clear},
+            {"setFile", l_setFile},
+            {"setBudget", l_setBudget},
+            {"getFirst", l_getFirst},
+            {"getTotal", l_getTotal},
+            {"get", l_get},
+            {nullptr, nullptr}
+        };
+
+        luaL_newlib(L, methods);
+        lua_setfield(L, -2, "__index");
+    }
+
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+namespace {
+    struct LogRef {
+        hc::Debugger* debugger;
+        hc::Handle<hc::CodeDataLog*> handle;
+    };
+}
+
+static hc::CodeDataLog* checkLog(lua_State* const L, int const index) {
+    auto const ref = static_cast<LogRef*>(luaL_checkudata(L, index, "hc::CodeDataLog"));
+    hc::CodeDataLog* const* const log = ref->debugger->translate(ref->handle);
+
+    if (log == nullptr) {
+        luaL_error(L, "the log is gone with the game that was unloaded");
+    }
+
+    return *log;
+}
+
+static int l_getFlags(lua_State* const L) {
+    auto const self = checkLog(L, 1);
+    uint8_t const flags = self->flags(static_cast<uint64_t>(luaL_checkinteger(L, 2)));
+
+    lua_pushboolean(L, (flags & hc::CodeDataLog::Code) != 0);
+    lua_pushboolean(L, (flags & hc::CodeDataLog::Data) != 0);
+    lua_pushboolean(L, (flags & hc::CodeDataLog::Written) != 0);
+    return 3;
+}
+
+static int l_merge(lua_State* const L) {
+    auto const self = checkLog(L, 1);
+    auto const other = checkLog(L, 2);
+    self->merge(*other);
+    return 0;
+}
+
+static int l_watch(lua_State* const L) {
+    auto const self = checkLog(L, 1);
+    uint64_t const address = static_cast<uint64_t>(luaL_checkinteger(L, 2));
+    uint64_t const length = static_cast<uint64_t>(luaL_checkinteger(L, 3));
+    bool const read = lua_toboolean(L, 4);
+    bool const write = lua_toboolean(L, 5);
+
+    lua_pushboolean(L, self->watch(address, length, read, write));
+    return 1;
+}
+
+static int l_save(lua_State* const L) {
+    static char const* const formats[] = {"plain", "full", nullptr};
+
+    auto const self = checkLog(L, 1);
+    char const* const path = luaL_checkstring(L, 2);
+    int const format = luaL_checkoption(L, 3, "plain", formats);
+
+    lua_pushboolean(L, self->save(path, format == 0 ? hc::CodeDataLog::Format::Plain : hc::CodeDataLog::Format::Full));
+    return 1;
+}
+
+static int l_load(lua_State* const L) {
+    auto const self = checkLog(L, 1);
+    lua_pushboolean(L, self->load(luaL_checkstring(L, 2)));
+    return 1;
+}
+
+static int l_clearLog(lua_State* const L) {
+    auto const self = checkLog(L, 1);
+    self->clear();
+    return 0;
+}
+
+static int pushLog(lua_State* const L, hc::Debugger* const debugger, hc::Handle<hc::CodeDataLog*> const& handle) {
+    new (lua_newuserdata(L, sizeof(LogRef))) LogRef{debugger, handle};
+
+    if (luaL_newmetatable(L, "hc::CodeDataLog")) {
+        static luaL_Reg const methods[] = {
+            {"getFlags", l_getFlags},
+            {"merge", l_merge},
+            {"watch", l_watch},
+            {"save", l_save},
+            {"load", l_load},
+            {"clear", l_clearLog},
+            {nullptr, nullptr}
+        };
+
+        luaL_newlib(L, methods);
+        lua_setfield(L, -2, "__index");
+    }
+
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+namespace {
+    struct ProfilerRef {
+        hc::Debugger* debugger;
+        hc::Handle<hc::Profiler*> handle;
+    };
+}
+
+static hc::Profiler* checkProfiler(lua_State* const L, int const index) {
+    auto const ref = static_cast<ProfilerRef*>(luaL_checkudata(L, index, "hc::Profiler"));
+    hc::Profiler* const* const profiler = ref->debugger->translate(ref->handle);
+
+    if (profiler == nullptr) {
+        luaL_error(L, "the profiler is gone with the game that was unloaded");
+    }
+
+    return *profiler;
+}
+
+static int l_setEnabled(lua_State* const L) {
+    auto const self = checkProfiler(L, 1);
+    self->setEnabled(lua_toboolean(L, 2));
+    return 0;
+}
+
+static int l_setPeriod(lua_State* const L) {
+    auto const self = checkProfiler(L, 1);
+    lua_Integer const period = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, period >= 1 && period <= hc::Profiler::MaxPeriod, 2, "invalid period");
+    self->setPeriod(static_cast<unsigned>(period));
+    return 0;
+}
+
+static int l_getPeriod(lua_State* const L) {
+    auto const self = checkProfiler(L, 1);
+    lua_pushinteger(L, self->getPeriod());
+    return 1;
+}
+
+static int l_reset(lua_State* const L) {
+    auto const self = checkProfiler(L, 1);
+    self->reset();
+    return 0;
+}
+
+static int l_getSampleCount(lua_State* const L) {
+    auto const self = checkProfiler(L, 1);
+    lua_pushinteger(L, static_cast<lua_Integer>(self->getTotal()));
+    return 1;
+}
+
+static int l_getCounts(lua_State* const L) {
+    auto const self = checkProfiler(L, 1);
+    uint64_t const base = self->base();
+
+    lua_createtable(L, 0, 0);
+
+    for (uint64_t offset = 0; offset < self->size(); offset++) {
+        uint32_t const count = self->count(base + offset);
+
+        if (count != 0) {
+            lua_pushinteger(L, count);
+            lua_rawseti(L, -2, static_cast<lua_Integer>(base + offset));
         }
+    }
+
+    return 1;
+}
 
-        addr += length;
+static int pushProfiler(lua_State* const L, hc::Debugger* const debugger, hc::Handle<hc::Profiler*> const& handle) {
+    new (lua_newuserdata(L, sizeof(ProfilerRef))) ProfilerRef{debugger, handle};
+
+    if (luaL_newmetatable(L, "hc::Profiler")) {
+        static luaL_Reg const methods[] = {
+            {"setEnabled", l_setEnabled},
+            {"setPeriod", l_setPeriod},
+            {"getPeriod", l_getPeriod},
+            {"reset", l_reset},
+            {"getSampleCount", l_getSampleCount},
+            {"getCounts", l_getCounts},
+            {nullptr, nullptr}
+        };
+
+        luaL_newlib(L, methods);
+        lua_setfield(L, -2, "__index");
     }
 
-    ImGui::EndChild();
+    lua_setmetatable(L, -2);
+    return 1;
 }
 
-void hc::Debugger::init() {}
+// The core doesn't pass any userdata to the breakpoint callback
+static hc::Debugger* instance = nullptr;
+
+void hc::Debugger::init() {
+    instance = this;
+}
+
+void hc::Debugger::update() {
+    for (auto const& trace : _traces) {
+        if (trace != nullptr) {
+            trace->update();
+        }
+    }
+}
+
+void hc::Debugger::onFrame() {
+    // Runs on the emulation thread right after the core ran a frame, it's safe to use the debug interface
+    if (_speculative) {
+        return;
+    }
+
+    for (size_t i = 0; i < _logs.size(); i++) {
+        Cpu* const decoder = _decoders[i].get();
+
+        // A cheap sample of where the game is, traces mark everything that runs while recording
+        if (decoder != nullptr) {
+            uint64_t const pc = decoder->programCounter();
+            uint64_t const length = decoder->instructionLength(pc, decoder->mainMemory());
+
+            if (length != 0) {
+                _logs[i]->markCode(pc, static_cast<unsigned>(length));
+            }
+        }
+
+        _logs[i]->onFrame();
+    }
+}
+
+void hc::Debugger::breakpointCallback(unsigned const id) {
+    if (instance != nullptr && !instance->_speculative) {
+        for (auto const& trace : instance->_traces) {
+            if (trace != nullptr) {
+                trace->onBreakpoint();
+            }
+        }
+
+        for (auto const& log : instance->_logs) {
+            log->onBreakpoint(id);
+        }
+    }
+}
+
+hc::Analysis* const* hc::Debugger::translate(Handle<Analysis*> const& handle) const {
+    return _analysisHandleAllocator.translate(handle);
+}
+
+hc::Trace* const* hc::Debugger::translate(Handle<Trace*> const& handle) const {
+    return _traceHandleAllocator.translate(handle);
+}
+
+hc::CodeDataLog* const* hc::Debugger::translate(Handle<CodeDataLog*> const& handle) const {
+    return _logHandleAllocator.translate(handle);
+}
+
+hc::Profiler* const* hc::Debugger::translate(Handle<Profiler*> const& handle) const {
+    return _profilerHandleAllocator.translate(handle);
+}
 
 char const* hc::Debugger::getTitle() {
     return ICON_FA_BUG " Debugger";
@@ -136,7 +975,8 @@ char const* hc::Debugger::getTitle() {
 void hc::Debugger::onGameLoaded() {
     static hc_DebuggerIf const templ = {
         1,
-        {NULL}
+        0,
+        {breakpointCallback, nullptr}
     };
 
     hc_Set setDebugger = (hc_Set)_config->getExtension("hc_set_debuggger");
@@ -159,8 +999,40 @@ void hc::Debugger::onGameLoaded() {
                 if (HC_CPU_API_VERSION(_debuggerIf->v1.system->v1.cpus[i]->v1.type) <= HC_API_VERSION) {
                     _cpus.emplace_back(cpu);
 
+                    // The analysis and the trace have their own instance to decode instructions, not tied to any view
+                    Cpu* const decoder = Cpu::create(_desktop, cpu, _userdata);
+                    _decoders.emplace_back(decoder);
+
+                    if (decoder != nullptr) {
+                        _analyses.emplace_back(new Analysis(decoder));
+                        _analysisHandles.emplace_back(_analysisHandleAllocator.allocate(_analyses.back().get()));
+                        _traces.emplace_back(new Trace(decoder));
+                        _traceHandles.emplace_back(_traceHandleAllocator.allocate(_traces.back().get()));
+                        _profilers.emplace_back(new Profiler(decoder));
+                        _profilerHandles.emplace_back(_profilerHandleAllocator.allocate(_profilers.back().get()));
+                        _traces.back()->setProfiler(_profilers.back().get());
+                    }
+                    else {
+                        _analyses.emplace_back(nullptr);
+                        _analysisHandles.emplace_back();
+                        _traces.emplace_back(nullptr);
+                        _traceHandles.emplace_back();
+                        _profilers.emplace_back(nullptr);
+                        _profilerHandles.emplace_back();
+                    }
+
                     DebugMemory* memory = new DebugMemory(cpu->v1.memory_region, _userdata);
                     _memorySelector->add(memory);
+
+                    CodeDataLog* const log = new CodeDataLog(memory);
+                    _logs.emplace_back(log);
+                    _logHandles.emplace_back(_logHandleAllocator.allocate(log));
+                    _memorySelector->setLog(memory, log);
+
+                    if (decoder != nullptr) {
+                        _analyses.back()->setLog(log);
+                        _traces.back()->setLog(log);
+                    }
                 }
                 else {
                     _desktop->warn(TAG "Unsupported CPU \"%s\"", cpu->v1.description);
@@ -170,6 +1042,24 @@ void hc::Debugger::onGameLoaded() {
     }
 }
 
+void hc::Debugger::onSync() {
+    if (_debuggerIf == nullptr) {
+        return;
+    }
+
+    hc_Cpu const* const selected = _debuggerIf->v1.system->v1.cpus[_selectedCpu];
+    auto const found = std::find(_cpus.begin(), _cpus.end(), selected);
+
+    if (found != _cpus.end()) {
+        CodeDataLog const* const log = _logs[found - _cpus.begin()].get();
+
+        _shownLog.code = log->count(CodeDataLog::Code);
+        _shownLog.data = log->count(CodeDataLog::Data);
+        _shownLog.written = log->count(CodeDataLog::Written);
+        _shownLog.detectWrites = log->getDetectWrites();
+    }
+}
+
 void hc::Debugger::onDraw() {
     if (_debuggerIf == nullptr) {
         return;
@@ -188,16 +1078,215 @@ void hc::Debugger::onDraw() {
     ImGui::Combo("##Cpus", &_selectedCpu, getter, &_cpus, count);
     ImGui::SameLine();
 
-    ImVec2 const rest = ImVec2(ImGui::GetContentRegionAvail().x, 0.0f);
+    hc_Cpu const* const selected = _debuggerIf->v1.system->v1.cpus[_selectedCpu];
+    auto const found = std::find(_cpus.begin(), _cpus.end(), selected);
+    Analysis* const analysis = found != _cpus.end() ? _analyses[found - _cpus.begin()].get() : nullptr;
+    Trace* const trace = found != _cpus.end() ? _traces[found - _cpus.begin()].get() : nullptr;
+
+    Profiler* const profiler = found != _cpus.end() ? _profilers[found - _cpus.begin()].get() : nullptr;
+
+    float const spacing = ImGui::GetStyle().ItemSpacing.x;
+    ImVec2 const quarter = ImVec2((ImGui::GetContentRegionAvail().x - spacing * 3.0f) / 4.0f, 0.0f);
 
-    if (ImGui::Button(ICON_FA_EYE " View", rest)) {
-        Cpu* const cpu = Cpu::create(_desktop, _debuggerIf->v1.system->v1.cpus[_selectedCpu], _userdata);
+    if (ImGui::Button(ICON_FA_EYE " View", quarter)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        Cpu* const cpu = Cpu::create(_desktop, selected, _userdata);
         _desktop->addView(cpu, false, true);
     }
+
+    ImGui::SameLine();
+
+    if (ImGuiAl::Button(ICON_FA_LIST " Listing", analysis != nullptr, quarter)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _desktop->addView(new Listing(_desktop, analysis), false, true);
+    }
+
+    ImGui::SameLine();
+
+    if (ImGuiAl::Button(ICON_FA_HISTORY " Trace", trace != nullptr, quarter)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _desktop->addView(new TraceView(_desktop, trace), false, true);
+    }
+
+    ImGui::SameLine();
+
+    if (ImGuiAl::Button(ICON_FA_TACHOMETER " Profiler", profiler != nullptr, quarter)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _desktop->addView(new ProfilerView(_desktop, profiler, analysis), false, true);
+    }
+
+    if (found != _cpus.end()) {
+        drawLog(_logs[found - _cpus.begin()].get());
+    }
+}
+
+void hc::Debugger::drawLog(CodeDataLog* const log) {
+    if (!ImGui::CollapsingHeader("Code/data log")) {
+        return;
+    }
+
+    ImGui::Text(
+        "%zu executed, %zu read, %zu written of %zu bytes",
+        _shownLog.code, _shownLog.data, _shownLog.written, log->size()
+    );
+
+    bool detectWrites = _shownLog.detectWrites;
+
+    if (ImGui::Checkbox("Compare memory every frame to find writes", &detectWrites)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        log->setDetectWrites(detectWrites);
+    }
+
+    ImGui::InputText("File", _logPath, sizeof(_logPath));
+
+    if (ImGuiAl::Button(ICON_FA_FLOPPY_O " Save", _logPath[0] != 0)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+
+        if (!log->save(_logPath, CodeDataLog::Format::Plain)) {
+            _desktop->error(TAG "Error saving log to \"%s\"", _logPath);
+        }
+    }
+
+    if (ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("Code and data flags, one byte per CPU address");
+    }
+
+    ImGui::SameLine();
+
+    if (ImGuiAl::Button(ICON_FA_FLOPPY_O " Save full", _logPath[0] != 0)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+
+        if (!log->save(_logPath, CodeDataLog::Format::Full)) {
+            _desktop->error(TAG "Error saving log to \"%s\"", _logPath);
+        }
+    }
+
+    ImGui::SameLine();
+
+    if (ImGuiAl::Button(ICON_FA_FOLDER_OPEN " Merge", _logPath[0] != 0)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+
+        if (!log->load(_logPath)) {
+            _desktop->error(TAG "Error loading log from \"%s\"", _logPath);
+        }
+    }
+
+    ImGui::SameLine();
+
+    if (ImGui::Button(ICON_FA_TRASH " Clear")) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        log->clear();
+    }
 }
 
 void hc::Debugger::onGameUnloaded() {
     _debuggerIf = nullptr;
     _cpus.clear();
     _selectedCpu = 0;
+
+    for (auto const& handle : _analysisHandles) {
+        _analysisHandleAllocator.free(handle);
+    }
+
+    for (auto const& handle : _traceHandles) {
+        _traceHandleAllocator.free(handle);
+    }
+
+    for (auto const& handle : _logHandles) {
+        _logHandleAllocator.free(handle);
+    }
+
+    for (auto const& handle : _profilerHandles) {
+        _profilerHandleAllocator.free(handle);
+    }
+
+    _analysisHandles.clear();
+    _traceHandles.clear();
+    _logHandles.clear();
+    _profilerHandles.clear();
+
+    // Analyses, traces and profilers use the decoders, the profilers' threads stop when they're destroyed
+    _analyses.clear();
+    _traces.clear();
+    _profilers.clear();
+    _decoders.clear();
+    _logs.clear();
+}
+
+int hc::Debugger::push(lua_State* const L) {
+    auto const self = static_cast<Debugger**>(lua_newuserdata(L, sizeof(Debugger*)));
+    *self = this;
+
+    if (luaL_newmetatable(L, "hc::Debugger")) {
+        static luaL_Reg const methods[] = {
+            {"getCpuCount", l_getCpuCount},
+            {"getAnalysis", l_getAnalysis},
+            {"getTrace", l_getTrace},
+            {"getLog", l_getLog},
+            {"getProfiler", l_getProfiler},
+            {nullptr, nullptr}
+        };
+
+        luaL_newlib(L, methods);
+        lua_setfield(L, -2, "__index");
+    }
+
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+hc::Debugger* hc::Debugger::check(lua_State* const L, int const index) {
+    return *static_cast<Debugger**>(luaL_checkudata(L, index, "hc::Debugger"));
+}
+
+int hc::Debugger::l_getCpuCount(lua_State* const L) {
+    auto const self = check(L, 1);
+    lua_pushinteger(L, static_cast<lua_Integer>(self->_cpus.size()));
+    return 1;
+}
+
+int hc::Debugger::l_getAnalysis(lua_State* const L) {
+    auto const self = check(L, 1);
+    lua_Integer const index = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, index >= 1 && static_cast<size_t>(index) <= self->_cpus.size(), 2, "invalid cpu index");
+
+    if (self->_analyses[index - 1] == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    return pushAnalysis(L, self, self->_analysisHandles[index - 1]);
+}
+
+int hc::Debugger::l_getTrace(lua_State* const L) {
+    auto const self = check(L, 1);
+    lua_Integer const index = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, index >= 1 && static_cast<size_t>(index) <= self->_cpus.size(), 2, "invalid cpu index");
+
+    if (self->_traces[index - 1] == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    return pushTrace(L, self, self->_traceHandles[index - 1]);
+}
+
+int hc::Debugger::l_getLog(lua_State* const L) {
+    auto const self = check(L, 1);
+    lua_Integer const index = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, index >= 1 && static_cast<size_t>(index) <= self->_cpus.size(), 2, "invalid cpu index");
+    return pushLog(L, self, self->_logHandles[index - 1]);
+}
+
+int hc::Debugger::l_getProfiler(lua_State* const L) {
+    auto const self = check(L, 1);
+    lua_Integer const index = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, index >= 1 && static_cast<size_t>(index) <= self->_cpus.size(), 2, "invalid cpu index");
+
+    if (self->_profilers[index - 1] == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    return pushProfiler(L, self, self->_profilerHandles[index - 1]);
 }
@@ -1,14 +1,21 @@
 #pragma once
 
 #include "Desktop.h"
+#include "Scriptable.h"
 #include "Config.h"
 #include "Cpu.h"
 #include "Memory.h"
+#include "Analysis.h"
+#include "Trace.h"
+#include "CodeDataLog.h"
+#include "Profiler.h"
+#include "Handle.h"
 
 extern "C" {
     #include "hcdebug.h"
 }
 
+#include <memory>
 #include <vector>
 
 namespace hc {
@@ -19,17 +26,96 @@ namespace hc {
         // hc::View
         virtual char const* getTitle() override;
         virtual void onGameUnloaded() override;
+        virtual void onSync() override;
         virtual void onDraw() override;
 
     protected:
+        enum {
+            // Memory edited while the game is paused is picked up after this many draws
+            RecheckDraws = 30
+        };
+
         bool _valid;
         Cpu* _cpu;
         Memory* _memory;
         unsigned _register;
         std::string _title;
+
+        uint64_t _lastAddress;
+        unsigned _draws;
+
+        // Lines decoded in onSync, as many as fitted in the window the last time it was drawn
+        size_t _numItems;
+        std::vector<DisasmCache::Line> _lines;
+    };
+
+    // Scrollable listing of everything found by an analysis, only the visible rows are drawn
+    class Listing : public View {
+    public:
+        Listing(Desktop* desktop, Analysis* analysis);
+
+        // hc::View
+        virtual char const* getTitle() override;
+        virtual void onGameUnloaded() override;
+        virtual void onSync() override;
+        virtual void onDraw() override;
+
+    protected:
+        enum {
+            DataPerRow = 8,
+            // Rows formatted in onSync around the ones drawn the last time, so scrolling doesn't show blanks
+            SyncMargin = 64
+        };
+
+        enum class RowType : uint8_t {
+            Label,
+            Code,
+            Data
+        };
+
+        struct Row {
+            uint64_t address;
+            RowType type;
+            uint8_t count;
+        };
+
+        // The text of the rows, which comes from the memory of the core and from the analysis, which Lua
+        // can change while the view draws
+        struct Line {
+            char text[96];
+            std::string tooltip;
+            bool used;
+        };
+
+        void analyse();
+        size_t findRow(uint64_t const address) const;
+        void formatRow(Row const& row, Line* const line);
+        void drawRow(size_t const index, float const width);
+
+        bool _valid;
+        Analysis* _analysis;
+        std::string _title;
+        std::vector<Row> _rows;
+
+        bool _followPc;
+        uint64_t _lastPc;
+        size_t _scrollTo;
+        char _goto[32];
+
+        // Set in onDraw, done in onSync
+        bool _analyse;
+        bool _addPc;
+
+        uint64_t _pc;
+        int _digits;
+        char _stats[160];
+        size_t _displayStart;
+        size_t _displayEnd;
+        size_t _firstLine;
+        std::vector<Line> _lines;
     };
 
-    class Debugger : public View {
+    class Debugger : public View, public Scriptable {
     public:
         Debugger(Desktop* desktop, Config* config, MemorySelector* memorySelector)
             : View(desktop)
@@ -37,19 +123,49 @@ namespace hc {
             , _memorySelector(memorySelector)
             , _debuggerIf(nullptr)
             , _selectedCpu(0)
-        {}
+            , _speculative(false)
+        {
+            _logPath[0] = 0;
+        }
 
         virtual ~Debugger() {}
 
         void init();
+        // Runs the steps of the traces being recorded, on the emulation thread
+        void update();
+        // Frames run ahead are rolled back, breakpoints hit while running them are ignored
+        void setSpeculative(bool const speculative) { _speculative = speculative; }
+
+        // Return nullptr if the analysis or trace is gone with the game that was unloaded
+        Analysis* const* translate(Handle<Analysis*> const& handle) const;
+        Trace* const* translate(Handle<Trace*> const& handle) const;
+        CodeDataLog* const* translate(Handle<CodeDataLog*> const& handle) const;
+        Profiler* const* translate(Handle<Profiler*> const& handle) const;
+
+        static Debugger* check(lua_State* const L, int const index);
 
         // hc::View
         virtual char const* getTitle() override;
         virtual void onGameLoaded() override;
         virtual void onGameUnloaded() override;
+        virtual void onFrame() override;
+        virtual void onSync() override;
         virtual void onDraw() override;
 
+        // hc::Scriptable
+        virtual int push(lua_State* const L) override;
+
     protected:
+        static int l_getCpuCount(lua_State* const L);
+        static int l_getAnalysis(lua_State* const L);
+        static int l_getTrace(lua_State* const L);
+        static int l_getLog(lua_State* const L);
+        static int l_getProfiler(lua_State* const L);
+
+        static void breakpointCallback(unsigned id);
+
+        void drawLog(CodeDataLog* const log);
+
         Config* _config;
         MemorySelector* _memorySelector;
 
@@ -58,5 +174,33 @@ namespace hc {
 
         std::vector<hc_Cpu const*> _cpus;
         int _selectedCpu;
+        bool _speculative;
+
+        // One per entry in _cpus, null when the CPU type isn't supported
+        std::vector<std::unique_ptr<Cpu>> _decoders;
+        std::vector<std::unique_ptr<Analysis>> _analyses;
+        std::vector<Handle<Analysis*>> _analysisHandles;
+        HandleAllocator<Analysis*> _analysisHandleAllocator;
+        std::vector<std::unique_ptr<Trace>> _traces;
+        std::vector<Handle<Trace*>> _traceHandles;
+        HandleAllocator<Trace*> _traceHandleAllocator;
+        std::vector<std::unique_ptr<Profiler>> _profilers;
+        std::vector<Handle<Profiler*>> _profilerHandles;
+        HandleAllocator<Profiler*> _profilerHandleAllocator;
+
+        // One per entry in _cpus, over the CPU's memory region
+        std::vector<std::unique_ptr<CodeDataLog>> _logs;
+        std::vector<Handle<CodeDataLog*>> _logHandles;
+        HandleAllocator<CodeDataLog*> _logHandleAllocator;
+        char _logPath[256];
+
+        // The log of the selected CPU, copied in onSync
+        struct {
+            size_t code;
+            size_t data;
+            size_t written;
+            bool detectWrites;
+        }
+        _shownLog;
     };
 }
@@ -26,16 +26,11 @@ void hc::Desktop::init(Logger* const logger) {
 
 void hc::Desktop::addView(View* const view, bool const top, bool const free) {
     auto const props = new ViewProperties {view, top, free, true};
-    _views.emplace(props);
+    _added.emplace_back(props);
 }
 
 void hc::Desktop::removeView(View const* const view) {
-    for (auto const& props : _views) {
-        if (props->view == view) {
-            props->opened = false;
-            return;
-        }
-    }
+    _removed.emplace_back(view);
 }
 
 double hc::Desktop::drawFps() {
@@ -63,6 +58,8 @@ void hc::Desktop::resetFrameFps() {
 }
 
 void hc::Desktop::onStarted() {
+    updateViews();
+
     for (auto const& props : _views) {
         View* const view = props->view;
         debug(TAG "onStarted %s", view->getTitle());
@@ -148,9 +145,21 @@ void hc::Desktop::onStep() {
     }
 }
 
-void hc::Desktop::onDraw() {
+void hc::Desktop::onSync() {
     _drawCount++;
+    updateViews();
 
+    for (auto const& props : _views) {
+        View* const view = props->view;
+        // Don't log stuff per frame
+
+        if (view != this && props->opened) {
+            view->onSync();
+        }
+    }
+}
+
+void hc::Desktop::onDraw() {
     ImGui::ShowDemoWindow();
 
     if (ImGui::Begin(getTitle())) {
@@ -195,26 +204,6 @@ void hc::Desktop::onDraw() {
             }
         }
     }
-
-    for (;;) {
-        bool done = true;
-
-        for (auto const& props : _views) {
-            if (!props->opened) {
-                if (props->free) {
-                    delete props->view;
-                }
-
-                _views.erase(props);
-                done = false;
-                break;
-            }
-        }
-
-        if (done) {
-            break;
-        }
-    }
 }
 
 void hc::Desktop::onGameUnloaded() {
@@ -236,6 +225,8 @@ void hc::Desktop::onCoreUnloaded() {
 }
 
 void hc::Desktop::onQuit() {
+    updateViews();
+
     for (auto const& props : _views) {
         View* const view = props->view;
         debug(TAG "onQuit plugin %s", view->getTitle());
@@ -250,6 +241,38 @@ void hc::Desktop::onQuit() {
     _drawTimer.stop();
 }
 
+void hc::Desktop::updateViews() {
+    for (auto const view : _removed) {
+        for (auto const& props : _views) {
+            if (props->view == view) {
+                props->opened = false;
+                break;
+            }
+        }
+    }
+
+    _removed.clear();
+
+    for (auto it = _views.begin(); it != _views.end();) {
+        ViewProperties* const props = *it;
+
+        if (!props->opened) {
+            if (props->free) {
+                delete props->view;
+            }
+
+            delete props;
+            it = _views.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    _views.insert(_added.begin(), _added.end());
+    _added.clear();
+}
+
 void hc::Desktop::vprintf(retro_log_level level, char const* format, va_list args) {
     _logger->vprintf(level, format, args);
 }
@@ -5,7 +5,9 @@
 #include <lrcpp/Frontend.h>
 
 #include <string.h>
+#include <mutex>
 #include <unordered_set>
+#include <vector>
 
 extern "C" {
     #include <lua.h>
@@ -36,6 +38,9 @@ namespace hc {
         virtual void onGameReset() {}
         virtual void onFrame() {}
         virtual void onStep() {}
+        // Called with the emulation stopped right before onDraw, which runs while the core runs. Views copy
+        // here what they draw, and take the emulation lock in onDraw to change anything the core uses
+        virtual void onSync() {}
         virtual void onDraw() {}
         virtual void onGameUnloaded() {}
         virtual void onCoreUnloaded() {}
@@ -51,9 +56,15 @@ namespace hc {
         virtual ~Desktop() {}
 
         void init(Logger* const logger);
+        // Need the emulation lock, the views only change in onSync so the emulation thread can go through
+        // them while the UI draws
         void addView(View* const view, bool const top, bool const free);
         void removeView(View const* const view);
 
+        // Held by the emulation thread while the core runs, and by the UI thread while handling events
+        // and in onSync
+        std::mutex& emulationLock() { return _lock; }
+
         double drawFps();
         void resetDrawFps();
         double frameFps();
@@ -75,6 +86,7 @@ namespace hc {
         virtual void onGameReset() override;
         virtual void onFrame() override;
         virtual void onStep() override;
+        virtual void onSync() override;
         virtual void onDraw() override;
         virtual void onGameUnloaded() override;
         virtual void onCoreUnloaded() override;
@@ -88,9 +100,14 @@ namespace hc {
             bool opened;
         };
 
+        void updateViews();
+
         Logger* _logger;
+        std::mutex _lock;
 
         std::unordered_set<ViewProperties*> _views;
+        std::vector<ViewProperties*> _added;
+        std::vector<View const*> _removed;
 
         uint64_t _drawCount;
         Timer _drawTimer;
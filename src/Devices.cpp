@@ -444,6 +444,7 @@ void hc::Keyboard::draw() {
             ImVec2 const size(static_cast<float>(sizes[i][j]), 20.0f);
 
             if (ImGui::Button(keys[j], size)) {
+                std::lock_guard<std::mutex> lock(_desktop->emulationLock());
                 _virtualState[codes[i][j]] = Perf::getTimeUs();
             }
 
@@ -459,11 +460,21 @@ void hc::Keyboard::draw() {
         "None","Left Shift", "Right Shift", "Left Control", "Right Control", "Left Alt", "Right Alt"
     };
 
+    // The locks are only changed here, but read by the core
+    int lock1 = _lock1;
+    int lock2 = _lock2;
+
     ImGui::Columns(2);
-    ImGui::Combo("Lock##1", &_lock1, lockables, sizeof(lockables) / sizeof(lockables[0]));
+    bool const changed1 = ImGui::Combo("Lock##1", &lock1, lockables, sizeof(lockables) / sizeof(lockables[0]));
     ImGui::NextColumn();
-    ImGui::Combo("Lock##2", &_lock2, lockables, sizeof(lockables) / sizeof(lockables[0]));
+    bool const changed2 = ImGui::Combo("Lock##2", &lock2, lockables, sizeof(lockables) / sizeof(lockables[0]));
     ImGui::Columns(1);
+
+    if (changed1 || changed2) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _lock1 = lock1;
+        _lock2 = lock2;
+    }
 }
 
 void hc::Keyboard::process(SDL_Event const* event) {
@@ -612,7 +623,7 @@ void hc::Keyboard::process(SDL_Event const* event) {
 }
 
 
-hc::Mouse::Mouse(Desktop* desktop) : Device(desktop), _video(nullptr) {}
+hc::Mouse::Mouse(Desktop* desktop) : Device(desktop), _video(nullptr), _leftDown(false), _rightDown(false) {}
 
 void hc::Mouse::init(Video* video) {
     _video = video;
@@ -623,11 +634,11 @@ bool hc::Mouse::getPosition(int* x, int* y) {
 }
 
 bool hc::Mouse::getLeftDown() const {
-    return ImGui::IsMouseDown(0);
+    return _leftDown;
 }
 
 bool hc::Mouse::getRightDown() const {
-    return ImGui::IsMouseDown(1);
+    return _rightDown;
 }
 
 char const* hc::Mouse::getName() const {
@@ -647,7 +658,18 @@ void hc::Mouse::draw() {
 }
 
 void hc::Mouse::process(SDL_Event const* event) {
-    (void)event;
+    if (event->type != SDL_MOUSEBUTTONDOWN && event->type != SDL_MOUSEBUTTONUP) {
+        return;
+    }
+
+    bool const down = event->button.state == SDL_PRESSED;
+
+    if (event->button.button == SDL_BUTTON_LEFT) {
+        _leftDown = down;
+    }
+    else if (event->button.button == SDL_BUTTON_RIGHT) {
+        _rightDown = down;
+    }
 }
 
 hc::Devices::Devices(Desktop* desktop)
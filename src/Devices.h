@@ -121,6 +121,8 @@ namespace hc {
         // Mouse coordinates are provided by the video component
         Video* _video;
         int _lastX, _lastY;
+        // Set from the events, the core reads them on the emulation thread
+        bool _leftDown, _rightDown;
     };
 
     class Devices: public View {
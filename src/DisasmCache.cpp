@@ -0,0 +1,104 @@
+#include "DisasmCache.h"
+#include "Cpu.h"
+
+#include <string.h>
+
+hc::DisasmCache::DisasmCache(Cpu* const cpu, Memory const* const memory)
+    : _cpu(cpu)
+    , _memory(memory)
+    , _generation(1)
+    , _decodes(0)
+{}
+
+void hc::DisasmCache::clear() {
+    _pages.clear();
+    _lines.clear();
+    _generation++;
+}
+
+hc::DisasmCache::Line const& hc::DisasmCache::get(uint64_t const address) {
+    auto const found = _lines.find(address);
+
+    if (found != _lines.end()) {
+        Line& line = found->second;
+        uint64_t const last = address + line.length - 1;
+
+        if (pageVersion(address / PageSize) == line.firstVersion && pageVersion(last / PageSize) == line.lastVersion) {
+            return line;
+        }
+
+        decode(&line, address);
+        return line;
+    }
+
+    Line& line = _lines[address];
+    decode(&line, address);
+    return line;
+}
+
+unsigned hc::DisasmCache::pageVersion(uint64_t const index) {
+    Page& page = _pages[index];
+
+    if (page.checked == _generation) {
+        return page.version;
+    }
+
+    // Addresses outside the memory read as zeros
+    uint64_t const start = index * PageSize;
+    uint64_t const end = start + PageSize;
+    uint64_t const base = _memory->base();
+    uint64_t const limit = base + _memory->size();
+    uint64_t const from = start > base ? start : base;
+    uint64_t const to = end < limit ? end : limit;
+
+    uint8_t bytes[PageSize];
+    memset(bytes, 0, sizeof(bytes));
+
+    if (from < to) {
+        _memory->read(from, bytes + (from - start), to - from);
+    }
+
+    // New pages start with a checked generation of zero, so they're always read the first time
+    if (page.checked == 0 || memcmp(bytes, page.bytes, sizeof(bytes)) != 0) {
+        memcpy(page.bytes, bytes, sizeof(bytes));
+        page.version++;
+    }
+
+    page.checked = _generation;
+    return page.version;
+}
+
+void hc::DisasmCache::decode(Line* const line, uint64_t const address) {
+    line->address = address;
+    line->firstVersion = pageVersion(address / PageSize);
+
+    uint64_t const length = _cpu->instructionLength(address, _memory);
+    line->length = length == 0 ? 1 : length < MaxBytes ? static_cast<unsigned>(length) : MaxBytes;
+
+    line->lastVersion = pageVersion((address + line->length - 1) / PageSize);
+
+    line->text[0] = line->tooltip[0] = 0;
+    _cpu->disasm(address, _memory, line->text, sizeof(line->text), line->tooltip, sizeof(line->tooltip));
+
+    // Take the bytes from the page copies instead of peeking them again
+    char* opcodes = line->opcodes;
+
+    for (unsigned i = 0; i < line->length; i++) {
+        uint64_t const byte = address + i;
+        line->bytes[i] = _pages[byte / PageSize].bytes[byte % PageSize];
+
+        if (i < 4) {
+            static char const hex[] = "0123456789abcdef";
+
+            if (i != 0) {
+                *opcodes++ = ' ';
+            }
+
+            *opcodes++ = hex[line->bytes[i] >> 4];
+            *opcodes++ = hex[line->bytes[i] & 15];
+        }
+    }
+
+    *opcodes = 0;
+    _decodes++;
+}
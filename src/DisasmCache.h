@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Memory.h"
+
+#include <stdint.h>
+#include <unordered_map>
+
+namespace hc {
+    class Cpu;
+
+    // Keeps decoded instructions by address so they're only disassembled again when the memory they came
+    // from changes. Memory is compared in pages against a copy taken when the page was last checked, and
+    // pages are only checked again after touch is called.
+    class DisasmCache {
+    public:
+        enum {
+            MaxBytes = 8,
+            PageSize = 256
+        };
+
+        struct Line {
+            uint64_t address;
+            unsigned length;
+            uint8_t bytes[MaxBytes];
+            char opcodes[MaxBytes * 3];
+            char text[64];
+            char tooltip[64];
+
+            // The versions of the first and last pages with the instruction's bytes when it was decoded
+            unsigned firstVersion;
+            unsigned lastVersion;
+        };
+
+        DisasmCache(Cpu* const cpu, Memory const* const memory);
+
+        // Memory may have changed, pages are checked again the next time they're used
+        void touch() { _generation++; }
+        void clear();
+
+        Line const& get(uint64_t const address);
+        unsigned length(uint64_t const address) { return get(address).length; }
+
+        size_t getLineCount() const { return _lines.size(); }
+        uint64_t getDecodeCount() const { return _decodes; }
+
+    protected:
+        struct Page {
+            uint8_t bytes[PageSize];
+            uint64_t checked;
+            unsigned version;
+        };
+
+        unsigned pageVersion(uint64_t const index);
+        void decode(Line* const line, uint64_t const address);
+
+        Cpu* const _cpu;
+        Memory const* const _memory;
+
+        uint64_t _generation;
+        uint64_t _decodes;
+        std::unordered_map<uint64_t, Page> _pages;
+        std::unordered_map<uint64_t, Line> _lines;
+    };
+}
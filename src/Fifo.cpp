@@ -1,16 +1,24 @@
 #include "Fifo.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 bool hc::Fifo::init(size_t const size) {
-    _buffer = (uint8_t*)malloc(size);
+    size_t capacity = 1;
+
+    while (capacity < size) {
+        capacity <<= 1;
+    }
+
+    _buffer = (uint8_t*)malloc(capacity);
 
     if (_buffer == NULL) {
         return false;
     }
 
-    _size = _avail = size;
-    _first = _last = 0;
+    _size = capacity;
+    _mask = capacity - 1;
+    reset();
     return true;
 }
 
@@ -19,54 +27,83 @@ void hc::Fifo::destroy() {
 }
 
 void hc::Fifo::reset() {
-    _avail = _size;
-    _first = _last = 0;
+    _head.store(0, std::memory_order_relaxed);
+    _tail.store(0, std::memory_order_release);
 }
 
-void hc::Fifo::read(void* const data, size_t const size) {
-    std::lock_guard<std::mutex> lock(_mutex);
+size_t hc::Fifo::read(void* const data, size_t size) {
+    size_t const head = _head.load(std::memory_order_relaxed);
+    // Acquire the producer's position so the bytes it wrote before it are visible
+    size_t const tail = _tail.load(std::memory_order_acquire);
+    size_t const offset = head & _mask;
+
+    if (size > tail - head) {
+        size = tail - head;
+    }
 
     size_t first = size;
     size_t second = 0;
 
-    if (first > _size - _first) {
-        first = _size - _first;
+    if (first > _size - offset) {
+        first = _size - offset;
         second = size - first;
     }
 
-    uint8_t* src = _buffer + _first;
-    memcpy(data, src, first);
+    memcpy(data, _buffer + offset, first);
     memcpy((uint8_t*)data + first, _buffer, second);
 
-    _first = (_first + size) % _size;
-    _avail += size;
+    // Hand the space back to the producer only after the copy
+    _head.store(head + size, std::memory_order_release);
+    return size;
 }
 
-void hc::Fifo::write(void const* const data, size_t const size) {
-    std::lock_guard<std::mutex> lock(_mutex);
+size_t hc::Fifo::write(void const* const data, size_t size) {
+    size_t const tail = _tail.load(std::memory_order_relaxed);
+    // Acquire the consumer's position so it is done reading the space that is reused
+    size_t const head = _head.load(std::memory_order_acquire);
+    size_t const offset = tail & _mask;
+
+    if (size > _size - (tail - head)) {
+        size = _size - (tail - head);
+    }
 
     size_t first = size;
     size_t second = 0;
 
-    if (first > _size - _last) {
-        first = _size - _last;
+    if (first > _size - offset) {
+        first = _size - offset;
         second = size - first;
     }
 
-    uint8_t* dest = _buffer + _last;
-    memcpy(dest, data, first);
-    memcpy(_buffer, (uint8_t*)data + first, second);
+    memcpy(_buffer + offset, data, first);
+    memcpy(_buffer, (uint8_t const*)data + first, second);
+
+    _tail.store(tail + size, std::memory_order_release);
+    return size;
+}
+
+void* hc::Fifo::acquireWrite(size_t* const size) {
+    size_t const tail = _tail.load(std::memory_order_relaxed);
+    size_t const head = _head.load(std::memory_order_acquire);
+    size_t const offset = tail & _mask;
+
+    size_t const avail = _size - (tail - head);
+    size_t const contiguous = _size - offset;
+
+    *size = avail < contiguous ? avail : contiguous;
+    return _buffer + offset;
+}
 
-    _last = (_last + size) % _size;
-    _avail -= size;
+void hc::Fifo::commitWrite(size_t const size) {
+    _tail.store(_tail.load(std::memory_order_relaxed) + size, std::memory_order_release);
 }
 
 size_t hc::Fifo::occupied() {
-    std::lock_guard<std::mutex> lock(_mutex);
-    return _size - _avail;
+    size_t const head = _head.load(std::memory_order_acquire);
+    size_t const tail = _tail.load(std::memory_order_acquire);
+    return tail - head;
 }
 
 size_t hc::Fifo::free() {
-    std::lock_guard<std::mutex> lock(_mutex);
-    return _avail;
+    return _size - occupied();
 }
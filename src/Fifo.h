@@ -1,17 +1,27 @@
 #pragma once
 
 #include <stddef.h>
-#include <mutex>
+#include <stdint.h>
+#include <atomic>
 
 namespace hc {
+    // Lock-free ring for one producer thread and one consumer thread
     class Fifo final {
     public:
+        // The size is rounded up to a power of two
         bool init(size_t const size);
         void destroy();
+        // Only when neither thread is using the fifo
         void reset();
 
-        void read(void* const data, size_t const size);
-        void write(void const* const data, size_t const size);
+        // Consumer, reads at most what is occupied and returns the size read
+        size_t read(void* const data, size_t size);
+
+        // Producer, writes at most what is free and returns the size written
+        size_t write(void const* const data, size_t size);
+        // Returns the contiguous free space at the write position, and its size
+        void* acquireWrite(size_t* const size);
+        void commitWrite(size_t const size);
 
         size_t size() { return _size; }
 
@@ -19,11 +29,19 @@ namespace hc {
         size_t free();
 
     protected:
-        std::mutex _mutex;
+        enum {
+            CacheLineSize = 64
+        };
+
         uint8_t* _buffer;
         size_t _size;
-        size_t _avail;
-        size_t _first;
-        size_t _last;
+        size_t _mask;
+
+        // Free-running positions, each written by only one of the threads
+        uint8_t _pad0[CacheLineSize];
+        std::atomic<size_t> _head;
+        uint8_t _pad1[CacheLineSize - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t> _tail;
+        uint8_t _pad2[CacheLineSize - sizeof(std::atomic<size_t>)];
     };
 }
@@ -42,6 +42,13 @@ void hc::Input::onCoreLoaded() {
     // TODO auto-assign controllers to ports here? Do it in the Lua console script?
 }
 
+void hc::Input::onSync() {
+    for (size_t port = 0; port < MaxPorts; port++) {
+        _shownTypes[port] = _controllerTypes[port];
+        _shownPorts[port] = _ports[port];
+    }
+}
+
 void hc::Input::onDraw() {
     static char const* const portNames[MaxPorts] = {"Port 1", "Port 2", "Port 3", "Port 4"};
 
@@ -54,31 +61,36 @@ void hc::Input::onDraw() {
                     return true;
                 };
 
-                auto& types = _controllerTypes[port];
-                int selected = _ports[port].selectedType;
+                auto& types = _shownTypes[port];
+                int selected = _shownPorts[port].selectedType;
 
                 ImGui::Combo("Type", &selected, getter, &types, static_cast<int>(types.size()));
 
-                if (selected != _ports[port].selectedType) {
-                    _ports[port].selectedType = selected;
-                    _ports[port].selectedDevice = -1;
-                    _ports[port].type = _controllerTypes[port][selected].id & RETRO_DEVICE_MASK;
-                    _ports[port].controller = nullptr;
+                if (selected != _shownPorts[port].selectedType) {
+                    std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+
+                    if (static_cast<size_t>(selected) < _controllerTypes[port].size()) {
+                        _ports[port].selectedType = selected;
+                        _ports[port].selectedDevice = -1;
+                        _ports[port].type = _controllerTypes[port][selected].id & RETRO_DEVICE_MASK;
+                        _ports[port].controller = nullptr;
 
-                    _frontend->setControllerPortDevice(port, _controllerTypes[port][selected].id);
+                        _frontend->setControllerPortDevice(port, _controllerTypes[port][selected].id);
+                    }
                 }
 
-                if (_ports[port].type == RETRO_DEVICE_JOYPAD) {
+                if (_shownPorts[port].type == RETRO_DEVICE_JOYPAD) {
                     static auto const getter = [](void* data, int idx, char const** text) -> bool {
                         auto controllers = static_cast<std::vector<Controller*> const*>(data);
                         *text = (*controllers)[idx]->getName();
                         return true;
                     };
 
-                    int selected = _ports[port].selectedDevice;
+                    int selected = _shownPorts[port].selectedDevice;
                     ImGui::Combo("Device", &selected, getter, &_controllers, static_cast<int>(_controllers.size()));
 
-                    if (selected != _ports[port].selectedDevice) {
+                    if (selected != _shownPorts[port].selectedDevice) {
+                        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
                         _ports[port].selectedDevice = selected;
                         _ports[port].controller = _controllers[selected];
                     }
@@ -24,6 +24,7 @@ namespace hc {
         // hc::View
         virtual char const* getTitle() override;
         virtual void onCoreLoaded() override;
+        virtual void onSync() override;
         virtual void onDraw() override;
         virtual void onCoreUnloaded() override;
 
@@ -79,6 +80,10 @@ namespace hc {
         // The device attached to each port
         Port _ports[MaxPorts];
 
+        // Copied in onSync, the core can set the controller types at any time
+        std::vector<ControllerInfo> _shownTypes[MaxPorts];
+        Port _shownPorts[MaxPorts];
+
         // Last mouse positions to calculate the deltas
         int _lastX;
         int _lastY;
@@ -25,14 +25,18 @@ void hc::Led::onGameReset() {
     }
 }
 
+void hc::Led::onSync() {
+    _shownStates = _states;
+}
+
 void hc::Led::onDraw() {
     static ImColor const on = ImColor(IM_COL32(255, 0, 0, 255));
     static ImColor const off = ImColor(IM_COL32(64, 64, 64, 255));
 
-    size_t const count = _states.size();
+    size_t const count = _shownStates.size();
 
     for (size_t i = 0; i < count; i++) {
-        ImGui::PushStyleColor(ImGuiCol_Text, _states[i] ? on.Value : off.Value);
+        ImGui::PushStyleColor(ImGuiCol_Text, _shownStates[i] ? on.Value : off.Value);
         ImGui::Text(ICON_FA_CIRCLE);
         ImGui::PopStyleColor(1);
         ImGui::SameLine();
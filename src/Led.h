@@ -20,6 +20,7 @@ namespace hc {
         // hc::View
         virtual char const* getTitle() override;
         virtual void onGameReset() override;
+        virtual void onSync() override;
         virtual void onDraw() override;
         virtual void onGameUnloaded() override;
 
@@ -33,5 +34,6 @@ namespace hc {
         static int l_setState(lua_State* const L);
 
         std::vector<int> _states;
+        std::vector<int> _shownStates;
     };
 }
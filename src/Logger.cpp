@@ -45,6 +45,9 @@ void hc::Logger::onDraw() {
         case 1: {
             std::string buffer;
 
+            // The emulation thread logs while the UI draws
+            std::lock_guard<std::mutex> lock(_mutex);
+
             _logger.iterate([&buffer](ImGuiAl::Log::Info const& header, char const* const line) -> bool {
                 switch (static_cast<ImGuiAl::Log::Level>(header.metaData)) {
                     case ImGuiAl::Log::Level::Debug:   buffer += "[DEBUG] "; break;
@@ -64,6 +67,7 @@ void hc::Logger::onDraw() {
         }
 
         case 2: {
+            std::lock_guard<std::mutex> lock(_mutex);
             _logger.clear();
             break;
         }
@@ -71,6 +75,7 @@ void hc::Logger::onDraw() {
 }
 
 void hc::Logger::onCoreUnloaded() {
+    std::lock_guard<std::mutex> lock(_mutex);
     _logger.clear();
 }
 
@@ -29,6 +29,23 @@ char const* hc::LuaRepl::getTitle() {
 }
 
 void hc::LuaRepl::onDraw() {
+    std::vector<Output> pending;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        pending.swap(_pending);
+    }
+
+    for (auto const& output : pending) {
+        if (output.setColor) {
+            _term.setForegroundColor(output.color);
+        }
+        else {
+            _term.printf("%s", output.text.c_str());
+            _term.scrollToBottom();
+        }
+    }
+
     _term.draw();
 }
 
@@ -73,6 +90,8 @@ int hc::LuaRepl::push(lua_State* L) {
 }
 
 void hc::LuaRepl::execute(char* const command) {
+    std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+
     lua_rawgeti(_L, LUA_REGISTRYINDEX, _execute);
     lua_pushstring(_L, command);
 
@@ -90,6 +109,8 @@ void hc::LuaRepl::execute(char* const command) {
 }
 
 void hc::LuaRepl::callback(ImGuiInputTextCallbackData* data) {
+    std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+
     lua_rawgeti(_L, LUA_REGISTRYINDEX, _history);
     lua_pushboolean(_L, data->EventKey == ImGuiKey_UpArrow);
 
@@ -103,27 +124,31 @@ void hc::LuaRepl::callback(ImGuiInputTextCallbackData* data) {
     lua_pop(_L, 1);
 }
 
+void hc::LuaRepl::queue(Output&& output) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pending.emplace_back(std::move(output));
+}
+
 int hc::LuaRepl::l_show(lua_State* L) {
     auto const self = static_cast<LuaRepl*>(lua_touserdata(L, lua_upvalueindex(1)));
-    self->_term.printf("%s", luaL_checkstring(L, 1));
-    self->_term.scrollToBottom();
+    self->queue(Output{false, 0, luaL_checkstring(L, 1)});
     return 0;
 }
 
 int hc::LuaRepl::l_green(lua_State* L) {
     auto const self = static_cast<LuaRepl*>(lua_touserdata(L, lua_upvalueindex(1)));
-    self->_term.setForegroundColor(ImGuiAl::Crt::CGA::BrightGreen);
+    self->queue(Output{true, ImGuiAl::Crt::CGA::BrightGreen, std::string()});
     return 0;
 }
 
 int hc::LuaRepl::l_yellow(lua_State* L) {
     auto const self = static_cast<LuaRepl*>(lua_touserdata(L, lua_upvalueindex(1)));
-    self->_term.setForegroundColor(ImGuiAl::Crt::CGA::Yellow);
+    self->queue(Output{true, ImGuiAl::Crt::CGA::Yellow, std::string()});
     return 0;
 }
 
 int hc::LuaRepl::l_red(lua_State* L) {
     auto const self = static_cast<LuaRepl*>(lua_touserdata(L, lua_upvalueindex(1)));
-    self->_term.setForegroundColor(ImGuiAl::Crt::CGA::BrightRed);
+    self->queue(Output{true, ImGuiAl::Crt::CGA::BrightRed, std::string()});
     return 0;
 }
@@ -5,6 +5,10 @@
 
 #include <imguial_term.h>
 
+#include <mutex>
+#include <string>
+#include <vector>
+
 extern "C" {
     #include <lua.h>
 }
@@ -39,10 +43,22 @@ namespace hc {
         static int l_yellow(lua_State* L);
         static int l_red(lua_State* L);
 
+        // Lua also runs on the emulation thread, what it shows is added to the terminal when it's drawn
+        struct Output {
+            bool setColor;
+            ImU32 color;
+            std::string text;
+        };
+
+        void queue(Output&& output);
+
         Logger* _logger;
         lua_State* _L;
         Terminal _term;
         int _execute;
         int _history;
+
+        std::mutex _mutex;
+        std::vector<Output> _pending;
     };
 }
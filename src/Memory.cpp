@@ -1,6 +1,9 @@
 #include "Memory.h"
 #include "Logger.h"
+#include "CodeDataLog.h"
 #include "cheats/Snapshot.h"
+#include "cheats/Search.h"
+#include "cheats/Set.h"
 
 #include <imguial_button.h>
 #include <IconsFontAwesome4.h>
@@ -37,6 +40,10 @@ namespace {
             }
         }
 
+        virtual uint8_t const* span(uint64_t address, uint64_t size) const override {
+            return address <= sizeof(_memory) && size <= sizeof(_memory) - address ? (uint8_t const*)&_memory + address : nullptr;
+        }
+
         void tick() {
             _memory.counter64++;
             _memory.counter32++;
@@ -140,12 +147,58 @@ namespace {
             }
         }
 
+        virtual void read(uint64_t address, void* buffer, uint64_t size) const override {
+            Memory* const* const memptr = _selector->translate(_handle);
+
+            if (memptr != nullptr) {
+                (*memptr)->read(address, buffer, size);
+            }
+            else {
+                memset(buffer, 0, size);
+            }
+        }
+
+        virtual uint8_t const* span(uint64_t address, uint64_t size) const override {
+            Memory* const* const memptr = _selector->translate(_handle);
+            return memptr != nullptr ? (*memptr)->span(address, size) : nullptr;
+        }
+
+        virtual bool highlight(hc::Set const* set) override {
+            if (_selector->translate(_handle) == nullptr) {
+                return false;
+            }
+
+            _selector->highlight(_handle, set);
+            return true;
+        }
+
     protected:
         hc::Handle<hc::Memory*> const _handle;
         hc::MemorySelector* const _selector;
     };
 }
 
+void hc::Memory::read(uint64_t address, void* buffer, uint64_t size) const {
+    uint8_t const* const data = span(address, size);
+
+    if (data != nullptr) {
+        memcpy(buffer, data, size);
+        return;
+    }
+
+    auto const bytes = static_cast<uint8_t*>(buffer);
+
+    for (uint64_t i = 0; i < size; i++) {
+        bytes[i] = peek(address + i);
+    }
+}
+
+uint8_t const* hc::Memory::span(uint64_t address, uint64_t size) const {
+    (void)address;
+    (void)size;
+    return nullptr;
+}
+
 unsigned hc::Memory::requiredDigits() {
     unsigned count = 0;
 
@@ -157,32 +210,7 @@ unsigned hc::Memory::requiredDigits() {
 }
 
 bool hc::Memory::find(uint64_t* start, uint8_t const* bytes, size_t length) {
-    if (length < 1 || length > size()) {
-        return false;
-    }
-
-    uint64_t const end = size() - length + 1;
-    uint8_t const first = bytes[0];
-
-    for (uint64_t i = *start; i < end; i++) {
-        if (peek(i) == first) {
-            bool found = true;
-
-            for (uint64_t j = 1; j < length; j++) {
-                if (bytes[j] != peek(i + j)) {
-                    found = false;
-                    break;
-                }
-            }
-
-            if (found) {
-                *start = i;
-                return true;
-            }
-        }
-    }
-
-    return false;
+    return search::first(*this, start, search::Pattern(bytes, length));
 }
 
 hc::Memory* hc::Memory::check(lua_State* L, int index) {
@@ -207,12 +235,18 @@ int hc::Memory::push(lua_State* L) {
             {"peek", l_peek},
             {"poke", l_poke},
             {"find", l_find},
+            {"findAll", l_findAll},
+            {"search", l_search},
             {"snapshot", l_snapshot},
+            {"highlight", l_highlight},
             {NULL, NULL}
         };
 
         luaL_newlib(L, methods);
         lua_setfield(L, -2, "__index");
+
+        lua_pushcfunction(L, l_collect);
+        lua_setfield(L, -2, "__gc");
     }
 
     lua_setmetatable(L, -2);
@@ -276,51 +310,96 @@ int hc::Memory::l_poke(lua_State* L) {
     return 0;
 }
 
-int hc::Memory::l_find(lua_State* L) {
-    auto const self = check(L, 1);
-    uint64_t address = luaL_checkinteger(L, 2);
-
-    if (lua_type(L, 3) == LUA_TTABLE) {
-        lua_len(L, 3);
+// Gets a needle from a table of byte values or from a string with the raw bytes
+static hc::search::Pattern checkNeedle(lua_State* L, int index) {
+    if (lua_type(L, index) == LUA_TTABLE) {
+        lua_len(L, index);
         lua_Integer const length = lua_tointeger(L, -1);
         lua_pop(L, 1);
 
-        uint8_t* const bytes = new uint8_t[length];
+        std::vector<uint8_t> bytes(length);
 
         for (lua_Integer i = 0; i < length; i++) {
-            lua_geti(L, 3, i + 1);
-            bytes[i] = static_cast<lua_Integer>(lua_tonumber(L, -1));
+            lua_geti(L, index, i + 1);
+            bytes[i] = static_cast<uint8_t>(lua_tointeger(L, -1));
             lua_pop(L, 1);
         }
 
-        if (self->find(&address, bytes, length)) {
-            delete[] bytes;
-            lua_pushinteger(L, address);
-            return 1;
-        }
+        return hc::search::Pattern(bytes.data(), bytes.size());
     }
-    else {
-        size_t length;
-        char const* string = luaL_checklstring(L, 3, &length);
 
-        if (self->find(&address, reinterpret_cast<uint8_t const*>(string), length)) {
-            lua_pushinteger(L, address);
-            return 1;
-        }
+    size_t length;
+    char const* string = luaL_checklstring(L, index, &length);
+    return hc::search::Pattern(reinterpret_cast<uint8_t const*>(string), length);
+}
+
+int hc::Memory::l_find(lua_State* L) {
+    auto const self = check(L, 1);
+    uint64_t address = luaL_checkinteger(L, 2);
+    search::Pattern const needle = checkNeedle(L, 3);
+
+    if (search::first(*self, &address, needle)) {
+        lua_pushinteger(L, address);
+        return 1;
     }
 
     return 0;
 }
 
+int hc::Memory::l_findAll(lua_State* L) {
+    auto const self = check(L, 1);
+    int const top = lua_gettop(L);
+    std::vector<search::Pattern> needles;
+
+    for (int i = 2; i <= top; i++) {
+        needles.emplace_back(checkNeedle(L, i));
+    }
+
+    return search::all(*self, needles)->push(L);
+}
+
+int hc::Memory::l_search(lua_State* L) {
+    auto const self = check(L, 1);
+    int const top = lua_gettop(L);
+    std::vector<search::Pattern> patterns(top > 1 ? top - 1 : 0);
+
+    for (int i = 2; i <= top; i++) {
+        char const* const text = luaL_checkstring(L, i);
+
+        if (!patterns[i - 2].parse(text)) {
+            return luaL_error(L, "invalid pattern \"%s\"", text);
+        }
+    }
+
+    return search::all(*self, patterns)->push(L);
+}
+
 int hc::Memory::l_snapshot(lua_State* L) {
     auto const self = check(L, 1);
     auto const snapshot = new Snapshot(self);
     return snapshot->push(L);
 }
 
+int hc::Memory::l_highlight(lua_State* L) {
+    auto const self = check(L, 1);
+    Set const* const set = lua_isnoneornil(L, 2) ? nullptr : Set::check(L, 2);
+
+    if (!self->highlight(set)) {
+        return luaL_error(L, "memory \"%s\" cannot be highlighted", self->name());
+    }
+
+    return 0;
+}
+
+int hc::Memory::l_collect(lua_State* L) {
+    auto const self = *static_cast<Memory**>(lua_touserdata(L, 1));
+    self->onCollected();
+    return 0;
+}
+
 void hc::MemorySelector::init() {
 #ifdef HC_DEBUG_MEMORY_ENABLED
-    add(new DebugMemory());
+    add(new ::DebugMemory());
 #endif
 }
 
@@ -328,6 +407,40 @@ void hc::MemorySelector::add(Memory* memory) {
     _regions.emplace_back(memory);
 }
 
+void hc::MemorySelector::highlight(Handle<Memory*> const& handle, Set const* set) {
+    Memory* const* const memptr = translate(handle);
+
+    if (memptr == nullptr) {
+        return;
+    }
+
+    if (set != nullptr) {
+        _highlights[(*memptr)->id()].reset(new Set(*set));
+    }
+    else {
+        _highlights.erase((*memptr)->id());
+    }
+}
+
+hc::Set const* hc::MemorySelector::highlighted(Memory const* memory) const {
+    auto const found = _highlights.find(memory->id());
+    return found != _highlights.end() ? found->second.get() : nullptr;
+}
+
+void hc::MemorySelector::setLog(Memory const* const memory, CodeDataLog const* const log) {
+    if (log != nullptr) {
+        _logs[memory] = log;
+    }
+    else {
+        _logs.erase(memory);
+    }
+}
+
+hc::CodeDataLog const* hc::MemorySelector::log(Memory const* const memory) const {
+    auto const found = _logs.find(memory);
+    return found != _logs.end() ? found->second : nullptr;
+}
+
 bool hc::MemorySelector::select(char const* const label, int* const selected, Handle<Memory*>* const handle) {
     static auto const getter = [](void* const data, int const idx, char const** const text) -> bool {
         auto const regions = static_cast<std::vector<Memory*> const*>(data);
@@ -367,7 +480,7 @@ char const* hc::MemorySelector::getTitle() {
 
 void hc::MemorySelector::onFrame() {
 #ifdef HC_DEBUG_MEMORY_ENABLED
-    static_cast<DebugMemory*>(_regions[0])->tick();
+    static_cast<::DebugMemory*>(_regions[0])->tick();
 #endif
 }
 
@@ -375,6 +488,7 @@ void hc::MemorySelector::onDraw() {
     Handle<Memory*> handle;
 
     if (select(ICON_FA_EYE " View", &_selected, &handle)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
         MemoryWatch* watch = new MemoryWatch(_desktop, handle, this);
         _desktop->addView(watch, false, true);
     }
@@ -383,6 +497,8 @@ void hc::MemorySelector::onDraw() {
 void hc::MemorySelector::onGameUnloaded() {
     _selected = 0;
     _handleAllocator.reset();
+    _highlights.clear();
+    _logs.clear();
 
 #ifdef HC_DEBUG_MEMORY_ENABLED
     _regions.erase(_regions.begin() + 1, _regions.end());
@@ -427,6 +543,15 @@ hc::MemoryWatch::MemoryWatch(Desktop* desktop, Handle<Memory*> handle, MemorySel
     : View(desktop)
     , _handle(handle)
     , _selector(selector)
+    , _memory(nullptr)
+    , _log(nullptr)
+    , _base(0)
+    , _size(0)
+    , _readMin(0)
+    , _readMax(0)
+    , _bytesOffset(0)
+    , _previewOffset(SIZE_MAX)
+    , _overlay(Overlay::Highlight)
 {
     Memory* const* const memptr = selector->translate(handle);
     Memory* const memory = *memptr;
@@ -440,16 +565,39 @@ hc::MemoryWatch::MemoryWatch(Desktop* desktop, Handle<Memory*> handle, MemorySel
     _editor.OptFooterExtraHeight = ImGui::GetTextLineHeight() * 5.0f;
     _editor.ReadOnly = memory->readonly();
 
+    // The editor data is the watch itself, it reads the bytes copied in onSync
     _editor.ReadFn = [](const ImU8* data, size_t off) -> ImU8 {
-        auto const region = reinterpret_cast<Memory const*>(data);
-        return region->peek(region->base() + off);
+        auto const self = reinterpret_cast<MemoryWatch*>(const_cast<ImU8*>(data));
+        return self->read(off);
     };
 
     _editor.WriteFn = [](ImU8* data, size_t off, ImU8 d) -> void {
-        auto region = reinterpret_cast<Memory*>(data);
-        region->poke(region->base() + off, d);
+        auto const self = reinterpret_cast<MemoryWatch*>(data);
+
+        std::lock_guard<std::mutex> lock(self->_desktop->emulationLock());
+        self->_memory->poke(self->_base + off, d);
+
+        if (off - self->_bytesOffset < self->_bytes.size()) {
+            self->_bytes[off - self->_bytesOffset] = d;
+        }
+    };
+
+    // Only called for the visible cells
+    _editor.HighlightFn = [](const ImU8* data, size_t off) -> bool {
+        static uint8_t const flags[] = {0, CodeDataLog::Code, CodeDataLog::Data, CodeDataLog::Written};
+
+        auto const self = reinterpret_cast<MemoryWatch const*>(data);
+        size_t const index = off - self->_bytesOffset;
+
+        if (self->_overlay != Overlay::Highlight) {
+            return index < self->_flags.size() && (self->_flags[index] & flags[static_cast<int>(self->_overlay)]) != 0;
+        }
+
+        return index < self->_highlighted.size() && self->_highlighted[index] != 0;
     };
 
+    _highlightColor = _editor.HighlightColor;
+
     _lastPreviewAddress = (size_t)-1;
     _lastEndianess = -1;
     _lastType = ImGuiDataType_COUNT;
@@ -459,6 +607,18 @@ char const* hc::MemoryWatch::getTitle() {
     return _title.c_str();
 }
 
+uint8_t hc::MemoryWatch::read(size_t const offset) {
+    if (_previewOffset != SIZE_MAX && offset - _previewOffset < PreviewBytes) {
+        return _previewBytes[offset - _previewOffset];
+    }
+
+    _readMin = std::min(_readMin, offset);
+    _readMax = std::max(_readMax, offset);
+
+    size_t const index = offset - _bytesOffset;
+    return index < _bytes.size() ? _bytes[index] : 0;
+}
+
 void hc::MemoryWatch::onFrame() {
     static uint8_t sizes[ImGuiDataType_COUNT] = {1, 1, 2, 2, 4, 4, 8, 8, 4, 8};
 
@@ -470,20 +630,10 @@ void hc::MemoryWatch::onFrame() {
 
     Memory* const memory = *memptr;
 
-    if (_editor.DataPreviewAddr != (size_t)-1) {
-        bool const clearSparkline = _lastPreviewAddress != _editor.DataPreviewAddr ||
-                                    _lastEndianess != _editor.PreviewEndianess ||
-                                    _lastType != _editor.PreviewDataType;
-
-        if (clearSparkline) {
-            _sparkline.clear();
-            _lastPreviewAddress = _editor.DataPreviewAddr;
-            _lastEndianess = _editor.PreviewEndianess;
-            _lastType = _editor.PreviewDataType;
-        }
-
-        uint64_t address = _editor.DataPreviewAddr + memory->base();
-        uint64_t const size = sizes[_editor.PreviewDataType];
+    // The preview is copied from the editor in onSync
+    if (_lastPreviewAddress != (size_t)-1) {
+        uint64_t address = _lastPreviewAddress + memory->base();
+        uint64_t const size = sizes[_lastType];
         uint64_t value = 0;
 
         switch (size) {
@@ -497,7 +647,7 @@ void hc::MemoryWatch::onFrame() {
             case 1: value = value << 8 | memory->peek(address++);
         }
 
-        if (_editor.PreviewEndianess == 0) {
+        if (_lastEndianess == 0) {
             uint64_t le = 0;
             uint8_t* dest = (uint8_t*)&le;
             uint8_t* source = (uint8_t*)&value + size;
@@ -516,32 +666,124 @@ void hc::MemoryWatch::onFrame() {
             value = le;
         }
 
-        if (_editor.PreviewDataType == ImGuiDataType_Float) {
+        // Frames run faster than the UI draws when fast forwarding, keep only the most recent samples
+        if (_samples.size() >= SparklineCount) {
+            _samples.erase(_samples.begin());
+        }
+
+        if (_lastType == ImGuiDataType_Float) {
             float val;
             memcpy(&val, &value, sizeof(val));
-            _sparkline.add(val);
+            _samples.push_back(val);
         }
-        else if (_editor.PreviewDataType == ImGuiDataType_Double) {
+        else if (_lastType == ImGuiDataType_Double) {
             double val;
             memcpy(&val, &value, sizeof(val));
-            _sparkline.add(static_cast<float>(val));
+            _samples.push_back(static_cast<float>(val));
         }
         else {
-            _sparkline.add(static_cast<float>(value));
+            _samples.push_back(static_cast<float>(value));
         }
     }
 }
 
-void hc::MemoryWatch::onDraw() {
+void hc::MemoryWatch::onSync() {
     Memory* const* const memptr = _selector->translate(_handle);
 
     if (memptr == nullptr) {
-        _desktop->removeView(this);
+        if (_memory != nullptr) {
+            _desktop->removeView(this);
+            _memory = nullptr;
+        }
+
         return;
     }
 
     Memory* const memory = *memptr;
+    _memory = memory;
+    _log = _selector->log(memory);
+    _base = memory->base();
+    _size = memory->size();
+
+    bool const clearSparkline = _lastPreviewAddress != _editor.DataPreviewAddr ||
+                                _lastEndianess != _editor.PreviewEndianess ||
+                                _lastType != _editor.PreviewDataType;
+
+    if (clearSparkline) {
+        _sparkline.clear();
+        _lastPreviewAddress = _editor.DataPreviewAddr;
+        _lastEndianess = _editor.PreviewEndianess;
+        _lastType = _editor.PreviewDataType;
+    }
+    else {
+        for (auto const sample : _samples) {
+            _sparkline.add(sample);
+        }
+    }
+
+    _samples.clear();
+
+    size_t const begin = _readMin >= SyncMargin ? _readMin - SyncMargin : 0;
+    size_t const end = static_cast<size_t>(std::min(static_cast<uint64_t>(_readMax) + 1 + SyncMargin, _size));
+
+    _bytesOffset = begin;
+    _bytes.resize(end > begin ? end - begin : 0);
+    memory->read(_base + begin, _bytes.data(), _bytes.size());
+
+    _flags.resize(_log != nullptr ? _bytes.size() : 0);
+
+    for (size_t i = 0; i < _flags.size(); i++) {
+        _flags[i] = _log->flags(_base + begin + i);
+    }
+
+    Set const* const highlight = _selector->highlighted(memory);
+    _highlighted.resize(highlight != nullptr ? _bytes.size() : 0);
+
+    for (size_t i = 0; i < _highlighted.size(); i++) {
+        _highlighted[i] = highlight->contains(_base + begin + i);
+    }
+
+    _previewOffset = _editor.DataPreviewAddr;
+
+    if (_previewOffset < _size) {
+        uint64_t const count = std::min(static_cast<uint64_t>(PreviewBytes), _size - _previewOffset);
+        memory->read(_base + _previewOffset, _previewBytes, count);
+    }
+    else {
+        _previewOffset = SIZE_MAX;
+    }
+}
+
+void hc::MemoryWatch::onDraw() {
+    if (_memory == nullptr) {
+        return;
+    }
+
+    if (_log != nullptr) {
+        static ImU32 const colors[] = {0, IM_COL32(255, 96, 96, 96), IM_COL32(96, 255, 96, 96), IM_COL32(96, 160, 255, 96)};
+
+        int overlay = static_cast<int>(_overlay);
+        ImGui::Combo("Overlay", &overlay, "Highlight\0Executed\0Read\0Written\0");
+        _overlay = static_cast<Overlay>(overlay);
+        _editor.HighlightColor = _overlay == Overlay::Highlight ? _highlightColor : colors[overlay];
+    }
+    else {
+        _overlay = Overlay::Highlight;
+        _editor.HighlightColor = _highlightColor;
+    }
+
+    size_t const readMin = _readMin;
+    size_t const readMax = _readMax;
+    _readMin = SIZE_MAX;
+    _readMax = 0;
+
+    _editor.DrawContents(this, _size, _base);
+
+    // Keep the last range if the editor didn't read anything
+    if (_readMin > _readMax) {
+        _readMin = readMin;
+        _readMax = readMax;
+    }
 
-    _editor.DrawContents(memory, memory->size(), memory->base());
     _sparkline.draw("#sparkline", ImGui::GetContentRegionAvail());
 }
@@ -4,6 +4,7 @@
 #include "PeekPoke.h"
 #include "Scriptable.h"
 #include "Handle.h"
+#include "cheats/Set.h"
 
 #include <imgui.h>
 #include <imgui_memory_editor.h>
@@ -15,12 +16,16 @@ extern "C" {
 
 #include <string>
 #include <vector>
+#include <map>
+#include <memory>
 
 extern "C" {
     #include <lauxlib.h>
 }
 
 namespace hc {
+    class CodeDataLog;
+
     class Memory : public MemoryPeek<Memory>, public MemoryPoke<Memory>, public Scriptable {
     public:
         virtual ~Memory() {}
@@ -33,6 +38,16 @@ namespace hc {
         virtual uint8_t peek(uint64_t address) const = 0;
         virtual void poke(uint64_t address, uint8_t value) = 0;
 
+        // Bulk access, implementations should override these when they can do better than one peek per byte
+        virtual void read(uint64_t address, void* buffer, uint64_t size) const;
+        virtual uint8_t const* span(uint64_t address, uint64_t size) const;
+
+        // Called when the Lua value created by push is garbage collected
+        virtual void onCollected() {}
+
+        // Highlights the addresses in set in the views of this memory, returns false if it isn't viewable
+        virtual bool highlight(Set const* set) { (void)set; return false; }
+
         unsigned requiredDigits();
         bool find(uint64_t* start, uint8_t const* bytes, size_t length);
 
@@ -51,7 +66,11 @@ namespace hc {
         static int l_peek(lua_State* L);
         static int l_poke(lua_State* L);
         static int l_find(lua_State* L);
+        static int l_findAll(lua_State* L);
+        static int l_search(lua_State* L);
         static int l_snapshot(lua_State* L);
+        static int l_highlight(lua_State* L);
+        static int l_collect(lua_State* L);
     };
 
     class MemorySelector : public View, public Scriptable {
@@ -65,6 +84,14 @@ namespace hc {
         bool select(char const* label, int* selected, Handle<Memory*>* handle);
         Memory* const* translate(Handle<Memory*> const& handle) const { return _handleAllocator.translate(handle); }
 
+        // The set is copied, nullptr removes the highlight
+        void highlight(Handle<Memory*> const& handle, Set const* set);
+        Set const* highlighted(Memory const* memory) const;
+
+        // Shown as an overlay in the watches of the memory, nullptr removes it
+        void setLog(Memory const* memory, CodeDataLog const* log);
+        CodeDataLog const* log(Memory const* memory) const;
+
         static MemorySelector* check(lua_State* L, int index);
 
         // hc::View
@@ -81,6 +108,9 @@ namespace hc {
 
         HandleAllocator<Memory*> _handleAllocator;
         std::vector<Memory*> _regions;
+        // Keyed by id, a memory allocated where a freed one was must not inherit its highlights
+        std::map<std::string, std::unique_ptr<Set const>> _highlights;
+        std::map<Memory const*, CodeDataLog const*> _logs;
         int _selected;
     };
 
@@ -92,19 +122,53 @@ namespace hc {
         // hc::View
         virtual char const* getTitle() override;
         virtual void onFrame() override;
+        virtual void onSync() override;
         virtual void onDraw() override;
 
     protected:
         enum {
-            SparklineCount = 512
+            SparklineCount = 512,
+            // Bytes copied in onSync around the ones the editor read the last time, so scrolling doesn't show zeroes
+            SyncMargin = 4096,
+            PreviewBytes = 8
         };
 
+        uint8_t read(size_t const offset);
+
         std::string _title;
         Handle<Memory*> const _handle;
         MemorySelector* const _selector;
         MemoryEditor _editor;
 
+        enum class Overlay : int {
+            Highlight,
+            Code,
+            Data,
+            Written
+        };
+
+        // Set in onSync, valid only while drawing
+        Memory* _memory;
+        CodeDataLog const* _log;
+        uint64_t _base;
+        uint64_t _size;
+
+        // The offsets the editor read in the last draw, and the bytes, log flags and highlights copied around them
+        size_t _readMin;
+        size_t _readMax;
+        size_t _bytesOffset;
+        std::vector<uint8_t> _bytes;
+        std::vector<uint8_t> _flags;
+        std::vector<uint8_t> _highlighted;
+        size_t _previewOffset;
+        uint8_t _previewBytes[PreviewBytes];
+
+        Overlay _overlay;
+        ImU32 _highlightColor;
+
+        // The preview is sampled by onFrame on the emulation thread, the values are added to the sparkline in onSync
         ImGuiAl::BufferedSparkline<SparklineCount> _sparkline;
+        std::vector<float> _samples;
         size_t _lastPreviewAddress;
         int _lastEndianess;
         ImGuiDataType _lastType;
@@ -0,0 +1,290 @@
+#include "Pacer.h"
+#include "Perf.h"
+#include "Video.h"
+
+#include <IconsFontAwesome4.h>
+
+extern "C" {
+    #include "lauxlib.h"
+}
+
+#include <float.h>
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#define TAG "[PAC] "
+
+hc::Pacer::Pacer(Desktop* desktop)
+    : View(desktop)
+    , _video(nullptr)
+    , _displayRate(0.0)
+    , _displaySync(false)
+    , _maxCatchUp(3)
+    , _period(1000000000.0 / 60.0)
+    , _origin(0)
+    , _frame(0)
+    , _next(0)
+    , _last(0)
+{
+    reset();
+}
+
+void hc::Pacer::init(Video const* const video) {
+    _video = video;
+}
+
+bool hc::Pacer::due(uint64_t* const deadline) {
+    uint64_t const now = Perf::getTimeNs();
+
+    if (now < _next) {
+        *deadline = _next;
+        return false;
+    }
+
+    // Too far behind after a stall, restart the schedule instead of running a burst of frames
+    if (now - _next > _maxCatchUp * _period) {
+        _origin = now;
+        _frame = 0;
+        _restarts++;
+    }
+
+    if (_last != 0) {
+        uint64_t const interval = now - _last;
+        uint64_t const bucket = interval / (BucketUs * 1000);
+
+        _histogram[bucket < BucketCount ? bucket : BucketCount - 1]++;
+        _recent[_recentIndex] = interval / 1000000.0f;
+        _recentIndex = (_recentIndex + 1) % RecentCount;
+
+        _count++;
+        _sum += interval;
+        _sumSquares += static_cast<double>(interval) * interval;
+        _max = interval > _max ? interval : _max;
+        _late += interval > _period * 1.5;
+    }
+
+    _last = now;
+    _frame++;
+    _next = _origin + static_cast<uint64_t>(_frame * _period);
+    return true;
+}
+
+void hc::Pacer::skipMissed() {
+    uint64_t const now = Perf::getTimeNs();
+
+    if (now > _next) {
+        _origin = _next = now;
+        _frame = 0;
+    }
+}
+
+void hc::Pacer::waitUntil(uint64_t const deadline) {
+    for (;;) {
+        uint64_t const now = Perf::getTimeNs();
+
+        if (now >= deadline) {
+            return;
+        }
+
+        uint64_t const left = deadline - now;
+
+        if (left > SpinNs) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(left - SpinNs));
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+char const* hc::Pacer::getTitle() {
+    return ICON_FA_CLOCK_O " Pacing";
+}
+
+void hc::Pacer::onGameStarted() {
+    start();
+}
+
+void hc::Pacer::onGameResumed() {
+    start();
+}
+
+void hc::Pacer::onSync() {
+    _shown.displayRate = _displayRate;
+    _shown.displaySync = _displaySync;
+    _shown.maxCatchUp = _maxCatchUp;
+    _shown.period = _period;
+
+    for (unsigned i = 0; i < BucketCount; i++) {
+        _shown.histogram[i] = static_cast<float>(_histogram[i]);
+    }
+
+    memcpy(_shown.recent, _recent, sizeof(_shown.recent));
+    _shown.recentIndex = _recentIndex;
+
+    _shown.mean = _count != 0 ? _sum / _count : 0.0;
+    _shown.variance = _count != 0 ? _sumSquares / _count - _shown.mean * _shown.mean : 0.0;
+    _shown.max = _max;
+    _shown.late = _late;
+    _shown.restarts = _restarts;
+}
+
+void hc::Pacer::onDraw() {
+    if (ImGui::Checkbox("Sync to display", &_shown.displaySync)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _displaySync = _shown.displaySync;
+        start();
+    }
+
+    ImGui::SameLine();
+
+    if (_shown.displayRate > 0.0) {
+        ImGui::Text("%.2f Hz display, %.3f ms frame period", _shown.displayRate, _shown.period / 1000000.0);
+    }
+    else {
+        ImGui::Text("Unknown display rate, %.3f ms frame period", _shown.period / 1000000.0);
+    }
+
+    if (ImGui::SliderInt("Max catch-up", &_shown.maxCatchUp, 0, 10, "%d frames")) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _maxCatchUp = _shown.maxCatchUp;
+    }
+
+    ImGui::Text(
+        "Mean %.3f ms, jitter %.3f ms, max %.3f ms",
+        _shown.mean / 1000000.0, sqrt(_shown.variance > 0.0 ? _shown.variance : 0.0) / 1000000.0, _shown.max / 1000000.0
+    );
+
+    ImGui::Text("%" PRIu64 " late frames, %" PRIu64 " restarts", _shown.late, _shown.restarts);
+
+    ImGui::SameLine();
+
+    if (ImGui::Button(ICON_FA_REFRESH " Reset")) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        reset();
+    }
+
+    ImVec2 const avail = ImGui::GetContentRegionAvail();
+    ImVec2 const size = ImVec2(avail.x, avail.y / 2.0f - ImGui::GetStyle().ItemSpacing.y);
+
+    if (size.y > 0.0f) {
+        float const period = static_cast<float>(_shown.period / 1000000.0);
+        ImGui::PlotLines("##Recent", _shown.recent, RecentCount, _shown.recentIndex, "Frame time (ms)", 0.0f, period * 2.0f, size);
+        ImGui::PlotHistogram("##Histogram", _shown.histogram, BucketCount, 0, "Frame time histogram, 0.5 ms buckets", FLT_MAX, FLT_MAX, size);
+    }
+}
+
+void hc::Pacer::onGameUnloaded() {
+    reset();
+}
+
+void hc::Pacer::start() {
+    double fps = _video->getCoreFps();
+
+    if (fps <= 0.0) {
+        fps = 60.0;
+    }
+
+    // Run at the display rate when it's within 1% of the game's, so frames are shown at a steady cadence,
+    // the audio rate control absorbs the difference
+    if (_displaySync && _displayRate > 0.0 && fabs(fps - _displayRate) / _displayRate < 0.01) {
+        fps = _displayRate;
+    }
+
+    _period = 1000000000.0 / fps;
+    _origin = _next = Perf::getTimeNs();
+    _frame = 0;
+    _last = 0;
+}
+
+void hc::Pacer::reset() {
+    memset(_histogram, 0, sizeof(_histogram));
+    memset(_recent, 0, sizeof(_recent));
+    _recentIndex = 0;
+    _count = 0;
+    _sum = _sumSquares = 0.0;
+    _max = 0;
+    _late = 0;
+    _restarts = 0;
+}
+
+int hc::Pacer::push(lua_State* const L) {
+    auto const self = static_cast<Pacer**>(lua_newuserdata(L, sizeof(Pacer*)));
+    *self = this;
+
+    if (luaL_newmetatable(L, "hc::Pacer")) {
+        static luaL_Reg const methods[] = {
+            {"getHistogram", l_getHistogram},
+            {"getStats", l_getStats},
+            {"reset", l_reset},
+            {nullptr, nullptr}
+        };
+
+        luaL_newlib(L, methods);
+        lua_setfield(L, -2, "__index");
+    }
+
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+hc::Pacer* hc::Pacer::check(lua_State* const L, int const index) {
+    return *static_cast<Pacer**>(luaL_checkudata(L, index, "hc::Pacer"));
+}
+
+int hc::Pacer::l_getHistogram(lua_State* const L) {
+    auto const self = check(L, 1);
+
+    lua_createtable(L, BucketCount, 1);
+
+    for (unsigned i = 0; i < BucketCount; i++) {
+        lua_pushinteger(L, static_cast<lua_Integer>(self->_histogram[i]));
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    lua_pushinteger(L, BucketUs);
+    lua_setfield(L, -2, "bucketUs");
+
+    return 1;
+}
+
+int hc::Pacer::l_getStats(lua_State* const L) {
+    auto const self = check(L, 1);
+
+    double const mean = self->_count != 0 ? self->_sum / self->_count : 0.0;
+    double const variance = self->_count != 0 ? self->_sumSquares / self->_count - mean * mean : 0.0;
+
+    lua_createtable(L, 0, 7);
+
+    lua_pushnumber(L, self->_period / 1000.0);
+    lua_setfield(L, -2, "periodUs");
+
+    lua_pushinteger(L, static_cast<lua_Integer>(self->_count));
+    lua_setfield(L, -2, "frames");
+
+    lua_pushnumber(L, mean / 1000.0);
+    lua_setfield(L, -2, "meanUs");
+
+    lua_pushnumber(L, sqrt(variance > 0.0 ? variance : 0.0) / 1000.0);
+    lua_setfield(L, -2, "jitterUs");
+
+    lua_pushnumber(L, self->_max / 1000.0);
+    lua_setfield(L, -2, "maxUs");
+
+    lua_pushinteger(L, static_cast<lua_Integer>(self->_late));
+    lua_setfield(L, -2, "late");
+
+    lua_pushinteger(L, static_cast<lua_Integer>(self->_restarts));
+    lua_setfield(L, -2, "restarts");
+
+    return 1;
+}
+
+int hc::Pacer::l_reset(lua_State* const L) {
+    auto const self = check(L, 1);
+    self->reset();
+    return 0;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Desktop.h"
+#include "Scriptable.h"
+
+#include <stdint.h>
+
+namespace hc {
+    // Schedules the game frames against a monotonic clock. Frame times are computed from the time the
+    // schedule started so rounding errors don't accumulate, and a stall only causes a limited burst of
+    // frames to catch up before the schedule restarts.
+    class Pacer : public View, public Scriptable {
+    public:
+        Pacer(Desktop* desktop);
+        virtual ~Pacer() {}
+
+        void init(Video const* const video);
+
+        // The refresh rate of the display showing the game, 0 if unknown
+        void setDisplayRate(double const hz) { _displayRate = hz; }
+
+        // Returns true if a frame must be run now, otherwise sets deadline to when the next one is due
+        bool due(uint64_t* const deadline);
+        // Restarts the schedule if it's behind, for when running late is expected
+        void skipMissed();
+        uint64_t getFramePeriodNs() const { return static_cast<uint64_t>(_period); }
+
+        // Sleeps until close to the deadline and spins the rest, sleeping alone is only precise to a
+        // millisecond or so
+        static void waitUntil(uint64_t const deadline);
+
+        static Pacer* check(lua_State* const L, int const index);
+
+        // hc::View
+        virtual char const* getTitle() override;
+        virtual void onGameStarted() override;
+        virtual void onGameResumed() override;
+        virtual void onSync() override;
+        virtual void onDraw() override;
+        virtual void onGameUnloaded() override;
+
+        // hc::Scriptable
+        virtual int push(lua_State* const L) override;
+
+    protected:
+        enum {
+            // Spin for the last part of the wait
+            SpinNs = 1500000,
+            BucketUs = 500,
+            BucketCount = 100,
+            RecentCount = 240
+        };
+
+        void start();
+        void reset();
+
+        static int l_getHistogram(lua_State* const L);
+        static int l_getStats(lua_State* const L);
+        static int l_reset(lua_State* const L);
+
+        Video const* _video;
+        double _displayRate;
+        bool _displaySync;
+        int _maxCatchUp;
+
+        double _period;
+        uint64_t _origin;
+        uint64_t _frame;
+        uint64_t _next;
+        uint64_t _last;
+
+        // Time between the starts of consecutive frames, as a histogram and as the most recent ones
+        uint64_t _histogram[BucketCount];
+        float _recent[RecentCount];
+        unsigned _recentIndex;
+        uint64_t _count;
+        double _sum;
+        double _sumSquares;
+        uint64_t _max;
+        uint64_t _late;
+        uint64_t _restarts;
+
+        // Copied in onSync, the schedule and the statistics are updated by the emulation thread
+        struct {
+            double displayRate;
+            bool displaySync;
+            int maxCatchUp;
+            double period;
+            float histogram[BucketCount];
+            float recent[RecentCount];
+            unsigned recentIndex;
+            double mean;
+            double variance;
+            uint64_t max;
+            uint64_t late;
+            uint64_t restarts;
+        }
+        _shown;
+    };
+}
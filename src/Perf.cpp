@@ -15,12 +15,12 @@ extern "C" {
 void hc::Perf::init() {}
 
 uint64_t hc::Perf::getTimeUs() {
-    auto const now_us = std::chrono::time_point_cast<std::chrono::microseconds>(std::chrono::system_clock::now());
+    auto const now_us = std::chrono::time_point_cast<std::chrono::microseconds>(std::chrono::steady_clock::now());
     return static_cast<int64_t>(now_us.time_since_epoch().count());
 }
 
 uint64_t hc::Perf::getTimeNs() {
-    auto const now_ns = std::chrono::time_point_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now());
+    auto const now_ns = std::chrono::time_point_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now());
     return static_cast<uint64_t>(now_ns.time_since_epoch().count());
 }
 
@@ -28,19 +28,49 @@ char const* hc::Perf::getTitle() {
     return ICON_FA_TASKS " Perf";
 }
 
-void hc::Perf::onDraw() {
-    ImGui::Text("       %7.3f (fps) application", _desktop->drawFps());
-    ImGui::Text("       %7.3f (fps) game", _desktop->frameFps());
+void hc::Perf::onSync() {
+    _drawFps = _desktop->drawFps();
+    _frameFps = _desktop->frameFps();
+
+    _shownCounters.resize(_counters.size());
+    size_t i = 0;
 
     for (const auto& pair : _counters) {
         Counter const& cnt = pair.second;
+        Shown& shown = _shownCounters[i++];
 
-        uint64_t const nsPerCall = cnt.counter->call_cnt != 0 ? cnt.counter->total / cnt.counter->call_cnt : 0;
+        shown.ident = cnt.counter->ident;
+        shown.value = cnt.counter->total;
+        shown.calls = cnt.counter->call_cnt;
+    }
+
+    _shownMemory.resize(_memory.size());
+    i = 0;
+
+    for (auto const& pair : _memory) {
+        Shown& shown = _shownMemory[i++];
+
+        shown.ident = pair.first;
+        shown.value = *pair.second;
+        shown.calls = 0;
+    }
+}
+
+void hc::Perf::onDraw() {
+    ImGui::Text("       %7.3f (fps) application", _drawFps);
+    ImGui::Text("       %7.3f (fps) game", _frameFps);
+
+    for (auto const& shown : _shownCounters) {
+        uint64_t const nsPerCall = shown.calls != 0 ? shown.value / shown.calls : 0;
         uint64_t const usPerCall = nsPerCall / 1000;
         unsigned const ms = usPerCall / 1000;
         unsigned const us = usPerCall - ms * 1000;
 
-        ImGui::Text("%6" PRIu64 " %3u.%03u (ms)  %s", cnt.counter->call_cnt, ms, us, cnt.counter->ident);
+        ImGui::Text("%6" PRIu64 " %3u.%03u (ms)  %s", shown.calls, ms, us, shown.ident.c_str());
+    }
+
+    for (auto const& shown : _shownMemory) {
+        ImGui::Text("       %7.2f (MiB) %s", shown.value / 1048576.0, shown.ident.c_str());
     }
 }
 
@@ -55,6 +85,7 @@ void hc::Perf::onCoreUnloaded() {
     }
 
     _counters.clear();
+    _memory.clear();
 }
 
 retro_time_t hc::Perf::getTimeUsec() {
@@ -84,6 +115,10 @@ void hc::Perf::register_(retro_perf_counter* counter) {
     }
 }
 
+void hc::Perf::registerMemory(char const* const ident, size_t const* const bytes) {
+    _memory[ident] = bytes;
+}
+
 void hc::Perf::start(retro_perf_counter* counter) {
     const retro_perf_tick_t tick = getCounter();
     counter->start = tick;
@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace hc
 {
@@ -18,13 +19,18 @@ namespace hc
 
         void init();
 
+        // Monotonic, only meaningful as differences
         static uint64_t getTimeUs();
         static uint64_t getTimeNs();
 
+        // Shows the bytes allocated by a component along with the counters, until the core is unloaded
+        void registerMemory(char const* const ident, size_t const* const bytes);
+
         static Perf* check(lua_State* const L, int const index);
 
         // hc::View
         virtual char const* getTitle() override;
+        virtual void onSync() override;
         virtual void onDraw() override;
         virtual void onCoreUnloaded() override;
 
@@ -54,5 +60,18 @@ namespace hc
         };
 
         std::unordered_map<std::string, Counter> _counters;
+        std::unordered_map<std::string, size_t const*> _memory;
+
+        // Copied in onSync, the counters are updated by the emulation thread
+        struct Shown {
+            std::string ident;
+            uint64_t value;
+            uint64_t calls;
+        };
+
+        double _drawFps;
+        double _frameFps;
+        std::vector<Shown> _shownCounters;
+        std::vector<Shown> _shownMemory;
     };
 }
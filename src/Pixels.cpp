@@ -0,0 +1,128 @@
+#include "Pixels.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Expands 5 and 6 bit components to 8 bits by replicating their high bits in the low ones
+static inline uint32_t expand5(uint32_t const c) { return c << 3 | c >> 2; }
+static inline uint32_t expand6(uint32_t const c) { return c << 2 | c >> 4; }
+
+#ifdef __SSE2__
+// Interleaves 8 16-bit blue and green pairs with 8 red values into 8 0xffRRGGBB pixels
+static inline void store8(uint32_t* const dest, __m128i const b, __m128i const g, __m128i const r) {
+    __m128i const bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+    __m128i const ra = _mm_or_si128(r, _mm_set1_epi16(static_cast<short>(0xff00)));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 4), _mm_unpackhi_epi16(bg, ra));
+}
+#endif
+
+void hc::pixels::convertRgb565(uint32_t* dest, uint16_t const* source, size_t count) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    __m128i const mask3 = _mm_set1_epi16(0x03);
+    __m128i const mask7 = _mm_set1_epi16(0x07);
+    __m128i const maskf8 = _mm_set1_epi16(0xf8);
+    __m128i const maskfc = _mm_set1_epi16(0xfc);
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i const p = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + i));
+
+        // rrrrrggg gggbbbbb
+        __m128i const r = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(p, 8), maskf8), _mm_and_si128(_mm_srli_epi16(p, 13), mask7));
+        __m128i const g = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(p, 3), maskfc), _mm_and_si128(_mm_srli_epi16(p, 9), mask3));
+        __m128i const b = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(p, 3), maskf8), _mm_and_si128(_mm_srli_epi16(p, 2), mask7));
+
+        store8(dest + i, b, g, r);
+    }
+#endif
+
+    for (; i < count; i++) {
+        uint32_t const p = source[i];
+        dest[i] = UINT32_C(0xff000000) | expand5(p >> 11) << 16 | expand6(p >> 5 & 0x3f) << 8 | expand5(p & 0x1f);
+    }
+}
+
+void hc::pixels::convert0Rgb1555(uint32_t* dest, uint16_t const* source, size_t count) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    __m128i const mask7 = _mm_set1_epi16(0x07);
+    __m128i const maskf8 = _mm_set1_epi16(0xf8);
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i const p = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + i));
+
+        // xrrrrrgg gggbbbbb
+        __m128i const r = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(p, 7), maskf8), _mm_and_si128(_mm_srli_epi16(p, 12), mask7));
+        __m128i const g = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(p, 2), maskf8), _mm_and_si128(_mm_srli_epi16(p, 7), mask7));
+        __m128i const b = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(p, 3), maskf8), _mm_and_si128(_mm_srli_epi16(p, 2), mask7));
+
+        store8(dest + i, b, g, r);
+    }
+#endif
+
+    for (; i < count; i++) {
+        uint32_t const p = source[i];
+        dest[i] = UINT32_C(0xff000000) | expand5(p >> 10 & 0x1f) << 16 | expand5(p >> 5 & 0x1f) << 8 | expand5(p & 0x1f);
+    }
+}
+
+void hc::pixels::convertXrgb8888(uint32_t* dest, uint32_t const* source, size_t count) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    __m128i const alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i const p = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_or_si128(p, alpha));
+    }
+#endif
+
+    for (; i < count; i++) {
+        dest[i] = source[i] | UINT32_C(0xff000000);
+    }
+}
+
+bool hc::pixels::convert(
+    uint32_t* dest,
+    void const* source,
+    unsigned width,
+    unsigned height,
+    size_t pitch,
+    retro_pixel_format format
+) {
+    auto const bytes = static_cast<uint8_t const*>(source);
+
+    switch (format) {
+        case RETRO_PIXEL_FORMAT_RGB565:
+            for (unsigned y = 0; y < height; y++, dest += width) {
+                convertRgb565(dest, reinterpret_cast<uint16_t const*>(bytes + y * pitch), width);
+            }
+
+            return true;
+
+        case RETRO_PIXEL_FORMAT_0RGB1555:
+            for (unsigned y = 0; y < height; y++, dest += width) {
+                convert0Rgb1555(dest, reinterpret_cast<uint16_t const*>(bytes + y * pitch), width);
+            }
+
+            return true;
+
+        case RETRO_PIXEL_FORMAT_XRGB8888:
+            for (unsigned y = 0; y < height; y++, dest += width) {
+                convertXrgb8888(dest, reinterpret_cast<uint32_t const*>(bytes + y * pitch), width);
+            }
+
+            return true;
+
+        case RETRO_PIXEL_FORMAT_UNKNOWN:
+            break;
+    }
+
+    return false;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <lrcpp/libretro.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hc {
+    namespace pixels {
+        // Converts a frame in any of the libretro pixel formats to tightly
+        // packed 32-bit pixels with 0xAARRGGBB values, which are in BGRA byte
+        // order in memory. Alpha is always 255.
+        bool convert(
+            uint32_t* dest,
+            void const* source,
+            unsigned width,
+            unsigned height,
+            size_t pitch,
+            retro_pixel_format format
+        );
+
+        // Converts a single row of count pixels
+        void convertRgb565(uint32_t* dest, uint16_t const* source, size_t count);
+        void convert0Rgb1555(uint32_t* dest, uint16_t const* source, size_t count);
+        void convertXrgb8888(uint32_t* dest, uint32_t const* source, size_t count);
+    }
+}
@@ -0,0 +1,392 @@
+#include "Profiler.h"
+
+#include <IconsFontAwesome4.h>
+#include <imgui.h>
+
+#include <inttypes.h>
+#include <algorithm>
+#include <map>
+
+#define TAG "[PRF] "
+
+hc::Profiler::Profiler(Cpu* const cpu)
+    : _cpu(cpu)
+    , _base(cpu->mainMemory()->base())
+    , _size(cpu->mainMemory()->size())
+    , _enabled(false)
+    , _period(1)
+    , _steps(0)
+    , _total(0)
+    , _next(0)
+    , _stored(0)
+{}
+
+hc::Profiler::~Profiler() {}
+
+void hc::Profiler::setEnabled(bool const enabled) {
+    // Only allocate the counts for the CPUs being profiled, the emulation thread doesn't look at them
+    // until enabled is set
+    if (enabled && _counts == nullptr) {
+        std::lock_guard<std::mutex> lock(_lock);
+        _counts.reset(new std::atomic<uint32_t>[_size]());
+        _samples.resize(StackSamples);
+    }
+
+    _enabled = enabled;
+}
+
+void hc::Profiler::setPeriod(unsigned const period) {
+    _period = std::min(std::max(period, 1U), static_cast<unsigned>(MaxPeriod));
+}
+
+void hc::Profiler::onStep() {
+    // Counting steps is cheap, walking the stack is not, so a longer period keeps the overhead down
+    if (_enabled && ++_steps >= _period) {
+        _steps = 0;
+        std::lock_guard<std::mutex> lock(_lock);
+        sample();
+    }
+}
+
+void hc::Profiler::reset() {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    if (_counts != nullptr) {
+        for (uint64_t i = 0; i < _size; i++) {
+            _counts[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    _total = 0;
+    _next = 0;
+    _stored = 0;
+}
+
+uint32_t hc::Profiler::count(uint64_t const address) const {
+    uint64_t const offset = address - _base;
+    return _counts != nullptr && offset < _size ? _counts[offset].load(std::memory_order_relaxed) : 0;
+}
+
+void hc::Profiler::recent(std::vector<Sample>* const samples) const {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    samples->clear();
+    samples->reserve(_stored);
+
+    if (_stored == StackSamples) {
+        samples->insert(samples->end(), _samples.begin() + _next, _samples.end());
+    }
+
+    samples->insert(samples->end(), _samples.begin(), _samples.begin() + _next);
+}
+
+void hc::Profiler::sample() {
+    uint64_t const pc = _cpu->programCounter();
+    uint64_t const offset = pc - _base;
+
+    if (offset < _size) {
+        _counts[offset].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Sample& sample = _samples[_next];
+    sample.pc = pc;
+    sample.depth = _cpu->stackWalk(_cpu->mainMemory(), sample.stack, MaxDepth);
+
+    _next = (_next + 1) % StackSamples;
+    _stored += _stored < StackSamples;
+    _total++;
+}
+
+hc::ProfilerView::ProfilerView(Desktop* desktop, Profiler* profiler, Analysis* analysis)
+    : View(desktop)
+    , _valid(true)
+    , _profiler(profiler)
+    , _analysis(analysis)
+    , _draws(RefreshDraws)
+    , _samples(0)
+    , _depth(0)
+{
+    static std::atomic<unsigned> counter;
+
+    _title = ICON_FA_TACHOMETER " ";
+    _title += profiler->cpu()->name();
+    _title += " Profiler##";
+    _title += counter++;
+}
+
+char const* hc::ProfilerView::getTitle() {
+    return _title.c_str();
+}
+
+void hc::ProfilerView::onGameUnloaded() {
+    _valid = false;
+}
+
+void hc::ProfilerView::onSync() {
+    if (!_valid) {
+        return;
+    }
+
+    // Symbolizing every sample is too much work to do on each draw
+    if (++_draws >= RefreshDraws) {
+        refresh();
+        _draws = 0;
+    }
+}
+
+void hc::ProfilerView::onDraw() {
+    if (!_valid) {
+        return;
+    }
+
+    bool enabled = _profiler->isEnabled();
+
+    if (ImGui::Checkbox("Enabled", &enabled)) {
+        _profiler->setEnabled(enabled);
+    }
+
+    ImGui::SameLine();
+    ImGui::TextDisabled("Samples are taken while a trace of this CPU records");
+
+    int period = static_cast<int>(_profiler->getPeriod());
+
+    if (ImGui::InputInt("Period", &period, 1, 100)) {
+        _profiler->setPeriod(static_cast<unsigned>(std::max(period, 1)));
+    }
+
+    ImGui::SameLine();
+    ImGui::TextDisabled("Steps between samples");
+
+    // Functions are found by the analysis, run it again when the profile shows unnamed addresses
+    if (ImGui::Button(ICON_FA_REFRESH " Analyse")) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _analysis->run();
+        _draws = RefreshDraws;
+    }
+
+    ImGui::SameLine();
+
+    if (ImGui::Button(ICON_FA_TRASH " Reset")) {
+        _profiler->reset();
+        _draws = RefreshDraws;
+    }
+
+    ImGui::SameLine();
+    ImGui::Text("%" PRIu64 " samples, %" PRIu64 " recent ones with stacks", _profiler->getTotal(), _samples);
+
+    if (ImGui::CollapsingHeader("Hot functions", ImGuiTreeNodeFlags_DefaultOpen)) {
+        drawTable();
+    }
+
+    if (ImGui::CollapsingHeader("Flame graph", ImGuiTreeNodeFlags_DefaultOpen)) {
+        drawFlameGraph();
+    }
+}
+
+void hc::ProfilerView::refresh() {
+    _functions.clear();
+    _nodes.clear();
+    _samples = 0;
+    _depth = 0;
+
+    if (!_analysis->valid()) {
+        _analysis->run();
+    }
+
+    std::map<uint64_t, size_t> indices;
+
+    auto const function = [&](uint64_t const address) -> Function& {
+        auto const found = indices.find(address);
+
+        if (found != indices.end()) {
+            return _functions[found->second];
+        }
+
+        indices.emplace(address, _functions.size());
+        _functions.push_back(Function{address, 0, 0, {0}});
+        label(address, _functions.back().name, sizeof(_functions.back().name));
+        return _functions.back();
+    };
+
+    uint64_t const base = _profiler->base();
+
+    for (uint64_t offset = 0; offset < _profiler->size(); offset++) {
+        uint32_t const count = _profiler->count(base + offset);
+
+        if (count != 0) {
+            function(symbolize(base + offset)).self += count;
+        }
+    }
+
+    // Stack words are only return addresses if they're right after a call
+    std::vector<uint64_t> returns;
+
+    for (auto const& call : _analysis->calls()) {
+        returns.push_back(call.from + _analysis->length(call.from));
+    }
+
+    std::sort(returns.begin(), returns.end());
+
+    std::vector<Profiler::Sample> samples;
+    _profiler->recent(&samples);
+
+    std::vector<uint64_t> frames;
+    _nodes.push_back(Node{0, 0, {}, "all"});
+
+    for (auto const& sample : samples) {
+        frames.clear();
+        frames.push_back(symbolize(sample.pc));
+
+        for (unsigned i = 0; i < sample.depth; i++) {
+            if (std::binary_search(returns.begin(), returns.end(), sample.stack[i])) {
+                frames.push_back(symbolize(sample.stack[i] - 1));
+            }
+        }
+
+        // Recursive functions count once per sample
+        for (size_t i = 0; i < frames.size(); i++) {
+            if (std::find(frames.begin(), frames.begin() + i, frames[i]) == frames.begin() + i) {
+                function(frames[i]).total++;
+            }
+        }
+
+        size_t node = 0;
+        _nodes[0].count++;
+
+        for (auto frame = frames.rbegin(); frame != frames.rend(); ++frame) {
+            size_t child = SIZE_MAX;
+
+            for (auto const index : _nodes[node].children) {
+                if (_nodes[index].address == *frame) {
+                    child = index;
+                    break;
+                }
+            }
+
+            if (child == SIZE_MAX) {
+                child = _nodes.size();
+                _nodes[node].children.push_back(child);
+                _nodes.push_back(Node{*frame, 0, {}, {0}});
+                label(*frame, _nodes.back().name, sizeof(_nodes.back().name));
+            }
+
+            node = child;
+            _nodes[node].count++;
+        }
+
+        _depth = std::max(_depth, static_cast<unsigned>(frames.size()));
+        _samples++;
+    }
+
+    std::sort(_functions.begin(), _functions.end(), [](Function const& a, Function const& b) {
+        return a.self > b.self || (a.self == b.self && a.address < b.address);
+    });
+
+    // Keep the same layout between refreshes
+    for (auto& node : _nodes) {
+        std::sort(node.children.begin(), node.children.end(), [this](size_t const a, size_t const b) {
+            return _nodes[a].address < _nodes[b].address;
+        });
+    }
+}
+
+uint64_t hc::ProfilerView::symbolize(uint64_t const address) const {
+    Analysis::Block const* const block = _analysis->findBlock(address);
+
+    if (block == nullptr || block->function == Analysis::NoFunction) {
+        return address;
+    }
+
+    return _analysis->functions()[block->function];
+}
+
+void hc::ProfilerView::label(uint64_t const address, char* const buffer, size_t const size) const {
+    int const digits = static_cast<int>(_profiler->cpu()->mainMemory()->requiredDigits());
+
+    if ((_analysis->flags(address) & Analysis::Function) != 0) {
+        snprintf(buffer, size, "sub_%0*" PRIx64, digits, address);
+    }
+    else {
+        snprintf(buffer, size, "%0*" PRIx64, digits, address);
+    }
+}
+
+void hc::ProfilerView::drawTable() {
+    uint64_t const total = _profiler->getTotal();
+
+    ImGui::Columns(4, "##hot");
+    ImGui::Text("Function");
+    ImGui::NextColumn();
+    ImGui::Text("Samples");
+    ImGui::NextColumn();
+    ImGui::Text("Self");
+    ImGui::NextColumn();
+    ImGui::Text("Total");
+    ImGui::NextColumn();
+    ImGui::Separator();
+
+    for (size_t i = 0; i < _functions.size() && i < MaxRows; i++) {
+        Function const& function = _functions[i];
+
+        ImGui::Text("%s", function.name);
+        ImGui::NextColumn();
+        ImGui::Text("%" PRIu64, function.self);
+        ImGui::NextColumn();
+        ImGui::Text("%.2f%%", total != 0 ? function.self * 100.0 / total : 0.0);
+        ImGui::NextColumn();
+        ImGui::Text("%.2f%%", _samples != 0 ? function.total * 100.0 / _samples : 0.0);
+        ImGui::NextColumn();
+    }
+
+    ImGui::Columns(1);
+}
+
+void hc::ProfilerView::drawFlameGraph() {
+    if (_nodes.empty() || _nodes[0].count == 0) {
+        return;
+    }
+
+    ImVec2 const origin = ImGui::GetCursorScreenPos();
+    float const width = ImGui::GetContentRegionAvail().x;
+    float const height = ImGui::GetTextLineHeightWithSpacing();
+
+    // Callers on top, the functions where the samples were taken at the bottom
+    drawNode(0, origin.x, origin.y, width, height);
+    ImGui::Dummy(ImVec2(width, height * (_depth + 1)));
+}
+
+void hc::ProfilerView::drawNode(size_t const index, float const x, float const y, float const width, float const height) {
+    if (width < 1.0f) {
+        return;
+    }
+
+    Node const& node = _nodes[index];
+    char const* const name = node.name;
+    ImDrawList* const drawList = ImGui::GetWindowDrawList();
+
+    // Warm colors that stay the same for a function
+    uint64_t const hash = (node.address + 1) * UINT64_C(0x9e3779b97f4a7c15);
+    ImU32 const color = IM_COL32(205 + (hash >> 58), 80 + ((hash >> 50) & 0x7f), 40 + ((hash >> 44) & 0x3f), 255);
+
+    ImVec2 const min = ImVec2(x, y);
+    ImVec2 const max = ImVec2(x + width - 1.0f, y + height - 1.0f);
+    drawList->AddRectFilled(min, max, color);
+
+    if (width > 24.0f) {
+        drawList->PushClipRect(min, max, true);
+        drawList->AddText(ImVec2(x + 2.0f, y + 1.0f), IM_COL32(0, 0, 0, 255), name);
+        drawList->PopClipRect();
+    }
+
+    if (ImGui::IsMouseHoveringRect(min, max)) {
+        ImGui::SetTooltip("%s: %" PRIu64 " samples, %.2f%%", name, node.count, node.count * 100.0 / _nodes[0].count);
+    }
+
+    float childX = x;
+
+    for (auto const child : node.children) {
+        float const childWidth = width * _nodes[child].count / node.count;
+        drawNode(child, childX, y + height, childWidth, height);
+        childX += childWidth;
+    }
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "Desktop.h"
+#include "Cpu.h"
+#include "Analysis.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hc {
+    // Counts how many times the program counter is found at each address. The debug interface can only be
+    // used while the core isn't running, and the place where retro_run returns says nothing about where the
+    // game spends its time, so samples are only taken for the instructions stepped by a trace, one every
+    // period steps. The most recent samples keep the stack so the time can be attributed to the callers.
+    class Profiler {
+    public:
+        enum {
+            MaxDepth = 16,
+            StackSamples = 16384,
+            MaxPeriod = 1000000
+        };
+
+        struct Sample {
+            uint64_t pc;
+            unsigned depth;
+            // Words on the stack that may be return addresses, innermost first
+            uint64_t stack[MaxDepth];
+        };
+
+        Profiler(Cpu* const cpu);
+        ~Profiler();
+
+        Cpu* cpu() const { return _cpu; }
+
+        bool isEnabled() const { return _enabled; }
+        void setEnabled(bool const enabled);
+
+        unsigned getPeriod() const { return _period; }
+        void setPeriod(unsigned const period);
+
+        // Called by traces before each instruction
+        void onStep();
+        void reset();
+
+        uint64_t getTotal() const { return _total; }
+        uint64_t base() const { return _base; }
+        uint64_t size() const { return _size; }
+        uint32_t count(uint64_t const address) const;
+        // Copies the samples with stacks, oldest first
+        void recent(std::vector<Sample>* const samples) const;
+
+    protected:
+        void sample();
+
+        Cpu* const _cpu;
+        uint64_t const _base;
+        uint64_t const _size;
+
+        std::atomic<bool> _enabled;
+        std::atomic<unsigned> _period;
+        // Only touched by the emulation thread
+        unsigned _steps;
+
+        // Flat array indexed by the program counter
+        std::unique_ptr<std::atomic<uint32_t>[]> _counts;
+        std::atomic<uint64_t> _total;
+
+        // Guards the samples, which the view copies while the emulation thread adds to them
+        mutable std::mutex _lock;
+        std::vector<Sample> _samples;
+        size_t _next;
+        size_t _stored;
+    };
+
+    class ProfilerView : public View {
+    public:
+        ProfilerView(Desktop* desktop, Profiler* profiler, Analysis* analysis);
+
+        // hc::View
+        virtual char const* getTitle() override;
+        virtual void onGameUnloaded() override;
+        virtual void onSync() override;
+        virtual void onDraw() override;
+
+    protected:
+        enum {
+            RefreshDraws = 30,
+            MaxRows = 100
+        };
+
+        // Named in refresh, the analysis can change while the view draws
+        struct Function {
+            uint64_t address;
+            uint64_t self;
+            // Samples with the function anywhere in the stack
+            uint64_t total;
+            char name[32];
+        };
+
+        struct Node {
+            uint64_t address;
+            uint64_t count;
+            std::vector<size_t> children;
+            char name[32];
+        };
+
+        void refresh();
+        uint64_t symbolize(uint64_t const address) const;
+        void label(uint64_t const address, char* const buffer, size_t const size) const;
+        void drawTable();
+        void drawFlameGraph();
+        void drawNode(size_t const index, float const x, float const y, float const width, float const height);
+
+        bool _valid;
+        Profiler* _profiler;
+        Analysis* _analysis;
+        std::string _title;
+        unsigned _draws;
+
+        std::vector<Function> _functions;
+        uint64_t _samples;
+        std::vector<Node> _nodes;
+        unsigned _depth;
+    };
+}
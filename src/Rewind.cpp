@@ -0,0 +1,461 @@
+#include "Rewind.h"
+#include "Perf.h"
+#include "Logger.h"
+
+#include <IconsFontAwesome4.h>
+
+extern "C" {
+    #include "lauxlib.h"
+}
+
+#include <new>
+#include <string.h>
+
+#define TAG "[RWD] "
+
+// The encoding has one leading token at most, the others skip at least one word and save more than
+// what their two varints cost
+static size_t maxEncodedSize(size_t const size) {
+    return size + 32;
+}
+
+static uint64_t load(uint8_t const* const p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint8_t* putVarint(uint8_t* out, size_t value) {
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+static size_t getVarint(uint8_t const** const in) {
+    uint8_t const* p = *in;
+    size_t value = 0;
+    unsigned shift = 0;
+
+    while (*p & 0x80) {
+        value |= static_cast<size_t>(*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+
+    value |= static_cast<size_t>(*p++) << shift;
+    *in = p;
+    return value;
+}
+
+// Writes the XOR of the two states as pairs of (equal words, different words) counts, each followed by
+// the XOR of the different words, and then the XOR of the bytes that don't fill a word
+static size_t encode(uint8_t* const out, uint8_t const* const state1, uint8_t const* const state2, size_t const size) {
+    size_t const words = size / 8;
+    uint8_t* o = out;
+    size_t w = 0;
+
+    while (w < words) {
+        size_t const equal = w;
+
+        while (w < words && load(state1 + w * 8) == load(state2 + w * 8)) {
+            w++;
+        }
+
+        size_t const different = w;
+
+        while (w < words && load(state1 + w * 8) != load(state2 + w * 8)) {
+            w++;
+        }
+
+        o = putVarint(o, different - equal);
+        o = putVarint(o, w - different);
+
+        for (size_t i = different; i < w; i++) {
+            uint64_t const x = load(state1 + i * 8) ^ load(state2 + i * 8);
+            memcpy(o, &x, sizeof(x));
+            o += sizeof(x);
+        }
+    }
+
+    for (size_t i = words * 8; i < size; i++) {
+        *o++ = state1[i] ^ state2[i];
+    }
+
+    return o - out;
+}
+
+static void decode(uint8_t* const state, uint8_t const* const in, size_t const size) {
+    size_t const words = size / 8;
+    uint8_t const* i = in;
+    size_t w = 0;
+
+    while (w < words) {
+        w += getVarint(&i);
+        size_t const count = getVarint(&i);
+
+        for (size_t j = 0; j < count; j++, w++) {
+            uint64_t const x = load(state + w * 8) ^ load(i);
+            memcpy(state + w * 8, &x, sizeof(x));
+            i += sizeof(x);
+        }
+    }
+
+    for (size_t j = words * 8; j < size; j++) {
+        state[j] ^= *i++;
+    }
+}
+
+hc::Rewind::Rewind(Desktop* desktop)
+    : View(desktop)
+    , _perf(nullptr)
+    , _enabled(false)
+    , _rewinding(false)
+    , _budget(64 << 20)
+    , _interval(1)
+    , _frames(0)
+    , _used(0)
+    , _hasCurrent(false)
+    , _allocated(0)
+    , _savedBytes(0)
+    , _encodedBytes(0)
+{}
+
+void hc::Rewind::init(Perf* const perf) {
+    _perf = perf;
+}
+
+void hc::Rewind::setEnabled(bool const enabled) {
+    _enabled = enabled;
+
+    if (!enabled) {
+        release();
+    }
+}
+
+void hc::Rewind::setBudget(size_t bytes) {
+    size_t const max = static_cast<size_t>(MaxBudgetMiB) << 20;
+    bytes = bytes < max ? bytes : max;
+
+    if (bytes != _budget) {
+        _budget = bytes;
+        release();
+    }
+}
+
+void hc::Rewind::setInterval(unsigned const frames) {
+    _interval = frames < 1 ? 1 : frames;
+}
+
+bool hc::Rewind::step() {
+    if (!_hasCurrent) {
+        return false;
+    }
+
+    _perf->start(&_stepPerf);
+
+    bool const ok = lrcpp::Frontend::getInstance().unserialize(_current.data(), _current.size());
+
+    if (_entries.empty()) {
+        _hasCurrent = false;
+    }
+    else {
+        // XORing the most recent delta gives the state saved before the one just restored
+        Entry const entry = _entries.back();
+        decode(_current.data(), _ring.data() + entry.offset, _current.size());
+
+        _entries.pop_back();
+        _used -= entry.size;
+    }
+
+    _frames = 0;
+    _perf->stop(&_stepPerf);
+
+    if (!ok) {
+        _desktop->error(TAG "Error unserializing state");
+    }
+
+    return ok;
+}
+
+char const* hc::Rewind::getTitle() {
+    return ICON_FA_BACKWARD " Rewind";
+}
+
+void hc::Rewind::onCoreLoaded() {
+    // Perf unregisters all counters when a core is unloaded
+    _savePerf.ident = "hc::Rewind::save";
+    _perf->register_(&_savePerf);
+    _stepPerf.ident = "hc::Rewind::step";
+    _perf->register_(&_stepPerf);
+    _perf->registerMemory("hc::Rewind", &_allocated);
+}
+
+void hc::Rewind::onFrame() {
+    if (!_enabled || _rewinding || ++_frames < _interval) {
+        return;
+    }
+
+    _frames = 0;
+    save();
+}
+
+void hc::Rewind::onSync() {
+    _shown.enabled = _enabled;
+    _shown.budget = static_cast<int>(_budget >> 20);
+    _shown.interval = static_cast<int>(_interval);
+    _shown.count = getCount();
+    _shown.used = _used;
+    _shown.size = _ring.size();
+    _shown.savedBytes = _savedBytes;
+    _shown.encodedBytes = _encodedBytes;
+}
+
+void hc::Rewind::onDraw() {
+    if (ImGui::Checkbox("Enabled", &_shown.enabled)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        setEnabled(_shown.enabled);
+    }
+
+    if (ImGui::SliderInt("Buffer", &_shown.budget, 1, MaxBudgetMiB, "%d MiB")) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        setBudget(static_cast<size_t>(_shown.budget) << 20);
+    }
+
+    if (ImGui::SliderInt("Interval", &_shown.interval, 1, 60, "%d frames")) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        setInterval(static_cast<unsigned>(_shown.interval));
+    }
+
+    // Rewinds while the button is held down
+    ImGui::Button(ICON_FA_BACKWARD " Rewind");
+
+    if (ImGui::IsItemActivated()) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _rewinding = true;
+    }
+    else if (ImGui::IsItemDeactivated()) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _rewinding = false;
+    }
+
+    ImGui::Text("%zu states, %zu frames", _shown.count, _shown.count * _shown.interval);
+    ImGui::Text("%.1f of %.1f MiB used", _shown.used / 1048576.0, _shown.size / 1048576.0);
+
+    if (_shown.savedBytes != 0) {
+        ImGui::Text("Deltas are %.2f%% of the states' size", _shown.encodedBytes * 100.0 / _shown.savedBytes);
+    }
+}
+
+void hc::Rewind::onGameUnloaded() {
+    _rewinding = false;
+    release();
+}
+
+void hc::Rewind::save() {
+    auto& frontend = lrcpp::Frontend::getInstance();
+    size_t size = 0;
+
+    if (!frontend.serializeSize(&size) || size == 0) {
+        return;
+    }
+
+    _perf->start(&_savePerf);
+
+    if (_ring.size() != _budget || _current.size() != size) {
+        clear();
+
+        try {
+            _ring.resize(_budget);
+            _current.resize(size);
+            _next.resize(size);
+            _encoded.resize(maxEncodedSize(size));
+        }
+        catch (std::bad_alloc const&) {
+            // This runs on the emulation thread, don't let the exception take the application down
+            _perf->stop(&_savePerf);
+            _enabled = false;
+            release();
+            _desktop->error(TAG "Out of memory allocating %zu bytes, rewind disabled", _budget);
+            return;
+        }
+
+        _allocated = _ring.size() + _current.size() + _next.size() + _encoded.size();
+    }
+
+    if (!frontend.serialize(_next.data(), size)) {
+        _perf->stop(&_savePerf);
+        _desktop->error(TAG "Error serializing state");
+        return;
+    }
+
+    if (_hasCurrent) {
+        size_t const encoded = encode(_encoded.data(), _next.data(), _current.data(), size);
+
+        _savedBytes += size;
+        _encodedBytes += encoded;
+
+        if (encoded <= _ring.size()) {
+            Entry const entry = allocate(encoded);
+            memcpy(_ring.data() + entry.offset, _encoded.data(), encoded);
+
+            _entries.push_back(entry);
+            _used += encoded;
+        }
+        else {
+            // Start over with this state as the only one
+            clear();
+        }
+    }
+
+    _current.swap(_next);
+    _hasCurrent = true;
+    _perf->stop(&_savePerf);
+}
+
+void hc::Rewind::clear() {
+    _entries.clear();
+    _used = 0;
+    _hasCurrent = false;
+    _frames = 0;
+}
+
+void hc::Rewind::release() {
+    clear();
+
+    std::vector<uint8_t>().swap(_ring);
+    std::vector<uint8_t>().swap(_current);
+    std::vector<uint8_t>().swap(_next);
+    std::vector<uint8_t>().swap(_encoded);
+
+    _allocated = 0;
+    _savedBytes = _encodedBytes = 0;
+}
+
+hc::Rewind::Entry hc::Rewind::allocate(size_t const size) {
+    size_t head = _entries.empty() ? 0 : _entries.back().offset + _entries.back().size;
+
+    if (head + size > _ring.size()) {
+        // Entries past the newest one are the oldest, drop them and wrap around
+        while (!_entries.empty() && _entries.front().offset >= head) {
+            _used -= _entries.front().size;
+            _entries.pop_front();
+        }
+
+        head = 0;
+    }
+
+    // Drop the oldest entries until there's room after the newest one
+    while (!_entries.empty()) {
+        Entry const& oldest = _entries.front();
+
+        if (oldest.offset >= head + size || oldest.offset + oldest.size <= head) {
+            break;
+        }
+
+        _used -= oldest.size;
+        _entries.pop_front();
+    }
+
+    Entry const entry = {head, size};
+    return entry;
+}
+
+int hc::Rewind::push(lua_State* const L) {
+    auto const self = static_cast<Rewind**>(lua_newuserdata(L, sizeof(Rewind*)));
+    *self = this;
+
+    if (luaL_newmetatable(L, "hc::Rewind")) {
+        static luaL_Reg const methods[] = {
+            {"isEnabled", l_isEnabled},
+            {"setEnabled", l_setEnabled},
+            {"getBudget", l_getBudget},
+            {"setBudget", l_setBudget},
+            {"getInterval", l_getInterval},
+            {"setInterval", l_setInterval},
+            {"isRewinding", l_isRewinding},
+            {"setRewinding", l_setRewinding},
+            {"step", l_step},
+            {"getCount", l_getCount},
+            {nullptr, nullptr}
+        };
+
+        luaL_newlib(L, methods);
+        lua_setfield(L, -2, "__index");
+    }
+
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+hc::Rewind* hc::Rewind::check(lua_State* const L, int const index) {
+    return *static_cast<Rewind**>(luaL_checkudata(L, index, "hc::Rewind"));
+}
+
+int hc::Rewind::l_isEnabled(lua_State* const L) {
+    auto const self = check(L, 1);
+    lua_pushboolean(L, self->isEnabled());
+    return 1;
+}
+
+int hc::Rewind::l_setEnabled(lua_State* const L) {
+    auto const self = check(L, 1);
+    self->setEnabled(lua_toboolean(L, 2));
+    return 0;
+}
+
+int hc::Rewind::l_getBudget(lua_State* const L) {
+    auto const self = check(L, 1);
+    lua_pushinteger(L, static_cast<lua_Integer>(self->getBudget()));
+    return 1;
+}
+
+int hc::Rewind::l_setBudget(lua_State* const L) {
+    auto const self = check(L, 1);
+    lua_Integer const bytes = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, bytes > 0, 2, "budget must be positive");
+
+    self->setBudget(static_cast<size_t>(bytes));
+    return 0;
+}
+
+int hc::Rewind::l_getInterval(lua_State* const L) {
+    auto const self = check(L, 1);
+    lua_pushinteger(L, self->getInterval());
+    return 1;
+}
+
+int hc::Rewind::l_setInterval(lua_State* const L) {
+    auto const self = check(L, 1);
+    lua_Integer const frames = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, frames > 0, 2, "interval must be positive");
+
+    self->setInterval(static_cast<unsigned>(frames));
+    return 0;
+}
+
+int hc::Rewind::l_isRewinding(lua_State* const L) {
+    auto const self = check(L, 1);
+    lua_pushboolean(L, self->isRewinding());
+    return 1;
+}
+
+int hc::Rewind::l_setRewinding(lua_State* const L) {
+    auto const self = check(L, 1);
+    self->setRewinding(lua_toboolean(L, 2));
+    return 0;
+}
+
+int hc::Rewind::l_step(lua_State* const L) {
+    auto const self = check(L, 1);
+    lua_pushboolean(L, self->step());
+    return 1;
+}
+
+int hc::Rewind::l_getCount(lua_State* const L) {
+    auto const self = check(L, 1);
+    lua_pushinteger(L, static_cast<lua_Integer>(self->getCount()));
+    return 1;
+}
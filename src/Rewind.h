@@ -0,0 +1,117 @@
+#pragma once
+
+#include "Desktop.h"
+#include "Scriptable.h"
+
+#include <lrcpp/Components.h>
+
+#include <deque>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hc {
+    // Keeps the states of the last frames in a ring of fixed size. Only the most recent state is kept
+    // whole, the others are stored as the XOR with the state that came after them, run-length encoded.
+    class Rewind : public View, public Scriptable {
+    public:
+        Rewind(Desktop* desktop);
+        virtual ~Rewind() {}
+
+        void init(Perf* const perf);
+
+        bool isEnabled() const { return _enabled; }
+        void setEnabled(bool const enabled);
+        size_t getBudget() const { return _budget; }
+        // Clamped to the maximum the view allows
+        void setBudget(size_t const bytes);
+        unsigned getInterval() const { return _interval; }
+        void setInterval(unsigned const frames);
+
+        // While rewinding, frames aren't saved and the emulation loop calls step instead of running the game forward
+        bool isRewinding() const { return _rewinding; }
+        void setRewinding(bool const rewinding) { _rewinding = rewinding; }
+
+        // Restores the most recent state and drops it, returns false if there are none left
+        bool step();
+        size_t getCount() const { return _hasCurrent ? _entries.size() + 1 : 0; }
+
+        static Rewind* check(lua_State* const L, int const index);
+
+        // hc::View
+        virtual char const* getTitle() override;
+        virtual void onCoreLoaded() override;
+        virtual void onFrame() override;
+        virtual void onSync() override;
+        virtual void onDraw() override;
+        virtual void onGameUnloaded() override;
+
+        // hc::Scriptable
+        virtual int push(lua_State* const L) override;
+
+    protected:
+        enum {
+            MaxBudgetMiB = 1024
+        };
+
+        struct Entry {
+            size_t offset;
+            size_t size;
+        };
+
+        void save();
+        void clear();
+        void release();
+        Entry allocate(size_t const size);
+
+        static int l_isEnabled(lua_State* const L);
+        static int l_setEnabled(lua_State* const L);
+        static int l_getBudget(lua_State* const L);
+        static int l_setBudget(lua_State* const L);
+        static int l_getInterval(lua_State* const L);
+        static int l_setInterval(lua_State* const L);
+        static int l_isRewinding(lua_State* const L);
+        static int l_setRewinding(lua_State* const L);
+        static int l_step(lua_State* const L);
+        static int l_getCount(lua_State* const L);
+
+        Perf* _perf;
+        retro_perf_counter _savePerf;
+        retro_perf_counter _stepPerf;
+
+        bool _enabled;
+        bool _rewinding;
+        size_t _budget;
+        unsigned _interval;
+        unsigned _frames;
+
+        // The encoded deltas, oldest first
+        std::vector<uint8_t> _ring;
+        std::deque<Entry> _entries;
+        size_t _used;
+
+        // The most recent state, the one being saved, and room for its encoded delta
+        bool _hasCurrent;
+        std::vector<uint8_t> _current;
+        std::vector<uint8_t> _next;
+        std::vector<uint8_t> _encoded;
+
+        // Bytes allocated, shown in the Perf view
+        size_t _allocated;
+        uint64_t _savedBytes;
+        uint64_t _encodedBytes;
+
+        // Copied in onSync, states are saved by the emulation thread
+        struct {
+            bool enabled;
+            int budget;
+            int interval;
+            size_t count;
+            size_t used;
+            size_t size;
+            uint64_t savedBytes;
+            uint64_t encodedBytes;
+        }
+        _shown;
+    };
+}
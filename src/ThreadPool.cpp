@@ -0,0 +1,112 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace {
+    struct Batch {
+        std::function<void(size_t)> const* job;
+        size_t count;
+        std::atomic<size_t> next;
+
+        std::mutex mutex;
+        std::condition_variable finished;
+        size_t done;
+    };
+}
+
+// Runs jobs from the batch until there are no more left, workers that only
+// get to it after the batch is over find next >= count and don't touch job
+static void run(std::shared_ptr<Batch> const& batch) {
+    size_t count = 0;
+
+    for (size_t i = batch->next++; i < batch->count; i = batch->next++) {
+        (*batch->job)(i);
+        count++;
+    }
+
+    if (count != 0) {
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        batch->done += count;
+
+        if (batch->done == batch->count) {
+            batch->finished.notify_all();
+        }
+    }
+}
+
+hc::ThreadPool::ThreadPool(unsigned const threads) : _quit(false) {
+    for (unsigned i = 0; i < threads; i++) {
+        _threads.emplace_back(&ThreadPool::worker, this);
+    }
+}
+
+hc::ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+
+    _wakeUp.notify_all();
+
+    for (auto& thread : _threads) {
+        thread.join();
+    }
+}
+
+void hc::ThreadPool::parallelFor(size_t const count, std::function<void(size_t)> const& job) {
+    if (count == 0) {
+        return;
+    }
+
+    auto const batch = std::make_shared<Batch>();
+    batch->job = &job;
+    batch->count = count;
+    batch->next = 0;
+    batch->done = 0;
+
+    size_t const helpers = std::min<size_t>(_threads.size(), count - 1);
+
+    if (helpers != 0) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            for (size_t i = 0; i < helpers; i++) {
+                _queue.emplace_back([batch]() { run(batch); });
+            }
+        }
+
+        _wakeUp.notify_all();
+    }
+
+    run(batch);
+
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->finished.wait(lock, [&batch]() { return batch->done == batch->count; });
+}
+
+hc::ThreadPool* hc::ThreadPool::instance() {
+    static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+    return &pool;
+}
+
+void hc::ThreadPool::worker() {
+    for (;;) {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeUp.wait(lock, [this]() { return _quit || !_queue.empty(); });
+
+            if (_quit) {
+                return;
+            }
+
+            task = std::move(_queue.front());
+            _queue.pop_front();
+        }
+
+        task();
+    }
+}
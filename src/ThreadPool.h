@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hc {
+    class ThreadPool final {
+    public:
+        ThreadPool(unsigned const threads);
+        ~ThreadPool();
+
+        unsigned threads() const { return static_cast<unsigned>(_threads.size()); }
+
+        // Calls job(i) for each i in [0, count) on the workers and on the
+        // calling thread, returns after all the calls have returned
+        void parallelFor(size_t const count, std::function<void(size_t)> const& job);
+
+        // Shared pool with one worker less than the number of cores
+        static ThreadPool* instance();
+
+    protected:
+        void worker();
+
+        std::vector<std::thread> _threads;
+        std::mutex _mutex;
+        std::condition_variable _wakeUp;
+        std::deque<std::function<void()>> _queue;
+        bool _quit;
+    };
+}
@@ -0,0 +1,874 @@
+#include "Trace.h"
+
+#include <IconsFontAwesome4.h>
+#include <imgui.h>
+#include <imguial_button.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+
+#define TAG "[TRC] "
+
+enum : uint8_t {
+    // The low bits are the instruction length minus one
+    LengthMask = 0x07,
+    Keyframe = 0x08,
+    PcJump = 0x10,
+    RegistersChanged = 0x20
+};
+
+namespace {
+    // Lets the disassembler decode the bytes saved in a record
+    class RecordMemory : public hc::Memory {
+    public:
+        RecordMemory(hc::Trace::Record const* record) : _record(record) {}
+        virtual ~RecordMemory() {}
+
+        // hc::Memory
+        virtual char const* id() const override { return "trace"; }
+        virtual char const* name() const override { return "Trace record"; }
+        virtual uint64_t base() const override { return _record->pc; }
+        virtual uint64_t size() const override { return _record->length; }
+        virtual bool readonly() const override { return true; }
+
+        virtual uint8_t peek(uint64_t address) const override {
+            uint64_t const offset = address - _record->pc;
+            return offset < _record->length ? _record->bytes[offset] : 0;
+        }
+
+        virtual void poke(uint64_t address, uint8_t value) override { (void)address; (void)value; }
+
+    protected:
+        hc::Trace::Record const* const _record;
+    };
+}
+
+// Appends chunks to the file and reads them back. Writes go through pwrite so a full disk is an error
+// instead of a signal when touching the mapping, and reads come from a read-only mapping that grows with
+// the file. Windows has no mmap and uses stdio with 64-bit offsets.
+class hc::Trace::File {
+public:
+    File()
+#ifdef _WIN32
+        : _file(nullptr)
+#else
+        : _fd(-1)
+        , _map(nullptr)
+        , _mapSize(0)
+#endif
+        , _size(0)
+    {}
+
+    ~File() {
+        close();
+    }
+
+    // Creates the file, or truncates it if it exists
+    bool open(char const* const path) {
+        close();
+#ifdef _WIN32
+        _file = fopen(path, "w+b");
+        return _file != nullptr;
+#else
+        _fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        return _fd >= 0;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (_file != nullptr) {
+            fclose(_file);
+            _file = nullptr;
+        }
+#else
+        if (_map != nullptr) {
+            munmap(_map, _mapSize);
+            _map = nullptr;
+            _mapSize = 0;
+        }
+
+        if (_fd >= 0) {
+            ::close(_fd);
+            _fd = -1;
+        }
+#endif
+        _size = 0;
+    }
+
+    uint64_t size() const { return _size; }
+
+    // Returns false if not all bytes were written, the file is left as it was
+    bool append(void const* const data, size_t const size) {
+#ifdef _WIN32
+        bool const ok = _fseeki64(_file, static_cast<__int64>(_size), SEEK_SET) == 0
+                     && fwrite(data, 1, size, _file) == size
+                     && fflush(_file) == 0;
+
+        if (ok) {
+            _size += size;
+        }
+
+        return ok;
+#else
+        uint8_t const* in = static_cast<uint8_t const*>(data);
+        size_t left = size;
+
+        while (left != 0) {
+            ssize_t const written = pwrite(_fd, in, left, static_cast<off_t>(_size + (size - left)));
+
+            if (written > 0) {
+                in += written;
+                left -= static_cast<size_t>(written);
+            }
+            else if (written == 0 || errno != EINTR) {
+                // The size isn't updated, so a partial chunk is never read back
+                return false;
+            }
+        }
+
+        _size += size;
+        return true;
+#endif
+    }
+
+    // Returns size bytes at offset, read into buffer when they can't be mapped, or nullptr on errors
+    uint8_t const* read(uint64_t const offset, size_t const size, std::vector<uint8_t>* const buffer) {
+        if (offset > _size || size > _size - offset) {
+            return nullptr;
+        }
+
+#ifndef _WIN32
+        if (offset + size > _mapSize) {
+            // Map past the end of the file so the mapping isn't redone for every chunk that is written,
+            // only the part backed by the file is ever accessed
+            uint64_t length = _mapSize != 0 ? static_cast<uint64_t>(_mapSize) * 2 : static_cast<uint64_t>(MinMapSize);
+
+            while (length < offset + size) {
+                length *= 2;
+            }
+
+            if (_map != nullptr) {
+                munmap(_map, _mapSize);
+                _map = nullptr;
+                _mapSize = 0;
+            }
+
+            if (length <= SIZE_MAX) {
+                void* const map = mmap(nullptr, static_cast<size_t>(length), PROT_READ, MAP_SHARED, _fd, 0);
+
+                if (map != MAP_FAILED) {
+                    _map = static_cast<uint8_t*>(map);
+                    _mapSize = static_cast<size_t>(length);
+                }
+            }
+        }
+
+        if (_map != nullptr) {
+            return _map + offset;
+        }
+#endif
+
+        buffer->resize(size);
+
+#ifdef _WIN32
+        bool const ok = _fseeki64(_file, static_cast<__int64>(offset), SEEK_SET) == 0
+                     && fread(buffer->data(), 1, size, _file) == size;
+#else
+        // Address space is short, e.g. a capture of several GiB on a 32-bit system
+        bool const ok = pread(_fd, buffer->data(), size, static_cast<off_t>(offset)) == static_cast<ssize_t>(size);
+#endif
+
+        return ok ? buffer->data() : nullptr;
+    }
+
+protected:
+    enum {
+        MinMapSize = 64 << 20
+    };
+
+#ifdef _WIN32
+    FILE* _file;
+#else
+    int _fd;
+    uint8_t* _map;
+    size_t _mapSize;
+#endif
+    uint64_t _size;
+};
+
+static uint8_t* putVarint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+// Returns false if the varint goes past end or is longer than 64 bits
+static bool getVarint(uint8_t const** const in, uint8_t const* const end, uint64_t* const value) {
+    uint8_t const* p = *in;
+    uint64_t result = 0;
+
+    for (unsigned shift = 0;; shift += 7) {
+        if (p == end || shift > 63) {
+            return false;
+        }
+
+        uint8_t const byte = *p++;
+        result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+    }
+
+    *in = p;
+    *value = result;
+    return true;
+}
+
+// Small differences in either direction become small unsigned numbers
+static uint64_t zigzag(uint64_t const delta) {
+    return (delta << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+}
+
+static uint64_t unzigzag(uint64_t const value) {
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+// A register that held the program counter is expected to hold the new one, so the PC register itself
+// doesn't need a delta for every instruction
+static uint64_t expected(hc::Trace::Record const& previous, uint64_t const pc, unsigned const reg) {
+    return previous.registers[reg] == previous.pc ? pc : previous.registers[reg];
+}
+
+hc::Trace::Trace(Cpu* const cpu)
+    : _cpu(cpu)
+    , _log(nullptr)
+    , _profiler(nullptr)
+    , _registerCount(std::min(cpu->registerCount(), static_cast<unsigned>(MaxRegisters)))
+    , _budget(16 << 20)
+    , _failed(false)
+    , _head(0)
+    , _chunkOpen(false)
+    , _total(0)
+    , _bytes(0)
+    , _remaining(0)
+    , _armed(0)
+    , _decodedFirst(0)
+    , _decodedCount(0)
+{
+    // Header, program counter, opcode bytes, changed registers mask, and one varint per register
+    _maxRecordSize = 1 + 10 + DisasmCache::MaxBytes + 5 + _registerCount * 10;
+    memset(&_previous, 0, sizeof(_previous));
+    setBudget(_budget);
+}
+
+hc::Trace::~Trace() {}
+
+void hc::Trace::setBudget(size_t const bytes) {
+    // Keep room for a few chunks so dropping the oldest one never reaches the chunk being written
+    size_t const minimum = 4 * ChunkRecords * _maxRecordSize;
+    _budget = bytes > minimum ? bytes : minimum;
+
+    if (_file == nullptr) {
+        clear();
+        _ring.resize(_budget);
+        _ring.shrink_to_fit();
+    }
+}
+
+bool hc::Trace::setFile(char const* const path) {
+    stop();
+
+    _file.reset();
+    _path.clear();
+
+    if (path != nullptr && *path != 0) {
+        std::unique_ptr<File> file(new File);
+
+        if (file->open(path)) {
+            _file = std::move(file);
+            _path = path;
+        }
+    }
+
+    // Only the chunk being written needs to be in memory when recording to a file
+    _ring.resize(_file != nullptr ? ChunkRecords * _maxRecordSize : _budget);
+    _ring.shrink_to_fit();
+    clear();
+
+    return _file != nullptr || path == nullptr || *path == 0;
+}
+
+void hc::Trace::start(uint64_t const count) {
+    _remaining = _cpu->canStepInto() ? count : 0;
+}
+
+void hc::Trace::onBreakpoint() {
+    if (_armed != 0) {
+        start(_armed);
+        _armed = 0;
+    }
+}
+
+void hc::Trace::stop() {
+    _remaining = 0;
+    flush();
+}
+
+void hc::Trace::update() {
+    if (_remaining == 0) {
+        return;
+    }
+
+    uint64_t const steps = _remaining < StepsPerUpdate ? _remaining : StepsPerUpdate;
+
+    for (uint64_t i = 0; i < steps && !_failed; i++) {
+        capture();
+        _cpu->stepInto();
+    }
+
+    _remaining = _failed ? 0 : _remaining - steps;
+
+    if (_remaining == 0) {
+        stop();
+    }
+}
+
+void hc::Trace::clear() {
+    _remaining = 0;
+    _chunks.clear();
+    _head = 0;
+    _chunkOpen = false;
+    _total = 0;
+    _bytes = 0;
+    _decodedCount = 0;
+    _failed = false;
+
+    if (_file != nullptr && !_file->open(_path.c_str())) {
+        _file.reset();
+        _path.clear();
+        _ring.resize(_budget);
+    }
+}
+
+hc::Trace::Record const* hc::Trace::get(uint64_t const index) {
+    if (index < getFirst() || index >= _total) {
+        return nullptr;
+    }
+
+    auto const found = std::upper_bound(_chunks.begin(), _chunks.end(), index, [](uint64_t const index, Chunk const& chunk) {
+        return index < chunk.first;
+    });
+
+    Chunk const& chunk = *(found - 1);
+
+    // Records of a chunk that failed to be written are gone
+    if (index - chunk.first >= chunk.count) {
+        return nullptr;
+    }
+
+    // The chunk being written grows, decode it again when it has new records
+    if ((_decodedCount != chunk.count || _decodedFirst != chunk.first) && !decode(chunk)) {
+        return nullptr;
+    }
+
+    return &_decoded[index - chunk.first];
+}
+
+void hc::Trace::capture() {
+    Record current;
+    Memory* const memory = _cpu->mainMemory();
+
+    current.pc = _cpu->programCounter();
+    uint64_t const length = _cpu->instructionLength(current.pc, memory);
+    current.length = length == 0 ? 1 : length < DisasmCache::MaxBytes ? static_cast<unsigned>(length) : DisasmCache::MaxBytes;
+    memory->read(current.pc, current.bytes, current.length);
+
+    for (unsigned i = 0; i < _registerCount; i++) {
+        current.registers[i] = _cpu->getRegister(i);
+    }
+
+    if (_log != nullptr) {
+        _log->markCode(current.pc, current.length);
+    }
+
+    if (_profiler != nullptr) {
+        _profiler->onStep();
+    }
+
+    reserve();
+
+    Chunk& chunk = _chunks.back();
+    uint8_t* const start = _ring.data() + _head;
+    uint8_t* out = start + 1;
+    uint8_t head = static_cast<uint8_t>(current.length - 1);
+    current.changed = 0;
+
+    if (chunk.count == 0) {
+        head |= Keyframe;
+        out = putVarint(out, current.pc);
+        memcpy(out, current.bytes, current.length);
+        out += current.length;
+
+        for (unsigned i = 0; i < _registerCount; i++) {
+            out = putVarint(out, current.registers[i]);
+        }
+    }
+    else {
+        uint64_t const predicted = _previous.pc + _previous.length;
+
+        if (current.pc != predicted) {
+            head |= PcJump;
+            out = putVarint(out, zigzag(current.pc - predicted));
+        }
+
+        memcpy(out, current.bytes, current.length);
+        out += current.length;
+
+        for (unsigned i = 0; i < _registerCount; i++) {
+            current.changed |= static_cast<uint32_t>(current.registers[i] != expected(_previous, current.pc, i)) << i;
+        }
+
+        if (current.changed != 0) {
+            head |= RegistersChanged;
+            out = putVarint(out, current.changed);
+
+            for (unsigned i = 0; i < _registerCount; i++) {
+                if ((current.changed >> i) & 1) {
+                    out = putVarint(out, zigzag(current.registers[i] - expected(_previous, current.pc, i)));
+                }
+            }
+        }
+    }
+
+    *start = head;
+
+    size_t const size = out - start;
+    chunk.size += static_cast<uint32_t>(size);
+    chunk.count++;
+    _head += size;
+    _total++;
+    _bytes += size;
+    _previous = current;
+}
+
+void hc::Trace::reserve() {
+    bool fresh = !_chunkOpen || _chunks.empty() || _chunks.back().count >= ChunkRecords;
+
+    if (_file != nullptr) {
+        if (fresh) {
+            flush();
+            _head = 0;
+        }
+    }
+    else {
+        if (_head + _maxRecordSize > _ring.size()) {
+            // Chunks past the head are the oldest, drop them and wrap around
+            while (!_chunks.empty() && _chunks.front().offset >= _head) {
+                _chunks.pop_front();
+            }
+
+            _head = 0;
+            fresh = true;
+        }
+
+        // Drop the oldest chunks until there's room for the record after the head
+        while (!_chunks.empty()) {
+            Chunk const& oldest = _chunks.front();
+
+            if (oldest.offset >= _head + _maxRecordSize || oldest.offset + oldest.size <= _head) {
+                break;
+            }
+
+            _chunks.pop_front();
+        }
+    }
+
+    if (fresh) {
+        _chunks.push_back(Chunk{_total, 0, 0, _head, false});
+        _chunkOpen = true;
+    }
+}
+
+void hc::Trace::flush() {
+    if (_file != nullptr && _chunkOpen && !_chunks.empty()) {
+        Chunk& chunk = _chunks.back();
+
+        uint64_t const offset = _file->size();
+
+        if (chunk.count == 0) {
+            _chunks.pop_back();
+        }
+        else if (_file->append(_ring.data() + chunk.offset, chunk.size)) {
+            chunk.offset = offset;
+            chunk.inFile = true;
+        }
+        else {
+            // Stop instead of recording more chunks that couldn't be read back either
+            _chunks.pop_back();
+            _remaining = 0;
+            _failed = true;
+        }
+    }
+
+    _chunkOpen = false;
+}
+
+bool hc::Trace::decode(Chunk const& chunk) {
+    uint8_t const* in = _ring.data() + chunk.offset;
+
+    // Whatever was decoded before is overwritten
+    _decodedCount = 0;
+
+    if (chunk.inFile) {
+        in = _file->read(chunk.offset, chunk.size, &_readBuffer);
+
+        if (in == nullptr) {
+            return false;
+        }
+    }
+
+    uint8_t const* const end = in + chunk.size;
+    _decoded.resize(chunk.count);
+
+    for (uint32_t i = 0; i < chunk.count; i++) {
+        Record& record = _decoded[i];
+
+        if (in == end) {
+            return false;
+        }
+
+        uint8_t const head = *in++;
+        record.length = (head & LengthMask) + 1;
+        record.changed = 0;
+
+        if ((head & Keyframe) != 0) {
+            if (!getVarint(&in, end, &record.pc) || static_cast<size_t>(end - in) < record.length) {
+                return false;
+            }
+
+            memcpy(record.bytes, in, record.length);
+            in += record.length;
+
+            for (unsigned j = 0; j < _registerCount; j++) {
+                if (!getVarint(&in, end, &record.registers[j])) {
+                    return false;
+                }
+            }
+
+            continue;
+        }
+        else if (i == 0) {
+            // Chunks always start with a keyframe
+            return false;
+        }
+
+        Record const& previous = _decoded[i - 1];
+        record.pc = previous.pc + previous.length;
+
+        if ((head & PcJump) != 0) {
+            uint64_t delta;
+
+            if (!getVarint(&in, end, &delta)) {
+                return false;
+            }
+
+            record.pc += unzigzag(delta);
+        }
+
+        if (static_cast<size_t>(end - in) < record.length) {
+            return false;
+        }
+
+        memcpy(record.bytes, in, record.length);
+        in += record.length;
+
+        for (unsigned j = 0; j < _registerCount; j++) {
+            record.registers[j] = expected(previous, record.pc, j);
+        }
+
+        if ((head & RegistersChanged) != 0) {
+            uint64_t changed;
+
+            if (!getVarint(&in, end, &changed)) {
+                return false;
+            }
+
+            record.changed = static_cast<uint32_t>(changed);
+
+            for (unsigned j = 0; j < _registerCount; j++) {
+                uint64_t delta;
+
+                if (((record.changed >> j) & 1) == 0) {
+                    continue;
+                }
+                else if (!getVarint(&in, end, &delta)) {
+                    return false;
+                }
+
+                record.registers[j] += unzigzag(delta);
+            }
+        }
+    }
+
+    _decodedFirst = chunk.first;
+    _decodedCount = chunk.count;
+    return true;
+}
+
+hc::TraceView::TraceView(Desktop* desktop, Trace* trace)
+    : View(desktop)
+    , _valid(true)
+    , _trace(trace)
+    , _count(100000)
+    , _follow(true)
+    , _displayStart(0)
+    , _displayEnd(0)
+    , _recordsFirst(0)
+{
+    static std::atomic<unsigned> counter;
+
+    _title = ICON_FA_HISTORY " ";
+    _title += trace->cpu()->name();
+    _title += " Trace##";
+    _title += counter++;
+
+    snprintf(_path, sizeof(_path), "%s", trace->getFile());
+}
+
+char const* hc::TraceView::getTitle() {
+    return _title.c_str();
+}
+
+void hc::TraceView::onGameUnloaded() {
+    _valid = false;
+}
+
+void hc::TraceView::onSync() {
+    _records.clear();
+
+    if (!_valid) {
+        return;
+    }
+
+    _shown.recording = _trace->isRecording();
+    _shown.armed = _trace->isArmed();
+    _shown.canStepInto = _trace->cpu()->canStepInto();
+    _shown.failed = _trace->hasFailed();
+    _shown.file = _trace->getFile();
+    _shown.budget = _trace->getBudget();
+    _shown.first = _trace->getFirst();
+    _shown.total = _trace->getTotal();
+    _shown.bytes = _trace->getBytes();
+    _shown.remaining = _trace->getRemaining();
+
+    // The first record drawn is relative to the first one in the trace
+    uint64_t const visible = _displayEnd > _displayStart ? _displayEnd - _displayStart : 0;
+    uint64_t begin = _shown.first + (_displayStart >= SyncMargin ? _displayStart - SyncMargin : 0);
+    uint64_t end = _shown.first + _displayEnd + SyncMargin;
+
+    // Records come in at the bottom while following, that's where the view will scroll to
+    if (_follow && _shown.recording) {
+        uint64_t const tail = visible + SyncMargin;
+        begin = _shown.total - _shown.first > tail ? _shown.total - tail : _shown.first;
+        end = _shown.total;
+    }
+
+    end = std::min(end, _shown.total);
+    _recordsFirst = begin;
+
+    for (uint64_t i = begin; i < end; i++) {
+        Trace::Record const* const record = _trace->get(i);
+
+        if (record == nullptr) {
+            // Keep the records in order so they can be found by index
+            _records.emplace_back();
+            _records.back().length = 0;
+            continue;
+        }
+
+        _records.emplace_back(*record);
+    }
+}
+
+void hc::TraceView::onDraw() {
+    if (!_valid) {
+        return;
+    }
+
+    Cpu* const cpu = _trace->cpu();
+    bool const recording = _shown.recording;
+
+    ImGui::InputInt("Instructions", &_count, 1000, 100000);
+    _count = _count < 1 ? 1 : _count;
+
+    if (ImGuiAl::Button(ICON_FA_PLAY " Record", _shown.canStepInto && !recording)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _trace->start(static_cast<uint64_t>(_count));
+    }
+
+    ImGui::SameLine();
+
+    if (ImGuiAl::Button(ICON_FA_BUG " Record on breakpoint", !_shown.armed && !recording)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _trace->arm(static_cast<uint64_t>(_count));
+    }
+
+    ImGui::SameLine();
+
+    if (ImGuiAl::Button(ICON_FA_STOP " Stop", recording || _shown.armed)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _trace->arm(0);
+        _trace->stop();
+    }
+
+    ImGui::SameLine();
+
+    if (ImGuiAl::Button(ICON_FA_TRASH " Clear", !recording)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _trace->clear();
+    }
+
+    if (_shown.file.empty()) {
+        int budget = static_cast<int>(_shown.budget >> 20);
+
+        if (ImGui::SliderInt("Buffer", &budget, 1, 1024, "%d MiB")) {
+            std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+            _trace->setBudget(static_cast<size_t>(budget) << 20);
+        }
+    }
+
+    ImGui::InputText("File", _path, sizeof(_path));
+    ImGui::SameLine();
+
+    if (ImGuiAl::Button(ICON_FA_FILE " Record to file", !recording && _path[0] != 0)) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+
+        if (!_trace->setFile(_path)) {
+            _desktop->error(TAG "Error opening \"%s\": %s", _path, strerror(errno));
+        }
+    }
+
+    ImGui::SameLine();
+
+    if (ImGuiAl::Button(ICON_FA_MICROCHIP " Record to memory", !recording && !_shown.file.empty())) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
+        _trace->setFile(nullptr);
+    }
+
+    uint64_t const first = _shown.first;
+    uint64_t const total = _shown.total;
+
+    if (_shown.failed) {
+        ImGui::Text("Error writing to \"%s\", recording stopped", _shown.file.c_str());
+    }
+
+    ImGui::Text(
+        "%" PRIu64 " instructions, %.2f bytes each, %" PRIu64 " left to record",
+        total - first, total != 0 ? static_cast<double>(_shown.bytes) / total : 0.0, _shown.remaining
+    );
+
+    ImGui::SameLine();
+    ImGui::Checkbox("Follow", &_follow);
+
+    ImGui::BeginChild("##trace");
+
+    float const lineHeight = ImGui::GetTextLineHeightWithSpacing();
+    int const digits = static_cast<int>(cpu->mainMemory()->requiredDigits());
+
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(total - first), lineHeight);
+    _displayStart = UINT64_MAX;
+    _displayEnd = 0;
+
+    while (clipper.Step()) {
+        _displayStart = std::min(_displayStart, static_cast<uint64_t>(clipper.DisplayStart));
+        _displayEnd = std::max(_displayEnd, static_cast<uint64_t>(clipper.DisplayEnd));
+
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            uint64_t const index = first + i;
+
+            // Records scrolled into view since onSync are drawn on the next frame
+            if (index < _recordsFirst || index - _recordsFirst >= _records.size()) {
+                ImGui::TextDisabled("%10" PRIu64, index);
+                continue;
+            }
+
+            Trace::Record const* const record = &_records[index - _recordsFirst];
+
+            if (record->length == 0) {
+                ImGui::TextDisabled("%10" PRIu64, index);
+                continue;
+            }
+
+            char opcodes[DisasmCache::MaxBytes * 3];
+            char* out = opcodes;
+
+            for (unsigned j = 0; j < record->length && j < 4; j++) {
+                out += snprintf(out, opcodes + sizeof(opcodes) - out, j == 0 ? "%02x" : " %02x", record->bytes[j]);
+            }
+
+            *out = 0;
+
+            RecordMemory const memory(record);
+            char buffer[64], tooltip[64];
+            cpu->disasm(record->pc, &memory, buffer, sizeof(buffer), tooltip, sizeof(tooltip));
+
+            char registers[256];
+            size_t length = 0;
+            registers[0] = 0;
+
+            for (unsigned j = 0; j < cpu->registerCount() && j < Trace::MaxRegisters && length < sizeof(registers); j++) {
+                if ((record->changed >> j) & 1) {
+                    length += snprintf(
+                        registers + length, sizeof(registers) - length, "%s=%" PRIx64 " ",
+                        cpu->registerName(j), record->registers[j]
+                    );
+                }
+            }
+
+            ImGui::Text(
+                "%10" PRIu64 "  %0*" PRIx64 ":  %-11s  %-20s  %s",
+                index, digits, record->pc, opcodes, buffer, registers
+            );
+
+            if (ImGui::IsItemHovered()) {
+                ImGui::BeginTooltip();
+
+                for (unsigned j = 0; j < cpu->registerCount() && j < Trace::MaxRegisters; j++) {
+                    ImGui::Text("%-4s %" PRIx64, cpu->registerName(j), record->registers[j]);
+                }
+
+                ImGui::EndTooltip();
+            }
+        }
+    }
+
+    clipper.End();
+
+    if (_displayStart > _displayEnd) {
+        _displayStart = _displayEnd = 0;
+    }
+
+    if (_follow && recording) {
+        ImGui::SetScrollHereY(1.0f);
+    }
+
+    ImGui::EndChild();
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "Desktop.h"
+#include "Cpu.h"
+#include "DisasmCache.h"
+#include "CodeDataLog.h"
+#include "Profiler.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hc {
+    // Records the instructions executed by a CPU by single stepping it. Each record has the program
+    // counter, the opcode bytes and the registers before the instruction runs, encoded as differences
+    // from the previous record. Records are grouped in chunks that start with a full keyframe, so any
+    // record can be found by decoding at most one chunk.
+    //
+    // Chunks are kept in a ring in memory, dropping the oldest ones when it's full, or written to a file
+    // as they're completed so captures are only limited by disk space. The file is memory-mapped to read
+    // the chunks back.
+    class Trace {
+    public:
+        enum {
+            MaxRegisters = 32,
+            ChunkRecords = 1024,
+            // Steps run by each call to update, so long captures don't block the UI
+            StepsPerUpdate = 20000
+        };
+
+        struct Record {
+            uint64_t pc;
+            unsigned length;
+            uint8_t bytes[DisasmCache::MaxBytes];
+            uint64_t registers[MaxRegisters];
+            // Registers that changed since the previous record
+            uint32_t changed;
+        };
+
+        Trace(Cpu* const cpu);
+        ~Trace();
+
+        Cpu* cpu() const { return _cpu; }
+        // Executed instructions are marked in the log as they're recorded
+        void setLog(CodeDataLog* const log) { _log = log; }
+        // Every recorded instruction is a sample when the profiler uses trace steps
+        void setProfiler(Profiler* const profiler) { _profiler = profiler; }
+
+        // Memory used by the ring, only the current chunk is kept in memory when writing to a file
+        size_t getBudget() const { return _budget; }
+        void setBudget(size_t const bytes);
+        // An empty path records to memory, the trace is cleared in both cases
+        bool setFile(char const* const path);
+        char const* getFile() const { return _path.c_str(); }
+        // Writing to the file failed and recording was stopped, cleared with the trace
+        bool hasFailed() const { return _failed; }
+
+        // Records the next count instructions, update runs the steps
+        void start(uint64_t const count);
+        // Starts recording count instructions when a breakpoint is hit
+        void arm(uint64_t const count) { _armed = count; }
+        void onBreakpoint();
+        void stop();
+        void update();
+        void clear();
+
+        bool isRecording() const { return _remaining != 0; }
+        bool isArmed() const { return _armed != 0; }
+        uint64_t getRemaining() const { return _remaining; }
+
+        // Records are numbered since the trace was cleared, the oldest ones are dropped when the ring is full
+        uint64_t getFirst() const { return _chunks.empty() ? _total : _chunks.front().first; }
+        uint64_t getTotal() const { return _total; }
+        uint64_t getBytes() const { return _bytes; }
+        // Returns nullptr if the record isn't available or its chunk can't be decoded
+        Record const* get(uint64_t const index);
+
+    protected:
+        class File;
+
+        struct Chunk {
+            uint64_t first;
+            uint32_t count;
+            uint32_t size;
+            // Offset in the ring or in the file
+            uint64_t offset;
+            bool inFile;
+        };
+
+        void capture();
+        void reserve();
+        void flush();
+        bool decode(Chunk const& chunk);
+
+        Cpu* const _cpu;
+        CodeDataLog* _log;
+        Profiler* _profiler;
+        unsigned _registerCount;
+        size_t _maxRecordSize;
+
+        size_t _budget;
+        std::string _path;
+        std::unique_ptr<File> _file;
+        bool _failed;
+
+        std::vector<uint8_t> _ring;
+        size_t _head;
+        std::deque<Chunk> _chunks;
+        bool _chunkOpen;
+        Record _previous;
+
+        uint64_t _total;
+        uint64_t _bytes;
+        uint64_t _remaining;
+        uint64_t _armed;
+
+        // The most recently decoded chunk
+        std::vector<Record> _decoded;
+        uint64_t _decodedFirst;
+        uint32_t _decodedCount;
+        std::vector<uint8_t> _readBuffer;
+    };
+
+    class TraceView : public View {
+    public:
+        TraceView(Desktop* desktop, Trace* trace);
+
+        // hc::View
+        virtual char const* getTitle() override;
+        virtual void onGameUnloaded() override;
+        virtual void onSync() override;
+        virtual void onDraw() override;
+
+    protected:
+        enum {
+            // Records copied in onSync around the ones drawn the last time, so scrolling doesn't show blanks
+            SyncMargin = 64
+        };
+
+        bool _valid;
+        Trace* _trace;
+        std::string _title;
+
+        int _count;
+        char _path[256];
+        bool _follow;
+
+        // The trace is recorded by the emulation thread, what's drawn is copied in onSync
+        struct {
+            bool recording;
+            bool armed;
+            bool canStepInto;
+            bool failed;
+            std::string file;
+            size_t budget;
+            uint64_t first;
+            uint64_t total;
+            uint64_t bytes;
+            uint64_t remaining;
+        }
+        _shown;
+
+        uint64_t _displayStart;
+        uint64_t _displayEnd;
+        uint64_t _recordsFirst;
+        std::vector<Trace::Record> _records;
+    };
+}
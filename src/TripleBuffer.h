@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+
+namespace hc {
+    // Hands the latest of a stream of values from one producer thread to one
+    // consumer thread without blocking either of them, values the consumer
+    // didn't get to see are dropped
+    template<typename T>
+    class TripleBuffer final {
+    public:
+        TripleBuffer() : _back(0), _middle(1), _front(2) {}
+
+        // Producer
+        T& back() { return _slots[_back]; }
+
+        void publish() {
+            _back = _middle.exchange(_back | Fresh, std::memory_order_acq_rel) & Index;
+        }
+
+        // Consumer, returns false if nothing was published since the last call
+        bool acquire() {
+            if ((_middle.load(std::memory_order_relaxed) & Fresh) == 0) {
+                return false;
+            }
+
+            _front = _middle.exchange(_front, std::memory_order_acq_rel) & Index;
+            return true;
+        }
+
+        T& front() { return _slots[_front]; }
+
+    protected:
+        enum : unsigned {
+            Index = 3,
+            Fresh = 4
+        };
+
+        T _slots[3];
+        unsigned _back;
+        std::atomic<unsigned> _middle;
+        unsigned _front;
+    };
+}
@@ -1,7 +1,10 @@
 #include "Video.h"
 #include "Logger.h"
+#include "Perf.h"
+#include "Pixels.h"
 
 #include <IconsFontAwesome4.h>
+#include <SDL.h>
 
 extern "C" {
     #include "lauxlib.h"
@@ -9,16 +12,68 @@ extern "C" {
 
 #define TAG "[VID] "
 
-hc::Video::Video(Desktop* desktop) : View(desktop), _mouseOnTexture(false) {}
+namespace {
+    // Pixel buffer object functions, they're not in OpenGL 1.1 and must be loaded at runtime
+    struct PboFunctions {
+        PFNGLGENBUFFERSPROC genBuffers;
+        PFNGLDELETEBUFFERSPROC deleteBuffers;
+        PFNGLBINDBUFFERPROC bindBuffer;
+        PFNGLBUFFERDATAPROC bufferData;
+        PFNGLMAPBUFFERPROC mapBuffer;
+        PFNGLUNMAPBUFFERPROC unmapBuffer;
+    };
+}
+
+static PboFunctions s_pbo;
+
+static bool loadPboFunctions() {
+    if (!SDL_GL_ExtensionSupported("GL_ARB_pixel_buffer_object")) {
+        return false;
+    }
+
+    // The ARB_vertex_buffer_object entry points work with any OpenGL version that has the extension
+    s_pbo.genBuffers = (PFNGLGENBUFFERSPROC)SDL_GL_GetProcAddress("glGenBuffersARB");
+    s_pbo.deleteBuffers = (PFNGLDELETEBUFFERSPROC)SDL_GL_GetProcAddress("glDeleteBuffersARB");
+    s_pbo.bindBuffer = (PFNGLBINDBUFFERPROC)SDL_GL_GetProcAddress("glBindBufferARB");
+    s_pbo.bufferData = (PFNGLBUFFERDATAPROC)SDL_GL_GetProcAddress("glBufferDataARB");
+    s_pbo.mapBuffer = (PFNGLMAPBUFFERPROC)SDL_GL_GetProcAddress("glMapBufferARB");
+    s_pbo.unmapBuffer = (PFNGLUNMAPBUFFERPROC)SDL_GL_GetProcAddress("glUnmapBufferARB");
+
+    return s_pbo.genBuffers != nullptr && s_pbo.deleteBuffers != nullptr && s_pbo.bindBuffer != nullptr &&
+           s_pbo.bufferData != nullptr && s_pbo.mapBuffer != nullptr && s_pbo.unmapBuffer != nullptr;
+}
+
+hc::Video::Video(Desktop* desktop) : View(desktop), _mouseOnTexture(false) {
+    _shown.mouseOnTexture = false;
+}
+
+void hc::Video::init(Perf* const perf) {
+    _perf = perf;
 
-void hc::Video::init() {
     _rotation = 0;
     _pixelFormat = RETRO_PIXEL_FORMAT_UNKNOWN;
     _coreFps = 0.0;
+    _skipFrames = false;
 
+    _maxWidth = _maxHeight = 0;
     _texture = 0;
     _textureWidth = _textureHeight = 0;
     _width = _height = 0;
+
+    _pbo = 0;
+    _usePbos = false;
+
+    // Headless runs have no OpenGL context, and never upload frames
+    if (SDL_GL_GetCurrentContext() != nullptr) {
+        _usePbos = loadPboFunctions();
+
+        if (_usePbos) {
+            _desktop->info(TAG "Using pixel buffer objects to upload frames");
+        }
+        else {
+            _desktop->warn(TAG "Pixel buffer objects not available, uploading frames synchronously");
+        }
+    }
 }
 
 double hc::Video::getCoreFps() const {
@@ -35,7 +90,18 @@ char const* hc::Video::getTitle() {
     return ICON_FA_DESKTOP " Video";
 }
 
+void hc::Video::onSync() {
+    _shown.maxWidth = _maxWidth;
+    _shown.maxHeight = _maxHeight;
+    _shown.aspectRatio = _aspectRatio;
+
+    _mousePos = _shown.mousePos;
+    _mouseOnTexture = _shown.mouseOnTexture;
+}
+
 void hc::Video::onDraw() {
+    upload();
+
     if (_texture != 0) {
         _texturePos = ImGui::GetCursorScreenPos();
 
@@ -43,11 +109,11 @@ void hc::Video::onDraw() {
         ImVec2 const max = ImGui::GetWindowContentRegionMax();
 
         float height = max.y - min.y;
-        float width = height * _aspectRatio;
+        float width = height * _shown.aspectRatio;
 
         if (width > max.x - min.x) {
             width = max.x - min.x;
-            height = width / _aspectRatio;
+            height = width / _shown.aspectRatio;
         }
 
         ImVec2 const size = ImVec2(width, height);
@@ -56,20 +122,26 @@ void hc::Video::onDraw() {
 
         ImGui::Image((ImTextureID)(uintptr_t)_texture, size, uv0, uv1);
 
-        _mouseOnTexture = ImGui::IsItemHovered();
+        _shown.mouseOnTexture = ImGui::IsItemHovered();
 
-        if (_mouseOnTexture) {
+        if (_shown.mouseOnTexture) {
             ImVec2 const mouse = ImGui::GetMousePos();
-            _mousePos = ImVec2((mouse.x - _texturePos.x) * _width / size.x, (mouse.y - _texturePos.y) * _height / size.y);
+            _shown.mousePos = ImVec2((mouse.x - _texturePos.x) * _width / size.x, (mouse.y - _texturePos.y) * _height / size.y);
 
             ImGui::SetMouseCursor(ImGuiMouseCursor_None);
         }
     }
 }
 
+void hc::Video::onCoreLoaded() {
+    // Perf unregisters all counters when a core is unloaded
+    _convertPerf.ident = "hc::Video::convert";
+    _perf->register_(&_convertPerf);
+}
+
 void hc::Video::onGameUnloaded() {
-    glDeleteTextures(1, &_texture);
-    _texture = 0;
+    deleteTexture();
+    _maxWidth = _maxHeight = 0;
     _textureWidth = _textureHeight = 0;
     _width = _height = 0;
 }
@@ -153,7 +225,9 @@ bool hc::Video::setGeometry(retro_game_geometry const* geometry) {
     _desktop->info(TAG "    max_height   = %u", geometry->max_height);
     _desktop->info(TAG "    aspect_ratio = %f", geometry->aspect_ratio);
 
-    setupTexture(geometry->max_width, geometry->max_height);
+    // The texture is created on the UI thread
+    _maxWidth = geometry->max_width;
+    _maxHeight = geometry->max_height;
     return true;
 }
 
@@ -191,39 +265,73 @@ bool hc::Video::getPreferredHwRender(unsigned* preferred) {
 }
 
 void hc::Video::refresh(void const* data, unsigned width, unsigned height, size_t pitch) {
-    if (data == nullptr || data == RETRO_HW_FRAME_BUFFER_VALID) {
+    if (_skipFrames || data == nullptr || data == RETRO_HW_FRAME_BUFFER_VALID || _pixelFormat == RETRO_PIXEL_FORMAT_UNKNOWN) {
         return;
     }
 
-    GLint previous_texture;
-    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
-    glBindTexture(GL_TEXTURE_2D, _texture);
+    // Frames are always converted to 32-bit BGRA, so the texture upload doesn't depend on the driver's
+    // conversions and other consumers of the frame only have to deal with one format
+    Frame& frame = _frames.back();
+    frame.pixels.resize(static_cast<size_t>(width) * height);
+    frame.width = width;
+    frame.height = height;
 
-    switch (_pixelFormat) {
-        case RETRO_PIXEL_FORMAT_XRGB8888:
-            glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch / 4);
-            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, data);
-            break;
+    _perf->start(&_convertPerf);
+    pixels::convert(frame.pixels.data(), data, width, height, pitch, _pixelFormat);
+    _perf->stop(&_convertPerf);
 
-        case RETRO_PIXEL_FORMAT_RGB565:
-            glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch / 2);
-            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, data);
-            break;
+    _frames.publish();
+}
 
-        case RETRO_PIXEL_FORMAT_0RGB1555:
-            glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch / 2);
-            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_BGRA, GL_UNSIGNED_SHORT_1_5_5_5_REV, data);
-            break;
+void hc::Video::upload() {
+    setupTexture(_shown.maxWidth, _shown.maxHeight);
 
-        case RETRO_PIXEL_FORMAT_UNKNOWN:
-            break;
+    if (!_frames.acquire()) {
+        return;
     }
 
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-    glBindTexture(GL_TEXTURE_2D, previous_texture);
+    Frame const& frame = _frames.front();
 
-    _width = width;
-    _height = height;
+    // Frames produced before the texture was resized are dropped
+    if (_texture == 0 || frame.width > _textureWidth || frame.height > _textureHeight) {
+        return;
+    }
+
+    void const* pixels = frame.pixels.data();
+    size_t const size = frame.pixels.size() * sizeof(frame.pixels[0]);
+
+    if (_usePbos) {
+        // Orphan the buffer's storage so mapping it doesn't wait for a transfer still using it, and
+        // cycle through a few buffers to keep the driver from reallocating the same one every frame
+        s_pbo.bindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbos[_pbo]);
+        s_pbo.bufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        void* const mapped = s_pbo.mapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+
+        if (mapped != nullptr) {
+            memcpy(mapped, frame.pixels.data(), size);
+            s_pbo.unmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            // glTexSubImage2D now takes an offset into the buffer and returns before the transfer is done
+            pixels = nullptr;
+            _pbo = (_pbo + 1) % PboCount;
+        }
+        else {
+            s_pbo.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+
+    // ImGui binds the textures it needs, so there's no need to restore the previous binding
+    glBindTexture(GL_TEXTURE_2D, _texture);
+
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame.width, frame.height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, pixels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (pixels == nullptr) {
+        s_pbo.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    _width = frame.width;
+    _height = frame.height;
 }
 
 uintptr_t hc::Video::getCurrentFramebuffer() {
@@ -242,9 +350,7 @@ void hc::Video::setupTexture(unsigned const width, unsigned const height) {
     _textureWidth = width;
     _textureHeight = height;
 
-    if (_texture != 0) {
-        glDeleteTextures(1, &_texture);
-    }
+    deleteTexture();
 
     GLint previous_texture;
     glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
@@ -255,21 +361,26 @@ void hc::Video::setupTexture(unsigned const width, unsigned const height) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    switch (_pixelFormat) {
-        case RETRO_PIXEL_FORMAT_XRGB8888:
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
-            break;
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL);
 
-        case RETRO_PIXEL_FORMAT_RGB565:
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, NULL);
-            break;
+    glBindTexture(GL_TEXTURE_2D, previous_texture);
 
-        case RETRO_PIXEL_FORMAT_0RGB1555:
-        default:
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGRA, GL_UNSIGNED_SHORT_1_5_5_5_REV, NULL);
-            break;
+    // The pixel buffer objects live as long as the texture they're uploaded to
+    if (_usePbos) {
+        s_pbo.genBuffers(PboCount, _pbos);
+        _pbo = 0;
     }
 
-    glBindTexture(GL_TEXTURE_2D, previous_texture);
     _desktop->info(TAG "Texture set to %u x %u", width, height);
 }
+
+void hc::Video::deleteTexture() {
+    if (_texture != 0) {
+        glDeleteTextures(1, &_texture);
+        _texture = 0;
+
+        if (_usePbos) {
+            s_pbo.deleteBuffers(PboCount, _pbos);
+        }
+    }
+}
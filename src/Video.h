@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Desktop.h"
+#include "TripleBuffer.h"
 
 #include <lrcpp/Components.h>
 
@@ -8,6 +9,7 @@
 #include <SDL_opengl.h>
 
 #include <stdint.h>
+#include <vector>
 
 namespace hc {
     class Video: public View, public lrcpp::Video {
@@ -15,12 +17,16 @@ namespace hc {
         Video(Desktop* desktop);
         virtual ~Video() {}
 
-        void init();
+        void init(Perf* const perf);
+        // Skipped frames aren't converted nor shown, used when fast-forwarding
+        void setSkipFrames(bool const skip) { _skipFrames = skip; }
         double getCoreFps() const;
         bool getMousePos(int* const x, int* const y) const;
 
         // hc::View
         virtual char const* getTitle() override;
+        virtual void onCoreLoaded() override;
+        virtual void onSync() override;
         virtual void onDraw() override;
         virtual void onGameUnloaded() override;
         virtual void onCoreUnloaded() override;
@@ -48,12 +54,38 @@ namespace hc {
         virtual retro_proc_address_t getProcAddress(char const* symbol) override;
 
     protected:
+        // A frame converted to 0xAARRGGBB pixels, refresh runs on the emulation thread and the texture is
+        // updated on the UI thread
+        struct Frame {
+            std::vector<uint32_t> pixels;
+            unsigned width;
+            unsigned height;
+        };
+
+        enum {
+            PboCount = 3
+        };
+
         void setupTexture(unsigned const width, unsigned const height);
+        void deleteTexture();
+        void upload();
+
+        Perf* _perf;
+        retro_perf_counter _convertPerf;
 
         unsigned _rotation;
         retro_pixel_format _pixelFormat;
         double _coreFps;
 
+        TripleBuffer<Frame> _frames;
+        bool _skipFrames;
+        bool _usePbos;
+        GLuint _pbos[PboCount];
+        unsigned _pbo;
+
+        unsigned _maxWidth;
+        unsigned _maxHeight;
+
         GLuint _texture;
         unsigned _textureWidth;
         unsigned _textureHeight;
@@ -64,5 +96,16 @@ namespace hc {
         ImVec2 _texturePos;
         ImVec2 _mousePos;
         bool _mouseOnTexture;
+
+        // Exchanged in onSync, the geometry is set by the emulation thread and the mouse position is
+        // read by it
+        struct {
+            unsigned maxWidth;
+            unsigned maxHeight;
+            float aspectRatio;
+            ImVec2 mousePos;
+            bool mouseOnTexture;
+        }
+        _shown;
     };
 }
@@ -0,0 +1,57 @@
+#include "Pixels.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <vector>
+
+// Times the row conversions on a frame sized buffer, the Makefile builds it once with the SSE2 kernels
+// and once with the scalar loops only. The checksums must be the same for both builds.
+
+namespace {
+    enum {
+        Width = 640,
+        Height = 480,
+        Frames = 500
+    };
+
+    template<typename T, typename F>
+    void bench(char const* const name, F const& convert) {
+        std::vector<T> source(Width * Height);
+        std::vector<uint32_t> dest(Width * Height);
+        uint32_t seed = 0x12345678;
+
+        for (auto& pixel : source) {
+            seed = seed * 1103515245 + 12345;
+            pixel = static_cast<T>(seed >> 8 | seed << 16);
+        }
+
+        auto const start = std::chrono::steady_clock::now();
+
+        for (unsigned frame = 0; frame < Frames; frame++) {
+            for (unsigned y = 0; y < Height; y++) {
+                convert(dest.data() + y * Width, source.data() + y * Width, Width);
+            }
+        }
+
+        std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+        uint32_t checksum = 0;
+
+        for (auto const pixel : dest) {
+            checksum = checksum * 31 + pixel;
+        }
+
+        double const pixels = static_cast<double>(Width) * Height * Frames;
+        printf("%-16s %8.1f Mpixels/s  checksum %08x\n", name, pixels / elapsed.count() / 1000000.0, checksum);
+    }
+}
+
+int main(int argc, char const* argv[]) {
+    printf("%s, %ux%u, %u frames\n", argc > 1 ? argv[1] : "pixels", Width, Height, Frames);
+
+    bench<uint16_t>("convertRgb565", hc::pixels::convertRgb565);
+    bench<uint16_t>("convert0Rgb1555", hc::pixels::convert0Rgb1555);
+    bench<uint32_t>("convertXrgb8888", hc::pixels::convertXrgb8888);
+    return 0;
+}
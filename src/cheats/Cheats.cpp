@@ -2,6 +2,11 @@
 #include "Memory.h"
 #include "Set.h"
 #include "Filter.h"
+#include "Scan.h"
+#include "History.h"
+#include "Session.h"
+#include "Snapshot.h"
+#include "LuaUtil.h"
 
 extern "C" {
     #include <lauxlib.h>
@@ -19,81 +24,217 @@ static int l_universal(lua_State* const L) {
     return hc::Set::universal()->push(L);
 }
 
-static int l_filter(lua_State* const L) {
-    char const* const op_str = luaL_checkstring(L, 2);
-    char const* const settings = luaL_checkstring(L, 4);
+namespace {
+    struct Settings {
+        hc::filter::Operator op;
+        bool is_signed;
+        size_t value_size;
+        hc::filter::Endianess endianess;
+    };
+}
+
+// Parses settings such as "ub", "swl" or "udb": signedness, value size, and endianess for sizes other than 1
+static void checkValueSettings(lua_State* const L, int const index, Settings* const s) {
+    char const* const settings = luaL_checkstring(L, index);
 
-    bool is_signed = false;
-    size_t value_size;
-    hc::filter::Endianess endianess = hc::filter::Endianess::Little;
+    s->is_signed = false;
+    s->endianess = hc::filter::Endianess::Little;
 
     switch (settings[0]) {
-        case 's': is_signed = true; break;
-        case 'u': is_signed = false; break;
-        default: return luaL_error(L, "invalid signedness \'%c\'", settings[0]);
+        case 's': s->is_signed = true; break;
+        case 'u': s->is_signed = false; break;
+        default: luaL_error(L, "invalid signedness \'%c\'", settings[0]); return;
     }
 
     switch (settings[1]) {
-        case 'b': value_size = 1; break;
-        case 'w': value_size = 2; break;
-        case 'd': value_size = 4; break;
-        case 'q': value_size = 8; break;
-        default: return luaL_error(L, "invalid operand size \'%c\'", settings[1]);
+        case 'b': s->value_size = 1; break;
+        case 'w': s->value_size = 2; break;
+        case 'd': s->value_size = 4; break;
+        case 'q': s->value_size = 8; break;
+        default: luaL_error(L, "invalid operand size \'%c\'", settings[1]); return;
     }
 
-    if (value_size != 1) {
+    if (s->value_size != 1) {
         switch (settings[2]) {
-            case 'l': endianess = hc::filter::Endianess::Little; break;
-            case 'b': endianess = hc::filter::Endianess::Big; break;
-            default: return luaL_error(L, "invalid endianess \'%c\'", settings[2]);
+            case 'l': s->endianess = hc::filter::Endianess::Little; break;
+            case 'b': s->endianess = hc::filter::Endianess::Big; break;
+            default: luaL_error(L, "invalid endianess \'%c\'", settings[2]); return;
         }
     }
 
-    if (settings[value_size == 1 ? 2 : 3] != 0) {
-        return luaL_error(L, "invalid settings string \"%s\"", settings);
+    if (settings[s->value_size == 1 ? 2 : 3] != 0) {
+        luaL_error(L, "invalid settings string \"%s\"", settings);
+        return;
     }
+}
+
+static void checkSettings(lua_State* const L, Settings* const s) {
+    char const* const op_str = luaL_checkstring(L, 2);
+    checkValueSettings(L, 4, s);
 
-    hc::filter::Operator op = hc::filter::Operator::NotEqual;
     uint8_t const op1 = op_str[0];
     uint8_t const op2 = op1 != 0 ? op_str[1] : 0;
 
     switch (op1 << 8 | op2) {
-        case '<' << 8 | 0:   /* < */  op = hc::filter::Operator::LessThan; break;
-        case '<' << 8 | '=': /* <= */ op = hc::filter::Operator::LessEqual; break;
-        case '>' << 8 | 0:   /* > */  op = hc::filter::Operator::GreaterThan; break;
-        case '>' << 8 | '=': /* >= */ op = hc::filter::Operator::GreaterEqual; break;
-        case '=' << 8 | '=': /* == */ op = hc::filter::Operator::Equal; break;
-        case '~' << 8 | '=': /* ~= */ op = hc::filter::Operator::NotEqual; break;
-        default: return luaL_error(L, "unknown operator %s", op_str);
+        case '<' << 8 | 0:   /* < */  s->op = hc::filter::Operator::LessThan; break;
+        case '<' << 8 | '=': /* <= */ s->op = hc::filter::Operator::LessEqual; break;
+        case '>' << 8 | 0:   /* > */  s->op = hc::filter::Operator::GreaterThan; break;
+        case '>' << 8 | '=': /* >= */ s->op = hc::filter::Operator::GreaterEqual; break;
+        case '=' << 8 | '=': /* == */ s->op = hc::filter::Operator::Equal; break;
+        case '~' << 8 | '=': /* ~= */ s->op = hc::filter::Operator::NotEqual; break;
+        default: luaL_error(L, "unknown operator %s", op_str); return;
     }
+}
+
+static hc::Set* filter(hc::Memory const& memory, lua_Integer value, Settings const& s, hc::Set const* candidates) {
+    if (candidates != nullptr) {
+        return s.is_signed ? hc::filter::fsigned(memory, value, s.op, s.endianess, s.value_size, candidates)
+                           : hc::filter::funsigned(memory, value, s.op, s.endianess, s.value_size, candidates);
+    }
+
+    return s.is_signed ? hc::filter::fsigned(memory, value, s.op, s.endianess, s.value_size)
+                       : hc::filter::funsigned(memory, value, s.op, s.endianess, s.value_size);
+}
+
+static hc::Set* filter(hc::Memory const& memory, hc::Memory const& other, Settings const& s, hc::Set const* candidates) {
+    if (candidates != nullptr) {
+        return s.is_signed ? hc::filter::fsigned(memory, other, s.op, s.endianess, s.value_size, candidates)
+                           : hc::filter::funsigned(memory, other, s.op, s.endianess, s.value_size, candidates);
+    }
+
+    return s.is_signed ? hc::filter::fsigned(memory, other, s.op, s.endianess, s.value_size)
+                       : hc::filter::funsigned(memory, other, s.op, s.endianess, s.value_size);
+}
 
+static int l_filter(lua_State* const L) {
+    Settings settings;
+    checkSettings(L, &settings);
+
+    hc::Set const* const candidates = lua_isnoneornil(L, 5) ? nullptr : hc::Set::check(L, 5);
+    hc::Memory const& memory = *hc::Memory::check(L, 1);
     hc::Set* result = nullptr;
 
     if (lua_isnumber(L, 3)) {
-        if (is_signed) {
-            result = hc::filter::fsigned(*hc::Memory::check(L, 1), lua_tointeger(L, 3), op, endianess, value_size);
-        }
-        else {
-            result = hc::filter::funsigned(*hc::Memory::check(L, 1), lua_tointeger(L, 3), op, endianess, value_size);
-        }
+        result = filter(memory, lua_tointeger(L, 3), settings, candidates);
     }
     else {
-        if (is_signed) {
-            result = hc::filter::fsigned(*hc::Memory::check(L, 1), *hc::Memory::check(L, 3), op, endianess, value_size);
-        }
-        else {
-            result = hc::filter::funsigned(*hc::Memory::check(L, 1), *hc::Memory::check(L, 3), op, endianess, value_size);
-        }
+        result = filter(memory, *hc::Memory::check(L, 3), settings, candidates);
+    }
+
+    if (result == nullptr) {
+        return luaL_error(L, "memory regions must have the same base and size");
     }
 
     return result->push(L);
 }
 
+static int l_filterAsync(lua_State* const L) {
+    Settings settings;
+    checkSettings(L, &settings);
+
+    // Check all arguments before allocating the scan
+    hc::Set const* const candidates = lua_isnoneornil(L, 5) ? nullptr : hc::Set::check(L, 5);
+    bool const isValue = lua_isnumber(L, 3);
+
+    hc::Memory::check(L, 1);
+
+    if (!isValue) {
+        hc::Memory::check(L, 3);
+    }
+
+    auto const scan = new hc::Scan;
+    hc::Memory const* const memory = scan->snapshot(L, 1);
+
+    if (candidates != nullptr) {
+        scan->keep(L, 5);
+    }
+
+    if (isValue) {
+        lua_Integer const value = lua_tointeger(L, 3);
+        scan->start([memory, value, settings, candidates]() { return filter(*memory, value, settings, candidates); });
+    }
+    else {
+        hc::Memory const* const other = scan->snapshot(L, 3);
+        scan->start([memory, other, settings, candidates]() { return filter(*memory, *other, settings, candidates); });
+    }
+
+    return scan->push(L);
+}
+
+static int l_history(lua_State* const L) {
+    hc::Memory const& memory = *hc::Memory::check(L, 1);
+
+    Settings settings;
+    checkValueSettings(L, 2, &settings);
+
+    hc::Set const* const candidates = lua_isnoneornil(L, 3) ? nullptr : hc::Set::check(L, 3);
+    auto const history = new hc::History(memory, candidates, settings.is_signed, settings.endianess, settings.value_size);
+    return history->push(L);
+}
+
+static int l_save(lua_State* const L) {
+    char const* const path = luaL_checkstring(L, 1);
+
+    Settings settings;
+    checkValueSettings(L, 2, &settings);
+    char const* const settingsString = lua_tostring(L, 2);
+
+    hc::Set const* const set = hc::Set::check(L, 3);
+    std::vector<hc::Snapshot const*> snapshots;
+    int const top = lua_gettop(L);
+
+    for (int i = 4; i <= top; i++) {
+        auto const snapshot = dynamic_cast<hc::Snapshot const*>(hc::Memory::check(L, i));
+        luaL_argcheck(L, snapshot != nullptr, i, "snapshot expected");
+        snapshots.emplace_back(snapshot);
+    }
+
+    luaL_argcheck(L, !snapshots.empty(), 4, "snapshot expected");
+
+    std::string error;
+
+    if (!hc::Session::save(path, settingsString, set, snapshots, &error)) {
+        return luaL_error(L, "%s", error.c_str());
+    }
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int l_load(lua_State* const L) {
+    char const* const path = luaL_checkstring(L, 1);
+    hc::Memory* const memory = hc::Memory::check(L, 2);
+
+    std::string settings;
+    hc::Set* set = nullptr;
+    std::vector<hc::Snapshot*> snapshots;
+    std::string error;
+
+    if (!hc::Session::load(path, memory, &settings, &set, &snapshots, &error)) {
+        return luaL_error(L, "%s", error.c_str());
+    }
+
+    luaL_checkstack(L, static_cast<int>(snapshots.size()) + 2, "too many snapshots");
+
+    lua_pushlstring(L, settings.c_str(), settings.length());
+    set->push(L);
+
+    for (auto const snapshot : snapshots) {
+        snapshot->push(L);
+    }
+
+    return static_cast<int>(snapshots.size()) + 2;
+}
+
 int hc::cheats::push(lua_State* const L) {
     static const luaL_Reg functions[] = {
         {"empty", l_empty},
         {"universal", l_universal},
         {"filter", l_filter},
+        {"filterAsync", l_filterAsync},
+        {"history", l_history},
+        {"saveSession", l_save},
+        {"loadSession", l_load},
         {nullptr, nullptr}
     };
 
@@ -115,6 +256,9 @@ int hc::cheats::push(lua_State* const L) {
     return 1;
 }
 
-void hc::cheats::onFrame() {
-
+void hc::cheats::onFrame(lua_State* const L, Logger* const logger) {
+    if (s_onFrame != LUA_NOREF) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, s_onFrame);
+        protectedCall(L, 0, 0, logger);
+    }
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "Logger.h"
+
 extern "C" {
     #include <lua.h>
 }
@@ -7,6 +9,6 @@ extern "C" {
 namespace hc {
     namespace cheats {
         int push(lua_State* const L);
-        void onFrame();
+        void onFrame(lua_State* const L, Logger* const logger);
     }
 }
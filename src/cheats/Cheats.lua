@@ -15,27 +15,94 @@ return function(M)
 
     M.next = function(operator, operand)
         local snapshot = cheats.memory:snapshot()
-        local nextset
 
-        if operand then
-            nextset = M.filter(snapshot, operator, operand, cheats.settings)
-        else
-            nextset = M.filter(snapshot, operator, cheats.current, cheats.settings)
+        -- Only the addresses still in the set are tested
+        cheats.set = M.filter(snapshot, operator, operand or cheats.current, cheats.settings, cheats.set)
+        cheats.current = snapshot
+        print(string_format('%d result(s)', cheats.set:size()))
+    end
+
+    M.nextAsync = function(operator, operand, callback)
+        local snapshot = cheats.memory:snapshot()
+        local scan = M.filterAsync(snapshot, operator, operand or cheats.current, cheats.settings, cheats.set)
+
+        onframe[#onframe + 1] = function()
+            if not scan:done() then
+                return true
+            end
+
+            cheats.set = scan:result()
+            cheats.current = snapshot
+            print(string_format('%d result(s)', cheats.set:size()))
+
+            if callback then
+                callback(cheats.set)
+            end
+
+            return false
         end
+    end
 
+    -- Searches for values that are not known, by recording how they change
+    M.unknown = function(memory, settings)
+        cheats.memory = memory
+        cheats.settings = settings
+        cheats.first = memory:snapshot()
+        cheats.current = cheats.first
+        cheats.set = M.universal()
+        cheats.history = M.history(cheats.first, settings)
+    end
+
+    M.record = function()
+        local snapshot = cheats.memory:snapshot()
+        cheats.history:record(snapshot)
         cheats.current = snapshot
-        cheats.set = cheats.set * nextset
+    end
+
+    M.select = function(predicate, arg1, arg2)
+        cheats.set = cheats.set * cheats.history:select(predicate, arg1, arg2)
+        print(string_format('%d result(s)', cheats.set:size()))
+    end
+
+    -- Saves the current search so it can be resumed with M.resume
+    M.save = function(path)
+        return M.saveSession(path, cheats.settings, cheats.set, cheats.first, cheats.current)
+    end
+
+    M.resume = function(path, memory)
+        local settings, set, first, current = M.loadSession(path, memory)
+
+        cheats.memory = memory
+        cheats.settings = settings
+        cheats.set = set
+        cheats.first = first
+        cheats.current = current or first
+        cheats.history = nil
         print(string_format('%d result(s)', cheats.set:size()))
     end
 
-    M.list = function()
-        for _, addr in cheats.set:elements() do
+    -- Lists one page of results, all of them if no page is given
+    M.list = function(page, size)
+        local iterator, state, control
+
+        if page then
+            iterator, state, control = ipairs(cheats.set:page(page, size or 32))
+        else
+            iterator, state, control = cheats.set:elements()
+        end
+
+        for _, addr in iterator, state, control do
             print(string_format('%08x %02x %02x', addr, cheats.first:peek(addr), cheats.current:peek(addr)))
         end
 
         return cheats.set
     end
 
+    -- Highlights the results in the views of the memory being searched
+    M.highlight = function()
+        cheats.memory:highlight(cheats.set)
+    end
+
     return function()
         local count = #onframe
         local i = 1
@@ -4,11 +4,53 @@
 #include "Memory.h"
 #include "cheats/Snapshot.h"
 #include "cheats/Set.h"
+#include "ThreadPool.h"
 
 extern "C" {
     #include <lauxlib.h>
 }
 
+#include <vector>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // Direct view of the bytes of a memory region, so that the filters don't
+    // have to go through the virtual peek for every byte. Regions that can't
+    // be addressed directly are read into a private buffer in one go.
+    class Bytes {
+    public:
+        Bytes(hc::Memory const& memory, uint64_t base, uint64_t size) : _base(base), _size(size) {
+            _data = memory.span(_base, _size);
+
+            if (_data == nullptr) {
+                _buffer.resize(_size);
+                memory.read(_base, _buffer.data(), _size);
+                _data = _buffer.data();
+            }
+        }
+
+        uint64_t base() const { return _base; }
+        uint64_t size() const { return _size; }
+        uint8_t peek(uint64_t address) const { return _data[address - _base]; }
+        uint8_t const* data(uint64_t address) const { return _data + (address - _base); }
+
+    protected:
+        uint64_t const _base;
+        uint64_t const _size;
+        uint8_t const* _data;
+        std::vector<uint8_t> _buffer;
+    };
+
+    // The set where a full region scan adds the addresses it finds
+    struct Into {
+        hc::Set* result;
+    };
+}
+
 template<typename A, typename T, hc::filter::Endianess E>
 static T first(A const a, uint64_t address) {
     if (sizeof(T) == 1) {
@@ -159,9 +201,137 @@ static bool compare(const T v1, const T v2) {
     }
 }
 
+#ifdef __SSE2__
+namespace {
+    // Lane operations for values of W bytes, 16 / W values per vector
+    template<size_t W> struct Lanes;
+
+    template<> struct Lanes<1> {
+        static __m128i set1(uint64_t v) { return _mm_set1_epi8(static_cast<char>(v)); }
+        static __m128i swap(__m128i x) { return x; }
+        static __m128i bias() { return _mm_set1_epi8(static_cast<char>(0x80)); }
+        static __m128i eq(__m128i a, __m128i b) { return _mm_cmpeq_epi8(a, b); }
+        static __m128i gt(__m128i a, __m128i b) { return _mm_cmpgt_epi8(a, b); }
+        static unsigned mask(size_t k) { (void)k; return 0xffff; }
+    };
+
+    template<> struct Lanes<2> {
+        static __m128i set1(uint64_t v) { return _mm_set1_epi16(static_cast<short>(v)); }
+        static __m128i swap(__m128i x) { return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8)); }
+        static __m128i bias() { return _mm_set1_epi16(static_cast<short>(0x8000)); }
+        static __m128i eq(__m128i a, __m128i b) { return _mm_cmpeq_epi16(a, b); }
+        static __m128i gt(__m128i a, __m128i b) { return _mm_cmpgt_epi16(a, b); }
+        static unsigned mask(size_t k) { return 0x5555U << k; }
+    };
+
+    template<> struct Lanes<4> {
+        static __m128i set1(uint64_t v) { return _mm_set1_epi32(static_cast<int>(v)); }
+
+        static __m128i swap(__m128i x) {
+            x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+            x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+            return Lanes<2>::swap(x);
+        }
+
+        static __m128i bias() { return _mm_set1_epi32(static_cast<int>(0x80000000U)); }
+        static __m128i eq(__m128i a, __m128i b) { return _mm_cmpeq_epi32(a, b); }
+        static __m128i gt(__m128i a, __m128i b) { return _mm_cmpgt_epi32(a, b); }
+        static unsigned mask(size_t k) { return 0x1111U << k; }
+    };
+
+    template<> struct Lanes<8> {
+        static __m128i set1(uint64_t v) { return _mm_set_epi32(static_cast<int>(v >> 32), static_cast<int>(v), static_cast<int>(v >> 32), static_cast<int>(v)); }
+
+        static __m128i swap(__m128i x) {
+            x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+            x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+            return Lanes<2>::swap(x);
+        }
+
+        static __m128i bias() { return _mm_set_epi32(static_cast<int>(0x80000000U), 0, static_cast<int>(0x80000000U), 0); }
+
+        static __m128i eq(__m128i a, __m128i b) {
+            __m128i const eq32 = _mm_cmpeq_epi32(a, b);
+            return _mm_and_si128(eq32, _mm_shuffle_epi32(eq32, _MM_SHUFFLE(2, 3, 0, 1)));
+        }
+
+        static __m128i gt(__m128i a, __m128i b) {
+            // SSE2 has no 64-bit compare: signed compare of the high halves,
+            // unsigned compare of the low halves when the high halves are equal
+            __m128i const low = _mm_set_epi32(0, static_cast<int>(0x80000000U), 0, static_cast<int>(0x80000000U));
+            __m128i const gt32 = _mm_cmpgt_epi32(a, b);
+            __m128i const eq32 = _mm_cmpeq_epi32(a, b);
+            __m128i const gtLow = _mm_cmpgt_epi32(_mm_xor_si128(a, low), _mm_xor_si128(b, low));
+            __m128i const gt64 = _mm_or_si128(gt32, _mm_and_si128(eq32, _mm_shuffle_epi32(gtLow, _MM_SHUFFLE(2, 2, 0, 0))));
+            return _mm_shuffle_epi32(gt64, _MM_SHUFFLE(3, 3, 1, 1));
+        }
+
+        static unsigned mask(size_t k) { return 0x0101U << k; }
+    };
+}
+
+template<typename T, hc::filter::Endianess E>
+static __m128i vector(Bytes const& a, uint64_t address) {
+    __m128i const x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(a.data(address)));
+    return E == hc::filter::Endianess::Big ? Lanes<sizeof(T)>::swap(x) : x;
+}
+
+template<typename T, hc::filter::Endianess E>
+static __m128i vector(int64_t a, uint64_t address) {
+    (void)address;
+    return Lanes<sizeof(T)>::set1(static_cast<uint64_t>(a));
+}
+
+template<typename T, hc::filter::Endianess E>
+static __m128i vector(uint64_t a, uint64_t address) {
+    (void)address;
+    return Lanes<sizeof(T)>::set1(a);
+}
+
+template<typename T, hc::filter::Operator O>
+static unsigned compare(__m128i v1, __m128i v2) {
+    typedef Lanes<sizeof(T)> L;
+
+    if (!std::is_signed<T>()) {
+        // Flip the sign bits so that the signed compares order unsigned values
+        v1 = _mm_xor_si128(v1, L::bias());
+        v2 = _mm_xor_si128(v2, L::bias());
+    }
+
+    switch (O) {
+        case hc::filter::Operator::LessThan: return _mm_movemask_epi8(L::gt(v2, v1));
+        case hc::filter::Operator::LessEqual: return _mm_movemask_epi8(L::gt(v1, v2)) ^ 0xffff;
+        case hc::filter::Operator::GreaterThan: return _mm_movemask_epi8(L::gt(v1, v2));
+        case hc::filter::Operator::GreaterEqual: return _mm_movemask_epi8(L::gt(v2, v1)) ^ 0xffff;
+        case hc::filter::Operator::Equal: return _mm_movemask_epi8(L::eq(v1, v2));
+        case hc::filter::Operator::NotEqual: return _mm_movemask_epi8(L::eq(v1, v2)) ^ 0xffff;
+    }
+
+    return 0;
+}
+
+// Tests the 16 values starting at address .. address + 15, bit i of the result
+// is set if the value at address + i passes. Values wider than one byte are
+// loaded once per byte offset inside the value, each load covering the values
+// that start at that offset.
 template<typename A, typename B, typename T, hc::filter::Endianess E, hc::filter::Operator O>
-static hc::Set* doFilter(A const a, B const b) {
-    hc::Set* result = hc::Set::empty();
+static unsigned block(A const a, B const b, uint64_t address) {
+    unsigned mask = 0;
+
+    for (size_t k = 0; k < sizeof(T); k++) {
+        __m128i const v1 = vector<T, E>(a, address + k);
+        __m128i const v2 = vector<T, E>(b, address + k);
+        mask |= compare<T, O>(v1, v2) & Lanes<sizeof(T)>::mask(k);
+    }
+
+    return mask;
+}
+#endif
+
+// Tests every address in the region
+template<typename A, typename B, typename T, hc::filter::Endianess E, hc::filter::Operator O>
+static hc::Set* doFilter(A const a, B const b, Into const into) {
+    hc::Set* const result = into.result;
 
     uint64_t address = a.base();
     uint64_t const size = a.size();
@@ -172,6 +342,28 @@ static hc::Set* doFilter(A const a, B const b) {
 
     uint64_t const end = address + size - sizeof(T) + 1;
 
+#ifdef __SSE2__
+    // A block reads sizeof(T) - 1 bytes past its last address
+    uint64_t const blockSize = 16 + sizeof(T) - 1;
+
+    if (size >= blockSize) {
+        uint64_t const blockEnd = address + size - blockSize + 1;
+
+        for (; address < blockEnd; address += 16) {
+            unsigned mask = block<A, B, T, E, O>(a, b, address);
+
+            while (mask != 0) {
+                result->add(address + __builtin_ctz(mask));
+                mask &= mask - 1;
+            }
+        }
+
+        if (address >= end) {
+            return result;
+        }
+    }
+#endif
+
     T current1 = first<A, T, E>(a, address);
     T current2 = first<B, T, E>(b, address);
 
@@ -193,70 +385,187 @@ static hc::Set* doFilter(A const a, B const b) {
     return result;
 }
 
-template<typename A, typename B, typename T, hc::filter::Endianess E>
-static hc::Set* doFilter(A const a, B const b, hc::filter::Operator op) {
+// Tests only the candidate addresses, which are never complemented here
+template<typename A, typename B, typename T, hc::filter::Endianess E, hc::filter::Operator O>
+static hc::Set* doFilter(A const a, B const b, hc::Set const* candidates) {
+    hc::Set* result = hc::Set::empty();
+
+    uint64_t const base = a.base();
+    uint64_t const size = a.size();
+
+    if (size < sizeof(T)) {
+        return result;
+    }
+
+    uint64_t const end = base + size - sizeof(T) + 1;
+
+    for (uint64_t const address : *candidates) {
+        if (address < base) {
+            continue;
+        }
+        else if (address >= end) {
+            break;
+        }
+
+        if (compare<T, O>(first<A, T, E>(a, address), first<B, T, E>(b, address))) {
+            result->add(address);
+        }
+    }
+
+    return result;
+}
+
+template<typename A, typename B, typename T, hc::filter::Endianess E, typename C>
+static hc::Set* doFilter(A const a, B const b, hc::filter::Operator op, C const candidates) {
     switch (op) {
         case hc::filter::Operator::LessThan:
-            return doFilter<A, B, T, E, hc::filter::Operator::LessThan>(a, b);
+            return doFilter<A, B, T, E, hc::filter::Operator::LessThan>(a, b, candidates);
 
         case hc::filter::Operator::LessEqual:
-            return doFilter<A, B, T, E, hc::filter::Operator::LessEqual>(a, b);
+            return doFilter<A, B, T, E, hc::filter::Operator::LessEqual>(a, b, candidates);
 
         case hc::filter::Operator::GreaterThan:
-            return doFilter<A, B, T, E, hc::filter::Operator::GreaterThan>(a, b);
+            return doFilter<A, B, T, E, hc::filter::Operator::GreaterThan>(a, b, candidates);
 
         case hc::filter::Operator::GreaterEqual:
-            return doFilter<A, B, T, E, hc::filter::Operator::GreaterEqual>(a, b);
+            return doFilter<A, B, T, E, hc::filter::Operator::GreaterEqual>(a, b, candidates);
 
         case hc::filter::Operator::Equal:
-            return doFilter<A, B, T, E, hc::filter::Operator::Equal>(a, b);
+            return doFilter<A, B, T, E, hc::filter::Operator::Equal>(a, b, candidates);
 
         case hc::filter::Operator::NotEqual:
-            return doFilter<A, B, T, E, hc::filter::Operator::NotEqual>(a, b);
+            return doFilter<A, B, T, E, hc::filter::Operator::NotEqual>(a, b, candidates);
     }
 
     return nullptr;
 }
 
-template<typename A, typename B, typename T>
-static hc::Set* doFilter(A const a, B const b, hc::filter::Operator op, hc::filter::Endianess endianess) {
+template<typename A, typename B, typename T, typename C>
+static hc::Set* doFilter(A const a, B const b, hc::filter::Operator op, hc::filter::Endianess endianess, C const candidates) {
     switch (endianess) {
         case hc::filter::Endianess::Little:
-            return doFilter<A, B, T, hc::filter::Endianess::Little>(a, b, op);
+            return doFilter<A, B, T, hc::filter::Endianess::Little>(a, b, op, candidates);
 
         case hc::filter::Endianess::Big:
-            return doFilter<A, B, T, hc::filter::Endianess::Big>(a, b, op);
+            return doFilter<A, B, T, hc::filter::Endianess::Big>(a, b, op, candidates);
     }
 
     return nullptr;
 }
 
-template<typename A, typename B>
-static hc::Set* doFilterSigned(A const a, B const b, hc::filter::Operator op, hc::filter::Endianess endianess, size_t value_size) {
+template<typename A, typename B, typename C>
+static hc::Set* doFilterSigned(A const a, B const b, hc::filter::Operator op, hc::filter::Endianess endianess, size_t value_size, C const candidates) {
     switch (value_size) {
-        case 1: return doFilter<A, B, int8_t>(a, b, op, endianess);
-        case 2: return doFilter<A, B, int16_t>(a, b, op, endianess);
-        case 4: return doFilter<A, B, int32_t>(a, b, op, endianess);
-        case 8: return doFilter<A, B, int64_t>(a, b, op, endianess);
+        case 1: return doFilter<A, B, int8_t>(a, b, op, endianess, candidates);
+        case 2: return doFilter<A, B, int16_t>(a, b, op, endianess, candidates);
+        case 4: return doFilter<A, B, int32_t>(a, b, op, endianess, candidates);
+        case 8: return doFilter<A, B, int64_t>(a, b, op, endianess, candidates);
     }
 
     return nullptr;
 }
 
-template<typename A, typename B>
-static hc::Set* doFilterUnsigned(A const a, B const b, hc::filter::Operator op, hc::filter::Endianess endianess, size_t value_size) {
+template<typename A, typename B, typename C>
+static hc::Set* doFilterUnsigned(A const a, B const b, hc::filter::Operator op, hc::filter::Endianess endianess, size_t value_size, C const candidates) {
     switch (value_size) {
-        case 1: return doFilter<A, B, uint8_t>(a, b, op, endianess);
-        case 2: return doFilter<A, B, uint16_t>(a, b, op, endianess);
-        case 4: return doFilter<A, B, uint32_t>(a, b, op, endianess);
-        case 8: return doFilter<A, B, uint64_t>(a, b, op, endianess);
+        case 1: return doFilter<A, B, uint8_t>(a, b, op, endianess, candidates);
+        case 2: return doFilter<A, B, uint16_t>(a, b, op, endianess, candidates);
+        case 4: return doFilter<A, B, uint32_t>(a, b, op, endianess, candidates);
+        case 8: return doFilter<A, B, uint64_t>(a, b, op, endianess, candidates);
     }
 
     return nullptr;
 }
 
+// Scans are split in chunks of this size, aligned so that chunks never
+// share a Set container
+#define CHUNK_SIZE (UINT64_C(1) << 20)
+
+// Runs filter on the chunks in parallel and appends the partial results in
+// order. A chunk tests the values starting inside it, so it reads
+// value_size - 1 bytes from the next chunk.
+template<typename F>
+static hc::Set* scan(hc::Memory const& memory1, hc::Memory const& memory2, size_t value_size, F const& filter) {
+    switch (value_size) {
+        case 1: case 2: case 4: case 8: break;
+        default: return nullptr;
+    }
+
+    uint64_t const base = memory1.base();
+    uint64_t const size = memory1.size();
+
+    if (size < value_size) {
+        return hc::Set::empty();
+    }
+
+    uint64_t const end = base + size - value_size + 1;
+    uint64_t const first = base & ~(CHUNK_SIZE - 1);
+    size_t const count = static_cast<size_t>((end - 1 - first) / CHUNK_SIZE + 1);
+    std::vector<hc::Set*> parts(count, nullptr);
+
+    hc::ThreadPool::instance()->parallelFor(count, [&](size_t i) {
+        uint64_t const chunkBegin = std::max(first + i * CHUNK_SIZE, base);
+        uint64_t const chunkEnd = std::min(first + (i + 1) * CHUNK_SIZE, end);
+        uint64_t const chunkLast = chunkEnd + value_size - 1;
+        hc::Set* const part = hc::Set::empty();
+
+        if (memory1.span(chunkBegin, chunkLast - chunkBegin) != nullptr && memory2.span(chunkBegin, chunkLast - chunkBegin) != nullptr) {
+            filter(chunkBegin, chunkLast - chunkBegin, Into{part});
+        }
+        else {
+            // Snapshots can only be accessed directly one page at a time, the
+            // values inside a page are tested in place and the ones straddling
+            // two pages on a copy of the bytes around the boundary
+            uint64_t address = chunkBegin;
+
+            while (address < chunkEnd) {
+                uint64_t const page = (address - base) / hc::Snapshot::PageSize + 1;
+                uint64_t const pageEnd = std::min(base + page * hc::Snapshot::PageSize, chunkLast);
+
+                if (pageEnd - address >= value_size) {
+                    filter(address, pageEnd - address, Into{part});
+                }
+
+                if (value_size > 1 && pageEnd < chunkLast) {
+                    uint64_t const from = std::max(address, pageEnd - value_size + 1);
+                    uint64_t const to = std::min(pageEnd + value_size - 1, chunkLast);
+                    filter(from, to - from, Into{part});
+                }
+
+                address = pageEnd;
+            }
+        }
+
+        parts[i] = part;
+    });
+
+    hc::Set* const result = parts[0];
+
+    for (size_t i = 1; i < count; i++) {
+        result->append(parts[i]);
+        delete parts[i];
+    }
+
+    return result;
+}
+
+// Filters the candidates only, complemented sets exclude addresses from
+// the whole region so they still need a full scan
+static hc::Set* narrow(hc::Set* all, hc::Set const* candidates) {
+    if (all == nullptr) {
+        return nullptr;
+    }
+
+    hc::Set* const result = all->intersection(candidates);
+    delete all;
+    return result;
+}
+
 hc::Set* hc::filter::fsigned(Memory const& memory, int64_t value, Operator op, Endianess endianess, size_t value_size) {
-    return doFilterSigned<Memory const&, int64_t>(memory, value, op, endianess, value_size);
+    return scan(memory, memory, value_size, [&](uint64_t base, uint64_t size, Into into) {
+        Bytes const bytes(memory, base, size);
+        return doFilterSigned<Bytes const&, int64_t>(bytes, value, op, endianess, value_size, into);
+    });
 }
 
 hc::Set* hc::filter::fsigned(Memory const& memory1, Memory const& memory2, Operator op, Endianess endianess, size_t value_size) {
@@ -264,11 +573,18 @@ hc::Set* hc::filter::fsigned(Memory const& memory1, Memory const& memory2, Opera
         return nullptr;
     }
 
-    return doFilterSigned<Memory const&, Memory const&>(memory1, memory2, op, endianess, value_size);
+    return scan(memory1, memory2, value_size, [&](uint64_t base, uint64_t size, Into into) {
+        Bytes const bytes1(memory1, base, size);
+        Bytes const bytes2(memory2, base, size);
+        return doFilterSigned<Bytes const&, Bytes const&>(bytes1, bytes2, op, endianess, value_size, into);
+    });
 }
 
 hc::Set* hc::filter::funsigned(Memory const& memory, uint64_t value, Operator op, Endianess endianess, size_t value_size) {
-    return doFilterUnsigned<Memory const&, uint64_t>(memory, value, op, endianess, value_size);
+    return scan(memory, memory, value_size, [&](uint64_t base, uint64_t size, Into into) {
+        Bytes const bytes(memory, base, size);
+        return doFilterUnsigned<Bytes const&, uint64_t>(bytes, value, op, endianess, value_size, into);
+    });
 }
 
 hc::Set* hc::filter::funsigned(Memory const& memory1, Memory const& memory2, Operator op, Endianess endianess, size_t value_size) {
@@ -276,5 +592,47 @@ hc::Set* hc::filter::funsigned(Memory const& memory1, Memory const& memory2, Ope
         return nullptr;
     }
 
-    return doFilterUnsigned<Memory const&, Memory const&>(memory1, memory2, op, endianess, value_size);
+    return scan(memory1, memory2, value_size, [&](uint64_t base, uint64_t size, Into into) {
+        Bytes const bytes1(memory1, base, size);
+        Bytes const bytes2(memory2, base, size);
+        return doFilterUnsigned<Bytes const&, Bytes const&>(bytes1, bytes2, op, endianess, value_size, into);
+    });
+}
+
+hc::Set* hc::filter::fsigned(Memory const& memory, int64_t value, Operator op, Endianess endianess, size_t value_size, Set const* candidates) {
+    if (candidates->complemented()) {
+        return narrow(fsigned(memory, value, op, endianess, value_size), candidates);
+    }
+
+    return doFilterSigned<Memory const&, int64_t>(memory, value, op, endianess, value_size, candidates);
+}
+
+hc::Set* hc::filter::fsigned(Memory const& memory1, Memory const& memory2, Operator op, Endianess endianess, size_t value_size, Set const* candidates) {
+    if (candidates->complemented()) {
+        return narrow(fsigned(memory1, memory2, op, endianess, value_size), candidates);
+    }
+    else if (memory1.base() != memory2.base() || memory1.size() != memory2.size()) {
+        return nullptr;
+    }
+
+    return doFilterSigned<Memory const&, Memory const&>(memory1, memory2, op, endianess, value_size, candidates);
+}
+
+hc::Set* hc::filter::funsigned(Memory const& memory, uint64_t value, Operator op, Endianess endianess, size_t value_size, Set const* candidates) {
+    if (candidates->complemented()) {
+        return narrow(funsigned(memory, value, op, endianess, value_size), candidates);
+    }
+
+    return doFilterUnsigned<Memory const&, uint64_t>(memory, value, op, endianess, value_size, candidates);
+}
+
+hc::Set* hc::filter::funsigned(Memory const& memory1, Memory const& memory2, Operator op, Endianess endianess, size_t value_size, Set const* candidates) {
+    if (candidates->complemented()) {
+        return narrow(funsigned(memory1, memory2, op, endianess, value_size), candidates);
+    }
+    else if (memory1.base() != memory2.base() || memory1.size() != memory2.size()) {
+        return nullptr;
+    }
+
+    return doFilterUnsigned<Memory const&, Memory const&>(memory1, memory2, op, endianess, value_size, candidates);
 }
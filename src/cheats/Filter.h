@@ -33,5 +33,12 @@ namespace hc {
 
         Set* funsigned(Memory const& memory, uint64_t value, Operator op, Endianess endianess, size_t valueSize);
         Set* funsigned(Memory const& memory1, Memory const& memory2, Operator op, Endianess endianess, size_t valueSize);
+
+        // Only test the addresses in candidates, the result is a subset of it
+        Set* fsigned(Memory const& memory, int64_t value, Operator op, Endianess endianess, size_t valueSize, Set const* candidates);
+        Set* fsigned(Memory const& memory1, Memory const& memory2, Operator op, Endianess endianess, size_t valueSize, Set const* candidates);
+
+        Set* funsigned(Memory const& memory, uint64_t value, Operator op, Endianess endianess, size_t valueSize, Set const* candidates);
+        Set* funsigned(Memory const& memory1, Memory const& memory2, Operator op, Endianess endianess, size_t valueSize, Set const* candidates);
     }
 }
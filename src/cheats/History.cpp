@@ -0,0 +1,403 @@
+#include "cheats/History.h"
+#include "cheats/Set.h"
+#include "cheats/Snapshot.h"
+#include "Memory.h"
+
+extern "C" {
+    #include <lauxlib.h>
+}
+
+#include <string.h>
+
+#include <algorithm>
+
+static uint64_t zigzag(int64_t value) {
+    return static_cast<uint64_t>(value) << 1 ^ static_cast<uint64_t>(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1 ^ (~(value & 1) + 1));
+}
+
+hc::History::History(Memory const& memory, Set const* candidates, bool isSigned, filter::Endianess endianess, size_t valueSize)
+    : _addresses(nullptr)
+    , _count(0)
+    , _base(memory.base())
+    , _size(memory.size())
+    , _isSigned(isSigned)
+    , _endianess(endianess)
+    , _valueSize(valueSize)
+{
+    // Only addresses where a whole value fits in the memory
+    Set* const all = Set::empty();
+
+    if (_size >= valueSize) {
+        all->addRange(_base, _base + _size - valueSize);
+    }
+
+    if (candidates != nullptr) {
+        _addresses = all->intersection(candidates);
+        delete all;
+    }
+    else {
+        _addresses = all;
+    }
+
+    _count = _addresses->size();
+
+    read(memory, &_last);
+    pack(&_first, _last, std::vector<uint8_t>());
+}
+
+hc::History::~History() {
+    delete _addresses;
+}
+
+bool hc::History::record(Memory const& memory) {
+    // The addresses only make sense in the memory they were taken from
+    if (memory.base() != _base || memory.size() != _size) {
+        return false;
+    }
+
+    std::vector<uint8_t> values;
+    read(memory, &values);
+
+    _columns.emplace_back();
+    pack(&_columns.back(), values, _last);
+    _last.swap(values);
+    return true;
+}
+
+hc::Set* hc::History::select(Predicate predicate, int64_t arg1, int64_t arg2) const {
+    // One pass per column over flat arrays, with no branches on the element
+    std::vector<uint8_t> keep(_count, 1);
+    std::vector<uint8_t> up, down;
+    std::vector<int64_t> values;
+    std::vector<uint64_t> column;
+
+    auto const inRange = [this, arg1, arg2](int64_t value) -> uint8_t {
+        if (_isSigned) {
+            return value >= arg1 && value <= arg2;
+        }
+
+        return static_cast<uint64_t>(value) >= static_cast<uint64_t>(arg1) && static_cast<uint64_t>(value) <= static_cast<uint64_t>(arg2);
+    };
+
+    if (predicate == Predicate::Range) {
+        unpack(_first, _count, &column);
+        values.resize(_count);
+
+        for (size_t i = 0; i < _count; i++) {
+            values[i] = unzigzag(column[i]);
+            keep[i] = inRange(values[i]);
+        }
+    }
+    else if (predicate == Predicate::Monotonic || predicate == Predicate::Changed) {
+        up.resize(_count, 0);
+        down.resize(_count, 0);
+    }
+
+    for (auto const& col : _columns) {
+        unpack(col, _count, &column);
+
+        switch (predicate) {
+            case Predicate::Increasing:
+                for (size_t i = 0; i < _count; i++) {
+                    keep[i] &= unzigzag(column[i]) > 0;
+                }
+
+                break;
+
+            case Predicate::Decreasing:
+                for (size_t i = 0; i < _count; i++) {
+                    keep[i] &= unzigzag(column[i]) < 0;
+                }
+
+                break;
+
+            case Predicate::Step:
+                for (size_t i = 0; i < _count; i++) {
+                    keep[i] &= unzigzag(column[i]) == arg1;
+                }
+
+                break;
+
+            case Predicate::Range:
+                for (size_t i = 0; i < _count; i++) {
+                    values[i] = static_cast<int64_t>(static_cast<uint64_t>(values[i]) + static_cast<uint64_t>(unzigzag(column[i])));
+                    keep[i] &= inRange(values[i]);
+                }
+
+                break;
+
+            case Predicate::Unchanged:
+                for (size_t i = 0; i < _count; i++) {
+                    keep[i] &= column[i] == 0;
+                }
+
+                break;
+
+            case Predicate::Monotonic:
+            case Predicate::Changed:
+                for (size_t i = 0; i < _count; i++) {
+                    int64_t const delta = unzigzag(column[i]);
+                    up[i] |= delta > 0;
+                    down[i] |= delta < 0;
+                }
+
+                break;
+        }
+    }
+
+    if (predicate == Predicate::Monotonic) {
+        for (size_t i = 0; i < _count; i++) {
+            keep[i] = up[i] != down[i];
+        }
+    }
+    else if (predicate == Predicate::Changed) {
+        for (size_t i = 0; i < _count; i++) {
+            keep[i] = up[i] | down[i];
+        }
+    }
+
+    Set* const result = Set::empty();
+    size_t i = 0;
+
+    for (uint64_t const address : *_addresses) {
+        if (keep[i++]) {
+            result->add(address);
+        }
+    }
+
+    return result;
+}
+
+size_t hc::History::bytes() const {
+    size_t total = _first.packed.size() * 8 + _last.size();
+
+    for (auto const& column : _columns) {
+        total += column.packed.size() * 8;
+    }
+
+    return total;
+}
+
+void hc::History::read(Memory const& memory, std::vector<uint8_t>* values) const {
+    values->resize(_count * _valueSize);
+
+    if (_count == 0) {
+        return;
+    }
+
+    uint64_t const base = _base;
+    uint64_t const size = _size;
+    uint8_t const* data = memory.span(base, size);
+    std::vector<uint8_t> buffer;
+
+    // Snapshots can only be accessed directly one page at a time, other
+    // memories that can't be accessed directly are copied, unless there are
+    // few candidates which are then read one by one
+    bool const paged = data == nullptr && memory.span(base, std::min<uint64_t>(size, Snapshot::PageSize)) != nullptr;
+    bool const sparse = data == nullptr && !paged && _count * 16 < size;
+
+    if (data == nullptr && !paged && !sparse) {
+        buffer.resize(size);
+        memory.read(base, buffer.data(), size);
+        data = buffer.data();
+    }
+
+    bool const big = _endianess == filter::Endianess::Big;
+    uint8_t* out = values->data();
+
+    uint64_t pageBase = 0, pageEnd = 0;
+    uint8_t const* page = nullptr;
+
+    for (uint64_t const address : *_addresses) {
+        uint8_t bytes[8];
+        uint8_t const* p = nullptr;
+
+        if (data != nullptr) {
+            p = data + (address - base);
+        }
+        else {
+            if (paged && (address < pageBase || address >= pageEnd)) {
+                pageBase = base + (address - base) / Snapshot::PageSize * Snapshot::PageSize;
+                pageEnd = std::min(pageBase + Snapshot::PageSize, base + size);
+                page = memory.span(pageBase, pageEnd - pageBase);
+            }
+
+            // Values straddling two pages are read
+            if (page != nullptr && address + _valueSize <= pageEnd) {
+                p = page + (address - pageBase);
+            }
+            else {
+                memory.read(address, bytes, _valueSize);
+                p = bytes;
+            }
+        }
+
+        for (size_t j = 0; j < _valueSize; j++) {
+            *out++ = p[big ? _valueSize - 1 - j : j];
+        }
+    }
+}
+
+int64_t hc::History::load(std::vector<uint8_t> const& values, size_t index) const {
+    uint8_t const* const p = values.data() + index * _valueSize;
+    uint64_t value = 0;
+
+    for (size_t j = 0; j < _valueSize; j++) {
+        value |= static_cast<uint64_t>(p[j]) << (j * 8);
+    }
+
+    unsigned const shift = 64 - 8 * static_cast<unsigned>(_valueSize);
+
+    if (_isSigned && shift != 0) {
+        value = static_cast<uint64_t>(static_cast<int64_t>(value << shift) >> shift);
+    }
+
+    return static_cast<int64_t>(value);
+}
+
+void hc::History::pack(Column* column, std::vector<uint8_t> const& values, std::vector<uint8_t> const& last) const {
+    // Two passes, one for the width and one to pack, so the deltas are never
+    // stored unpacked
+    auto const delta = [this, &values, &last](size_t i) -> uint64_t {
+        uint64_t const previous = last.empty() ? 0 : static_cast<uint64_t>(load(last, i));
+        return zigzag(static_cast<int64_t>(static_cast<uint64_t>(load(values, i)) - previous));
+    };
+
+    uint64_t all = 0;
+
+    for (size_t i = 0; i < _count; i++) {
+        all |= delta(i);
+    }
+
+    column->bits = all == 0 ? 0 : 64 - __builtin_clzll(all);
+    column->packed.assign((_count * column->bits + 63) / 64, 0);
+
+    unsigned const bits = column->bits;
+    uint64_t* const packed = column->packed.data();
+
+    for (size_t i = 0; bits != 0 && i < _count; i++) {
+        size_t const bit = i * bits;
+        unsigned const shift = bit % 64;
+        uint64_t const value = delta(i);
+
+        packed[bit / 64] |= value << shift;
+
+        if (shift + bits > 64) {
+            packed[bit / 64 + 1] |= value >> (64 - shift);
+        }
+    }
+}
+
+void hc::History::unpack(Column const& column, size_t count, std::vector<uint64_t>* values) {
+    values->resize(count);
+    unsigned const bits = column.bits;
+    uint64_t* const out = values->data();
+
+    if (bits == 0) {
+        std::fill(values->begin(), values->end(), 0);
+        return;
+    }
+
+    uint64_t const mask = bits == 64 ? ~UINT64_C(0) : (UINT64_C(1) << bits) - 1;
+    uint64_t const* const packed = column.packed.data();
+
+    for (size_t i = 0; i < count; i++) {
+        size_t const bit = i * bits;
+        unsigned const shift = bit % 64;
+        uint64_t value = packed[bit / 64] >> shift;
+
+        if (shift + bits > 64) {
+            value |= packed[bit / 64 + 1] << (64 - shift);
+        }
+
+        out[i] = value & mask;
+    }
+}
+
+#define HISTORY_MT "hc::History"
+
+hc::History* hc::History::check(lua_State* L, int index) {
+    return *static_cast<History**>(luaL_checkudata(L, index, HISTORY_MT));
+}
+
+int hc::History::push(lua_State* L) {
+    History** const self = static_cast<History**>(lua_newuserdata(L, sizeof(*self)));
+    *self = this;
+
+    if (luaL_newmetatable(L, HISTORY_MT)) {
+        static const luaL_Reg methods[] = {
+            {"record", l_record},
+            {"select", l_select},
+            {"size", l_size},
+            {"steps", l_steps},
+            {"bytes", l_bytes},
+            {NULL, NULL}
+        };
+
+        luaL_newlib(L, methods);
+        lua_setfield(L, -2, "__index");
+
+        lua_pushcfunction(L, l_collect);
+        lua_setfield(L, -2, "__gc");
+    }
+
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+int hc::History::l_record(lua_State* L) {
+    auto const self = check(L, 1);
+    auto const memory = Memory::check(L, 2);
+
+    if (!self->record(*memory)) {
+        return luaL_error(L, "memory \"%s\" is not the one the history was created with", memory->id());
+    }
+
+    return 0;
+}
+
+int hc::History::l_select(lua_State* L) {
+    static char const* const names[] = {
+        "increasing", "decreasing", "monotonic", "step", "range", "changed", "unchanged", nullptr
+    };
+
+    static Predicate const predicates[] = {
+        Predicate::Increasing, Predicate::Decreasing, Predicate::Monotonic, Predicate::Step,
+        Predicate::Range, Predicate::Changed, Predicate::Unchanged
+    };
+
+    auto const self = check(L, 1);
+    Predicate const predicate = predicates[luaL_checkoption(L, 2, nullptr, names)];
+    lua_Integer const arg1 = luaL_optinteger(L, 3, 0);
+    lua_Integer const arg2 = luaL_optinteger(L, 4, 0);
+
+    return self->select(predicate, arg1, arg2)->push(L);
+}
+
+int hc::History::l_size(lua_State* L) {
+    auto const self = check(L, 1);
+    lua_pushinteger(L, self->size());
+    return 1;
+}
+
+int hc::History::l_steps(lua_State* L) {
+    auto const self = check(L, 1);
+    lua_pushinteger(L, self->steps());
+    return 1;
+}
+
+int hc::History::l_bytes(lua_State* L) {
+    auto const self = check(L, 1);
+    lua_pushinteger(L, self->bytes());
+    return 1;
+}
+
+int hc::History::l_collect(lua_State* L) {
+    auto const self = *static_cast<History**>(lua_touserdata(L, 1));
+    delete self;
+    return 0;
+}
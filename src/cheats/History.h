@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Scriptable.h"
+#include "cheats/Filter.h"
+
+extern "C" {
+    #include <lua.h>
+}
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace hc {
+    class Memory;
+    class Set;
+
+    // Values of a set of addresses across several recordings, for searches
+    // where the initial value is unknown. Each recording is a column with the
+    // zigzag encoded deltas from the previous one, bit-packed with the width
+    // of the largest delta, so steps where nothing changed take no space.
+    class History : public Scriptable {
+    public:
+        enum class Predicate {
+            Increasing,   // went up on every step
+            Decreasing,   // went down on every step
+            Monotonic,    // changed, and always in the same direction
+            Step,         // changed by exactly arg1 on every step
+            Range,        // always in [arg1, arg2]
+            Changed,      // changed at least once
+            Unchanged     // never changed
+        };
+
+        // Records the initial values, candidates can be nullptr for every
+        // address in memory
+        History(Memory const& memory, Set const* candidates, bool isSigned, filter::Endianess endianess, size_t valueSize);
+        virtual ~History();
+
+        // Returns false if memory doesn't have the base and size of the one
+        // the history was created with
+        bool record(Memory const& memory);
+        Set* select(Predicate predicate, int64_t arg1, int64_t arg2) const;
+
+        size_t size() const { return _count; }
+        size_t steps() const { return _columns.size(); }
+        size_t bytes() const;
+
+        static History* check(lua_State* L, int index);
+
+        // hc::Scriptable
+        virtual int push(lua_State* L) override;
+
+    protected:
+        struct Column {
+            unsigned bits;
+            std::vector<uint64_t> packed;
+        };
+
+        // Values are kept with the width of the value, little endian
+        void read(Memory const& memory, std::vector<uint8_t>* values) const;
+        int64_t load(std::vector<uint8_t> const& values, size_t index) const;
+        // Packs the deltas from last to values, last can be empty for all zeros
+        void pack(Column* column, std::vector<uint8_t> const& values, std::vector<uint8_t> const& last) const;
+
+        static void unpack(Column const& column, size_t count, std::vector<uint64_t>* values);
+
+        static int l_record(lua_State* L);
+        static int l_select(lua_State* L);
+        static int l_size(lua_State* L);
+        static int l_steps(lua_State* L);
+        static int l_bytes(lua_State* L);
+        static int l_collect(lua_State* L);
+
+        Set* _addresses;
+        size_t _count;
+        uint64_t const _base;
+        uint64_t const _size;
+        bool const _isSigned;
+        filter::Endianess const _endianess;
+        size_t const _valueSize;
+
+        Column _first;
+        std::vector<Column> _columns;
+        std::vector<uint8_t> _last;
+    };
+}
@@ -0,0 +1,122 @@
+#include "cheats/Scan.h"
+#include "cheats/Set.h"
+#include "cheats/Snapshot.h"
+#include "Memory.h"
+
+extern "C" {
+    #include <lauxlib.h>
+}
+
+#include <chrono>
+
+hc::Scan::Scan() : _result(nullptr), _resultRef(LUA_NOREF) {}
+
+hc::Scan::~Scan() {
+    // The job may still be reading the snapshots
+    Set* const result = wait();
+
+    if (_resultRef == LUA_NOREF) {
+        delete result;
+    }
+}
+
+hc::Memory const* hc::Scan::snapshot(lua_State* L, int index) {
+    Memory* const memory = Memory::check(L, index);
+
+    if (dynamic_cast<Snapshot*>(memory) != nullptr) {
+        keep(L, index);
+        return memory;
+    }
+
+    _snapshots.emplace_back(new Snapshot(memory));
+    return _snapshots.back().get();
+}
+
+void hc::Scan::keep(lua_State* L, int index) {
+    lua_pushvalue(L, index);
+    _refs.emplace_back(luaL_ref(L, LUA_REGISTRYINDEX));
+}
+
+void hc::Scan::start(std::function<Set*()> const& job) {
+    _future = std::async(std::launch::async, job);
+}
+
+bool hc::Scan::done() const {
+    return !_future.valid() || _future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+hc::Set* hc::Scan::wait() {
+    if (_future.valid()) {
+        _result = _future.get();
+    }
+
+    return _result;
+}
+
+#define SCAN_MT "hc::Scan"
+
+hc::Scan* hc::Scan::check(lua_State* L, int index) {
+    return *static_cast<Scan**>(luaL_checkudata(L, index, SCAN_MT));
+}
+
+int hc::Scan::push(lua_State* L) {
+    Scan** const self = static_cast<Scan**>(lua_newuserdata(L, sizeof(*self)));
+    *self = this;
+
+    if (luaL_newmetatable(L, SCAN_MT)) {
+        static const luaL_Reg methods[] = {
+            {"done", l_done},
+            {"result", l_result},
+            {NULL, NULL}
+        };
+
+        luaL_newlib(L, methods);
+        lua_setfield(L, -2, "__index");
+
+        lua_pushcfunction(L, l_collect);
+        lua_setfield(L, -2, "__gc");
+    }
+
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+int hc::Scan::l_done(lua_State* L) {
+    auto const self = check(L, 1);
+    lua_pushboolean(L, self->done());
+    return 1;
+}
+
+int hc::Scan::l_result(lua_State* L) {
+    auto const self = check(L, 1);
+
+    if (self->_resultRef != LUA_NOREF) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, self->_resultRef);
+        return 1;
+    }
+
+    Set* const result = self->wait();
+
+    if (result == nullptr) {
+        return luaL_error(L, "scan failed");
+    }
+
+    // The set is owned by Lua from now on
+    result->push(L);
+    lua_pushvalue(L, -1);
+    self->_resultRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    return 1;
+}
+
+int hc::Scan::l_collect(lua_State* L) {
+    auto const self = *static_cast<Scan**>(lua_touserdata(L, 1));
+    self->wait();
+
+    for (int const ref : self->_refs) {
+        luaL_unref(L, LUA_REGISTRYINDEX, ref);
+    }
+
+    luaL_unref(L, LUA_REGISTRYINDEX, self->_resultRef);
+    delete self;
+    return 0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Scriptable.h"
+
+extern "C" {
+    #include <lua.h>
+}
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace hc {
+    class Memory;
+    class Set;
+
+    // A filter running in a background thread. The job must only read data
+    // the emulation can't change, so live memories are snapshotted first.
+    class Scan : public Scriptable {
+    public:
+        Scan();
+        virtual ~Scan();
+
+        // Returns a memory that is safe to scan, either the snapshot at index
+        // or a new snapshot of the memory at index
+        Memory const* snapshot(lua_State* L, int index);
+        // Keeps the Lua value at index alive until the scan is collected
+        void keep(lua_State* L, int index);
+
+        void start(std::function<Set*()> const& job);
+        bool done() const;
+        Set* wait();
+
+        static Scan* check(lua_State* L, int index);
+
+        // hc::Scriptable
+        virtual int push(lua_State* L) override;
+
+    protected:
+        static int l_done(lua_State* L);
+        static int l_result(lua_State* L);
+        static int l_collect(lua_State* L);
+
+        std::future<Set*> _future;
+        Set* _result;
+        int _resultRef;
+        std::vector<int> _refs;
+        std::vector<std::unique_ptr<Memory>> _snapshots;
+    };
+}
@@ -0,0 +1,386 @@
+#include "cheats/Search.h"
+#include "cheats/Set.h"
+#include "cheats/Snapshot.h"
+#include "Memory.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <queue>
+
+// Anchors shorter than this are found with memchr, longer ones with BMH
+#define BMH_MIN_LENGTH 4
+
+namespace {
+    // The bytes of a memory region, directly when the memory can provide a
+    // pointer to them, or read into a private buffer otherwise
+    class Haystack {
+    public:
+        Haystack(hc::Memory const& memory, uint64_t address, uint64_t size) {
+            _data = memory.span(address, size);
+
+            if (_data == nullptr) {
+                _buffer.resize(size);
+                memory.read(address, _buffer.data(), size);
+                _data = _buffer.data();
+            }
+        }
+
+        uint8_t const* data() const { return _data; }
+
+    protected:
+        uint8_t const* _data;
+        std::vector<uint8_t> _buffer;
+    };
+
+    // Multi-pattern matcher for exact patterns, states are a dense DFA with
+    // the failure links already folded into the transitions
+    class AhoCorasick {
+    public:
+        AhoCorasick(std::vector<hc::search::Pattern> const& patterns) {
+            newState();
+
+            for (auto const& pattern : patterns) {
+                uint32_t state = 0;
+
+                for (uint8_t const byte : pattern.values()) {
+                    if (_next[state * 256 + byte] == 0) {
+                        uint32_t const created = newState();
+                        _next[state * 256 + byte] = created;
+                    }
+
+                    state = _next[state * 256 + byte];
+                }
+
+                _lengths[state].emplace_back(pattern.length());
+            }
+
+            std::vector<uint32_t> fail(_lengths.size(), 0);
+            std::queue<uint32_t> queue;
+
+            for (unsigned byte = 0; byte < 256; byte++) {
+                if (_next[byte] != 0) {
+                    queue.push(_next[byte]);
+                }
+            }
+
+            while (!queue.empty()) {
+                uint32_t const state = queue.front();
+                queue.pop();
+
+                auto const& inherited = _lengths[fail[state]];
+                _lengths[state].insert(_lengths[state].end(), inherited.begin(), inherited.end());
+
+                for (unsigned byte = 0; byte < 256; byte++) {
+                    uint32_t const child = _next[state * 256 + byte];
+
+                    if (child != 0) {
+                        fail[child] = _next[fail[state] * 256 + byte];
+                        queue.push(child);
+                    }
+                    else {
+                        _next[state * 256 + byte] = _next[fail[state] * 256 + byte];
+                    }
+                }
+            }
+        }
+
+        // Calls hit with the end offset and the length of each match, state
+        // carries over from the data scanned before so matches can start there
+        template<typename F>
+        void scan(uint8_t const* data, size_t size, uint32_t* state, F const& hit) const {
+            uint32_t current = *state;
+
+            for (size_t i = 0; i < size; i++) {
+                current = _next[current * 256 + data[i]];
+
+                for (size_t const length : _lengths[current]) {
+                    hit(i + 1, length);
+                }
+            }
+
+            *state = current;
+        }
+
+    protected:
+        uint32_t newState() {
+            _next.resize(_next.size() + 256, 0);
+            _lengths.emplace_back();
+            return static_cast<uint32_t>(_lengths.size() - 1);
+        }
+
+        std::vector<uint32_t> _next;
+        std::vector<std::vector<size_t>> _lengths;
+    };
+}
+
+hc::search::Pattern::Pattern(uint8_t const* bytes, size_t length) : _values(bytes, bytes + length), _masks(length, 0xff) {}
+
+static int nibble(char const k) {
+    if (k >= '0' && k <= '9') {
+        return k - '0';
+    }
+    else if (k >= 'a' && k <= 'f') {
+        return k - 'a' + 10;
+    }
+    else if (k >= 'A' && k <= 'F') {
+        return k - 'A' + 10;
+    }
+    else if (k == '?') {
+        return 16;
+    }
+
+    return -1;
+}
+
+bool hc::search::Pattern::parse(char const* text) {
+    _values.clear();
+    _masks.clear();
+
+    for (;;) {
+        while (*text == ' ') {
+            text++;
+        }
+
+        if (*text == 0) {
+            break;
+        }
+
+        int const high = nibble(text[0]);
+        int const low = high >= 0 ? nibble(text[1]) : -1;
+
+        if (low < 0) {
+            _values.clear();
+            _masks.clear();
+            return false;
+        }
+
+        _values.emplace_back((high & 15) << 4 | (low & 15));
+        _masks.emplace_back((high == 16 ? 0x00 : 0xf0) | (low == 16 ? 0x00 : 0x0f));
+        _values.back() &= _masks.back();
+        text += 2;
+    }
+
+    return !_values.empty();
+}
+
+bool hc::search::Pattern::exact() const {
+    return std::all_of(_masks.begin(), _masks.end(), [](uint8_t mask) { return mask == 0xff; });
+}
+
+bool hc::search::Pattern::matches(uint8_t const* data) const {
+    size_t const length = _values.size();
+
+    for (size_t i = 0; i < length; i++) {
+        if ((data[i] & _masks[i]) != _values[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Calls hit with the offset of each match in data, in ascending order, until
+// hit returns false. The longest run of exact bytes in the pattern is the
+// anchor used to skip through the data, matches of the anchor are then
+// checked against the whole pattern.
+template<typename F>
+static void scan(uint8_t const* data, size_t size, hc::search::Pattern const& pattern, F const& hit) {
+    size_t const length = pattern.length();
+
+    if (length == 0 || length > size) {
+        return;
+    }
+
+    auto const& masks = pattern.masks();
+    size_t anchor = 0, anchorLength = 0;
+
+    for (size_t i = 0; i < length;) {
+        size_t j = i;
+
+        while (j < length && masks[j] == 0xff) {
+            j++;
+        }
+
+        if (j - i > anchorLength) {
+            anchor = i;
+            anchorLength = j - i;
+        }
+
+        i = j + 1;
+    }
+
+    size_t const last = size - length;
+
+    if (anchorLength == 0) {
+        for (size_t i = 0; i <= last; i++) {
+            if (pattern.matches(data + i) && !hit(i)) {
+                return;
+            }
+        }
+
+        return;
+    }
+
+    uint8_t const* const needle = pattern.values().data() + anchor;
+    bool const exact = anchorLength == length;
+
+    if (anchorLength < BMH_MIN_LENGTH) {
+        // memchr is vectorized by the C library
+        uint8_t const* const end = data + anchor + last + 1;
+
+        for (uint8_t const* found = data + anchor; found < end; found++) {
+            found = static_cast<uint8_t const*>(memchr(found, needle[0], end - found));
+
+            if (found == nullptr) {
+                return;
+            }
+
+            size_t const offset = found - data - anchor;
+            bool const match = exact ? memcmp(found, needle, length) == 0 : pattern.matches(data + offset);
+
+            if (match && !hit(offset)) {
+                return;
+            }
+        }
+
+        return;
+    }
+
+    size_t skip[256];
+    std::fill(skip, skip + 256, anchorLength);
+
+    for (size_t i = 0; i < anchorLength - 1; i++) {
+        skip[needle[i]] = anchorLength - 1 - i;
+    }
+
+    uint8_t const lastByte = needle[anchorLength - 1];
+
+    for (size_t offset = 0; offset <= last;) {
+        uint8_t const* const window = data + offset + anchor;
+        uint8_t const byte = window[anchorLength - 1];
+
+        if (byte == lastByte && memcmp(window, needle, anchorLength - 1) == 0) {
+            if ((exact || pattern.matches(data + offset)) && !hit(offset)) {
+                return;
+            }
+        }
+
+        offset += skip[byte];
+    }
+}
+
+// Calls f(address, data, size) with the bytes of the range, which snapshots
+// can only provide directly one page at a time. Each page is followed by a
+// copy of the bytes around its end so that matches of length bytes that
+// straddle two pages are seen too, f returns false to stop.
+template<typename F>
+static void pieces(hc::Memory const& memory, uint64_t address, uint64_t size, size_t length, F const& f) {
+    uint8_t const* const data = memory.span(address, size);
+
+    if (data != nullptr) {
+        f(address, data, size);
+        return;
+    }
+
+    uint64_t const base = memory.base();
+    uint64_t const end = address + size;
+
+    while (address < end) {
+        uint64_t const page = (address - base) / hc::Snapshot::PageSize + 1;
+        uint64_t const pageEnd = std::min(base + page * hc::Snapshot::PageSize, end);
+        Haystack const haystack(memory, address, pageEnd - address);
+
+        if (!f(address, haystack.data(), pageEnd - address)) {
+            return;
+        }
+
+        if (length > 1 && pageEnd < end) {
+            uint64_t const from = std::max(address, pageEnd - length + 1);
+            uint64_t const to = std::min(pageEnd + length - 1, end);
+            Haystack const boundary(memory, from, to - from);
+
+            if (!f(from, boundary.data(), to - from)) {
+                return;
+            }
+        }
+
+        address = pageEnd;
+    }
+}
+
+bool hc::search::first(Memory const& memory, uint64_t* start, Pattern const& pattern) {
+    uint64_t const base = memory.base();
+    uint64_t const end = base + memory.size();
+    uint64_t const address = std::max(*start, base);
+
+    if (address >= end) {
+        return false;
+    }
+
+    bool found = false;
+
+    pieces(memory, address, end - address, pattern.length(), [&](uint64_t at, uint8_t const* data, uint64_t count) {
+        scan(data, count, pattern, [&](size_t offset) {
+            *start = at + offset;
+            found = true;
+            return false;
+        });
+
+        return !found;
+    });
+
+    return found;
+}
+
+hc::Set* hc::search::all(Memory const& memory, std::vector<Pattern> const& patterns) {
+    uint64_t const base = memory.base();
+    uint64_t const size = memory.size();
+
+    std::vector<uint64_t> offsets;
+
+    bool const exact = std::all_of(patterns.begin(), patterns.end(), [](Pattern const& pattern) {
+        return pattern.exact() && pattern.length() != 0;
+    });
+
+    if (patterns.size() > 1 && exact) {
+        AhoCorasick const matcher(patterns);
+        uint32_t state = 0;
+
+        // The matcher goes through the pages in order, no need to look at the
+        // boundaries between them
+        pieces(memory, base, size, 1, [&](uint64_t at, uint8_t const* data, uint64_t count) {
+            matcher.scan(data, count, &state, [&](size_t end, size_t length) {
+                offsets.emplace_back(at - base + end - length);
+            });
+
+            return true;
+        });
+    }
+    else {
+        for (auto const& pattern : patterns) {
+            pieces(memory, base, size, pattern.length(), [&](uint64_t at, uint8_t const* data, uint64_t count) {
+                scan(data, count, pattern, [&](size_t offset) {
+                    offsets.emplace_back(at - base + offset);
+                    return true;
+                });
+
+                return true;
+            });
+        }
+    }
+
+    // Several patterns can match at the same address
+    if (patterns.size() > 1) {
+        std::sort(offsets.begin(), offsets.end());
+        offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+    }
+
+    Set* const result = Set::empty();
+
+    for (uint64_t const offset : offsets) {
+        result->add(base + offset);
+    }
+
+    return result;
+}
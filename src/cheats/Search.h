@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace hc {
+    class Memory;
+    class Set;
+
+    namespace search {
+        // A sequence of bytes to search for, a byte in memory matches when
+        // (byte & mask) == value, so masks other than 0xff are wildcards
+        class Pattern {
+        public:
+            Pattern() {}
+            Pattern(uint8_t const* bytes, size_t length);
+
+            // Parses hex bytes such as "3E ?? CD" or "3E?? C?", where ? matches
+            // any nibble; spaces are optional
+            bool parse(char const* text);
+
+            size_t length() const { return _values.size(); }
+            bool exact() const;
+            bool matches(uint8_t const* data) const;
+
+            std::vector<uint8_t> const& values() const { return _values; }
+            std::vector<uint8_t> const& masks() const { return _masks; }
+
+        protected:
+            std::vector<uint8_t> _values;
+            std::vector<uint8_t> _masks;
+        };
+
+        // Finds the first match at or after *start
+        bool first(Memory const& memory, uint64_t* start, Pattern const& pattern);
+
+        // Finds the addresses where any of the patterns match
+        Set* all(Memory const& memory, std::vector<Pattern> const& patterns);
+    }
+}
@@ -0,0 +1,419 @@
+#include "cheats/Session.h"
+#include "cheats/Set.h"
+#include "cheats/Snapshot.h"
+#include "Memory.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <stdlib.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <map>
+#include <memory>
+
+#define SESSION_MAGIC "HCSESS01"
+
+// ftell returns a 32-bit long on Windows, sessions can be bigger than 2 GiB
+static int64_t tell(FILE* file) {
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return static_cast<int64_t>(ftello(file));
+#endif
+}
+
+namespace {
+    struct Header {
+        char magic[8];
+        char id[64];
+        char settings[16];
+        uint64_t base;
+        uint64_t size;
+        uint64_t pageSize;
+        uint64_t snapshotCount;
+        uint64_t pageTablesOffset;  // snapshotCount tables of page offsets
+        uint64_t setOffset;
+        uint64_t containerCount;
+        uint64_t complemented;
+    };
+
+    struct ContainerHeader {
+        uint64_t key;
+        uint32_t type;
+        uint32_t cardinality;
+        uint64_t count;  // uint16_t values for arrays and runs, uint64_t words for bitmaps
+    };
+
+    // Keeps the file contents in memory for as long as a page points into it
+    class Mapping {
+    public:
+        Mapping() : _data(nullptr), _size(0) {}
+
+        ~Mapping() {
+#ifdef _WIN32
+            free(_data);
+#else
+            if (_data != nullptr) {
+                munmap(_data, _size);
+            }
+#endif
+        }
+
+        bool open(char const* path) {
+#ifdef _WIN32
+            // No mmap, read the whole file
+            FILE* const file = fopen(path, "rb");
+
+            if (file == nullptr) {
+                return false;
+            }
+
+            _fseeki64(file, 0, SEEK_END);
+            int64_t const size = tell(file);
+            _fseeki64(file, 0, SEEK_SET);
+
+            _data = size > 0 ? malloc(size) : nullptr;
+            _size = size > 0 ? size : 0;
+            bool const ok = _data != nullptr && fread(_data, 1, _size, file) == _size;
+            fclose(file);
+            return ok;
+#else
+            int const fd = ::open(path, O_RDONLY);
+
+            if (fd < 0) {
+                return false;
+            }
+
+            struct stat st;
+
+            if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                ::close(fd);
+                return false;
+            }
+
+            void* const data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+
+            if (data == MAP_FAILED) {
+                return false;
+            }
+
+            _data = data;
+            _size = st.st_size;
+            return true;
+#endif
+        }
+
+        uint8_t const* data() const { return static_cast<uint8_t const*>(_data); }
+        size_t size() const { return _size; }
+
+        // Checks that count items of itemSize bytes at offset are inside the file
+        bool contains(uint64_t offset, uint64_t count, uint64_t itemSize) const {
+            return offset <= _size && (itemSize == 0 || count <= (_size - offset) / itemSize);
+        }
+
+    protected:
+        void* _data;
+        size_t _size;
+    };
+}
+
+static bool write(FILE* file, void const* data, size_t size) {
+    return fwrite(data, 1, size, file) == size;
+}
+
+static bool align(FILE* file) {
+    static uint8_t const zeros[8] = {0};
+    int64_t const position = tell(file);
+    return position >= 0 && write(file, zeros, (8 - position % 8) % 8);
+}
+
+// Same format as the value settings in Cheats.cpp, signedness, size, and endianess unless the size is a byte
+static bool validSettings(char const* settings) {
+    if (settings[0] != 's' && settings[0] != 'u') {
+        return false;
+    }
+
+    if (settings[1] == 'b') {
+        return settings[2] == 0;
+    }
+
+    if (settings[1] != 'w' && settings[1] != 'd' && settings[1] != 'q') {
+        return false;
+    }
+
+    return (settings[2] == 'l' || settings[2] == 'b') && settings[3] == 0;
+}
+
+static std::string failed(char const* what, char const* path) {
+    std::string error(what);
+    error += " \"";
+    error += path;
+    error += "\": ";
+    error += strerror(errno);
+    return error;
+}
+
+bool hc::Session::save(
+    char const* path,
+    char const* settings,
+    Set const* set,
+    std::vector<Snapshot const*> const& snapshots,
+    std::string* error
+) {
+    if (snapshots.empty()) {
+        *error = "a session needs at least one snapshot";
+        return false;
+    }
+
+    Snapshot const* const first = snapshots[0];
+
+    for (auto const snapshot : snapshots) {
+        if (snapshot->base() != first->base() || snapshot->size() != first->size()) {
+            *error = "all snapshots must be of the same memory";
+            return false;
+        }
+    }
+
+    FILE* const file = fopen(path, "wb");
+
+    if (file == nullptr) {
+        *error = failed("could not create", path);
+        return false;
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SESSION_MAGIC, sizeof(header.magic));
+    strncpy(header.id, first->memoryId(), sizeof(header.id) - 1);
+    strncpy(header.settings, settings, sizeof(header.settings) - 1);
+    header.base = first->base();
+    header.size = first->size();
+    header.pageSize = Snapshot::PageSize;
+    header.snapshotCount = snapshots.size();
+    header.containerCount = set->_containers.size();
+    header.complemented = set->complemented();
+
+    // Header is rewritten at the end with the offsets
+    bool ok = write(file, &header, sizeof(header));
+
+    // Pages shared between snapshots are written only once
+    std::map<Snapshot::Page const*, uint64_t> offsets;
+    std::vector<uint64_t> tables;
+
+    for (auto const snapshot : snapshots) {
+        for (auto const& page : snapshot->_pages) {
+            auto const found = offsets.find(page.get());
+
+            if (found != offsets.end()) {
+                tables.emplace_back(found->second);
+                continue;
+            }
+
+            ok = ok && align(file);
+            int64_t const offset = tell(file);
+            ok = ok && offset >= 0 && write(file, page.get(), sizeof(*page));
+
+            offsets.emplace(page.get(), offset);
+            tables.emplace_back(offset);
+        }
+    }
+
+    ok = ok && align(file);
+    int64_t const pageTablesOffset = tell(file);
+    ok = ok && pageTablesOffset >= 0 && write(file, tables.data(), tables.size() * sizeof(tables[0]));
+    header.pageTablesOffset = pageTablesOffset;
+
+    int64_t const setOffset = tell(file);
+    ok = ok && setOffset >= 0;
+    header.setOffset = setOffset;
+
+    for (auto const& container : set->_containers) {
+        ContainerHeader ch;
+        ch.key = container.key;
+        ch.type = static_cast<uint32_t>(container.type);
+        ch.cardinality = container.cardinality;
+
+        ok = ok && align(file);
+
+        if (container.type == Set::Container::Type::Bitmap) {
+            ch.count = container.bits.size();
+            ok = ok && write(file, &ch, sizeof(ch));
+            ok = ok && write(file, container.bits.data(), ch.count * sizeof(uint64_t));
+        }
+        else {
+            ch.count = container.values.size();
+            ok = ok && write(file, &ch, sizeof(ch));
+            ok = ok && write(file, container.values.data(), ch.count * sizeof(uint16_t));
+        }
+    }
+
+    ok = ok && fseek(file, 0, SEEK_SET) == 0;
+    ok = ok && write(file, &header, sizeof(header));
+
+    if (fclose(file) != 0 || !ok) {
+        *error = failed("error writing to", path);
+        remove(path);
+        return false;
+    }
+
+    return true;
+}
+
+bool hc::Session::load(
+    char const* path,
+    Memory* memory,
+    std::string* settings,
+    Set** set,
+    std::vector<Snapshot*>* snapshots,
+    std::string* error
+) {
+    auto const mapping = std::make_shared<Mapping>();
+
+    if (!mapping->open(path)) {
+        *error = failed("could not open", path);
+        return false;
+    }
+
+    uint8_t const* const data = mapping->data();
+
+    if (!mapping->contains(0, 1, sizeof(Header))) {
+        *error = "file too small to be a session";
+        return false;
+    }
+
+    Header header;
+    memcpy(&header, data, sizeof(header));
+    header.id[sizeof(header.id) - 1] = 0;
+    header.settings[sizeof(header.settings) - 1] = 0;
+
+    if (memcmp(header.magic, SESSION_MAGIC, sizeof(header.magic)) != 0 || header.pageSize != Snapshot::PageSize) {
+        *error = "not a session file, or from an incompatible version";
+        return false;
+    }
+
+    if (strcmp(header.id, memory->id()) != 0 || header.base != memory->base() || header.size != memory->size()) {
+        *error = "the session was saved from a different memory region";
+        return false;
+    }
+
+    if (header.snapshotCount == 0 || !validSettings(header.settings)) {
+        *error = "corrupted session file";
+        return false;
+    }
+
+    uint64_t const pageCount = (header.size + Snapshot::PageSize - 1) / Snapshot::PageSize;
+
+    if (pageCount != 0 && header.snapshotCount > UINT64_MAX / pageCount) {
+        *error = "corrupted session file";
+        return false;
+    }
+
+    uint64_t const tableCount = header.snapshotCount * pageCount;
+
+    if (header.pageTablesOffset % 8 != 0 || !mapping->contains(header.pageTablesOffset, tableCount, sizeof(uint64_t))) {
+        *error = "corrupted session file";
+        return false;
+    }
+
+    // Validate everything before creating any objects
+    uint64_t const* const tables = reinterpret_cast<uint64_t const*>(data + header.pageTablesOffset);
+
+    for (uint64_t i = 0; i < tableCount; i++) {
+        if (tables[i] % 8 != 0 || !mapping->contains(tables[i], 1, sizeof(Snapshot::Page))) {
+            *error = "corrupted session file";
+            return false;
+        }
+    }
+
+    std::unique_ptr<Set> loaded(Set::empty());
+    uint64_t offset = header.setOffset;
+
+    for (uint64_t i = 0; i < header.containerCount; i++) {
+        offset = (offset + 7) & ~UINT64_C(7);
+
+        if (!mapping->contains(offset, 1, sizeof(ContainerHeader))) {
+            *error = "corrupted session file";
+            return false;
+        }
+
+        ContainerHeader ch;
+        memcpy(&ch, data + offset, sizeof(ch));
+        offset += sizeof(ch);
+
+        // Keys are the upper 48 bits, in ascending order
+        if (ch.key > UINT64_MAX >> 16 || (!loaded->_containers.empty() && ch.key <= loaded->_containers.back().key)) {
+            *error = "corrupted session file";
+            return false;
+        }
+
+        Set::Container container(ch.key);
+
+        switch (ch.type) {
+            case static_cast<uint32_t>(Set::Container::Type::Bitmap):
+                if (ch.count != 1024 || !mapping->contains(offset, ch.count, sizeof(uint64_t))) {
+                    *error = "corrupted session file";
+                    return false;
+                }
+
+                container.type = Set::Container::Type::Bitmap;
+                container.bits.resize(ch.count);
+                memcpy(container.bits.data(), data + offset, ch.count * sizeof(uint64_t));
+                offset += ch.count * sizeof(uint64_t);
+                break;
+
+            case static_cast<uint32_t>(Set::Container::Type::Array):
+            case static_cast<uint32_t>(Set::Container::Type::Run):
+                if (ch.count > 65536 * 2 || !mapping->contains(offset, ch.count, sizeof(uint16_t))) {
+                    *error = "corrupted session file";
+                    return false;
+                }
+
+                container.type = static_cast<Set::Container::Type>(ch.type);
+                container.values.resize(ch.count);
+                memcpy(container.values.data(), data + offset, ch.count * sizeof(uint16_t));
+                offset += ch.count * sizeof(uint16_t);
+                break;
+
+            default:
+                *error = "corrupted session file";
+                return false;
+        }
+
+        // The cardinality in the file isn't trusted, it's recomputed from the values
+        if (!container.validate()) {
+            *error = "corrupted session file";
+            return false;
+        }
+
+        loaded->_size += container.cardinality;
+        loaded->_containers.emplace_back(std::move(container));
+    }
+
+    loaded->_complemented = header.complemented != 0;
+
+    // Pages alias the mapping, which is unmapped when the last of them goes away
+    for (uint64_t i = 0; i < header.snapshotCount; i++) {
+        std::vector<std::shared_ptr<Snapshot::Page const>> pages;
+        pages.reserve(pageCount);
+
+        for (uint64_t j = 0; j < pageCount; j++) {
+            auto const page = reinterpret_cast<Snapshot::Page const*>(data + tables[i * pageCount + j]);
+            pages.emplace_back(mapping, page);
+        }
+
+        snapshots->emplace_back(new Snapshot(memory, std::move(pages)));
+    }
+
+    *settings = header.settings;
+    *set = loaded.release();
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace hc {
+    class Memory;
+    class Set;
+    class Snapshot;
+
+    // Saves and loads cheat searches. The file has a header with the memory
+    // region, the settings string, a page table per snapshot, the set
+    // containers as they are in memory, and the snapshot pages, each unique
+    // page stored once. Loaded snapshots point directly into the mapped file.
+    class Session {
+    public:
+        static bool save(
+            char const* path,
+            char const* settings,
+            Set const* set,
+            std::vector<Snapshot const*> const& snapshots,
+            std::string* error
+        );
+
+        // The snapshots must have been saved from a memory with the same id,
+        // base and size as memory
+        static bool load(
+            char const* path,
+            Memory* memory,
+            std::string* settings,
+            Set** set,
+            std::vector<Snapshot*>* snapshots,
+            std::string* error
+        );
+    };
+}
@@ -1,246 +1,910 @@
 #include "cheats/Set.h"
 
 #include <inttypes.h>
+#include <string.h>
 
-#include <atomic>
 #include <algorithm>
 #include <iterator>
+#include <new>
 
 extern "C" {
     #include "lauxlib.h"
 }
 
-hc::Set::Set() : _complemented(false) {}
+// Arrays with more elements than this take more space than a bitmap
+#define ARRAY_MAX 4096
+#define BITMAP_WORDS 1024
+
+static size_t countRuns(uint64_t const* bits) {
+    size_t runs = 0;
+    uint64_t carry = 0;
+
+    for (size_t i = 0; i < BITMAP_WORDS; i++) {
+        uint64_t const word = bits[i];
+        runs += __builtin_popcountll(word & ~(word << 1 | carry));
+        carry = word >> 63;
+    }
+
+    return runs;
+}
+
+bool hc::Set::Container::contains(uint16_t low) const {
+    switch (type) {
+        case Type::Array:
+            return std::binary_search(values.begin(), values.end(), low);
+
+        case Type::Bitmap:
+            return (bits[low / 64] >> (low % 64) & 1) != 0;
+
+        case Type::Run: {
+            // Find the last run starting at or before low
+            size_t lo = 0, hi = values.size() / 2;
+
+            while (lo < hi) {
+                size_t const mid = (lo + hi) / 2;
+
+                if (values[mid * 2] <= low) {
+                    lo = mid + 1;
+                }
+                else {
+                    hi = mid;
+                }
+            }
+
+            return lo != 0 && low - values[lo * 2 - 2] <= values[lo * 2 - 1];
+        }
+    }
+
+    return false;
+}
+
+void hc::Set::Container::add(uint16_t low) {
+    switch (type) {
+        case Type::Array:
+            values.emplace_back(low);
+
+            if (values.size() > ARRAY_MAX) {
+                bits.resize(BITMAP_WORDS);
+                bitmap(bits.data());
+                values.clear();
+                values.shrink_to_fit();
+                type = Type::Bitmap;
+            }
+
+            break;
+
+        case Type::Bitmap:
+            bits[low / 64] |= UINT64_C(1) << (low % 64);
+            break;
+
+        case Type::Run:
+            if (!values.empty() && values[values.size() - 2] + values[values.size() - 1] + 1 == low) {
+                values[values.size() - 1]++;
+            }
+            else {
+                values.emplace_back(low);
+                values.emplace_back(0);
+            }
+
+            break;
+    }
+
+    cardinality++;
+}
+
+void hc::Set::Container::optimize() {
+    size_t runs = 0;
+
+    if (type == Type::Bitmap) {
+        runs = countRuns(bits.data());
+    }
+    else if (type == Type::Array) {
+        for (size_t i = 0; i < values.size(); i++) {
+            runs += i == 0 || values[i] != values[i - 1] + 1;
+        }
+    }
+    else {
+        runs = values.size() / 2;
+    }
+
+    size_t const arrayBytes = cardinality * 2;
+    size_t const bitmapBytes = BITMAP_WORDS * 8;
+    size_t const runBytes = runs * 4;
+
+    Type best = Type::Bitmap;
+
+    if (runBytes < arrayBytes && runBytes < bitmapBytes) {
+        best = Type::Run;
+    }
+    else if (cardinality <= ARRAY_MAX) {
+        best = Type::Array;
+    }
+
+    if (best == type) {
+        values.shrink_to_fit();
+        return;
+    }
+
+    // Re-encode from a bitmap
+    std::vector<uint64_t> words;
+
+    if (type == Type::Bitmap) {
+        words.swap(bits);
+    }
+    else {
+        words.resize(BITMAP_WORDS);
+        bitmap(words.data());
+    }
+
+    values.clear();
+
+    if (best == Type::Bitmap) {
+        bits.swap(words);
+    }
+    else if (best == Type::Array) {
+        values.reserve(cardinality);
+
+        for (size_t i = 0; i < BITMAP_WORDS; i++) {
+            for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+                values.emplace_back(static_cast<uint16_t>(i * 64 + __builtin_ctzll(word)));
+            }
+        }
+    }
+    else {
+        values.reserve(runs * 2);
+        uint32_t start = 0;
+        bool inRun = false;
+
+        for (uint32_t low = 0; low < BITMAP_WORDS * 64; low++) {
+            bool const set = (words[low / 64] >> (low % 64) & 1) != 0;
+
+            if (set && !inRun) {
+                start = low;
+                inRun = true;
+            }
+            else if (!set && inRun) {
+                values.emplace_back(static_cast<uint16_t>(start));
+                values.emplace_back(static_cast<uint16_t>(low - 1 - start));
+                inRun = false;
+            }
+        }
+
+        if (inRun) {
+            values.emplace_back(static_cast<uint16_t>(start));
+            values.emplace_back(static_cast<uint16_t>(BITMAP_WORDS * 64 - 1 - start));
+        }
+    }
+
+    values.shrink_to_fit();
+    type = best;
+}
+
+void hc::Set::Container::bitmap(uint64_t* words) const {
+    switch (type) {
+        case Type::Array:
+            memset(words, 0, BITMAP_WORDS * 8);
+
+            for (uint16_t const low : values) {
+                words[low / 64] |= UINT64_C(1) << (low % 64);
+            }
+
+            break;
+
+        case Type::Bitmap:
+            memcpy(words, bits.data(), BITMAP_WORDS * 8);
+            break;
+
+        case Type::Run:
+            memset(words, 0, BITMAP_WORDS * 8);
+
+            for (size_t i = 0; i < values.size(); i += 2) {
+                uint32_t low = values[i];
+                uint32_t const last = low + values[i + 1];
+
+                // Partial first word, whole words, partial last word
+                for (; low <= last && low % 64 != 0; low++) {
+                    words[low / 64] |= UINT64_C(1) << (low % 64);
+                }
+
+                for (; low + 63 <= last; low += 64) {
+                    words[low / 64] = ~UINT64_C(0);
+                }
+
+                for (; low <= last; low++) {
+                    words[low / 64] |= UINT64_C(1) << (low % 64);
+                }
+            }
+
+            break;
+    }
+}
+
+bool hc::Set::Container::first(size_t* index, uint32_t* low) const {
+    *index = 0;
+
+    if (type == Type::Bitmap) {
+        *low = 0;
+
+        if ((bits[0] & 1) != 0) {
+            return true;
+        }
+    }
+    else if (!values.empty()) {
+        *low = values[0];
+        return true;
+    }
+    else {
+        return false;
+    }
+
+    return next(index, low);
+}
+
+bool hc::Set::Container::next(size_t* index, uint32_t* low) const {
+    switch (type) {
+        case Type::Array:
+            if (++*index < values.size()) {
+                *low = values[*index];
+                return true;
+            }
+
+            return false;
+
+        case Type::Bitmap: {
+            uint32_t const from = *low + 1;
+
+            if (from >= BITMAP_WORDS * 64) {
+                return false;
+            }
+
+            size_t i = from / 64;
+            uint64_t word = bits[i] & ~UINT64_C(0) << (from % 64);
+
+            while (word == 0) {
+                if (++i == BITMAP_WORDS) {
+                    return false;
+                }
+
+                word = bits[i];
+            }
+
+            *low = static_cast<uint32_t>(i * 64 + __builtin_ctzll(word));
+            return true;
+        }
+
+        case Type::Run:
+            if (*low < static_cast<uint32_t>(values[*index * 2]) + values[*index * 2 + 1]) {
+                ++*low;
+                return true;
+            }
+
+            if ((++*index) * 2 < values.size()) {
+                *low = values[*index * 2];
+                return true;
+            }
+
+            return false;
+    }
+
+    return false;
+}
+
+bool hc::Set::Container::lowerBound(uint32_t from, size_t* index, uint32_t* low) const {
+    if (from == 0) {
+        return first(index, low);
+    }
+
+    switch (type) {
+        case Type::Array: {
+            auto const found = std::lower_bound(values.begin(), values.end(), from);
+
+            if (found == values.end()) {
+                return false;
+            }
+
+            *index = found - values.begin();
+            *low = *found;
+            return true;
+        }
+
+        case Type::Bitmap:
+            *index = 0;
+            *low = from - 1;
+            return next(index, low);
+
+        case Type::Run: {
+            // Find the last run starting at or before from
+            size_t lo = 0, hi = values.size() / 2;
+
+            while (lo < hi) {
+                size_t const mid = (lo + hi) / 2;
+
+                if (values[mid * 2] <= from) {
+                    lo = mid + 1;
+                }
+                else {
+                    hi = mid;
+                }
+            }
+
+            if (lo != 0 && from - values[lo * 2 - 2] <= values[lo * 2 - 1]) {
+                *index = lo - 1;
+                *low = from;
+                return true;
+            }
+
+            if (lo * 2 < values.size()) {
+                *index = lo;
+                *low = values[lo * 2];
+                return true;
+            }
+
+            return false;
+        }
+    }
+
+    return false;
+}
+
+bool hc::Set::Container::select(uint32_t rank, size_t* index, uint32_t* low) const {
+    if (rank >= cardinality) {
+        return false;
+    }
+
+    switch (type) {
+        case Type::Array:
+            *index = rank;
+            *low = values[rank];
+            return true;
+
+        case Type::Bitmap:
+            for (size_t i = 0; i < BITMAP_WORDS; i++) {
+                uint64_t word = bits[i];
+                uint32_t const count = __builtin_popcountll(word);
+
+                if (rank < count) {
+                    for (; rank != 0; rank--) {
+                        word &= word - 1;
+                    }
+
+                    *index = 0;
+                    *low = static_cast<uint32_t>(i * 64 + __builtin_ctzll(word));
+                    return true;
+                }
+
+                rank -= count;
+            }
+
+            return false;
+
+        case Type::Run:
+            for (size_t i = 0; i < values.size(); i += 2) {
+                uint32_t const length = static_cast<uint32_t>(values[i + 1]) + 1;
+
+                if (rank < length) {
+                    *index = i / 2;
+                    *low = values[i] + rank;
+                    return true;
+                }
+
+                rank -= length;
+            }
+
+            return false;
+    }
+
+    return false;
+}
+
+uint32_t hc::Set::Container::rank(uint32_t low) const {
+    switch (type) {
+        case Type::Array:
+            return static_cast<uint32_t>(std::lower_bound(values.begin(), values.end(), low) - values.begin());
+
+        case Type::Bitmap: {
+            uint32_t count = 0;
+            size_t const words = low / 64;
+
+            for (size_t i = 0; i < words; i++) {
+                count += __builtin_popcountll(bits[i]);
+            }
+
+            if (low % 64 != 0) {
+                count += __builtin_popcountll(bits[words] & ((UINT64_C(1) << (low % 64)) - 1));
+            }
+
+            return count;
+        }
+
+        case Type::Run: {
+            uint32_t count = 0;
+
+            for (size_t i = 0; i < values.size() && values[i] < low; i += 2) {
+                count += std::min(static_cast<uint32_t>(values[i + 1]) + 1, low - values[i]);
+            }
+
+            return count;
+        }
+    }
+
+    return 0;
+}
+
+bool hc::Set::Container::validate() {
+    uint32_t count = 0;
+
+    switch (type) {
+        case Type::Array:
+            for (size_t i = 1; i < values.size(); i++) {
+                if (values[i] <= values[i - 1]) {
+                    return false;
+                }
+            }
+
+            count = static_cast<uint32_t>(values.size());
+            break;
+
+        case Type::Bitmap:
+            if (bits.size() != BITMAP_WORDS) {
+                return false;
+            }
+
+            for (uint64_t const word : bits) {
+                count += __builtin_popcountll(word);
+            }
+
+            break;
+
+        case Type::Run: {
+            if (values.size() % 2 != 0) {
+                return false;
+            }
+
+            uint32_t next = 0;
+
+            for (size_t i = 0; i < values.size(); i += 2) {
+                uint32_t const start = values[i];
+                uint32_t const end = start + values[i + 1];
+
+                if (start < next || end > 0xffff) {
+                    return false;
+                }
+
+                count += end - start + 1;
+                next = end + 1;
+            }
+
+            break;
+        }
+
+        default:
+            return false;
+    }
+
+    cardinality = count;
+    return true;
+}
+
+void hc::Set::Container::combine(Container* result, Container const& c1, Container const& c2, Operation op) {
+    if (c1.type == Type::Array && c2.type == Type::Array) {
+        switch (op) {
+            case Operation::Union:
+                result->values.reserve(c1.values.size() + c2.values.size());
+                std::set_union(c1.values.begin(), c1.values.end(), c2.values.begin(), c2.values.end(), std::back_inserter(result->values));
+                break;
+
+            case Operation::Intersection:
+                result->values.reserve(std::min(c1.values.size(), c2.values.size()));
+                std::set_intersection(c1.values.begin(), c1.values.end(), c2.values.begin(), c2.values.end(), std::back_inserter(result->values));
+                break;
+
+            case Operation::Difference:
+                result->values.reserve(c1.values.size());
+                std::set_difference(c1.values.begin(), c1.values.end(), c2.values.begin(), c2.values.end(), std::back_inserter(result->values));
+                break;
+        }
+
+        result->type = Type::Array;
+        result->cardinality = static_cast<uint32_t>(result->values.size());
+    }
+    else if (op != Operation::Union && c1.type == Type::Array) {
+        // Only the array elements can end up in the result, probe the other container
+        bool const keep = op == Operation::Intersection;
+        result->values.reserve(c1.values.size());
+
+        for (uint16_t const low : c1.values) {
+            if (c2.contains(low) == keep) {
+                result->values.emplace_back(low);
+            }
+        }
+
+        result->type = Type::Array;
+        result->cardinality = static_cast<uint32_t>(result->values.size());
+    }
+    else if (op == Operation::Intersection && c2.type == Type::Array) {
+        combine(result, c2, c1, op);
+        return;
+    }
+    else {
+        uint64_t words[BITMAP_WORDS];
+        result->bits.resize(BITMAP_WORDS);
+        c1.bitmap(result->bits.data());
+        c2.bitmap(words);
+
+        uint64_t* const bits = result->bits.data();
+        size_t cardinality = 0;
+
+        switch (op) {
+            case Operation::Union:
+                for (size_t i = 0; i < BITMAP_WORDS; i++) {
+                    bits[i] |= words[i];
+                    cardinality += __builtin_popcountll(bits[i]);
+                }
+
+                break;
+
+            case Operation::Intersection:
+                for (size_t i = 0; i < BITMAP_WORDS; i++) {
+                    bits[i] &= words[i];
+                    cardinality += __builtin_popcountll(bits[i]);
+                }
+
+                break;
+
+            case Operation::Difference:
+                for (size_t i = 0; i < BITMAP_WORDS; i++) {
+                    bits[i] &= ~words[i];
+                    cardinality += __builtin_popcountll(bits[i]);
+                }
+
+                break;
+        }
+
+        result->type = Type::Bitmap;
+        result->cardinality = static_cast<uint32_t>(cardinality);
+    }
+
+    result->optimize();
+}
+
+hc::Set::const_iterator::const_iterator(std::vector<Container> const* containers, size_t container)
+    : _containers(containers)
+    , _container(container)
+    , _index(0)
+    , _low(0)
+    , _value(0) {
+
+    settle();
+}
+
+hc::Set::const_iterator::const_iterator(std::vector<Container> const* containers, size_t container, size_t index, uint32_t low)
+    : _containers(containers)
+    , _container(container)
+    , _index(index)
+    , _low(low)
+    , _value((*containers)[container].key << 16 | low) {}
+
+void hc::Set::const_iterator::settle() {
+    // Containers are never empty, but be defensive
+    while (_container < _containers->size()) {
+        Container const& container = (*_containers)[_container];
+
+        if (container.first(&_index, &_low)) {
+            _value = container.key << 16 | _low;
+            return;
+        }
+
+        _container++;
+    }
+
+    _index = 0;
+    _low = 0;
+}
+
+hc::Set::const_iterator& hc::Set::const_iterator::operator++() {
+    Container const& container = (*_containers)[_container];
+
+    if (container.next(&_index, &_low)) {
+        _value = container.key << 16 | _low;
+    }
+    else {
+        _container++;
+        settle();
+    }
+
+    return *this;
+}
+
+hc::Set::const_iterator hc::Set::const_iterator::operator++(int) {
+    const_iterator const previous = *this;
+    ++*this;
+    return previous;
+}
+
+hc::Set::Set() : _size(0), _complemented(false) {}
+
+void hc::Set::add(uint64_t element) {
+    uint64_t const key = element >> 16;
+
+    if (_containers.empty() || _containers.back().key != key) {
+        if (!_containers.empty()) {
+            _containers.back().optimize();
+        }
+
+        _containers.emplace_back(key);
+    }
+
+    _containers.back().add(static_cast<uint16_t>(element));
+    _size++;
+}
+
+void hc::Set::addRange(uint64_t first, uint64_t last) {
+    Set range;
+
+    for (uint64_t key = first >> 16;; key++) {
+        uint32_t const low = key == first >> 16 ? static_cast<uint32_t>(first & 0xffff) : 0;
+        uint32_t const high = key == last >> 16 ? static_cast<uint32_t>(last & 0xffff) : 0xffff;
+
+        range._containers.emplace_back(key);
+        Container& container = range._containers.back();
+        container.type = Container::Type::Run;
+        container.values.emplace_back(static_cast<uint16_t>(low));
+        container.values.emplace_back(static_cast<uint16_t>(high - low));
+        container.cardinality = high - low + 1;
+        range._size += container.cardinality;
+
+        if (key == last >> 16) {
+            break;
+        }
+    }
+
+    append(&range);
+}
+
+void hc::Set::append(Set* other) {
+    auto begin = other->_containers.begin();
+    auto const end = other->_containers.end();
+
+    // Both sets can have elements with the same key at the boundary
+    if (begin != end && !_containers.empty() && _containers.back().key == begin->key) {
+        Container& last = _containers.back();
+        Container merged(last.key);
+        Container::combine(&merged, last, *begin, Container::Operation::Union);
+
+        _size += merged.cardinality - last.cardinality;
+        last = std::move(merged);
+        ++begin;
+    }
+
+    for (; begin != end; ++begin) {
+        _size += begin->cardinality;
+        _containers.emplace_back(std::move(*begin));
+    }
+
+    other->_containers.clear();
+    other->_size = 0;
+}
 
 bool hc::Set::contains(uint64_t element) const {
-    bool const contains = std::binary_search(_elements.begin(), _elements.end(), element);
+    uint64_t const key = element >> 16;
+
+    auto const found = std::lower_bound(_containers.begin(), _containers.end(), key, [](Container const& container, uint64_t value) {
+        return container.key < value;
+    });
+
+    bool const contains = found != _containers.end() && found->key == key && found->contains(static_cast<uint16_t>(element));
     return _complemented ? !contains : contains;
 }
 
+hc::Set::const_iterator hc::Set::lowerBound(uint64_t element) const {
+    uint64_t const key = element >> 16;
+
+    auto const found = std::lower_bound(_containers.begin(), _containers.end(), key, [](Container const& container, uint64_t value) {
+        return container.key < value;
+    });
+
+    size_t const container = found - _containers.begin();
+
+    if (found != _containers.end() && found->key == key) {
+        size_t index = 0;
+        uint32_t low = 0;
+
+        if (found->lowerBound(static_cast<uint16_t>(element), &index, &low)) {
+            return const_iterator(&_containers, container, index, low);
+        }
+
+        return const_iterator(&_containers, container + 1);
+    }
+
+    return const_iterator(&_containers, container);
+}
+
+hc::Set::const_iterator hc::Set::at(size_t index) const {
+    for (size_t i = 0; i < _containers.size(); i++) {
+        Container const& container = _containers[i];
+
+        if (index < container.cardinality) {
+            size_t position = 0;
+            uint32_t low = 0;
+            container.select(static_cast<uint32_t>(index), &position, &low);
+            return const_iterator(&_containers, i, position, low);
+        }
+
+        index -= container.cardinality;
+    }
+
+    return end();
+}
+
+size_t hc::Set::count(uint64_t first, uint64_t last) const {
+    if (first > last) {
+        return 0;
+    }
+
+    uint64_t const firstKey = first >> 16;
+    uint64_t const lastKey = last >> 16;
+
+    auto i = std::lower_bound(_containers.begin(), _containers.end(), firstKey, [](Container const& container, uint64_t value) {
+        return container.key < value;
+    });
+
+    size_t count = 0;
+
+    for (; i != _containers.end() && i->key <= lastKey; ++i) {
+        // Only the containers at the ends of the range are partially counted
+        uint32_t const lo = i->key == firstKey ? static_cast<uint16_t>(first) : 0;
+        uint32_t const hi = i->key == lastKey ? static_cast<uint32_t>(static_cast<uint16_t>(last)) + 1 : 65536;
+
+        if (lo == 0 && hi == 65536) {
+            count += i->cardinality;
+        }
+        else {
+            count += i->rank(hi) - i->rank(lo);
+        }
+    }
+
+    return count;
+}
+
+void hc::Set::forEach(uint64_t first, uint64_t last, bool (*callback)(uint64_t element, void* userdata), void* userdata) const {
+    auto const end = this->end();
+
+    for (auto it = lowerBound(first); it != end && *it <= last; ++it) {
+        if (!callback(*it, userdata)) {
+            break;
+        }
+    }
+}
+
+hc::Set* hc::Set::combine(Set const* set1, Set const* set2, Container::Operation op) {
+    Set* result = new Set;
+
+    auto const& c1 = set1->_containers;
+    auto const& c2 = set2->_containers;
+    size_t i = 0, j = 0;
+
+    while (i < c1.size() || j < c2.size()) {
+        if (j == c2.size() || (i < c1.size() && c1[i].key < c2[j].key)) {
+            if (op != Container::Operation::Intersection) {
+                result->_containers.emplace_back(c1[i]);
+                result->_size += c1[i].cardinality;
+            }
+
+            i++;
+        }
+        else if (i == c1.size() || c2[j].key < c1[i].key) {
+            if (op == Container::Operation::Union) {
+                result->_containers.emplace_back(c2[j]);
+                result->_size += c2[j].cardinality;
+            }
+
+            j++;
+        }
+        else {
+            Container container(c1[i].key);
+            Container::combine(&container, c1[i], c2[j], op);
+
+            if (container.cardinality != 0) {
+                result->_size += container.cardinality;
+                result->_containers.emplace_back(std::move(container));
+            }
+
+            i++;
+            j++;
+        }
+    }
+
+    result->_containers.shrink_to_fit();
+    return result;
+}
+
 hc::Set* hc::Set::union_(Set const* other) const {
+    Set* result = nullptr;
+
     if (!_complemented && !other->_complemented) {
         // A + B
-        Set* result = new Set;
-        result->_elements.reserve(_elements.size() + other->_elements.size());
-
-        std::set_union(
-            _elements.begin(),
-            _elements.end(),
-            other->_elements.begin(),
-            other->_elements.end(),
-            std::inserter(result->_elements, result->_elements.begin())
-        );
-
-        result->_elements.shrink_to_fit();
-        return result;
+        result = combine(this, other, Container::Operation::Union);
     }
     else if (!_complemented && other->_complemented) {
         // A + ~B = ~(B - A)
         // https://www.wolframalpha.com/input/?i=is+A+union+B%27+%3D+%28B+difference+A%29%27
-        Set* result = new Set;
-        result->_elements.reserve(_elements.size());
-
-        std::set_difference(
-            other->_elements.begin(),
-            other->_elements.end(),
-            _elements.begin(),
-            _elements.end(),
-            std::inserter(result->_elements, result->_elements.begin())
-        );
-
-        result->_elements.shrink_to_fit();
+        result = combine(other, this, Container::Operation::Difference);
         result->_complemented = true;
-        return result;
     }
     else if (_complemented && !other->_complemented) {
         // ~A + B = ~(A - B)
         // https://www.wolframalpha.com/input/?i=is+A%27+union+B+%3D+%28A+difference+B%29%27
-        Set* result = new Set;
-        result->_elements.reserve(_elements.size());
-
-        std::set_difference(
-            _elements.begin(),
-            _elements.end(),
-            other->_elements.begin(),
-            other->_elements.end(),
-            std::inserter(result->_elements, result->_elements.begin())
-        );
-
-        result->_elements.shrink_to_fit();
+        result = combine(this, other, Container::Operation::Difference);
         result->_complemented = true;
-        return result;
     }
     else {
         // ~A + ~B = ~(A * B)
         // https://www.wolframalpha.com/input/?i=is+A%27+union+B%27+%3D+%28A+intersects+B%29%27
-        Set* result = new Set;
-        result->_elements.reserve(std::min(_elements.size(), other->_elements.size()));
-
-        std::set_intersection(
-            _elements.begin(),
-            _elements.end(),
-            other->_elements.begin(),
-            other->_elements.end(),
-            std::inserter(result->_elements, result->_elements.begin())
-        );
-
-        result->_elements.shrink_to_fit();
+        result = combine(this, other, Container::Operation::Intersection);
         result->_complemented = true;
-        return result;
     }
 
-    return nullptr;
+    return result;
 }
 
 hc::Set* hc::Set::intersection(Set const* other) const {
+    Set* result = nullptr;
+
     if (!_complemented && !other->_complemented) {
         // A * B
-        Set* result = new Set;
-        result->_elements.reserve(std::min(_elements.size(), other->_elements.size()));
-
-        std::set_intersection(
-            _elements.begin(),
-            _elements.end(),
-            other->_elements.begin(),
-            other->_elements.end(),
-            std::inserter(result->_elements, result->_elements.begin())
-        );
-
-        result->_elements.shrink_to_fit();
-        return result;
+        result = combine(this, other, Container::Operation::Intersection);
     }
     else if (!_complemented && other->_complemented) {
         // A * ~B = A - B
         // https://www.wolframalpha.com/input/?i=is+A+intersect+B%27+%3D+A+difference+B
-        Set* result = new Set;
-        result->_elements.reserve(_elements.size());
-
-        std::set_difference(
-            _elements.begin(),
-            _elements.end(),
-            other->_elements.begin(),
-            other->_elements.end(),
-            std::inserter(result->_elements, result->_elements.begin())
-        );
-
-        result->_elements.shrink_to_fit();
-        return result;
+        result = combine(this, other, Container::Operation::Difference);
     }
     else if (_complemented && !other->_complemented) {
         // ~A * B = B - A
         // https://www.wolframalpha.com/input/?i=is+A%27+intersects+B+%3D+B+difference+A
-        Set* result = new Set;
-        result->_elements.reserve(_elements.size());
-
-        std::set_difference(
-            other->_elements.begin(),
-            other->_elements.end(),
-            _elements.begin(),
-            _elements.end(),
-            std::inserter(result->_elements, result->_elements.begin())
-        );
-
-        result->_elements.shrink_to_fit();
-        return result;
+        result = combine(other, this, Container::Operation::Difference);
     }
     else {
         // ~A * ~B = ~(A + B)
         // https://www.wolframalpha.com/input/?i=is+A%27+intersect+B%27+%3D+%28A+union+B%29%27
-        Set* result = new Set;
-        result->_elements.reserve(_elements.size() + other->_elements.size());
-
-        std::set_union(
-            _elements.begin(),
-            _elements.end(),
-            other->_elements.begin(),
-            other->_elements.end(),
-            std::inserter(result->_elements, result->_elements.begin())
-        );
-
-        result->_elements.shrink_to_fit();
+        result = combine(this, other, Container::Operation::Union);
         result->_complemented = true;
-        return result;
     }
 
-    return nullptr;
+    return result;
 }
 
 hc::Set* hc::Set::difference(Set const* other) const {
+    Set* result = nullptr;
+
     if (!_complemented && !other->_complemented) {
         // A - B
-        Set* result = new Set;
-        result->_elements.reserve(_elements.size());
-
-        std::set_difference(
-            _elements.begin(),
-            _elements.end(),
-            other->_elements.begin(),
-            other->_elements.end(),
-            std::inserter(result->_elements, result->_elements.begin())
-        );
-
-        result->_elements.shrink_to_fit();
-        return result;
+        result = combine(this, other, Container::Operation::Difference);
     }
     else if (!_complemented && other->_complemented) {
         // A - ~B = A * B
         // https://www.wolframalpha.com/input/?i=is+A+difference+B%27+%3D+A+intersect+B
-        Set* result = new Set;
-        result->_elements.reserve(std::min(_elements.size(), other->_elements.size()));
-
-        std::set_intersection(
-            _elements.begin(),
-            _elements.end(),
-            other->_elements.begin(),
-            other->_elements.end(),
-            std::inserter(result->_elements, result->_elements.begin())
-        );
-
-        result->_elements.shrink_to_fit();
-        return result;
+        result = combine(this, other, Container::Operation::Intersection);
     }
     else if (_complemented && !other->_complemented) {
         // ~A - B = ~(A + B)
         // https://www.wolframalpha.com/input/?i=is+A%27+difference+B+%3D+%28A+union+B%29%27
-        Set* result = new Set;
-        result->_elements.reserve(_elements.size() + other->_elements.size());
-
-        std::set_union(
-            _elements.begin(),
-            _elements.end(),
-            other->_elements.begin(),
-            other->_elements.end(),
-            std::inserter(result->_elements, result->_elements.begin())
-        );
-
-        result->_elements.shrink_to_fit();
+        result = combine(this, other, Container::Operation::Union);
         result->_complemented = true;
-        return result;
     }
     else {
         // ~A - ~B = B - A
         // https://www.wolframalpha.com/input/?i=is+A%27+difference+B%27+%3D+B+difference+A
-        Set* result = new Set;
-        result->_elements.reserve(_elements.size());
-
-        std::set_difference(
-            other->_elements.begin(),
-            other->_elements.end(),
-            _elements.begin(),
-            _elements.end(),
-            std::inserter(result->_elements, result->_elements.begin())
-        );
-
-        result->_elements.shrink_to_fit();
-        return result;
+        result = combine(other, this, Container::Operation::Difference);
     }
 
-    return nullptr;
+    return result;
 }
 
 hc::Set* hc::Set::complement() const {
     Set* result = new Set;
-    result->_elements = _elements;
+    result->_containers = _containers;
+    result->_size = _size;
     result->_complemented = !_complemented;
     return result;
 }
@@ -275,7 +939,10 @@ int hc::Set::push(lua_State* const L) {
             {"intersection", l_intersection},
             {"difference", l_difference},
             {"complement", l_complement},
+            {"count", l_count},
             {"elements", l_elements},
+            {"range", l_range},
+            {"page", l_page},
             {"asTable", l_asTable},
             {NULL, NULL}
         };
@@ -343,14 +1010,40 @@ int hc::Set::l_complement(lua_State* L) {
     return result->push(L);
 }
 
-int hc::Set::l_elements(lua_State* L) {
+int hc::Set::l_count(lua_State* L) {
+    auto self = check(L, 1);
+
+    if (lua_isnoneornil(L, 2)) {
+        lua_pushinteger(L, self->size());
+        return 1;
+    }
+
+    uint64_t const first = luaL_checkinteger(L, 2);
+    uint64_t const last = luaL_checkinteger(L, 3);
+    size_t const count = self->count(first, last);
+
+    // A complemented set has all the elements in the range that are not stored
+    lua_pushinteger(L, self->_complemented && first <= last ? last - first + 1 - count : count);
+    return 1;
+}
+
+namespace {
+    struct Cursor {
+        hc::Set::const_iterator iterator;
+        uint64_t last;
+    };
+}
+
+static int pushCursor(lua_State* L, hc::Set::const_iterator const& iterator, uint64_t last) {
     static auto const next = [](lua_State* L) -> int {
-        auto self = *static_cast<Set**>(lua_touserdata(L, 1));
-        size_t index = lua_tointeger(L, 2);
+        auto self = *static_cast<hc::Set**>(lua_touserdata(L, lua_upvalueindex(1)));
+        auto cursor = static_cast<Cursor*>(lua_touserdata(L, lua_upvalueindex(2)));
+        lua_Integer const index = lua_tointeger(L, 2);
 
-        if (index < self->_elements.size()) {
+        if (cursor->iterator != self->end() && *cursor->iterator <= cursor->last) {
             lua_pushinteger(L, index + 1);
-            lua_pushinteger(L, self->_elements[index]);
+            lua_pushinteger(L, *cursor->iterator);
+            ++cursor->iterator;
             return 2;
         }
 
@@ -358,23 +1051,68 @@ int hc::Set::l_elements(lua_State* L) {
         return 1;
     };
 
-    check(L, 1);
-
-    lua_pushcfunction(L, next);
+    // The set and the cursor are upvalues, the set keeps the containers alive
     lua_pushvalue(L, 1);
+    new (lua_newuserdata(L, sizeof(Cursor))) Cursor{iterator, last};
+    lua_pushcclosure(L, next, 2);
+    lua_pushnil(L);
     lua_pushinteger(L, 0);
     return 3;
 }
 
+int hc::Set::l_elements(lua_State* L) {
+    auto self = check(L, 1);
+    return pushCursor(L, self->begin(), UINT64_MAX);
+}
+
+int hc::Set::l_range(lua_State* L) {
+    auto self = check(L, 1);
+    uint64_t const first = luaL_checkinteger(L, 2);
+    uint64_t const last = luaL_checkinteger(L, 3);
+
+    if (self->_complemented) {
+        return luaL_error(L, "cannot enumerate the elements of a complemented set");
+    }
+
+    return pushCursor(L, self->lowerBound(first), last);
+}
+
+int hc::Set::l_page(lua_State* L) {
+    auto self = check(L, 1);
+    lua_Integer const page = luaL_checkinteger(L, 2);
+    lua_Integer const size = luaL_checkinteger(L, 3);
+
+    luaL_argcheck(L, page >= 1, 2, "pages start at 1");
+    luaL_argcheck(L, size >= 1, 3, "page size must be positive");
+
+    if (self->_complemented) {
+        return luaL_error(L, "cannot enumerate the elements of a complemented set");
+    }
+
+    // Only the elements in the page are visited
+    size_t const first = static_cast<size_t>(page - 1) * size;
+    size_t const count = first < self->_size ? std::min(self->_size - first, static_cast<size_t>(size)) : 0;
+
+    lua_createtable(L, static_cast<int>(count), 0);
+    auto it = self->at(first);
+
+    for (size_t i = 1; i <= count; i++, ++it) {
+        lua_pushinteger(L, *it);
+        lua_rawseti(L, -2, i);
+    }
+
+    return 1;
+}
+
 int hc::Set::l_asTable(lua_State* L) {
     auto self = check(L, 1);
 
-    size_t size = self->_elements.size();
-    lua_createtable(L, size, 0);
+    lua_createtable(L, self->_size, 0);
+    lua_Integer i = 1;
 
-    for (size_t i = 0; i < size; i++) {
-        lua_pushinteger(L, self->_elements[i]);
-        lua_rawseti(L, -2, i + 1);
+    for (uint64_t const element : *self) {
+        lua_pushinteger(L, element);
+        lua_rawseti(L, -2, i++);
     }
 
     return 1;
@@ -8,16 +8,98 @@ extern "C" {
 
 #include <vector>
 #include <algorithm>
+#include <iterator>
+#include <stddef.h>
 #include <stdint.h>
 
 namespace hc {
+    // Elements are grouped by their upper 48 bits, and the lower 16 bits of
+    // each group are stored in a sorted array, a bitmap or a list of runs,
+    // whichever is the smallest for the group's density.
     class Set : public Scriptable {
+    protected:
+        friend class Session;
+
+        struct Container {
+            enum class Type : uint8_t {
+                Array,
+                Bitmap,
+                Run
+            };
+
+            enum class Operation {
+                Union,
+                Intersection,
+                Difference
+            };
+
+            Container(uint64_t key) : key(key), type(Type::Array), cardinality(0) {}
+
+            bool contains(uint16_t low) const;
+            void add(uint16_t low);
+            void optimize();
+            void bitmap(uint64_t* bits) const;
+            bool first(size_t* index, uint32_t* low) const;
+            bool next(size_t* index, uint32_t* low) const;
+            // Positions index and low at the first element >= from, or at the element of the given rank
+            bool lowerBound(uint32_t from, size_t* index, uint32_t* low) const;
+            bool select(uint32_t rank, size_t* index, uint32_t* low) const;
+            // Number of elements less than low, low can be 65536
+            uint32_t rank(uint32_t low) const;
+            // Checks that the values are sorted, unique and in range, and sets the cardinality from them
+            bool validate();
+
+            static void combine(Container* result, Container const& c1, Container const& c2, Operation op);
+
+            uint64_t key;
+            Type type;
+            uint32_t cardinality;
+            // Array: the sorted values, Run: pairs of start and length - 1
+            std::vector<uint16_t> values;
+            // Bitmap: 1024 words
+            std::vector<uint64_t> bits;
+        };
+
     public:
-        size_t size() const { return _elements.size(); }
-        size_t size(size_t universal_size) const { return _complemented ? universal_size - _elements.size() : _elements.size(); }
+        class const_iterator {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef uint64_t value_type;
+            typedef ptrdiff_t difference_type;
+            typedef uint64_t const* pointer;
+            typedef uint64_t reference;
+
+            uint64_t operator*() const { return _value; }
+            const_iterator& operator++();
+            const_iterator operator++(int);
+
+            bool operator==(const_iterator const& other) const { return _container == other._container && _low == other._low; }
+            bool operator!=(const_iterator const& other) const { return !(*this == other); }
+
+        protected:
+            friend class Set;
+
+            const_iterator(std::vector<Container> const* containers, size_t container);
+            const_iterator(std::vector<Container> const* containers, size_t container, size_t index, uint32_t low);
+            void settle();
+
+            std::vector<Container> const* _containers;
+            size_t _container;
+            size_t _index;
+            uint32_t _low;
+            uint64_t _value;
+        };
+
+        size_t size() const { return _size; }
+        size_t size(size_t universal_size) const { return _complemented ? universal_size - _size : _size; }
         bool complemented() const { return _complemented; }
 
-        void add(uint64_t element) { _elements.emplace_back(element); }
+        // Elements must be added in ascending order
+        void add(uint64_t element);
+        // Adds all elements in [first, last] as runs, they must be greater than the ones already here
+        void addRange(uint64_t first, uint64_t last);
+        // Moves all elements of other into this set, they must be greater than the ones already here
+        void append(Set* other);
         bool contains(uint64_t element) const;
 
         Set* union_(Set const* other) const;
@@ -28,8 +110,16 @@ namespace hc {
         static Set* empty();
         static Set* universal();
 
-        std::vector<uint64_t>::const_iterator begin() const { return _elements.begin(); }
-        std::vector<uint64_t>::const_iterator end() const { return _elements.end(); }
+        const_iterator begin() const { return const_iterator(&_containers, 0); }
+        const_iterator end() const { return const_iterator(&_containers, _containers.size()); }
+
+        // These work on the elements stored in the set, regardless of it being complemented
+        const_iterator lowerBound(uint64_t element) const;
+        const_iterator at(size_t index) const;
+        // Counts the elements in [first, last] using only the container cardinalities and ranks
+        size_t count(uint64_t first, uint64_t last) const;
+        // Calls callback for each element in [first, last] until it returns false
+        void forEach(uint64_t first, uint64_t last, bool (*callback)(uint64_t element, void* userdata), void* userdata) const;
 
         static Set* check(lua_State* L, int index);
 
@@ -39,17 +129,23 @@ namespace hc {
     protected:
         Set();
 
+        static Set* combine(Set const* set1, Set const* set2, Container::Operation op);
+
         static int l_size(lua_State* const L);
         static int l_contains(lua_State* const L);
         static int l_union(lua_State* const L);
         static int l_intersection(lua_State* const L);
         static int l_difference(lua_State* const L);
         static int l_complement(lua_State* const L);
+        static int l_count(lua_State* const L);
         static int l_elements(lua_State* const L);
+        static int l_range(lua_State* const L);
+        static int l_page(lua_State* const L);
         static int l_asTable(lua_State* const L);
         static int l_collect(lua_State* const L);
 
-        std::vector<uint64_t> _elements;
+        std::vector<Container> _containers;
+        size_t _size;
         bool _complemented;
     };
 }
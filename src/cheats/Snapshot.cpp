@@ -2,8 +2,11 @@
 #include "Memory.h"
 
 #include <inttypes.h>
+#include <string.h>
 #include <sys/time.h>
 #include <atomic>
+#include <algorithm>
+#include <map>
 
 extern "C" {
     #include <lauxlib.h>
@@ -38,40 +41,126 @@ static std::string createName(char const* memory_name) {
     return name;
 }
 
-static void* snapshot(hc::Memory* const memory) {
-    uint8_t* const data = new uint8_t[memory->size()];
-    uint64_t const end = memory->base() + memory->size();
+static uint64_t hash(uint8_t const* data, size_t size) {
+    // FNV-1a over 64-bit words
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
 
-    for (uint64_t i = 0, address = memory->base(); address < end; i++, address++) {
-        data[i] = memory->peek(address);
+    for (size_t i = 0; i < size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * UINT64_C(0x100000001b3);
     }
 
-    return data;
+    return hash;
 }
 
-hc::Snapshot::Snapshot(Memory* memory) : Snapshot(memory->base(), memory->size(), snapshot(memory), memory) {}
+hc::Snapshot::Latest* hc::Snapshot::latest(Memory const* memory) {
+    static std::map<std::string, Latest> latest;
 
-hc::Snapshot::Snapshot(uint64_t baseAddress, uint64_t size, void const* data, Memory* memory)
+    // Snapshots of snapshots get a new memory id each time, drop the entries nothing refers to anymore
+    for (auto it = latest.begin(); it != latest.end();) {
+        auto const& pages = it->second.pages;
+
+        bool const expired = std::all_of(pages.begin(), pages.end(), [](std::weak_ptr<Page const> const& page) {
+            return page.expired();
+        });
+
+        if (expired && it->first != memory->id()) {
+            it = latest.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    return &latest[memory->id()];
+}
+
+hc::Snapshot::Snapshot(Memory* memory)
     : _id(createId())
     , _name(createName(memory->name()))
-    , _baseAddress(baseAddress)
-    , _size(size)
-    , _data(data)
-    , _memory(memory)
-{}
+    , _baseAddress(memory->base())
+    , _size(memory->size())
+    , _memoryId(memory->id())
+{
+    size_t const count = (_size + PageSize - 1) / PageSize;
+    _pages.reserve(count);
+
+    Latest* const previous = latest(memory);
+
+    if (previous->base != _baseAddress || previous->size != _size) {
+        previous->base = _baseAddress;
+        previous->size = _size;
+        previous->pages.clear();
+    }
 
-hc::Snapshot::~Snapshot() {
-    free(const_cast<void*>(_data));
+    previous->pages.resize(count);
+    Page page;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t const offset = static_cast<uint64_t>(i) * PageSize;
+        uint64_t const size = std::min<uint64_t>(PageSize, _size - offset);
+
+        memory->read(_baseAddress + offset, page.data, size);
+        memset(page.data + size, 0, PageSize - size);
+        page.hash = hash(page.data, PageSize);
+
+        auto const shared = previous->pages[i].lock();
+
+        if (shared && shared->hash == page.hash && memcmp(shared->data, page.data, PageSize) == 0) {
+            _pages.emplace_back(shared);
+        }
+        else {
+            // Not make_shared, the weak_ptr in latest would keep the page's memory allocated along with the control block
+            _pages.emplace_back(std::shared_ptr<Page const>(new Page(page)));
+            previous->pages[i] = _pages.back();
+        }
+    }
 }
 
+hc::Snapshot::Snapshot(Memory* memory, std::vector<std::shared_ptr<Page const>>&& pages)
+    : _id(createId())
+    , _name(createName(memory->name()))
+    , _baseAddress(memory->base())
+    , _size(memory->size())
+    , _pages(std::move(pages))
+    , _memoryId(memory->id())
+{}
+
 uint8_t hc::Snapshot::peek(uint64_t address) const {
     uint64_t addr = address - _baseAddress;
 
     if (addr < _size) {
-        auto data = static_cast<uint8_t const*>(_data);
-        uint8_t byte = data[addr];
-        return byte;
+        return _pages[addr / PageSize]->data[addr % PageSize];
     }
 
     return 0;
 }
+
+void hc::Snapshot::read(uint64_t address, void* buffer, uint64_t size) const {
+    uint64_t addr = address - _baseAddress;
+    uint8_t* dest = static_cast<uint8_t*>(buffer);
+
+    while (size != 0 && addr < _size) {
+        uint64_t const offset = addr % PageSize;
+        uint64_t const count = std::min(std::min(size, PageSize - offset), _size - addr);
+
+        memcpy(dest, _pages[addr / PageSize]->data + offset, count);
+        dest += count;
+        addr += count;
+        size -= count;
+    }
+
+    memset(dest, 0, size);
+}
+
+uint8_t const* hc::Snapshot::span(uint64_t address, uint64_t size) const {
+    uint64_t const addr = address - _baseAddress;
+
+    // Only ranges inside a single page are contiguous
+    if (addr < _size && size <= _size - addr && addr % PageSize + size <= PageSize) {
+        return _pages[addr / PageSize]->data + addr % PageSize;
+    }
+
+    return nullptr;
+}
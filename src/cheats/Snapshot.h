@@ -10,15 +10,23 @@ extern "C" {
 #include <stddef.h>
 #include <stdint.h>
 #include <string>
+#include <vector>
+#include <memory>
 
 namespace hc {
+    // Snapshots are stored as fixed-size pages, pages that didn't change
+    // since the previous snapshot of the same memory are shared with it
     class Snapshot : public Memory {
     public:
+        enum {
+            PageSize = 4096
+        };
+
         Snapshot(Memory* memory);
-        Snapshot(uint64_t baseAddress, uint64_t size, void const* data, Memory* memory);
-        virtual ~Snapshot();
+        virtual ~Snapshot() {}
 
-        Memory const* memory() const { return _memory; }
+        // The id of the memory the snapshot was taken from, which can be collected before the snapshot
+        char const* memoryId() const { return _memoryId.c_str(); }
 
         // hc::Memory
         virtual char const* id() const override { return _id.c_str(); }
@@ -28,13 +36,34 @@ namespace hc {
         virtual bool readonly() const override { return true; }
         virtual uint8_t peek(uint64_t address) const override;
         virtual void poke(uint64_t address, uint8_t value) override { (void)address; (void)value; }
+        virtual void read(uint64_t address, void* buffer, uint64_t size) const override;
+        virtual uint8_t const* span(uint64_t address, uint64_t size) const override;
+        virtual void onCollected() override { delete this; }
 
     protected:
+        friend class Session;
+
+        struct Page {
+            uint64_t hash;
+            uint8_t data[PageSize];
+        };
+
+        // The pages of the most recent snapshot of a memory
+        struct Latest {
+            uint64_t base;
+            uint64_t size;
+            std::vector<std::weak_ptr<Page const>> pages;
+        };
+
+        static Latest* latest(Memory const* memory);
+
+        Snapshot(Memory* memory, std::vector<std::shared_ptr<Page const>>&& pages);
+
         std::string const _id;
         std::string const _name;
         uint64_t const _baseAddress;
         uint64_t const _size;
-        void const* const _data;
-        Memory* const _memory;
+        std::vector<std::shared_ptr<Page const>> _pages;
+        std::string const _memoryId;
     };
 }
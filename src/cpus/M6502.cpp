@@ -38,11 +38,11 @@ static uint64_t disasm(uint64_t address, hc::Memory const* memory, char* buffer,
     return (next_pc - address) & 0xffffU;
 }
 
-hc::M6502::M6502(Desktop* desktop, hc_Cpu const* cpu, void* userdata) : Cpu(desktop, cpu, userdata), _hasChanged(0) {
-    for (unsigned i = 0; i < HC_6502_NUM_REGISTERS; i++) {
-        _previousValue[i] = _cpu->v1.get_register(_userdata, i);
-    }
-}
+static char const* const registerNames[HC_6502_NUM_REGISTERS] = {
+    "A", "X", "Y", "S", "PC", "P"
+};
+
+hc::M6502::M6502(Desktop* desktop, hc_Cpu const* cpu, void* userdata) : Cpu(desktop, cpu, userdata) {}
 
 uint64_t hc::M6502::instructionLength(uint64_t address, Memory const* memory) {
     char buffer[32];
@@ -55,8 +55,51 @@ void hc::M6502::disasm(uint64_t address, Memory const* memory, char* buffer, siz
     ::disasm(address, memory, buffer, size);
 }
 
-void hc::M6502::onFrame() {
-    _hasChanged = 0;
+hc::Cpu::Flow hc::M6502::flow(uint64_t address, Memory const* memory, uint64_t* target) {
+    uint8_t const op = memory->peek(address);
+
+    switch (op) {
+        case 0x4c: *target = memory->peek(address + 1) | memory->peek(address + 2) << 8; return Flow::Jump; // jmp abs
+        case 0x20: *target = memory->peek(address + 1) | memory->peek(address + 2) << 8; return Flow::Call; // jsr
+        case 0x6c: return Flow::Indirect; // jmp (ind)
+        case 0x40: case 0x60: return Flow::Return; // rti, rts
+    }
+
+    // bpl, bmi, bvc, bvs, bcc, bcs, bne, beq
+    if ((op & 0x1f) == 0x10) {
+        *target = (address + 2 + static_cast<int8_t>(memory->peek(address + 1))) & 0xffff;
+        return Flow::Branch;
+    }
+
+    return Flow::Next;
+}
+
+void hc::M6502::entryPoints(Memory const* memory, std::vector<uint64_t>* entries) {
+    // The nmi, reset and irq/brk vectors
+    for (uint64_t vector = 0xfffa; vector < 0x10000; vector += 2) {
+        if (vector >= memory->base() && vector + 1 < memory->base() + memory->size()) {
+            entries->push_back(memory->peek(vector) | memory->peek(vector + 1) << 8);
+        }
+    }
+
+    entries->push_back(programCounter());
+}
+
+unsigned hc::M6502::stackWalk(Memory const* memory, uint64_t* addresses, unsigned count) {
+    uint64_t const s = getRegister(HC_6502_S);
+
+    // Pushed bytes don't keep the return addresses aligned, try every offset; rts returns after the pushed address
+    for (unsigned i = 0; i < count; i++) {
+        uint8_t const low = memory->peek(0x100 + ((s + 1 + i) & 0xff));
+        uint8_t const high = memory->peek(0x100 + ((s + 2 + i) & 0xff));
+        addresses[i] = ((low | high << 8) + 1) & 0xffff;
+    }
+
+    return count;
+}
+
+char const* hc::M6502::registerName(unsigned reg) const {
+    return reg < HC_6502_NUM_REGISTERS ? registerNames[reg] : "?";
 }
 
 void hc::M6502::onDraw() {
@@ -65,39 +108,27 @@ void hc::M6502::onDraw() {
     }
 
     for (unsigned i = 0; i < HC_6502_NUM_REGISTERS; i++) {
-        static char const* const names[HC_6502_NUM_REGISTERS] = {
-            "A", "X", "Y", "S", "PC", "P"
-        };
-
         static uint8_t const width[HC_6502_NUM_REGISTERS] = {
             8, 8, 8, 8, 16, 8
         };
 
-        uint32_t const regBit = UINT32_C(1) << i;
-
-        if ((_hasChanged & regBit) == 0) {
-            uint64_t const value = _cpu->v1.get_register(_userdata, i);
-            _hasChanged |= ((value == _previousValue[i]) - 1) & regBit;
-            _previousValue[i] = value;
-        }
-
-        bool const highlight = (regBit & _hasChanged) != 0;
+        bool const highlight = ((_hasChanged >> i) & 1) != 0;
 
         if (i == HC_6502_P) {
             static char const* const flags[] = {"N", "V", "X", "B", "D", "I", "Z", "C"};
-            drawFlags(i, names[i], flags, width[i], highlight);
+            drawFlags(i, registerNames[i], flags, width[i], highlight);
         }
         else {
-            drawRegister(i, names[i], width[i], highlight);
+            drawRegister(i, registerNames[i], width[i], highlight);
         }
     }
 
     if (ImGui::Button(ICON_FA_CODE " Disassembly")) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
         _desktop->addView(new Disasm(_desktop, this, mainMemory(), HC_6502_PC), false, true);
     }
 
     if (ImGuiAl::Button(ICON_FA_EYE " Step", canStepInto())) {
-        _hasChanged = 0;
-        stepInto();
+        step();
     }
 }
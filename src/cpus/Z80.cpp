@@ -278,11 +278,11 @@ static void info(uint64_t address, hc::Memory const* memory, uint8_t* length, ui
     }
 }
 
-hc::Z80::Z80(Desktop* desktop, hc_Cpu const* cpu, void* userdata) : Cpu(desktop, cpu, userdata), _hasChanged(0) {
-    for (unsigned i = 0; i < HC_Z80_NUM_REGISTERS; i++) {
-        _previousValue[i] = _cpu->v1.get_register(_userdata, i);
-    }
-}
+static char const* const registerNames[HC_Z80_NUM_REGISTERS] = {
+    "A", "F", "BC", "DE", "HL", "IX", "IY", "AF2", "BC2", "DE2", "HL2", "I", "R", "SP", "PC", "IFF", "IM", "WZ"
+};
+
+hc::Z80::Z80(Desktop* desktop, hc_Cpu const* cpu, void* userdata) : Cpu(desktop, cpu, userdata) {}
 
 uint64_t hc::Z80::instructionLength(uint64_t address, Memory const* memory) {
     uint8_t length = 0;
@@ -342,8 +342,67 @@ void hc::Z80::disasm(uint64_t address, Memory const* memory, char* buffer, size_
     );
 }
 
-void hc::Z80::onFrame() {
-    _hasChanged = 0;
+hc::Cpu::Flow hc::Z80::flow(uint64_t address, Memory const* memory, uint64_t* target) {
+    uint8_t const op = memory->peek(address);
+
+    auto const relative = [&]() -> uint64_t {
+        return (address + 2 + static_cast<int8_t>(memory->peek(address + 1))) & 0xffff;
+    };
+
+    auto const absolute = [&]() -> uint64_t {
+        return memory->peek(address + 1) | memory->peek(address + 2) << 8;
+    };
+
+    switch (op) {
+        case 0x10: *target = relative(); return Flow::Branch; // djnz
+        case 0x18: *target = relative(); return Flow::Jump; // jr
+
+        case 0x20: case 0x28: case 0x30: case 0x38: *target = relative(); return Flow::Branch; // jr cc
+
+        case 0xc3: *target = absolute(); return Flow::Jump; // jp
+        case 0xcd: *target = absolute(); return Flow::Call; // call
+        case 0xc9: return Flow::Return; // ret
+        case 0xe9: return Flow::Indirect; // jp (hl)
+
+        // jp (ix), jp (iy)
+        case 0xdd: case 0xfd: return memory->peek(address + 1) == 0xe9 ? Flow::Indirect : Flow::Next;
+        // retn, reti
+        case 0xed: return (memory->peek(address + 1) & 0xc7) == 0x45 ? Flow::Return : Flow::Next;
+    }
+
+    switch (op & 0xc7) {
+        case 0xc0: return Flow::ConditionalReturn; // ret cc
+        case 0xc2: *target = absolute(); return Flow::Branch; // jp cc
+        case 0xc4: *target = absolute(); return Flow::Call; // call cc
+        case 0xc7: *target = op & 0x38; return Flow::Call; // rst
+    }
+
+    return Flow::Next;
+}
+
+void hc::Z80::entryPoints(Memory const* memory, std::vector<uint64_t>* entries) {
+    (void)memory;
+
+    // Reset, the im 1 interrupt handler, and the nmi handler
+    entries->push_back(0x0000);
+    entries->push_back(0x0038);
+    entries->push_back(0x0066);
+    entries->push_back(programCounter());
+}
+
+unsigned hc::Z80::stackWalk(Memory const* memory, uint64_t* addresses, unsigned count) {
+    uint64_t const sp = getRegister(HC_Z80_SP);
+
+    for (unsigned i = 0; i < count; i++) {
+        uint64_t const address = (sp + i * 2) & 0xffff;
+        addresses[i] = memory->peek(address) | memory->peek((address + 1) & 0xffff) << 8;
+    }
+
+    return count;
+}
+
+char const* hc::Z80::registerName(unsigned reg) const {
+    return reg < HC_Z80_NUM_REGISTERS ? registerNames[reg] : "?";
 }
 
 void hc::Z80::onDraw() {
@@ -352,43 +411,31 @@ void hc::Z80::onDraw() {
     }
 
     for (unsigned i = 0; i < HC_Z80_NUM_REGISTERS; i++) {
-        static char const* const names[HC_Z80_NUM_REGISTERS] = {
-            "A", "F", "BC", "DE", "HL", "IX", "IY", "AF2", "BC2", "DE2", "HL2", "I", "R", "SP", "PC", "IFF", "IM", "WZ"
-        };
-
         static uint8_t const width[HC_Z80_NUM_REGISTERS] = {
             8, 8, 16, 16, 16, 16, 16, 16, 16, 16, 16, 8, 8, 16, 16, 2, 8, 16
         };
 
-        uint32_t const regBit = UINT32_C(1) << i;
-
-        if ((_hasChanged & regBit) == 0) {
-            uint64_t const value = _cpu->v1.get_register(_userdata, i);
-            _hasChanged |= ((value == _previousValue[i]) - 1) & regBit;
-            _previousValue[i] = value;
-        }
-
-        bool const highlight = (regBit & _hasChanged) != 0;
+        bool const highlight = ((_hasChanged >> i) & 1) != 0;
 
         if (i == HC_Z80_F) {
             static char const* const flags[] = {"S", "Z", "Y", "H", "X", "PV", "N", "C"};
-            drawFlags(i, names[i], flags, width[i], highlight);
+            drawFlags(i, registerNames[i], flags, width[i], highlight);
         }
         else if (i == HC_Z80_IFF) {
             static char const* const flags[] = {"IFF1", "IFF2"};
-            drawFlags(i, names[i], flags, width[i], highlight);
+            drawFlags(i, registerNames[i], flags, width[i], highlight);
         }
         else {
-            drawRegister(i, names[i], width[i], highlight);
+            drawRegister(i, registerNames[i], width[i], highlight);
         }
     }
 
     if (ImGui::Button(ICON_FA_CODE " Disassembly")) {
+        std::lock_guard<std::mutex> lock(_desktop->emulationLock());
         _desktop->addView(new Disasm(_desktop, this, mainMemory(), HC_Z80_PC), false, true);
     }
 
     if (ImGuiAl::Button(ICON_FA_EYE " Step", canStepInto())) {
-        _hasChanged = 0;
-        stepInto();
+        step();
     }
 }
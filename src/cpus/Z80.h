@@ -11,15 +11,16 @@ namespace hc {
         ~Z80() {}
 
         // hc::Cpu
+        virtual uint64_t programCounter() const override { return getRegister(HC_Z80_PC); }
+        virtual unsigned registerCount() const override { return HC_Z80_NUM_REGISTERS; }
+        virtual char const* registerName(unsigned reg) const override;
         virtual uint64_t instructionLength(uint64_t address, Memory const* memory) override;
         virtual void disasm(uint64_t address, Memory const* memory, char* buffer, size_t size, char* tooltip, size_t ttsz) override;
+        virtual Flow flow(uint64_t address, Memory const* memory, uint64_t* target) override;
+        virtual void entryPoints(Memory const* memory, std::vector<uint64_t>* entries) override;
+        virtual unsigned stackWalk(Memory const* memory, uint64_t* addresses, unsigned count) override;
 
         // hc::View
-        virtual void onFrame() override;
         virtual void onDraw() override;
-
-    protected:
-        uint32_t _hasChanged;
-        uint16_t _previousValue[HC_Z80_NUM_REGISTERS];
     };
 }
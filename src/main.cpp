@@ -1,12 +1,32 @@
 #include "Application.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 
-int main(int, char**) {
+int main(int argc, char** argv) {
+    hc::Application::Options options;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            options.headless = true;
+        }
+        else if (strcmp(argv[i], "--paced") == 0) {
+            options.paced = true;
+        }
+        else if (argv[i][0] != '-' && options.script == nullptr) {
+            options.script = argv[i];
+        }
+        else {
+            fprintf(stderr, "Usage: %s [--headless [--paced]] [script.lua]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
     hc::Application app;
 
-    if (!app.init("Hackable Console", 1024, 640)) {
+    if (!app.init("Hackable Console", 1024, 640, options)) {
         return EXIT_FAILURE;
     }
 